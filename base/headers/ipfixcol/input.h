@@ -165,6 +165,35 @@ struct __attribute__((__packed__)) input_info_file {
 	char *name;                 /**< name of the input file */
 };
 
+/**
+ * \struct input_block
+ * \brief Reference counted memory shared by more IPFIX packets.
+ *
+ * An input plugin can pass packets as parts of a larger memory block (e.g.
+ * a buffer of a file or a mapped file) instead of allocating each packet
+ * separately (see get_packet_block()). The block is released by its
+ * \p release function when the last reference is dropped.
+ */
+struct input_block {
+	unsigned int refs;          /**< number of references */
+	void (*release)(struct input_block *block); /**< release the block */
+};
+
+/**
+ * \brief Add a reference to a memory block.
+ *
+ * \param[in,out] block Memory block
+ */
+API void input_block_ref(struct input_block *block);
+
+/**
+ * \brief Remove a reference to a memory block.
+ *
+ * The block is released when the last reference is removed.
+ * \param[in,out] block Memory block
+ */
+API void input_block_unref(struct input_block *block);
+
 /**
  * \brief Input plugin initialization function.
  *
@@ -202,6 +231,26 @@ API int input_init(char *params, void **config);
  */
 API int get_packet(void *config, struct input_info** info, char **packet, int *source_status);
 
+/**
+ * \brief Pass input data placed in a shared memory block (optional).
+ *
+ * The same as get_packet(), but the packet is not allocated separately. It
+ * points into a memory \p block and ipfixcol core takes over one reference
+ * to the block instead of freeing the packet. The core uses this function
+ * instead of get_packet() when the input plugin provides it.
+ *
+ * \param[in] config  Plugin-specific configuration data prepared by init
+ * function.
+ * \param[out] info   Information structure describing the source of the data.
+ * \param[out] packet Flow information data in the form of IPFIX packet.
+ * \param[out] block  Memory block of the packet (NULL if the packet was
+ *  allocated separately)
+ * \param[out] source_status Status of source (enum SOURCE_STATUS)
+ * \return the same as get_packet()
+ */
+API int get_packet_block(void *config, struct input_info** info, char **packet,
+	struct input_block **block, int *source_status);
+
 /**
  * \brief Input plugin "destructor".
  *
@@ -0,0 +1,98 @@
+/**
+ * \file headers/ipfixcol/ipfix_file.h
+ * \brief Layout of compressed IPFIX files
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef IPFIX_FILE_H
+#define IPFIX_FILE_H
+
+/**
+ * \defgroup ipfixFileLayout Layout of compressed IPFIX files
+ * \ingroup publicAPIs
+ *
+ * An uncompressed IPFIX file is a plain sequence of IPFIX messages.
+ *
+ * A compressed file is a sequence of standard LZ4 or zstd frames. Each frame
+ * holds a whole number of IPFIX messages, i.e. a message never spans two
+ * frames, so every frame can be decompressed independently. The last frame
+ * of a properly closed file is a skippable frame with an index of all data
+ * frames. Standard tools (lz4, zstd) skip the index and decompress the file
+ * into a plain IPFIX file.
+ *
+ * Layout of the index frame (all fields are little endian):
+ * \verbatim
+ *   uint32_t magic  (IPFIX_FILE_SKIP_MAGIC)
+ *   uint32_t size   (size of the following content)
+ *   struct ipfix_file_frame entries[count]
+ *   struct ipfix_file_footer footer
+ * \endverbatim
+ * Offset of a data frame is the sum of compressed sizes of the previous
+ * frames.
+ *
+ * @{
+ */
+
+#include <stdint.h>
+
+/** Magic number of an LZ4 frame                                            */
+#define IPFIX_FILE_LZ4_MAGIC  (0x184D2204U)
+/** Magic number of a zstd frame                                            */
+#define IPFIX_FILE_ZSTD_MAGIC (0xFD2FB528U)
+/** Magic number of the skippable frame with the index (LZ4 and zstd)       */
+#define IPFIX_FILE_SKIP_MAGIC (0x184D2A5EU)
+/** Magic number at the end of the index ("IPXI")                           */
+#define IPFIX_FILE_IDX_MAGIC  (0x49585049U)
+/** Version of the index                                                    */
+#define IPFIX_FILE_IDX_VERSION (1U)
+
+/** \brief Index entry of a data frame */
+struct __attribute__((__packed__)) ipfix_file_frame {
+	uint32_t comp_size;    /**< Size of the compressed frame                */
+	uint32_t data_size;    /**< Size of the decompressed IPFIX messages     */
+	uint32_t msg_cnt;      /**< Number of IPFIX messages                    */
+	uint32_t export_time;  /**< Export time of the first IPFIX message      */
+};
+
+/** \brief Footer of the index (the last bytes of the file) */
+struct __attribute__((__packed__)) ipfix_file_footer {
+	uint32_t frame_cnt;    /**< Number of data frames                       */
+	uint32_t version;      /**< Version of the index                        */
+	uint32_t magic;        /**< #IPFIX_FILE_IDX_MAGIC                       */
+};
+
+/**@}*/
+
+#endif /* IPFIX_FILE_H */
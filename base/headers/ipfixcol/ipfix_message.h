@@ -132,6 +132,14 @@ API uint16_t get_next_data_record_offset(uint8_t *data_record, struct ipfix_temp
  */
 API int message_free(struct ipfix_message *msg);
 
+/**
+ * \brief Dispose memory of the IPFIX packet of a message
+ *
+ * The packet is freed or a reference to its memory block is removed.
+ * \param[in] msg IPFIX message
+ */
+API void message_free_packet(struct ipfix_message *msg);
+
 /**
  * \brief Get data from record
  *
@@ -105,6 +105,19 @@ struct __attribute__((packed)) metadata {
 	char dstName[32];
 };
 
+/**
+ * \struct ipfix_msg_stamps
+ * \brief Monotonic timestamps (ns) of a message for pipeline statistics
+ *
+ * Zero when the statistics socket is not configured.
+ */
+struct __attribute__((__packed__)) ipfix_msg_stamps {
+	/** Message received by the input plugin */
+	uint64_t input;
+	/** Message inserted into the queue of the next stage */
+	uint64_t queued;
+};
+
 /**
  * \struct ipfix_message
  * \brief Structure covering main parts of the IPFIX packet by pointers into it.
@@ -134,6 +147,10 @@ struct __attribute__((__packed__)) ipfix_message {
 	void *live_profile;
 	/** List of metadata structures */
 	struct metadata *metadata;
+	/** Memory block of the packet (NULL if the packet is allocated separately) */
+	struct input_block                *block;
+	/** Timestamps for pipeline statistics */
+	struct ipfix_msg_stamps           stamps;
 };
 
 /**
@@ -45,6 +45,7 @@
 #include "preprocessor.h"
 #include "intermediate_process.h"
 #include "output_manager.h"
+#include "perf.h"
 #include "utils/elements/collection.h"
 
 #include <sys/types.h>
@@ -185,6 +186,7 @@ void config_free_plugin(struct plugin_config *plugin)
 				plugin->inter->intermediate_close(plugin->inter->plugin_config);
 				dlclose(plugin->inter->dll_handler);
 			}
+			perf_stage_remove(plugin->inter->perf);
 			free(plugin->inter);
 		}
 		
@@ -355,6 +357,9 @@ int config_add_input(configurator *config, struct plugin_config *plugin, int ind
 		goto err;
 	}
 	
+	/* Optional function passing packets in shared memory blocks */
+	config->input.get_block = dlsym(config->input.dll_handler, "get_packet_block");
+
 	config->input.close = dlsym(config->input.dll_handler, "input_close");
 	if (config->input.close == NULL) {
 		MSG_ERROR(msg_module, "[%d] Unable to load input xml_conf (%s)", config->proc_id, dlerror());
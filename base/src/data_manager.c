@@ -47,6 +47,7 @@
 #include <ipfixcol/storage.h>
 #include "configurator.h"
 #include "data_manager.h"
+#include "perf.h"
 
 /** Identifier to MSG_* macros */
 static char *msg_module = "data manager";
@@ -75,6 +76,7 @@ static inline void data_manager_free (struct data_manager_config* config)
 					free(config->storage_plugins[i]->thread_config);
 				}
 				
+				perf_stage_remove(config->storage_plugins[i]->perf);
 				free(config->storage_plugins[i]);
 				config->storage_plugins[i] = NULL;
 			}
@@ -97,7 +99,8 @@ static void* storage_plugin_thread(void *cfg)
 {
     struct storage *config = (struct storage*) cfg; 
 	struct ipfix_message *msg, *starting_msg = NULL;
-	int can_read = 0, stop = 0;
+	int can_read = 0, stop = 0, ret;
+	uint64_t start;
 	unsigned int index = config->thread_config->queue->read_offset;
 
 	/* set the thread name to reflect the configuration */
@@ -133,7 +136,15 @@ static void* storage_plugin_thread(void *cfg)
 			break;
 		default: /* DATA */
 			if (can_read) {
-				config->store(config->config, msg, config->thread_config->template_mgr);
+				start = perf_now();
+				ret = config->store(config->config, msg, config->thread_config->template_mgr);
+
+				/* Stamps are read-only here, the message is shared by all storage plugins */
+				if (config->perf) {
+					perf_stage_update(config->perf, msg->data_records_count, msg->stamps,
+							start, perf_now(), ret != 0);
+				}
+
 				rbuffer_remove_reference(config->thread_config->queue, index, 1);
 			}
 			break;
@@ -206,6 +217,8 @@ int data_manager_add_plugin(struct data_manager_config *config, struct storage *
 	plugin->thread_config = plugin_cfg;
 	plugin->odid = config->observation_domain_id;
 	
+	plugin->perf = perf_stage_add("storage", plugin->thread_name, config->observation_domain_id);
+
 	/* Set thread name */
 	name_len = strlen(plugin->thread_name);
 	snprintf(plugin->thread_name + name_len, 16 - name_len, " %d", config->observation_domain_id);
@@ -216,6 +229,8 @@ int data_manager_add_plugin(struct data_manager_config *config, struct storage *
 		plugin->close(&(plugin->config));
 		free(plugin_cfg);
 		plugin->thread_config = NULL;
+		perf_stage_remove(plugin->perf);
+		plugin->perf = NULL;
 		return 0;
 	}
 	
@@ -259,6 +274,9 @@ int data_manager_remove_plugin(struct data_manager_config* config, int id)
 		rbuffer_write(config->store_queue, msg, config->plugins_count);
 		pthread_join(plugin->thread_config->thread_id, NULL);
 		config->plugins_count--;
+
+		perf_stage_remove(plugin->perf);
+		plugin->perf = NULL;
 	}
 	
 	return 0;
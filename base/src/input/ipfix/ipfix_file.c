@@ -48,23 +48,38 @@
 
 #include <unistd.h>
 #include <sys/types.h>
-#include <fcntl.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
 
 #include "ipfixcol.h"
+#include "ipfix_reader.h"
 
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
 #define NO_INPUT_FILE         (-2)
 
+/**
+ * Returned by read_packet() when an input file (not the last one) is closed.
+ * It is passed to the core as the length of an empty message with the closed
+ * source status.
+ */
+#define FILE_CLOSED           (1)
+
+/** Maximal number of files read in parallel */
+#define WORKERS_MAX           (64)
+/** Size of the queue of messages of a worker */
+#define WORKER_QUEUE_SIZE     (1024)
+/** Maximal number of messages moved between a worker and the core at once */
+#define WORKER_BATCH          (64)
+
 /** Identifier to MSG_* macros */
 static char *msg_module = "ipfix input";
 
@@ -73,20 +88,111 @@ struct input_info_file_list {
 	struct input_info_file_list	*next;
 };
 
+/** \brief IPFIX message read by a worker (msg == NULL marks the end of a file) */
+struct file_msg {
+	uint8_t *msg;                    /**< IPFIX message                      */
+	uint16_t len;                    /**< Length of the message              */
+	struct input_block *block;       /**< Buffer of the message              */
+	struct input_info_file *info;    /**< Input file of the message          */
+};
+
+/** \brief Worker reading input files (one after another) */
+struct file_worker {
+	pthread_t thread;                /**< Thread of the worker               */
+	struct ipfix_config *conf;       /**< Plugin configuration               */
+	struct file_msg queue[WORKER_QUEUE_SIZE]; /**< Read messages             */
+	size_t head;                     /**< Next message to take               */
+	size_t count;                    /**< Number of messages in the queue    */
+};
+
 /**
  * \struct ipfix_config
  * \brief  IPFIX input plugin specific "config" structure 
  */
 struct ipfix_config {
-	int fd;                  /**< file descriptor */
+	int fd;                  /**< state of the input (NO_INPUT_FILE = no more files) */
+	ipfix_reader_t *reader;  /**< reader of the current file */
+	enum READER_MODE mode;   /**< mode of reading of plain files */
+	uint32_t start_time;     /**< skip messages exported before this time (0 = none) */
 	xmlChar *xml_file;       /**< input file URI from XML configuration file. (e.g.: "file://tmp/ipfix.dump") */
 	char *file;              /**< path where to look for IPFIX files. Same as xml_file, but without 'file:' */
 	char **input_files;      /**< list of all input files */
 	int findex;              /**< index to the current file in the list of files */
 	struct input_info_file_list	*in_info_list;
 	struct input_info_file *in_info; /**< info structure about current input file */
+
+	/* Parallel reading of files (workers_cnt > 0) */
+	struct file_worker *workers;     /**< workers reading files */
+	int workers_cnt;                 /**< number of workers */
+	int workers_running;             /**< number of workers with more files */
+	int workers_next;                /**< next worker to take messages from */
+	int stop;                        /**< stop the workers */
+	pthread_mutex_t mutex;           /**< lock of the file list and queues */
+	pthread_cond_t cond_data;        /**< a worker queued messages or ended */
+	pthread_cond_t cond_space;       /**< the core took messages */
+	struct file_msg batch[WORKER_BATCH]; /**< messages taken from a worker */
+	int batch_cnt;                   /**< number of messages in the batch */
+	int batch_pos;                   /**< next message of the batch */
 };
 
+/**
+ * \brief Create an input info structure of a new input file
+ *
+ * \param[in] conf input plugin config structure
+ * \param[in] name name of the file
+ * \return pointer to the structure or NULL
+ */
+static struct input_info_file *input_info_add(struct ipfix_config *conf, char *name)
+{
+	struct input_info_file_list *info = calloc(1, sizeof(struct input_info_file_list));
+	if (!info) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	info->in_info.name   = name;
+	info->in_info.type   = SOURCE_TYPE_IPFIX_FILE;
+	info->in_info.status = SOURCE_STATUS_NEW;
+
+	/* Insert new input info into list */
+	info->next = conf->in_info_list;
+	conf->in_info_list = info;
+
+	return &info->in_info;
+}
+
+/**
+ * \brief Open an input file and skip frames exported before the start time
+ *
+ * \param[in] conf input plugin config structure
+ * \param[in] name name of the file
+ * \return reader or NULL
+ */
+static ipfix_reader_t *open_reader(const struct ipfix_config *conf, const char *name)
+{
+	ipfix_reader_t *reader = reader_open(name, conf->mode);
+
+	if (reader && conf->start_time) {
+		/* files without the index are filtered message by message */
+		reader_seek_time(reader, conf->start_time);
+	}
+
+	return reader;
+}
+
+/**
+ * \brief Check whether a message was exported before the start time
+ *
+ * \param[in] conf input plugin config structure
+ * \param[in] msg IPFIX message
+ * \return non-zero if the message is skipped
+ */
+static inline int before_start(const struct ipfix_config *conf, const uint8_t *msg)
+{
+	return conf->start_time
+		&& ntohl(((const struct ipfix_header *) msg)->export_time) < conf->start_time;
+}
+
 /**
  * \brief Open input file
  *
@@ -99,7 +205,7 @@ struct ipfix_config {
  */
 static int prepare_input_file(struct ipfix_config *conf)
 {
-	int fd;
+	ipfix_reader_t *reader;
 	int ret = 0;
 
 	if (conf->input_files[conf->findex] == NULL) {
@@ -110,31 +216,24 @@ static int prepare_input_file(struct ipfix_config *conf)
 
 	MSG_INFO(msg_module, "Opening input file: %s", conf->input_files[conf->findex]);
 	
-	fd = open(conf->input_files[conf->findex], O_RDONLY);
-	if (fd == -1) {
-		/* input file doesn't exist or we don't have read permission */
-		MSG_ERROR(msg_module, "Unable to open input file: %s", conf->input_files[conf->findex]);
+	reader = open_reader(conf, conf->input_files[conf->findex]);
+	if (reader == NULL) {
+		/* input file doesn't exist, we don't have read permission or
+		 * the format is not supported */
+		conf->findex += 1;
 		return -1;
 	}
 
 	/* New file == new input info */
-	struct input_info_file_list *info = calloc(1, sizeof(struct input_info_file_list));
-	if (!info) {
-		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
-		close(fd);
+	conf->in_info = input_info_add(conf, conf->input_files[conf->findex]);
+	if (!conf->in_info) {
+		reader_close(reader);
 		return -1;
 	}
 	
-	info->in_info.name   = conf->input_files[conf->findex];
-	info->in_info.type   = SOURCE_TYPE_IPFIX_FILE;
-	info->in_info.status = SOURCE_STATUS_NEW; 
-	
-	/* Insert new input info into list */
-	info->next = conf->in_info_list;
-	conf->in_info_list = info;
-	
 	conf->findex += 1;
-	conf->fd = fd;
+	conf->fd = 0;
+	conf->reader = reader;
 	
 	return ret;
 }
@@ -147,12 +246,13 @@ static int prepare_input_file(struct ipfix_config *conf)
  */
 static int close_input_file(struct ipfix_config *conf)
 {
-	int ret = close(conf->fd);
-	if (ret == -1) {
-		MSG_ERROR(msg_module, "Error when closing output file");
-		return -1;
+	if (conf->reader == NULL) {
+		return 0;
 	}
 
+	reader_close(conf->reader);
+	conf->reader = NULL;
+
 	MSG_INFO(msg_module, "Input file closed");
 
 	conf->fd = -1;
@@ -173,9 +273,7 @@ static int next_file(struct ipfix_config *conf)
 {
 	int ret;
 
-	if (conf->fd <= 0) {
-		close_input_file(conf);
-	}
+	close_input_file(conf);
 
 	ret = 1;
 	while (ret) {
@@ -195,6 +293,297 @@ static int next_file(struct ipfix_config *conf)
 	return ret;
 }
 
+/**
+ * \brief Pass messages read by a worker to its queue
+ *
+ * Waits until there is enough space in the queue.
+ *
+ * \param[in] worker worker
+ * \param[in] msgs messages
+ * \param[in] cnt number of messages
+ * \return number of queued messages (less than cnt only when the workers are
+ * stopped)
+ */
+static int worker_push(struct file_worker *worker, struct file_msg *msgs, int cnt)
+{
+	struct ipfix_config *conf = worker->conf;
+	int done = 0;
+
+	pthread_mutex_lock(&conf->mutex);
+	while (done < cnt && !conf->stop) {
+		if (worker->count == WORKER_QUEUE_SIZE) {
+			pthread_cond_wait(&conf->cond_space, &conf->mutex);
+			continue;
+		}
+
+		while (done < cnt && worker->count < WORKER_QUEUE_SIZE) {
+			size_t idx = (worker->head + worker->count) % WORKER_QUEUE_SIZE;
+			worker->queue[idx] = msgs[done++];
+			worker->count++;
+		}
+
+		pthread_cond_signal(&conf->cond_data);
+	}
+	pthread_mutex_unlock(&conf->mutex);
+
+	return done;
+}
+
+/**
+ * \brief Read one input file by a worker
+ *
+ * \param[in] worker worker
+ * \param[in] name name of the file
+ * \param[in] info input info of the file
+ */
+static void worker_read_file(struct file_worker *worker, char *name,
+		struct input_info_file *info)
+{
+	struct file_msg msgs[WORKER_BATCH];
+	enum READER_STATUS status = READER_OK;
+	ipfix_reader_t *reader;
+	size_t pushed = 0;
+
+	MSG_INFO(msg_module, "Opening input file: %s", name);
+
+	reader = open_reader(worker->conf, name);
+	if (reader == NULL) {
+		return;
+	}
+
+	while (status == READER_OK) {
+		int cnt = 0;
+		while (cnt < WORKER_BATCH) {
+			status = reader_next(reader, &msgs[cnt].msg, &msgs[cnt].len, &msgs[cnt].block);
+			if (status != READER_OK) {
+				break;
+			}
+
+			if (before_start(worker->conf, msgs[cnt].msg)) {
+				input_block_unref(msgs[cnt].block);
+				continue;
+			}
+
+			msgs[cnt++].info = info;
+		}
+
+		int done = worker_push(worker, msgs, cnt);
+		pushed += done;
+		if (done < cnt) {
+			/* stopped, drop the rest */
+			for (int i = done; i < cnt; ++i) {
+				input_block_unref(msgs[i].block);
+			}
+			break;
+		}
+	}
+
+	if (status == READER_ERROR) {
+		MSG_ERROR(msg_module, "Input file %s may be corrupted; skipping...", name);
+	}
+
+	if (status != READER_OK && pushed > 0) {
+		/* let the core close the source of the file */
+		struct file_msg end = {NULL, 0, NULL, info};
+		worker_push(worker, &end, 1);
+	}
+
+	reader_close(reader);
+	MSG_INFO(msg_module, "Input file %s closed", name);
+}
+
+/**
+ * \brief Main function of a worker
+ *
+ * Takes input files from the list one by one and reads them.
+ *
+ * \param[in] arg worker
+ * \return NULL
+ */
+static void *worker_main(void *arg)
+{
+	struct file_worker *worker = arg;
+	struct ipfix_config *conf = worker->conf;
+
+	while (1) {
+		pthread_mutex_lock(&conf->mutex);
+		char *name = conf->input_files[conf->findex];
+		if (conf->stop || name == NULL) {
+			conf->workers_running--;
+			pthread_cond_signal(&conf->cond_data);
+			pthread_mutex_unlock(&conf->mutex);
+			break;
+		}
+
+		conf->findex++;
+		struct input_info_file *info = input_info_add(conf, name);
+		pthread_mutex_unlock(&conf->mutex);
+
+		if (info) {
+			worker_read_file(worker, name, info);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Start workers reading files in parallel
+ *
+ * \param[in] conf input plugin config structure
+ * \param[in] cnt number of workers
+ * \return 0 on success, negative value otherwise
+ */
+static int workers_start(struct ipfix_config *conf, int cnt)
+{
+	conf->workers = calloc(cnt, sizeof(struct file_worker));
+	if (!conf->workers) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return -1;
+	}
+
+	pthread_mutex_init(&conf->mutex, NULL);
+	pthread_cond_init(&conf->cond_data, NULL);
+	pthread_cond_init(&conf->cond_space, NULL);
+
+	pthread_mutex_lock(&conf->mutex);
+	for (int i = 0; i < cnt; ++i) {
+		conf->workers[i].conf = conf;
+		if (pthread_create(&conf->workers[i].thread, NULL, worker_main, &conf->workers[i]) != 0) {
+			MSG_ERROR(msg_module, "Unable to create a reading thread");
+			break;
+		}
+
+		conf->workers_cnt++;
+		conf->workers_running++;
+	}
+	pthread_mutex_unlock(&conf->mutex);
+
+	return (conf->workers_cnt > 0) ? 0 : -1;
+}
+
+/**
+ * \brief Stop workers and drop messages that have not been processed
+ *
+ * \param[in] conf input plugin config structure
+ */
+static void workers_stop(struct ipfix_config *conf)
+{
+	pthread_mutex_lock(&conf->mutex);
+	conf->stop = 1;
+	pthread_cond_broadcast(&conf->cond_space);
+	pthread_mutex_unlock(&conf->mutex);
+
+	for (int i = 0; i < conf->workers_cnt; ++i) {
+		struct file_worker *worker = &conf->workers[i];
+		pthread_join(worker->thread, NULL);
+
+		for (size_t j = 0; j < worker->count; ++j) {
+			struct input_block *block = worker->queue[(worker->head + j) % WORKER_QUEUE_SIZE].block;
+			if (block) {
+				input_block_unref(block);
+			}
+		}
+	}
+
+	for (int i = conf->batch_pos; i < conf->batch_cnt; ++i) {
+		if (conf->batch[i].block) {
+			input_block_unref(conf->batch[i].block);
+		}
+	}
+
+	pthread_cond_destroy(&conf->cond_space);
+	pthread_cond_destroy(&conf->cond_data);
+	pthread_mutex_destroy(&conf->mutex);
+	free(conf->workers);
+	conf->workers = NULL;
+}
+
+/**
+ * \brief Take the next message read by the workers
+ *
+ * Messages of workers are taken in batches in round robin order.
+ *
+ * \param[in] conf input plugin config structure
+ * \return pointer to the message or NULL when all files have been read
+ */
+static struct file_msg *workers_next_msg(struct ipfix_config *conf)
+{
+	if (conf->batch_pos < conf->batch_cnt) {
+		return &conf->batch[conf->batch_pos++];
+	}
+
+	conf->batch_cnt = 0;
+	conf->batch_pos = 0;
+
+	pthread_mutex_lock(&conf->mutex);
+	while (conf->batch_cnt == 0) {
+		for (int i = 0; i < conf->workers_cnt && conf->batch_cnt == 0; ++i) {
+			struct file_worker *worker = &conf->workers[conf->workers_next];
+			conf->workers_next = (conf->workers_next + 1) % conf->workers_cnt;
+
+			while (worker->count > 0 && conf->batch_cnt < WORKER_BATCH) {
+				conf->batch[conf->batch_cnt++] = worker->queue[worker->head];
+				worker->head = (worker->head + 1) % WORKER_QUEUE_SIZE;
+				worker->count--;
+			}
+		}
+
+		if (conf->batch_cnt > 0) {
+			pthread_cond_broadcast(&conf->cond_space);
+			break;
+		}
+
+		if (conf->workers_running == 0) {
+			/* all files read */
+			pthread_mutex_unlock(&conf->mutex);
+			return NULL;
+		}
+
+		pthread_cond_wait(&conf->cond_data, &conf->mutex);
+	}
+	pthread_mutex_unlock(&conf->mutex);
+
+	return &conf->batch[conf->batch_pos++];
+}
+
+/**
+ * \brief Wait until the workers read another message or all of them end
+ *
+ * \param[in] conf input plugin config structure
+ * \return non-zero when all files have been read
+ */
+static int workers_done(struct ipfix_config *conf)
+{
+	int done = 0;
+
+	if (conf->batch_pos < conf->batch_cnt) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&conf->mutex);
+	while (1) {
+		int queued = 0;
+		for (int i = 0; i < conf->workers_cnt && !queued; ++i) {
+			queued = (conf->workers[i].count > 0);
+		}
+
+		if (queued) {
+			break;
+		}
+
+		if (conf->workers_running == 0) {
+			done = 1;
+			break;
+		}
+
+		pthread_cond_wait(&conf->cond_data, &conf->mutex);
+	}
+	pthread_mutex_unlock(&conf->mutex);
+
+	return done;
+}
+
 /**
  * \brief Plugin initialization
  *
@@ -208,6 +597,8 @@ int input_init(char *params, void **config)
 	char **input_files;
 	xmlDocPtr doc;
 	xmlNodePtr cur;
+	xmlChar *str;
+	int parallel = 1;
 	int ret;
 	int i;
 
@@ -232,15 +623,50 @@ int input_init(char *params, void **config)
 	}
 	if (xmlStrcmp(cur->name, (const xmlChar *) "fileReader")) {
 		MSG_ERROR(msg_module, "Root node != fileReader");
-		goto err_init;
+		goto err_xml;
 	}
 
 	cur = cur->xmlChildrenNode;
 	while (cur != NULL) {
 		/* find out where to look for input file */
-		if (!xmlStrcmp(cur->name, (const xmlChar *) "file")) {
+		if (!xmlStrcmp(cur->name, (const xmlChar *) "file") && conf->xml_file == NULL) {
 			conf->xml_file = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-			break;
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "readMode")) {
+			str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (str && !xmlStrcmp(str, (const xmlChar *) "mmap")) {
+				conf->mode = READER_MODE_MMAP;
+			} else if (str && !xmlStrcmp(str, (const xmlChar *) "read")) {
+				conf->mode = READER_MODE_READ;
+			} else {
+				MSG_ERROR(msg_module, "Element \"readMode\": unknown mode (use \"read\" or \"mmap\")");
+				xmlFree(str);
+				goto err_xml;
+			}
+			xmlFree(str);
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "parallelFiles")) {
+			str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			parallel = str ? atoi((char *) str) : 0;
+			xmlFree(str);
+			if (parallel < 1 || parallel > WORKERS_MAX) {
+				MSG_ERROR(msg_module, "Element \"parallelFiles\": invalid value (1 - %d)", WORKERS_MAX);
+				goto err_xml;
+			}
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "startTime")) {
+			char *end = NULL;
+			unsigned long value = 0;
+
+			str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (str) {
+				errno = 0;
+				value = strtoul((char *) str, &end, 10);
+			}
+			if (!str || *end != '\0' || errno != 0 || value > UINT32_MAX) {
+				MSG_ERROR(msg_module, "Element \"startTime\": invalid value (seconds since UNIX epoch)");
+				xmlFree(str);
+				goto err_xml;
+			}
+			xmlFree(str);
+			conf->start_time = (uint32_t) value;
 		}
 
 		cur = cur->next;
@@ -278,6 +704,22 @@ int input_init(char *params, void **config)
 			MSG_INFO(msg_module, "\t%s", input_files[i]);
 		}
 	}
+
+	if (parallel > 1) {
+		/* read more files at once by workers */
+		if (input_files[0] == NULL) {
+			MSG_ERROR(msg_module, "No input file(s); nothing to do");
+			goto err_init;
+		}
+
+		for (i = 0; input_files[i] != NULL && i < parallel; i++);
+		if (workers_start(conf, i) != 0) {
+			goto err_init;
+		}
+
+		*config = conf;
+		return 0;
+	}
 	
 	ret = next_file(conf);
 	if (ret < 0) {
@@ -299,6 +741,9 @@ err_init:
 	}
 
 	if (conf->input_files) {
+		for (i = 0; conf->input_files[i]; i++) {
+			free(conf->input_files[i]);
+		}
 		free(conf->input_files);
 	}
 
@@ -309,156 +754,163 @@ err_init:
 }
 
 /**
- * \brief Read IPFIX message from file
+ * \brief Read the next IPFIX message of the input files
  *
- * \param[in] config  input plugin config structure
- * \param[out] info  information about source of the IPFIX data 
- * \param[out] packet  IPFIX message in memory
+ * \param[in] conf  input plugin config structure
+ * \param[out] info  information about source of the IPFIX data
+ * \param[out] msg  IPFIX message
+ * \param[out] block  buffer of the message (can be NULL only when files are
+ * not read in parallel, the message is then valid until the next call)
  * \param[out] source_status Status of source (new, opened, closed)
- * \return length of the message on success. otherwise:
- * INPUT_INTR - on signal interrupt,
- * INPUT_CLOSED - if there are no more input files,
- * negative value on other possible errors
- */ 
-int get_packet(void *config, struct input_info **info, char **packet, int *source_status)
+ * \return length of the message on success, FILE_CLOSED when an input file
+ * is closed, INPUT_CLOSED if there are no more input files
+ */
+static int read_packet(struct ipfix_config *conf, struct input_info **info,
+		uint8_t **msg, struct input_block **block, int *source_status)
 {
-	int ret;
-	int counter = 0;
-	struct ipfix_header *header;
+	enum READER_STATUS status;
 	uint16_t packet_len;
-	struct ipfix_config *conf;
-	char *packet_orig;	
-
-	conf = (struct ipfix_config *) config;
-	*info = (struct input_info *) &(conf->in_info_list->in_info);
-	
-	packet_orig = *packet;
-	
-	header = (struct ipfix_header *) malloc(sizeof(*header));
-	if (!header) {
-		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
-		return INPUT_ERROR;
-	}
+	int ret;
 
-	/* read IPFIX header only */
-read_header:
-	ret = read(conf->fd, header, sizeof(*header));
-	if (ret == -1) {
-		if (errno == EINTR) {
-			ret = INPUT_INTR;
-			goto err_header;
-		}
-		MSG_ERROR(msg_module, "Failed to read IPFIX message header: %s", strerror(errno));
-		ret = INPUT_ERROR;
-		goto err_header;
-	}
-	if (ret == 0) {
-		/* EOF, next file? */
-		*source_status = SOURCE_STATUS_CLOSED;
-		ret = next_file(conf);
-		if (ret == NO_INPUT_FILE) {
+	if (conf->workers) {
+		struct file_msg *next = workers_next_msg(conf);
+		if (!next) {
 			/* all files processed */
-			ret = INPUT_CLOSED;
-			goto err_header;
+			*info = (struct input_info *) &(conf->in_info_list->in_info);
+			return INPUT_CLOSED;
 		}
-		/* next file is ready */
-		goto read_header;
-	}
 
-	/* check magic number */
-	if (ntohs(header->version) != IPFIX_VERSION) {
-		/* not an IPFIX file */
-		MSG_ERROR(msg_module, "Bad magic number; expected %x, got %x", IPFIX_VERSION, ntohs(header->version));
+		*msg = next->msg;
+		*block = next->block;
+		packet_len = next->len;
+		*info = (struct input_info *) next->info;
 
-		/* we don't know how big is this message. It's not IPFIX message or
-		 * header is corrupted. skip whole file */
-		MSG_ERROR(msg_module, "Input file may be corrupted; skipping...");
-
-		/* try to open next input file */
-		*source_status = SOURCE_STATUS_CLOSED;
-		ret = next_file(conf);
-		if (ret == NO_INPUT_FILE) {
-			/* all files processed */
-			ret = INPUT_CLOSED;
-			goto err_info;
+		if (next->msg == NULL) {
+			/* end of the file */
+			*source_status = SOURCE_STATUS_CLOSED;
+			return workers_done(conf) ? INPUT_CLOSED : FILE_CLOSED;
+		}
+	} else {
+		*info = (struct input_info *) &(conf->in_info_list->in_info);
+
+		while (1) {
+			status = reader_next(conf->reader, msg, &packet_len, block);
+			if (status == READER_OK) {
+				if (before_start(conf, *msg)) {
+					if (block) {
+						input_block_unref(*block);
+					}
+					continue;
+				}
+				break;
+			}
+
+			if (status == READER_ERROR) {
+				/* we don't know how big is this message. It's not IPFIX message or
+				 * header is corrupted. skip whole file */
+				MSG_ERROR(msg_module, "Input file may be corrupted; skipping...");
+			}
+
+			/* EOF, next file? */
+			struct input_info *closed = (struct input_info *) &(conf->in_info_list->in_info);
+			ret = next_file(conf);
+			if (ret == NO_INPUT_FILE) {
+				/* all files processed */
+				*info = closed;
+				*source_status = SOURCE_STATUS_CLOSED;
+				return INPUT_CLOSED;
+			}
+
+			if (closed->status != SOURCE_STATUS_NEW) {
+				/* close the source of the file before messages of the next one */
+				*info = closed;
+				*source_status = SOURCE_STATUS_CLOSED;
+				return FILE_CLOSED;
+			}
 		}
 
-		goto read_header;
+		*info = (struct input_info *) &(conf->in_info_list->in_info);
 	}
 
-	/* get packet length */
-	packet_len = ntohs(header->length);
-	if (packet_len < sizeof(*header)) {
-		/* invalid length of the IPFIX message */
-		MSG_ERROR(msg_module, "Input file has invalid length (too short)");
-		goto err_header;
+	/* Set source status */
+	*source_status = (*info)->status;
+	if ((*info)->status == SOURCE_STATUS_NEW) {
+		(*info)->status = SOURCE_STATUS_OPENED;
+		(*info)->odid = ntohl(((struct ipfix_header *) *msg)->observation_domain_id);
+	}
+
+	return packet_len;
+}
+
+/**
+ * \brief Read IPFIX message from file
+ *
+ * \param[in] config  input plugin config structure
+ * \param[out] info  information about source of the IPFIX data 
+ * \param[out] packet  IPFIX message in memory
+ * \param[out] source_status Status of source (new, opened, closed)
+ * \return length of the message on success. otherwise:
+ * INPUT_INTR - on signal interrupt,
+ * INPUT_CLOSED - if there are no more input files,
+ * negative value on other possible errors
+ */ 
+int get_packet(void *config, struct input_info **info, char **packet, int *source_status)
+{
+	struct ipfix_config *conf = (struct ipfix_config *) config;
+	struct input_block *block = NULL;
+	uint8_t *msg;
+	int len;
+
+	len = read_packet(conf, info, &msg, conf->workers ? &block : NULL, source_status);
+	if (len <= 0 || *source_status == SOURCE_STATUS_CLOSED) {
+		return len;
 	}
 
 	if (*packet == NULL) {
 		/* allocate memory for whole IPFIX message */
-		*packet = (char *) malloc(packet_len);
+		*packet = (char *) malloc(len);
 		if (*packet == NULL) {
 			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
-			goto err_header;
+			if (block) {
+				input_block_unref(block);
+			}
+			return INPUT_ERROR;
 		}
 	}
 
-	memcpy(*packet, header, sizeof(*header));
-	counter += sizeof(*header);
-
-	/* get rest of the packet */
-	ret = read(conf->fd, (*packet)+counter, packet_len-counter);
-	if (ret == -1) {
-		if (errno == EINTR) {
-			ret = INPUT_INTR;
-			goto err_info;
-		}
-		MSG_ERROR(msg_module, "Error while reading from input file: %s", strerror(errno));
-		ret = INPUT_ERROR;
-		goto err_info;
-	}
-	if (ret == 0 && packet_len-counter > 0) {
-		/* EOF, next file? */
-		*source_status = SOURCE_STATUS_CLOSED;
-		ret = next_file(conf);
-		if (ret == NO_INPUT_FILE) {
-			/* all files processed */
-			ret = INPUT_CLOSED;
-			goto err_info;
-		}
-		if (packet_orig != *packet) {
-			/* this plugin allocated this memory */
-			free(*packet);
-			*packet = NULL;
-		}
-
-		goto read_header;
+	memcpy(*packet, msg, len);
+	if (block) {
+		input_block_unref(block);
 	}
-	counter += ret;
 
-	free(header);
-	
-	*info = (struct input_info *) &(conf->in_info_list->in_info);
-	
-	/* Set source status */
-	*source_status = (*info)->status;
-	if ((*info)->status == SOURCE_STATUS_NEW) {
-		(*info)->status = SOURCE_STATUS_OPENED;
-		(*info)->odid = ntohl(((struct ipfix_header *) *packet)->observation_domain_id);
-	}
+	return len;
+}
 
-	return packet_len;
-	
-err_info:
-	if (packet_orig != *packet) {
-		/* this plugin allocated this memory */
-		free(*packet);
-		*packet = NULL;
+/**
+ * \brief Read IPFIX message from file without copying
+ *
+ * The message is a part of a buffer (or a mapped window) of the file.
+ *
+ * \param[in] config  input plugin config structure
+ * \param[out] info  information about source of the IPFIX data
+ * \param[out] packet  IPFIX message in memory
+ * \param[out] block  buffer of the message
+ * \param[out] source_status Status of source (new, opened, closed)
+ * \return the same as get_packet()
+ */
+int get_packet_block(void *config, struct input_info **info, char **packet,
+		struct input_block **block, int *source_status)
+{
+	uint8_t *msg;
+	int len;
+
+	*block = NULL;
+	len = read_packet((struct ipfix_config *) config, info, &msg, block, source_status);
+	if (len > 0 && *source_status != SOURCE_STATUS_CLOSED) {
+		*packet = (char *) msg;
 	}
 
-err_header:
-	free(header);
-	return ret;
+	return len;
 }
 
 /**
@@ -470,10 +922,14 @@ err_header:
 int input_close(void **config)
 {
 	struct ipfix_config *conf = *config;
-	struct input_info_file_list *aux_list = conf->in_info_list;
+	struct input_info_file_list *aux_list;
 	int ret = 0;
 	int i;
 
+	if (conf->workers) {
+		workers_stop(conf);
+	}
+
 	/* free list of input files */
 	if (conf->input_files) {
 		for (i = 0; conf->input_files[i]; i++) {
@@ -482,6 +938,9 @@ int input_close(void **config)
 		free(conf->input_files);
 	}
 
+	close_input_file(conf);
+
+	aux_list = conf->in_info_list;
 	while (aux_list) {
 		conf->in_info_list = conf->in_info_list->next;
 		free(aux_list);
@@ -489,7 +948,6 @@ int input_close(void **config)
 	}
 
 	xmlFree(conf->xml_file);
-	free(conf->in_info);
 	free(conf);
 
 	return ret;
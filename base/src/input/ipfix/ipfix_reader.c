@@ -0,0 +1,852 @@
+/**
+ * \file src/input/ipfix/ipfix_reader.c
+ * \brief Reader of IPFIX files
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <ipfixcol.h>
+#include <ipfixcol/ipfix_file.h>
+#include "ipfix_reader.h"
+
+/** Size of the buffer of plain and stream compressed files */
+#define READER_BUFFER_SIZE (1024 * 1024)
+/** Size of the buffer of compressed data (stream mode)     */
+#define READER_INPUT_SIZE (256 * 1024)
+/** Size of a mapped window of a plain file (mmap mode)     */
+#define READER_MAP_SIZE (64 * 1024 * 1024)
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "ipfix input";
+
+/** Format of a file */
+enum READER_FORMAT {
+	FORMAT_PLAIN,           /**< Plain IPFIX messages                    */
+	FORMAT_LZ4,             /**< LZ4 frames                              */
+	FORMAT_ZSTD             /**< zstd frames                             */
+};
+
+/**
+ * \brief Buffer of messages
+ *
+ * Messages are handed out as parts of the buffer, so the buffer is released
+ * after the last message (and the reader) drops its reference.
+ */
+struct reader_chunk {
+	struct input_block block;     /**< References (must be the first)        */
+	uint8_t *data;                /**< Data                                  */
+	size_t size;                  /**< Size of the data                      */
+	void *map;                    /**< Mapped window (NULL = heap buffer)    */
+	size_t map_size;              /**< Size of the mapped window             */
+};
+
+/** \brief Reader of IPFIX files */
+struct ipfix_reader {
+	int fd;                       /**< Input file                            */
+	enum READER_FORMAT format;    /**< Format of the file                    */
+	enum READER_MODE mode;        /**< Mode of reading                       */
+	int eof;                      /**< End of the input file reached         */
+	off_t file_size;              /**< Size of the file (mmap mode)          */
+	off_t data_offset;            /**< Offset of the buffer (mmap mode)      */
+
+	struct reader_chunk *chunk;   /**< Current buffer                        */
+	uint8_t *buffer;              /**< Decompressed (or plain) data          */
+	size_t buffer_size;           /**< Size of the buffer                    */
+	size_t buffer_len;            /**< Valid data in the buffer              */
+	size_t buffer_pos;            /**< Position of the next message          */
+
+	uint8_t *input;               /**< Compressed data                       */
+	size_t input_size;            /**< Size of the compressed data buffer    */
+	size_t input_len;             /**< Valid data in the buffer              */
+	size_t input_pos;             /**< Processed data in the buffer          */
+
+	struct ipfix_file_frame *idx; /**< Index of frames (host byte order)     */
+	size_t idx_cnt;               /**< Number of frames                      */
+	size_t frame;                 /**< Next frame to read                    */
+	off_t frame_offset;           /**< Offset of the next frame              */
+
+#ifdef HAVE_LZ4
+	LZ4F_dctx *lz4;               /**< LZ4 context                           */
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DCtx *zstd;              /**< zstd context                          */
+#endif
+};
+
+/**
+ * \brief Release a buffer of messages
+ * \param[in] block Buffer
+ */
+static void reader_chunk_release(struct input_block *block)
+{
+	struct reader_chunk *chunk = (struct reader_chunk *) block;
+
+	if (chunk->map) {
+		munmap(chunk->map, chunk->map_size);
+	}
+
+	free(chunk);
+}
+
+/**
+ * \brief Replace the current buffer with a new one
+ * \param[in,out] reader Reader
+ * \param[in]     chunk  New buffer
+ * \param[in]     len    Valid data in the new buffer
+ */
+static void reader_chunk_set(ipfix_reader_t *reader, struct reader_chunk *chunk,
+	size_t len)
+{
+	if (reader->chunk) {
+		input_block_unref(&reader->chunk->block);
+	}
+
+	reader->chunk = chunk;
+	reader->buffer = chunk->data;
+	reader->buffer_size = chunk->size;
+	reader->buffer_len = len;
+	reader->buffer_pos = 0;
+}
+
+/**
+ * \brief Prepare the buffer for new data
+ *
+ * Unprocessed data are moved to the beginning of the buffer. If the current
+ * buffer is still used by handed out messages, a new one is allocated.
+ * \param[in,out] reader Reader
+ * \param[in]     size   Minimal size of the buffer
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int reader_buffer_reset(ipfix_reader_t *reader, size_t size)
+{
+	struct reader_chunk *chunk = reader->chunk;
+	size_t rest = reader->buffer_len - reader->buffer_pos;
+
+	if (size < READER_BUFFER_SIZE) {
+		size = READER_BUFFER_SIZE;
+	}
+
+	if (chunk && !chunk->map && chunk->size >= size
+			&& __sync_fetch_and_add(&chunk->block.refs, 0) == 1) {
+		// Nobody else uses the buffer
+		memmove(chunk->data, chunk->data + reader->buffer_pos, rest);
+		reader->buffer_len = rest;
+		reader->buffer_pos = 0;
+		return 0;
+	}
+
+	chunk = malloc(sizeof(*chunk) + size);
+	if (!chunk) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return 1;
+	}
+
+	chunk->block.refs = 1;
+	chunk->block.release = reader_chunk_release;
+	chunk->data = (uint8_t *) (chunk + 1);
+	chunk->size = size;
+	chunk->map = NULL;
+	chunk->map_size = 0;
+
+	if (rest > 0) {
+		memcpy(chunk->data, reader->buffer + reader->buffer_pos, rest);
+	}
+
+	reader_chunk_set(reader, chunk, rest);
+	return 0;
+}
+
+/**
+ * \brief Map the next window of a plain file
+ *
+ * The window starts with unprocessed data of the current one.
+ * \param[in,out] reader Reader
+ * \return On success returns 0. If the end of the file is reached, returns
+ *   a positive value. On failure returns a negative value.
+ */
+static int reader_map(ipfix_reader_t *reader)
+{
+	off_t offset = reader->data_offset + reader->buffer_pos;
+	off_t start = offset - offset % sysconf(_SC_PAGESIZE);
+
+	if (offset >= reader->file_size) {
+		return 1;
+	}
+
+	size_t len = READER_MAP_SIZE;
+	if ((off_t) len > reader->file_size - start) {
+		len = reader->file_size - start;
+	}
+
+	// Private writable mapping, the core modifies headers of messages
+	void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		reader->fd, start);
+	if (map == MAP_FAILED) {
+		MSG_ERROR(msg_module, "Unable to map input file (%s)", strerror(errno));
+		return -1;
+	}
+
+	struct reader_chunk *chunk = malloc(sizeof(*chunk));
+	if (!chunk) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		munmap(map, len);
+		return -1;
+	}
+
+	madvise(map, len, MADV_SEQUENTIAL);
+	// Read ahead the next window
+	posix_fadvise(reader->fd, start + len, READER_MAP_SIZE, POSIX_FADV_WILLNEED);
+
+	chunk->block.refs = 1;
+	chunk->block.release = reader_chunk_release;
+	chunk->data = (uint8_t *) map + (offset - start);
+	chunk->size = len - (offset - start);
+	chunk->map = map;
+	chunk->map_size = len;
+
+	reader_chunk_set(reader, chunk, chunk->size);
+	reader->data_offset = offset;
+	reader->eof = (start + (off_t) len == reader->file_size);
+	return 0;
+}
+
+/**
+ * \brief Read data from a given position of a file
+ * \param[in]  fd     File descriptor
+ * \param[out] data   Buffer
+ * \param[in]  len    Size of the data
+ * \param[in]  offset Position
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int reader_pread_all(int fd, void *data, size_t len, off_t offset)
+{
+	uint8_t *ptr = data;
+
+	while (len > 0) {
+		ssize_t ret = pread(fd, ptr, len, offset);
+		if (ret == -1 && errno == EINTR) {
+			continue;
+		}
+
+		if (ret <= 0) {
+			return 1;
+		}
+
+		ptr += ret;
+		len -= (size_t) ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Load the index of frames (if present)
+ * \param[in,out] reader Reader
+ * \return On success returns 0. Otherwise (missing or invalid index)
+ *   returns non-zero value.
+ */
+static int reader_idx_load(ipfix_reader_t *reader)
+{
+	struct ipfix_file_footer footer;
+	struct stat st;
+	uint32_t header[2];
+
+	if (fstat(reader->fd, &st) == -1 || (size_t) st.st_size < sizeof(footer)
+			|| reader_pread_all(reader->fd, &footer, sizeof(footer),
+				st.st_size - sizeof(footer))
+			|| le32toh(footer.magic) != IPFIX_FILE_IDX_MAGIC
+			|| le32toh(footer.version) != IPFIX_FILE_IDX_VERSION) {
+		return 1;
+	}
+
+	size_t cnt = le32toh(footer.frame_cnt);
+	size_t entries = cnt * sizeof(struct ipfix_file_frame);
+	size_t frame_size = sizeof(header) + entries + sizeof(footer);
+	if (cnt == 0 || (size_t) st.st_size < frame_size) {
+		return 1;
+	}
+
+	off_t start = st.st_size - frame_size;
+	if (reader_pread_all(reader->fd, header, sizeof(header), start)
+			|| le32toh(header[0]) != IPFIX_FILE_SKIP_MAGIC
+			|| le32toh(header[1]) != entries + sizeof(footer)) {
+		return 1;
+	}
+
+	struct ipfix_file_frame *idx = malloc(entries);
+	if (!idx) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return 1;
+	}
+
+	if (reader_pread_all(reader->fd, idx, entries, start + sizeof(header))) {
+		free(idx);
+		return 1;
+	}
+
+	// Check consistency of the index
+	off_t total = 0;
+	size_t max_size = 0;
+	for (size_t i = 0; i < cnt; ++i) {
+		idx[i].comp_size = le32toh(idx[i].comp_size);
+		idx[i].data_size = le32toh(idx[i].data_size);
+		idx[i].msg_cnt = le32toh(idx[i].msg_cnt);
+		idx[i].export_time = le32toh(idx[i].export_time);
+		total += idx[i].comp_size;
+
+		if (idx[i].comp_size > max_size) {
+			max_size = idx[i].comp_size;
+		}
+	}
+
+	if (total != start) {
+		free(idx);
+		return 1;
+	}
+
+	reader->idx = idx;
+	reader->idx_cnt = cnt;
+
+	// Buffer for whole compressed frames
+	if (max_size > reader->input_size) {
+		uint8_t *new_input = realloc(reader->input, max_size);
+		if (!new_input) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+
+		reader->input = new_input;
+		reader->input_size = max_size;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Detect a format of the file and prepare decompression
+ * \param[in,out] reader Reader
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int reader_detect(ipfix_reader_t *reader, const char *path)
+{
+	uint32_t magic;
+
+	if (reader_pread_all(reader->fd, &magic, sizeof(magic), 0)) {
+		// Empty or too short file
+		reader->format = FORMAT_PLAIN;
+		return 0;
+	}
+
+	switch (le32toh(magic)) {
+	case IPFIX_FILE_LZ4_MAGIC:
+#ifdef HAVE_LZ4
+		if (LZ4F_isError(LZ4F_createDecompressionContext(&reader->lz4,
+				LZ4F_VERSION))) {
+			return 1;
+		}
+		reader->format = FORMAT_LZ4;
+		break;
+#else
+		MSG_ERROR(msg_module, "LZ4 compressed file '%s' is not supported by "
+			"this build", path);
+		return 1;
+#endif
+	case IPFIX_FILE_ZSTD_MAGIC:
+#ifdef HAVE_ZSTD
+		reader->zstd = ZSTD_createDCtx();
+		if (!reader->zstd) {
+			return 1;
+		}
+		reader->format = FORMAT_ZSTD;
+		break;
+#else
+		MSG_ERROR(msg_module, "zstd compressed file '%s' is not supported by "
+			"this build", path);
+		return 1;
+#endif
+	default:
+		reader->format = FORMAT_PLAIN;
+		return 0;
+	}
+
+	(void) path;
+	reader->input_size = READER_INPUT_SIZE;
+	reader->input = malloc(reader->input_size);
+	if (!reader->input) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return 1;
+	}
+
+	if (reader_idx_load(reader)) {
+		MSG_INFO(msg_module, "File '%s' has no index of frames, reading it as "
+			"a stream", path);
+	}
+
+	return 0;
+}
+
+/* Open a file */
+ipfix_reader_t *reader_open(const char *path, enum READER_MODE mode)
+{
+	ipfix_reader_t *reader = calloc(1, sizeof(*reader));
+	if (!reader) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return NULL;
+	}
+
+	reader->fd = open(path, O_RDONLY);
+	if (reader->fd == -1) {
+		/* input file doesn't exist or we don't have read permission */
+		MSG_ERROR(msg_module, "Unable to open input file: %s", path);
+		free(reader);
+		return NULL;
+	}
+
+	if (reader_detect(reader, path)) {
+		reader_close(reader);
+		return NULL;
+	}
+
+	// Only plain files can be mapped, compressed files are read
+	reader->mode = (reader->format == FORMAT_PLAIN) ? mode : READER_MODE_READ;
+	if (reader->mode == READER_MODE_MMAP) {
+		struct stat st;
+		if (fstat(reader->fd, &st) == -1) {
+			MSG_ERROR(msg_module, "Unable to get size of input file: %s", path);
+			reader_close(reader);
+			return NULL;
+		}
+
+		reader->file_size = st.st_size;
+	}
+
+	posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return reader;
+}
+
+/* Close a file */
+void reader_close(ipfix_reader_t *reader)
+{
+	if (!reader) {
+		return;
+	}
+
+#ifdef HAVE_LZ4
+	if (reader->lz4) {
+		LZ4F_freeDecompressionContext(reader->lz4);
+	}
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_freeDCtx(reader->zstd);
+#endif
+
+	if (reader->chunk) {
+		// Handed out messages can still use the buffer
+		input_block_unref(&reader->chunk->block);
+	}
+
+	close(reader->fd);
+	free(reader->idx);
+	free(reader->input);
+	free(reader);
+}
+
+/* Skip indexed frames with messages exported before a time */
+int reader_seek_time(ipfix_reader_t *reader, uint32_t time)
+{
+	size_t frame = 0;
+	off_t offset = 0;
+
+	if (reader->idx_cnt == 0) {
+		return 1;
+	}
+
+	// Messages of a frame are not newer than the first one of the next frame
+	while (frame + 1 < reader->idx_cnt && reader->idx[frame + 1].export_time < time) {
+		offset += reader->idx[frame].comp_size;
+		frame++;
+	}
+
+	MSG_DEBUG(msg_module, "Skipping %zu of %zu frames exported before %" PRIu32,
+		frame, reader->idx_cnt, time);
+
+	reader->frame = frame;
+	reader->frame_offset = offset;
+	reader->buffer_len = 0;
+	reader->buffer_pos = 0;
+	reader->eof = 0;
+	return 0;
+}
+
+/**
+ * \brief Decompress a part of the compressed stream
+ * \param[in,out] reader Reader
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int reader_decompress(ipfix_reader_t *reader)
+{
+	const uint8_t *src = reader->input + reader->input_pos;
+	size_t src_len = reader->input_len - reader->input_pos;
+	uint8_t *dst = reader->buffer + reader->buffer_len;
+	size_t dst_len = reader->buffer_size - reader->buffer_len;
+
+	switch (reader->format) {
+#ifdef HAVE_LZ4
+	case FORMAT_LZ4: {
+		size_t ret = LZ4F_decompress(reader->lz4, dst, &dst_len, src, &src_len,
+			NULL);
+		if (LZ4F_isError(ret)) {
+			MSG_ERROR(msg_module, "LZ4 decompression failed (%s)",
+				LZ4F_getErrorName(ret));
+			return 1;
+		}
+		}
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case FORMAT_ZSTD: {
+		ZSTD_inBuffer in = {src, src_len, 0};
+		ZSTD_outBuffer out = {dst, dst_len, 0};
+		size_t ret = ZSTD_decompressStream(reader->zstd, &out, &in);
+		if (ZSTD_isError(ret)) {
+			MSG_ERROR(msg_module, "zstd decompression failed (%s)",
+				ZSTD_getErrorName(ret));
+			return 1;
+		}
+		src_len = in.pos;
+		dst_len = out.pos;
+		}
+		break;
+#endif
+	default:
+		(void) src;
+		(void) dst;
+		return 1;
+	}
+
+	reader->input_pos += src_len;
+	reader->buffer_len += dst_len;
+	return 0;
+}
+
+/**
+ * \brief Decompress a whole frame
+ * \param[in,out] reader Reader
+ * \param[in]     frame  Index entry of the frame
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int reader_decompress_frame(ipfix_reader_t *reader,
+	const struct ipfix_file_frame *frame)
+{
+	switch (reader->format) {
+#ifdef HAVE_LZ4
+	case FORMAT_LZ4:
+		LZ4F_resetDecompressionContext(reader->lz4);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case FORMAT_ZSTD:
+		ZSTD_DCtx_reset(reader->zstd, ZSTD_reset_session_only);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	reader->input_len = frame->comp_size;
+	reader->input_pos = 0;
+
+	while (reader->input_pos < reader->input_len) {
+		size_t prev_pos = reader->input_pos;
+		size_t prev_len = reader->buffer_len;
+		if (reader_decompress(reader)) {
+			return 1;
+		}
+
+		if (reader->input_pos == prev_pos && reader->buffer_len == prev_len) {
+			// No progress
+			break;
+		}
+	}
+
+	if (reader->buffer_len != frame->data_size) {
+		MSG_ERROR(msg_module, "Unexpected size of a decompressed frame");
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Check that a decompressed frame consists of complete IPFIX messages
+ * \param[in] reader Reader (with the frame in the buffer)
+ * \param[in] frame  Index entry of the frame
+ * \return If the frame is valid returns 0. Otherwise returns non-zero value.
+ */
+static int reader_check_frame(const ipfix_reader_t *reader,
+	const struct ipfix_file_frame *frame)
+{
+	size_t pos = 0;
+	uint32_t cnt = 0;
+
+	while (reader->buffer_len - pos >= IPFIX_HEADER_LENGTH) {
+		struct ipfix_header header;
+		memcpy(&header, reader->buffer + pos, IPFIX_HEADER_LENGTH);
+		uint16_t len = ntohs(header.length);
+
+		if (ntohs(header.version) != IPFIX_VERSION
+				|| len < IPFIX_HEADER_LENGTH || len > reader->buffer_len - pos) {
+			return 1;
+		}
+
+		pos += len;
+		cnt++;
+	}
+
+	return (pos != reader->buffer_len || cnt != frame->msg_cnt);
+}
+
+/**
+ * \brief Load the next frame of an indexed file
+ *
+ * Damaged frames are skipped.
+ * \param[in,out] reader Reader
+ * \return On success returns 0. At the end of the file returns non-zero value.
+ */
+static int reader_next_frame(ipfix_reader_t *reader)
+{
+	while (reader->frame < reader->idx_cnt) {
+		const struct ipfix_file_frame *frame = &reader->idx[reader->frame];
+		off_t offset = reader->frame_offset;
+
+		reader->frame++;
+		reader->frame_offset += frame->comp_size;
+		reader->buffer_pos = reader->buffer_len;
+		if (reader_buffer_reset(reader, frame->data_size)) {
+			return 1;
+		}
+
+		if (reader_pread_all(reader->fd, reader->input, frame->comp_size,
+				offset) == 0 && reader_decompress_frame(reader, frame) == 0
+				&& reader_check_frame(reader, frame) == 0) {
+			return 0;
+		}
+
+		MSG_ERROR(msg_module, "Frame %zu of the input file is damaged; "
+			"skipping...", reader->frame - 1);
+		reader->buffer_len = 0;
+		reader->buffer_pos = 0;
+	}
+
+	return 1;
+}
+
+/**
+ * \brief Make sure that the buffer contains at least given amount of data
+ *
+ * Only for plain files and compressed files without the index.
+ * \param[in,out] reader Reader
+ * \param[in]     need   Required amount of data from the current position
+ * \return On success returns 0. If the end of the file is reached, returns
+ *   a positive value. On failure returns a negative value.
+ */
+static int reader_fill(ipfix_reader_t *reader, size_t need)
+{
+	if (reader->buffer_len - reader->buffer_pos >= need) {
+		return 0;
+	}
+
+	if (reader->mode == READER_MODE_MMAP) {
+		if (reader->eof) {
+			return 1;
+		}
+
+		int ret = reader_map(reader);
+		if (ret != 0) {
+			return ret;
+		}
+
+		return (reader->buffer_len < need) ? 1 : 0;
+	}
+
+	// Move the rest of the data to the beginning of the buffer
+	if (reader_buffer_reset(reader, need)) {
+		return -1;
+	}
+
+	while (reader->buffer_len < need) {
+		if (reader->format == FORMAT_PLAIN) {
+			if (reader->eof) {
+				return 1;
+			}
+
+			ssize_t ret = read(reader->fd, reader->buffer + reader->buffer_len,
+				reader->buffer_size - reader->buffer_len);
+			if (ret == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				MSG_ERROR(msg_module, "Error while reading from input file: %s",
+					strerror(errno));
+				return -1;
+			}
+
+			reader->eof = (ret == 0);
+			reader->buffer_len += (size_t) ret;
+			continue;
+		}
+
+		if (reader->input_pos == reader->input_len) {
+			// Read more compressed data
+			if (reader->eof) {
+				return 1;
+			}
+
+			ssize_t ret = read(reader->fd, reader->input, reader->input_size);
+			if (ret == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				MSG_ERROR(msg_module, "Error while reading from input file: %s",
+					strerror(errno));
+				return -1;
+			}
+
+			reader->eof = (ret == 0);
+			reader->input_len = (size_t) ret;
+			reader->input_pos = 0;
+			continue;
+		}
+
+		if (reader_decompress(reader)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Get the next IPFIX message */
+enum READER_STATUS reader_next(ipfix_reader_t *reader, uint8_t **msg,
+	uint16_t *len, struct input_block **block)
+{
+	struct ipfix_header header;
+
+	if (reader->idx_cnt > 0) {
+		// Indexed file: messages never span frames and frames are checked
+		while (reader->buffer_pos >= reader->buffer_len) {
+			if (reader_next_frame(reader)) {
+				return READER_EOF;
+			}
+		}
+
+		memcpy(&header, reader->buffer + reader->buffer_pos, IPFIX_HEADER_LENGTH);
+		*msg = reader->buffer + reader->buffer_pos;
+		*len = ntohs(header.length);
+		reader->buffer_pos += *len;
+
+		if (block) {
+			input_block_ref(&reader->chunk->block);
+			*block = &reader->chunk->block;
+		}
+		return READER_OK;
+	}
+
+	int ret = reader_fill(reader, IPFIX_HEADER_LENGTH);
+	if (ret > 0 && reader->buffer_len == reader->buffer_pos) {
+		return READER_EOF;
+	}
+
+	if (ret != 0) {
+		MSG_ERROR(msg_module, "Failed to read IPFIX message header");
+		return READER_ERROR;
+	}
+
+	memcpy(&header, reader->buffer + reader->buffer_pos, IPFIX_HEADER_LENGTH);
+
+	/* check magic number */
+	if (ntohs(header.version) != IPFIX_VERSION) {
+		MSG_ERROR(msg_module, "Bad magic number; expected %x, got %x",
+			IPFIX_VERSION, ntohs(header.version));
+		return READER_ERROR;
+	}
+
+	/* get packet length */
+	uint16_t packet_len = ntohs(header.length);
+	if (packet_len < IPFIX_HEADER_LENGTH) {
+		/* invalid length of the IPFIX message */
+		MSG_ERROR(msg_module, "Input file has invalid length (too short)");
+		return READER_ERROR;
+	}
+
+	if (reader_fill(reader, packet_len) != 0) {
+		MSG_ERROR(msg_module, "Truncated IPFIX message in the input file");
+		return READER_ERROR;
+	}
+
+	*msg = reader->buffer + reader->buffer_pos;
+	*len = packet_len;
+	reader->buffer_pos += packet_len;
+
+	if (block) {
+		input_block_ref(&reader->chunk->block);
+		*block = &reader->chunk->block;
+	}
+	return READER_OK;
+}
@@ -0,0 +1,125 @@
+/**
+ * \file src/input/ipfix/ipfix_reader.h
+ * \brief Reader of IPFIX files (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef IPFIX_READER_H
+#define IPFIX_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ipfixcol.h>
+
+/**
+ * \defgroup ipfixReader Reader of IPFIX files
+ * \ingroup ipfixInputFileFormat
+ *
+ * Reads plain IPFIX files as well as LZ4 and zstd compressed files
+ * (see ipfixcol/ipfix_file.h). Compressed files with an index are read
+ * frame by frame and a damaged frame is skipped. Files without the index
+ * (e.g. unfinished files) are decompressed as a stream.
+ *
+ * Messages are handed out as parts of reference counted buffers (or mapped
+ * windows of plain files), so they don't have to be copied.
+ *
+ * @{
+ */
+
+/** Status of reading */
+enum READER_STATUS {
+	READER_OK,              /**< Message successfully read               */
+	READER_EOF,             /**< End of the file                         */
+	READER_ERROR            /**< Malformed or unreadable file            */
+};
+
+/** Mode of reading of plain files */
+enum READER_MODE {
+	READER_MODE_READ,       /**< Read into large buffers                 */
+	READER_MODE_MMAP        /**< Map windows of the file                 */
+};
+
+// Structure prototype
+typedef struct ipfix_reader ipfix_reader_t;
+
+/**
+ * \brief Open a file
+ *
+ * Compressed files are always read in #READER_MODE_READ mode.
+ * \param[in] path Path to the file
+ * \param[in] mode Mode of reading
+ * \return Pointer or NULL
+ */
+ipfix_reader_t *reader_open(const char *path, enum READER_MODE mode);
+
+/**
+ * \brief Close a file
+ * \param[in,out] reader Reader
+ */
+void reader_close(ipfix_reader_t *reader);
+
+/**
+ * \brief Get the next IPFIX message
+ *
+ * If \p block is NULL, the message is valid until the next call of the
+ * function. Otherwise a reference to the buffer of the message is returned
+ * and the message is valid until the reference is removed (see
+ * input_block_unref()).
+ * \param[in,out] reader Reader
+ * \param[out]    msg    Pointer to the message
+ * \param[out]    len    Length of the message
+ * \param[out]    block  Buffer of the message (can be NULL)
+ * \return Status
+ */
+enum READER_STATUS reader_next(ipfix_reader_t *reader, uint8_t **msg,
+	uint16_t *len, struct input_block **block);
+
+/**
+ * \brief Skip indexed frames with messages exported before a time
+ *
+ * Reading continues from the last frame whose first message was exported
+ * before the time, so older messages can still be read from that frame.
+ * Messages of the file are expected to be ordered by export time. Must be
+ * called before the first message is read.
+ * \param[in,out] reader Reader
+ * \param[in]     time   Export time (seconds since UNIX epoch)
+ * \return On success returns 0. If the file has no index, returns non-zero
+ * value and the file is read from the beginning.
+ */
+int reader_seek_time(ipfix_reader_t *reader, uint32_t time);
+
+/**@}*/
+
+#endif /* IPFIX_READER_H */
@@ -684,6 +684,7 @@ void filter_copy_metainfo(struct ipfix_message *src, struct ipfix_message *dst)
 	dst->source_status = src->source_status;
 	dst->templ_records_count = src->templ_records_count;
 	dst->opt_templ_records_count = src->opt_templ_records_count;
+	dst->stamps = src->stamps;
 }
 
 /**
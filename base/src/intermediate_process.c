@@ -47,6 +47,7 @@
 #include "queues.h"
 #include "intermediate_process.h"
 #include "config.h"
+#include "perf.h"
 #include <ipfixcol/intermediate.h>
 
 static char *msg_module = "intermediate_process";
@@ -63,6 +64,9 @@ void *ip_loop(void *config)
 {
 	struct intermediate *conf = (struct intermediate *) config;
 	struct ipfix_message *msg;
+	struct ipfix_msg_stamps stamps = {0, 0};
+	uint16_t records = 0;
+	uint64_t start = 0;
 	unsigned int index;
 
 	prctl(PR_SET_NAME, conf->thread_name, 0, 0, 0);
@@ -90,10 +94,21 @@ void *ip_loop(void *config)
 		}
 		conf->index = index;
 		conf->dropped = false;
+
+		/* the message can be freed by the next stage during processing */
+		if (conf->perf) {
+			start = perf_now();
+			stamps = msg->stamps;
+			records = msg->data_records_count;
+		}
 		
 		/* process message */
 		conf->intermediate_process_message(conf->plugin_config, msg);
 
+		if (conf->perf) {
+			perf_stage_update(conf->perf, records, stamps, start, perf_now(), conf->dropped);
+		}
+
 		if (!conf->dropped) {
 			/* remove message from input queue, but do not free memory (it must be done later in output manager) */
 			rbuffer_remove_reference(conf->in_queue, index, 0);
@@ -141,10 +156,14 @@ int ip_init(struct intermediate *conf, uint32_t ip_id)
 
 	free(ip_params);
 	
+	conf->perf = perf_stage_add("intermediate", conf->thread_name, 0);
+
 	/* start main thread */
 	ret = pthread_create(&(conf->thread_id), NULL, ip_loop, (void *)conf);
 	if (ret != 0) {
 		MSG_ERROR(msg_module, "Unable to create thread for intermediate process");
+		perf_stage_remove(conf->perf);
+		conf->perf = NULL;
 		return -1;
 	}
 
@@ -165,6 +184,11 @@ int pass_message(void *config, struct ipfix_message *msg)
 		MSG_WARNING(msg_module, "NULL message from intermediate plugin; skipping...");
 		return 0;
 	}
+
+	if (conf->perf) {
+		perf_stamp_queued(msg, perf_now());
+	}
+
 	ret = rbuffer_write(conf->out_queue, msg, 1);
 
 	return ret;
@@ -199,6 +223,7 @@ int ip_destroy(struct intermediate *conf)
 	/* Close plugin */
 	conf->intermediate_close(conf->plugin_config);
 
+	perf_stage_remove(conf->perf);
 	free(conf);
 
 	return 0;
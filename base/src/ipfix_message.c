@@ -360,7 +360,7 @@ int message_free(struct ipfix_message *msg)
 		return -1;
 	}
 
-	free(msg->pkt_header);
+	message_free_packet(msg);
 	free(msg);
 
 	/* note we do not want to free input_info structure, it is input plugin's job */
@@ -368,6 +368,45 @@ int message_free(struct ipfix_message *msg)
 	return 0;
 }
 
+/**
+ * \brief Dispose memory of the IPFIX packet of a message
+ *
+ * \param[in] msg IPFIX message
+ */
+void message_free_packet(struct ipfix_message *msg)
+{
+	if (msg->block) {
+		input_block_unref(msg->block);
+		msg->block = NULL;
+	} else {
+		free(msg->pkt_header);
+	}
+
+	msg->pkt_header = NULL;
+}
+
+/**
+ * \brief Add a reference to a memory block of packets
+ *
+ * \param[in,out] block Memory block
+ */
+void input_block_ref(struct input_block *block)
+{
+	__sync_fetch_and_add(&block->refs, 1);
+}
+
+/**
+ * \brief Remove a reference to a memory block of packets
+ *
+ * \param[in,out] block Memory block
+ */
+void input_block_unref(struct input_block *block)
+{
+	if (__sync_sub_and_fetch(&block->refs, 1) == 0) {
+		block->release(block);
+	}
+}
+
 /*
  * ---------------------------------------------------------------------------
  * ---------------------------------------------------------------------------
@@ -70,6 +70,7 @@
 #include "preprocessor.h"
 #include "output_manager.h"
 #include "configurator.h"
+#include "perf.h"
 
 /**
  * \defgroup internalAPIs ipfixcol's Internal APIs
@@ -191,6 +192,7 @@ int main (int argc, char* argv[])
 	char *startup_config = NULL, *internal_config = NULL;
 	struct sigaction action;
 	char *packet = NULL;
+	struct input_block *block = NULL;
 	struct input_info* input_info;
 	void *output_manager_config = NULL;
 	xmlXPathObjectPtr collectors = NULL;
@@ -373,6 +375,12 @@ int main (int argc, char* argv[])
 		goto cleanup_err;
 	}
 	
+	/* Start pipeline statistics (if configured) before the stages are created */
+	if (perf_init(config->collector_node) != 0) {
+		MSG_ERROR(msg_module, "[%d] Unable to start pipeline statistics", config->proc_id);
+		goto cleanup_err;
+	}
+
 	/* Create output queue for preprocessor */
 	preprocessor_set_output_queue(rbuffer_init(ring_buffer_size));
 	
@@ -402,7 +410,13 @@ int main (int argc, char* argv[])
 	/* main loop */
 	while (!terminating) {
 		/* get data to process */
-		if ((get_retval = config->input.get(config->input.config, &input_info, &packet, &source_status)) < 0) {
+		if (config->input.get_block) {
+			get_retval = config->input.get_block(config->input.config, &input_info, &packet, &block, &source_status);
+		} else {
+			get_retval = config->input.get(config->input.config, &input_info, &packet, &source_status);
+		}
+
+		if (get_retval < 0) {
 			if ((!reconf && !terminating) || get_retval != INPUT_INTR) {
 				/* If interrupted and closing, it's OK */
 				/* We don't print warnings or errors here, since we leave that responsibility
@@ -416,20 +430,27 @@ int main (int argc, char* argv[])
 				reconf = 0;
 			}
 			
-			if (packet) {
+			if (block) {
+				input_block_unref(block);
+				block = NULL;
+			} else if (packet) {
 				free(packet);
-				packet = NULL;
 			}
 
+			packet = NULL;
 			continue;
 		} else if (get_retval == INPUT_CLOSED) {
 			/* ensure that parser gets NULL packet => closed connection */
-			if (packet != NULL) {
+			if (block) {
+				input_block_unref(block);
+				block = NULL;
+			} else if (packet != NULL) {
 				/* free the memory allocated by xml_conf (if any) right away */
 				free(packet);
-				packet = NULL;
 			}
 
+			packet = NULL;
+
 			/* if input plugin is file reader, end collector */
 			if (input_info->type == SOURCE_TYPE_IPFIX_FILE) {
 				terminating = 1;
@@ -437,9 +458,10 @@ int main (int argc, char* argv[])
 		}
 
 		/* distribute data to the particular Data Manager for further processing */
-		preprocessor_parse_msg(packet, get_retval, input_info, source_status);
+		preprocessor_parse_msg(packet, get_retval, input_info, source_status, block);
 		source_status = SOURCE_STATUS_OPENED;
 		packet = NULL;
+		block = NULL;
 		input_info = NULL;
 	}
 	
@@ -467,6 +489,9 @@ cleanup:
 		config_destroy(config);
 	}
 
+	/* Close pipeline statistics socket */
+	perf_close();
+
 	/* Unlink pidfile by parent process. */
 	if (pidfile_path && unlink(pidfile_path) != 0) {
 		MSG_ERROR(msg_module, "Cannot unlink pidfile \"%s\": %s", pidfile_path, strerror(errno));
@@ -54,6 +54,7 @@
 #include "configurator.h"
 #include "data_manager.h"
 #include "output_manager.h"
+#include "perf.h"
 
 /* MSG_ macros identifiers */
 static const char *msg_module = "output manager";
@@ -346,6 +347,7 @@ static void *output_manager_plugin_thread(void* config)
 	struct ipfix_message* msg = NULL;
 	unsigned int index;
 	uint32_t odid;
+	uint64_t start;
 
 	conf = (struct output_manager_config *) config;
 	index = conf->in_queue->read_offset;
@@ -358,6 +360,7 @@ static void *output_manager_plugin_thread(void* config)
 		/* get next data */
 		index = -1;
 		msg = rbuffer_read(conf->in_queue, &index);
+		start = perf_now();
 
 		if (!msg) {
 			rbuffer_remove_reference(conf->in_queue, index, 1);
@@ -429,8 +432,21 @@ static void *output_manager_plugin_thread(void* config)
 			continue;
 		}
 
+		/* Storage plugins read the message concurrently, stamp it before it is shared */
+		if (conf->perf) {
+			uint64_t end = perf_now();
+			struct ipfix_msg_stamps stamps = msg->stamps;
+
+			perf_stamp_queued(msg, end);
+			perf_stage_update(conf->perf, msg->data_records_count, stamps, start, end, false);
+		}
+
 		/* Write data into input queue of Storage Plugins */
 		if (rbuffer_write(data_config->store_queue, msg, data_config->plugins_count) != 0) {
+			if (conf->perf) {
+				conf->perf->drops++;
+			}
+
 			MSG_WARNING(msg_module, "[%u] Unable to write into Data Manager input queue; skipping data...", data_config->observation_domain_id);
 			rbuffer_remove_reference(conf->in_queue, index, 1);
 			free(msg);
@@ -600,17 +616,40 @@ static void statistics_print_cpu(struct stat_conf *conf, FILE *stat_out_file)
  */
 void statistics_print_buffers(struct output_manager_config *conf, FILE *stat_out_file)
 {
+	struct ring_buffer *prep_buffer = get_preprocessor_output_queue();
+	struct data_manager_config *dm = conf->data_managers;
+	startup_config *startup = conf->plugins_config->startup;
+	int i;
+
 	if (stat_out_file) {
-		/* Add contents here */
+		/* Occupancy and size of each queue of the pipeline */
+		fprintf(stat_out_file, "%s=%u\n", "QUEUE_PREPROCESSOR", prep_buffer->count);
+		fprintf(stat_out_file, "%s=%u\n", "QUEUE_PREPROCESSOR_SIZE", prep_buffer->size);
+
+		for (i = 0; startup && startup->inter[i]; ++i) {
+			struct ring_buffer *out_queue = startup->inter[i]->inter->out_queue;
+			fprintf(stat_out_file, "%s_%d=%u\n", "QUEUE_INTERMEDIATE", i, out_queue->count);
+			fprintf(stat_out_file, "%s_%d_SIZE=%u\n", "QUEUE_INTERMEDIATE", i, out_queue->size);
+		}
+
+		while (dm) {
+			fprintf(stat_out_file, "%s_%u=%u\n", "QUEUE_STORAGE", dm->observation_domain_id, dm->store_queue->count);
+			fprintf(stat_out_file, "%s_%u_SIZE=%u\n", "QUEUE_STORAGE", dm->observation_domain_id, dm->store_queue->size);
+			dm = dm->next;
+		}
 	} else {
 		/* Print info about preprocessor's output queue */
 		MSG_ALWAYS(" | Queue utilization:", NULL);
-
-		struct ring_buffer *prep_buffer = get_preprocessor_output_queue();
 		MSG_ALWAYS(" |     Preprocessor output queue: %u / %u", prep_buffer->count, prep_buffer->size);
 
+		/* Print info about output queues of Intermediate plugins */
+		for (i = 0; startup && startup->inter[i]; ++i) {
+			struct ring_buffer *out_queue = startup->inter[i]->inter->out_queue;
+			MSG_ALWAYS(" |     Intermediate plugin '%s' output queue: %u / %u",
+					startup->inter[i]->inter->thread_name, out_queue->count, out_queue->size);
+		}
+
 		/* Print info about Output Manager queues */
-		struct data_manager_config *dm = conf->data_managers;
 		if (dm) {
 			if (conf->manager_mode == OM_SINGLE) {
 				MSG_ALWAYS(" |     Output Manager output queue: %u / %u", dm->store_queue->count, dm->store_queue->size);
@@ -880,6 +919,7 @@ int output_manager_create(configurator *plugins_config, int stat_interval, bool
 	conf->stat_interval = stat_interval;
 	conf->plugins_config = plugins_config;
 	conf->perman_odid_merge = odid_merge;
+	conf->perf = perf_stage_add("output_manager", "ipfixcol OM", 0);
 
 	if (conf->manager_mode == OM_SINGLE) {
 		MSG_INFO(msg_module, "Configuring Output Manager in single manager mode");
@@ -974,6 +1014,7 @@ void output_manager_close(void *config)
 		}
 	}
 
+	perf_stage_remove(manager->perf);
 	free(manager);
 }
 
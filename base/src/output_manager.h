@@ -95,6 +95,7 @@ struct output_manager_config {
 	int stat_interval;                          /**< Stat's interval */
 	struct stat_conf stats;                     /**< Statistics */
 	configurator *plugins_config;               /**< Plugins configurator */
+	struct perf_stage *perf;                    /**< Pipeline statistics (NULL if disabled) */
 	pthread_mutex_t in_q_mutex;
 	pthread_cond_t  in_q_cond;
 };
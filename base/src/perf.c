@@ -0,0 +1,585 @@
+/**
+ * \file perf.c
+ * \brief Instrumentation of the processing pipeline
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/prctl.h>
+#include <ipfixcol.h>
+
+#include "perf.h"
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "perf";
+
+/** Timeout of polling of the statistics socket (ms) */
+#define PERF_POLL_TIMEOUT 500
+/** Maximal length of a request */
+#define PERF_REQ_LEN 1024
+/** Timeout of sending and receiving on a client connection (s) */
+#define PERF_CLIENT_TIMEOUT 2
+/** Prometheus histogram buckets: powers of two from 2^10 ns (~1 us) ... */
+#define PERF_PROM_MIN_EXP 10
+/** ... to 2^36 ns (~69 s) */
+#define PERF_PROM_MAX_EXP 36
+
+bool perf_enabled = false;
+
+/** Registered stages */
+static struct perf_stage *stages = NULL;
+static pthread_mutex_t stages_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Statistics socket */
+static int sock_fd = -1;
+static char *sock_path = NULL;
+static pthread_t sock_thread;
+static volatile int sock_done = 0;
+static uint64_t start_time;
+
+/**
+ * \brief Get histogram bucket of a value
+ */
+static inline int perf_hist_index(uint64_t val)
+{
+	if (val < (1 << PERF_HIST_SUB_BITS)) {
+		return val;
+	}
+
+	int msb = 63 - __builtin_clzll(val);
+	int sub = (val >> (msb - PERF_HIST_SUB_BITS)) & ((1 << PERF_HIST_SUB_BITS) - 1);
+	return ((msb - PERF_HIST_SUB_BITS + 1) << PERF_HIST_SUB_BITS) + sub;
+}
+
+/**
+ * \brief Get the highest value of a histogram bucket
+ */
+static uint64_t perf_hist_bound(int idx)
+{
+	if (idx < (1 << PERF_HIST_SUB_BITS)) {
+		return idx;
+	}
+
+	int msb = (idx >> PERF_HIST_SUB_BITS) + PERF_HIST_SUB_BITS - 1;
+	uint64_t sub = idx & ((1 << PERF_HIST_SUB_BITS) - 1);
+	uint64_t width = 1ULL << (msb - PERF_HIST_SUB_BITS);
+	return (1ULL << msb) + sub * width + width - 1;
+}
+
+/**
+ * \brief Add a value to a histogram
+ */
+static inline void perf_hist_add(struct perf_hist *hist, uint64_t val)
+{
+	hist->buckets[perf_hist_index(val)]++;
+	hist->sum += val;
+	hist->count++;
+	if (val > hist->max) {
+		hist->max = val;
+	}
+}
+
+/**
+ * \brief Get a percentile of a histogram
+ *
+ * \param[in] hist Histogram
+ * \param[in] perc Percentile (0 - 1)
+ * \return Upper bound of the bucket with the percentile
+ */
+static uint64_t perf_hist_percentile(const struct perf_hist *hist, double perc)
+{
+	uint64_t total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < PERF_HIST_BUCKETS; ++i) {
+		total += hist->buckets[i];
+	}
+
+	if (total == 0) {
+		return 0;
+	}
+
+	uint64_t limit = (uint64_t) (perc * total);
+	for (i = 0; i < PERF_HIST_BUCKETS; ++i) {
+		sum += hist->buckets[i];
+		if (sum > limit) {
+			break;
+		}
+	}
+
+	uint64_t bound = perf_hist_bound(i < PERF_HIST_BUCKETS ? i : PERF_HIST_BUCKETS - 1);
+	return (bound < hist->max) ? bound : hist->max;
+}
+
+/**
+ * \brief Account a message processed by a stage
+ */
+void perf_stage_update(struct perf_stage *stage, uint16_t records, struct ipfix_msg_stamps stamps,
+		uint64_t start, uint64_t end, bool dropped)
+{
+	stage->messages++;
+	stage->records += records;
+	stage->busy_ns += end - start;
+
+	if (dropped) {
+		stage->drops++;
+	}
+
+	/* Messages created by plugins have no timestamps */
+	if (stamps.queued && start >= stamps.queued) {
+		perf_hist_add(&stage->wait, start - stamps.queued);
+	}
+
+	if (stamps.input && end >= stamps.input) {
+		perf_hist_add(&stage->latency, end - stamps.input);
+	}
+}
+
+/**
+ * \brief Add a pipeline stage
+ */
+struct perf_stage *perf_stage_add(const char *type, const char *name, uint32_t odid)
+{
+	struct perf_stage *stage;
+
+	if (!perf_enabled) {
+		return NULL;
+	}
+
+	stage = calloc(1, sizeof(struct perf_stage));
+	if (!stage) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	strncpy_safe(stage->type, type, sizeof(stage->type));
+	strncpy_safe(stage->name, name, sizeof(stage->name));
+	stage->odid = odid;
+
+	/* Append to keep the order of the pipeline */
+	pthread_mutex_lock(&stages_mutex);
+	if (!stages) {
+		stages = stage;
+	} else {
+		struct perf_stage *last = stages;
+		while (last->next) {
+			last = last->next;
+		}
+		last->next = stage;
+		stage->prev = last;
+	}
+	pthread_mutex_unlock(&stages_mutex);
+
+	return stage;
+}
+
+/**
+ * \brief Remove a pipeline stage
+ */
+void perf_stage_remove(struct perf_stage *stage)
+{
+	if (!stage) {
+		return;
+	}
+
+	pthread_mutex_lock(&stages_mutex);
+	if (stage->prev) {
+		stage->prev->next = stage->next;
+	} else {
+		stages = stage->next;
+	}
+	if (stage->next) {
+		stage->next->prev = stage->prev;
+	}
+	pthread_mutex_unlock(&stages_mutex);
+
+	free(stage);
+}
+
+/**
+ * \brief Print a string with escaped quotes and backslashes
+ */
+static void perf_print_str(FILE *out, const char *str)
+{
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\') {
+			fputc('\\', out);
+		}
+		fputc(*str, out);
+	}
+}
+
+/**
+ * \brief Print a histogram as a JSON object
+ */
+static void perf_json_hist(FILE *out, const struct perf_hist *hist)
+{
+	fprintf(out, "{\"count\": %" PRIu64 ", \"sum\": %" PRIu64 ", \"p50\": %" PRIu64
+			", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p999\": %" PRIu64
+			", \"max\": %" PRIu64 "}",
+			hist->count, hist->sum, perf_hist_percentile(hist, 0.5),
+			perf_hist_percentile(hist, 0.9), perf_hist_percentile(hist, 0.99),
+			perf_hist_percentile(hist, 0.999), hist->max);
+}
+
+/**
+ * \brief Print all stages as JSON
+ */
+static void perf_print_json(FILE *out)
+{
+	struct perf_stage *stage;
+
+	fprintf(out, "{\"uptime_ns\": %" PRIu64 ", \"stages\": [", perf_now() - start_time);
+	for (stage = stages; stage; stage = stage->next) {
+		fprintf(out, "%s\n  {\"type\": \"%s\", \"name\": \"", (stage == stages) ? "" : ",", stage->type);
+		perf_print_str(out, stage->name);
+		fprintf(out, "\", \"odid\": %u, \"messages\": %" PRIu64 ", \"records\": %" PRIu64
+				", \"drops\": %" PRIu64 ", \"busy_ns\": %" PRIu64 ", \"queue_wait_ns\": ",
+				stage->odid, stage->messages, stage->records, stage->drops, stage->busy_ns);
+		perf_json_hist(out, &stage->wait);
+		fprintf(out, ", \"latency_ns\": ");
+		perf_json_hist(out, &stage->latency);
+		fprintf(out, "}");
+	}
+	fprintf(out, "\n]}\n");
+}
+
+/**
+ * \brief Print labels of a stage in Prometheus format
+ */
+static void perf_prom_labels(FILE *out, const struct perf_stage *stage)
+{
+	fprintf(out, "stage=\"%s\",plugin=\"", stage->type);
+	perf_print_str(out, stage->name);
+	fprintf(out, "\",odid=\"%u\"", stage->odid);
+}
+
+/**
+ * \brief Print a histogram of all stages in Prometheus format
+ *
+ * \param[in] out Output
+ * \param[in] name Metric name
+ * \param[in] help Description of the metric
+ * \param[in] offset Offset of the histogram in the stage structure
+ */
+static void perf_prom_hist(FILE *out, const char *name, const char *help, size_t offset)
+{
+	struct perf_stage *stage;
+
+	fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (stage = stages; stage; stage = stage->next) {
+		const struct perf_hist *hist = (const struct perf_hist *) ((const char *) stage + offset);
+		uint64_t cumulative = 0;
+		int idx = 0;
+
+		for (int exp = PERF_PROM_MIN_EXP; exp <= PERF_PROM_MAX_EXP; ++exp) {
+			/* Buckets of values lower than 2^exp */
+			int end = (exp - PERF_HIST_SUB_BITS + 1) << PERF_HIST_SUB_BITS;
+			for (; idx < end; ++idx) {
+				cumulative += hist->buckets[idx];
+			}
+
+			fprintf(out, "%s_bucket{", name);
+			perf_prom_labels(out, stage);
+			fprintf(out, ",le=\"%.9g\"} %" PRIu64 "\n", (double) (1ULL << exp) / 1e9, cumulative);
+		}
+
+		fprintf(out, "%s_bucket{", name);
+		perf_prom_labels(out, stage);
+		fprintf(out, ",le=\"+Inf\"} %" PRIu64 "\n", hist->count);
+		fprintf(out, "%s_sum{", name);
+		perf_prom_labels(out, stage);
+		fprintf(out, "} %.9f\n", hist->sum / 1e9);
+		fprintf(out, "%s_count{", name);
+		perf_prom_labels(out, stage);
+		fprintf(out, "} %" PRIu64 "\n", hist->count);
+	}
+}
+
+/**
+ * \brief Print all stages in Prometheus text format
+ */
+static void perf_print_prometheus(FILE *out)
+{
+	struct perf_stage *stage;
+	const struct {
+		const char *name;
+		const char *help;
+		size_t offset;
+		bool seconds;
+	} counters[] = {
+		{"ipfixcol_stage_messages_total", "Messages processed by the stage", offsetof(struct perf_stage, messages), false},
+		{"ipfixcol_stage_records_total", "Data records processed by the stage", offsetof(struct perf_stage, records), false},
+		{"ipfixcol_stage_drops_total", "Messages dropped by the stage", offsetof(struct perf_stage, drops), false},
+		{"ipfixcol_stage_busy_seconds_total", "Time spent by processing of messages", offsetof(struct perf_stage, busy_ns), true},
+	};
+
+	for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", counters[i].name, counters[i].help, counters[i].name);
+		for (stage = stages; stage; stage = stage->next) {
+			uint64_t val = *(const uint64_t *) ((const char *) stage + counters[i].offset);
+			fprintf(out, "%s{", counters[i].name);
+			perf_prom_labels(out, stage);
+			if (counters[i].seconds) {
+				fprintf(out, "} %.9f\n", val / 1e9);
+			} else {
+				fprintf(out, "} %" PRIu64 "\n", val);
+			}
+		}
+	}
+
+	perf_prom_hist(out, "ipfixcol_stage_queue_wait_seconds",
+			"Time spent by messages in the input queue of the stage", offsetof(struct perf_stage, wait));
+	perf_prom_hist(out, "ipfixcol_stage_latency_seconds",
+			"Time since the input of messages to the end of the stage", offsetof(struct perf_stage, latency));
+}
+
+/**
+ * \brief Serve one client of the statistics socket
+ *
+ * Clients get JSON by default. Prometheus text format is returned when the
+ * request contains "metrics" or "prometheus". HTTP requests (e.g.
+ * curl --unix-socket) get an HTTP response.
+ */
+static void perf_serve(int fd)
+{
+	char req[PERF_REQ_LEN] = "";
+	char *body = NULL;
+	size_t body_len = 0;
+	struct pollfd pfd = {fd, POLLIN, 0};
+	struct timeval timeout = {PERF_CLIENT_TIMEOUT, 0};
+
+	/* A client that does not read must not block the thread (and perf_close()) */
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	/* The request is optional, wait only a moment for it */
+	if (poll(&pfd, 1, 100) > 0) {
+		ssize_t len = recv(fd, req, sizeof(req) - 1, 0);
+		req[len > 0 ? len : 0] = '\0';
+	}
+
+	bool http = (strncmp(req, "GET ", 4) == 0);
+	if (http) {
+		/* Keep only the path */
+		char *end = strchr(req + 4, ' ');
+		if (end) {
+			*end = '\0';
+		}
+	}
+	bool prometheus = (strstr(req, "metrics") || strstr(req, "prometheus"));
+
+	FILE *out = open_memstream(&body, &body_len);
+	if (!out) {
+		return;
+	}
+
+	pthread_mutex_lock(&stages_mutex);
+	if (prometheus) {
+		perf_print_prometheus(out);
+	} else {
+		perf_print_json(out);
+	}
+	pthread_mutex_unlock(&stages_mutex);
+	fclose(out);
+
+	if (http) {
+		char header[256];
+		int header_len = snprintf(header, sizeof(header),
+				"HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+				"Connection: close\r\n\r\n",
+				prometheus ? "text/plain; version=0.0.4" : "application/json", body_len);
+		send(fd, header, header_len, MSG_NOSIGNAL);
+	}
+
+	size_t sent = 0;
+	while (sent < body_len) {
+		ssize_t ret = send(fd, body + sent, body_len - sent, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			break;
+		}
+		sent += ret;
+	}
+
+	free(body);
+}
+
+/**
+ * \brief Thread of the statistics socket
+ */
+static void *perf_thread(void *arg)
+{
+	(void) arg;
+	struct pollfd pfd = {sock_fd, POLLIN, 0};
+
+	prctl(PR_SET_NAME, "ipfixcol:perf", 0, 0, 0);
+
+	while (!sock_done) {
+		if (poll(&pfd, 1, PERF_POLL_TIMEOUT) <= 0) {
+			continue;
+		}
+
+		int fd = accept(sock_fd, NULL, NULL);
+		if (fd == -1) {
+			continue;
+		}
+
+		perf_serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Start instrumentation if statisticsSocket is configured
+ */
+int perf_init(xmlNode *collector_node)
+{
+	xmlNode *node = collector_node;
+	char *path = NULL;
+
+	/* Find statisticsSocket in collectingProcess */
+	while (node != NULL) {
+		if (node->type == XML_COMMENT_NODE) {
+			node = node->next;
+			continue;
+		}
+
+		if (xmlStrcmp(node->name, (const xmlChar *) "collectingProcess") == 0) {
+			node = node->xmlChildrenNode;
+			continue;
+		}
+
+		if (xmlStrcmp(node->name, (const xmlChar *) "statisticsSocket") == 0) {
+			path = (char *) xmlNodeGetContent(node);
+			break;
+		}
+
+		node = node->next;
+	}
+
+	if (!path) {
+		return 0;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) == 0 || strlen(path) >= sizeof(addr.sun_path)) {
+		MSG_ERROR(msg_module, "Invalid statistics socket path '%s'", path);
+		xmlFree(path);
+		return 1;
+	}
+
+	strncpy_safe(addr.sun_path, path, sizeof(addr.sun_path));
+	sock_path = strdup(path);
+	xmlFree(path);
+	if (!sock_path) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	/* Remove socket of previous run */
+	unlink(sock_path);
+
+	sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock_fd == -1 || bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1
+			|| listen(sock_fd, 8) == -1) {
+		MSG_ERROR(msg_module, "Unable to open statistics socket '%s': %s", sock_path, strerror(errno));
+		goto err;
+	}
+
+	perf_enabled = true;
+	start_time = perf_now();
+
+	if (pthread_create(&sock_thread, NULL, perf_thread, NULL) != 0) {
+		MSG_ERROR(msg_module, "Unable to create statistics socket thread");
+		perf_enabled = false;
+		unlink(sock_path);
+		goto err;
+	}
+
+	MSG_INFO(msg_module, "Pipeline statistics available at '%s'", sock_path);
+	return 0;
+
+err:
+	if (sock_fd != -1) {
+		close(sock_fd);
+		sock_fd = -1;
+	}
+	free(sock_path);
+	sock_path = NULL;
+	return 1;
+}
+
+/**
+ * \brief Stop the statistics socket and free all stages
+ */
+void perf_close()
+{
+	if (!perf_enabled) {
+		return;
+	}
+
+	sock_done = 1;
+	pthread_join(sock_thread, NULL);
+	close(sock_fd);
+	unlink(sock_path);
+	free(sock_path);
+
+	/* Stages of plugins that were not removed by their owners */
+	pthread_mutex_lock(&stages_mutex);
+	while (stages) {
+		struct perf_stage *next = stages->next;
+		free(stages);
+		stages = next;
+	}
+	pthread_mutex_unlock(&stages_mutex);
+
+	perf_enabled = false;
+}
@@ -0,0 +1,161 @@
+/**
+ * \file perf.h
+ * \brief Instrumentation of the processing pipeline
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <libxml/tree.h>
+
+#include "ipfixcol.h"
+
+/** Sub-buckets of each power of two in histograms (precision 1/16) */
+#define PERF_HIST_SUB_BITS 4
+/** Number of histogram buckets (covers all 64bit values) */
+#define PERF_HIST_BUCKETS (64 << PERF_HIST_SUB_BITS)
+
+/**
+ * \brief Log-linear histogram of durations (nanoseconds)
+ */
+struct perf_hist {
+	uint64_t count;                        /**< Number of values */
+	uint64_t sum;                          /**< Sum of values */
+	uint64_t max;                          /**< Maximal value */
+	uint64_t buckets[PERF_HIST_BUCKETS];   /**< Counts of values */
+};
+
+/**
+ * \brief Counters of a pipeline stage
+ *
+ * Counters are updated only by the thread of the stage and read by the
+ * statistics socket without locking.
+ */
+struct perf_stage {
+	char type[16];            /**< Stage type (preprocessor, intermediate, ...) */
+	char name[16];            /**< Plugin name */
+	uint32_t odid;            /**< ODID of the Data Manager (storage plugins) */
+	uint64_t messages;        /**< Processed messages */
+	uint64_t records;         /**< Processed data records */
+	uint64_t drops;           /**< Dropped messages */
+	uint64_t busy_ns;         /**< Time spent by processing */
+	struct perf_hist wait;    /**< Time in the input queue of the stage */
+	struct perf_hist latency; /**< Time since the input of the message */
+	struct perf_stage *prev;  /**< Previous stage */
+	struct perf_stage *next;  /**< Next stage */
+};
+
+/** Instrumentation is enabled (statisticsSocket is configured) */
+extern bool perf_enabled;
+
+/**
+ * \brief Get monotonic time
+ *
+ * \return Time in nanoseconds (0 when instrumentation is disabled)
+ */
+static inline uint64_t perf_now()
+{
+	struct timespec ts;
+
+	if (!perf_enabled) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * \brief Stamp a message leaving a stage into a queue
+ *
+ * \param[in,out] msg IPFIX message
+ * \param[in] now Current time (perf_now())
+ */
+static inline void perf_stamp_queued(struct ipfix_message *msg, uint64_t now)
+{
+	msg->stamps.queued = now;
+}
+
+/**
+ * \brief Start instrumentation if statisticsSocket is configured
+ *
+ * \param[in] collector_node collectingProcess node of startup configuration
+ * \return 0 on success (or disabled instrumentation), nonzero otherwise
+ */
+int perf_init(xmlNode *collector_node);
+
+/**
+ * \brief Stop the statistics socket and free all stages
+ */
+void perf_close();
+
+/**
+ * \brief Add a pipeline stage
+ *
+ * \param[in] type Stage type
+ * \param[in] name Plugin name
+ * \param[in] odid ODID of the Data Manager (0 if not applicable)
+ * \return New stage or NULL (disabled instrumentation or memory error)
+ */
+struct perf_stage *perf_stage_add(const char *type, const char *name, uint32_t odid);
+
+/**
+ * \brief Remove a pipeline stage
+ *
+ * \param[in] stage Stage (NULL is ignored)
+ */
+void perf_stage_remove(struct perf_stage *stage);
+
+/**
+ * \brief Account a message processed by a stage
+ *
+ * Takes a copy of timestamps because the message can be already passed to
+ * (and freed by) the next stage.
+ *
+ * \param[in,out] stage Stage
+ * \param[in] records Number of data records in the message
+ * \param[in] stamps Timestamps of the message when the stage got it
+ * \param[in] start Time when the stage got the message
+ * \param[in] end Time when the stage finished the message
+ * \param[in] dropped The message was dropped by the stage
+ */
+void perf_stage_update(struct perf_stage *stage, uint16_t records, struct ipfix_msg_stamps stamps,
+		uint64_t start, uint64_t end, bool dropped);
+
+#endif /* PERF_H_ */
@@ -49,12 +49,14 @@
 #include <ipfixcol.h>
 #include <ipfixcol/ipfix_message.h>
 #include "crc.h"
+#include "perf.h"
 
 /** Identifier to MSG_* macros */
 static char *msg_module = "preprocessor";
 
 static struct ring_buffer *preprocessor_out_queue = NULL;
 static configurator *global_config = NULL;
+static struct perf_stage *preprocessor_perf = NULL;
 
 /* Sequence number counter for each flow data source */
 struct data_source_info {
@@ -219,6 +221,10 @@ void data_source_info_destroy()
 void preprocessor_set_output_queue(struct ring_buffer *out_queue)
 {
 	preprocessor_out_queue = out_queue;
+
+	if (!preprocessor_perf) {
+		preprocessor_perf = perf_stage_add("preprocessor", "preprocessor", 0);
+	}
 }
 
 /**
@@ -556,18 +562,23 @@ static uint32_t preprocessor_process_templates(struct ipfix_message *msg)
  * @param len Packet length
  * @param input_info Input informations about source etc.
  * @param source_status Status of source (new, opened, closed)
+ * @param block Memory block of the packet (NULL if the packet is allocated separately)
  */
-void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info, int source_status)
+void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info, int source_status,
+		struct input_block *block)
 {
 	struct ipfix_message* msg;
 	uint32_t exporter_ip_addr;
 	uint32_t *seqn;
+	uint64_t start = perf_now();
 
 	/* Check input info */
 	if (input_info == NULL) {
 		MSG_WARNING(msg_module, "Invalid parameters in preprocessor_parse_msg");
 
-		if (packet) {
+		if (block) {
+			input_block_unref(block);
+		} else if (packet) {
 			free(packet);
 		}
 
@@ -579,6 +590,11 @@ void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info
 	exporter_ip_addr = preprocessor_compute_crc(input_info);
 
 	if (source_status == SOURCE_STATUS_CLOSED) {
+		if (block) {
+			/* the packet is not passed with a closed source */
+			input_block_unref(block);
+		}
+
 		/* Inform intermediate plugins and output manager about closed input */
 		msg = calloc(1, sizeof(struct ipfix_message));
 		if (!msg) {
@@ -598,11 +614,21 @@ void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info
 		/* Process IPFIX packet and fill up the ipfix_message structure */
 		msg = message_create_from_mem(packet, len, input_info, source_status);
 		if (!msg) {
-			free(packet);
+			if (preprocessor_perf) {
+				preprocessor_perf->drops++;
+			}
+
+			if (block) {
+				input_block_unref(block);
+			} else {
+				free(packet);
+			}
 			packet = NULL;
 			return;
 		}
 
+		msg->block = block;
+
 		if (source_status == SOURCE_STATUS_NEW) {
 			data_source_info_add_source(exporter_ip_addr, ntohl(msg->pkt_header->observation_domain_id));
 
@@ -651,8 +677,20 @@ void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info
 		msg->input_info->data_records += msg->data_records_count;
 	}
 
+	if (preprocessor_perf) {
+		uint64_t end = perf_now();
+
+		msg->stamps.input = start;
+		perf_stamp_queued(msg, end);
+		perf_stage_update(preprocessor_perf, msg->data_records_count, msg->stamps, start, end, false);
+	}
+
 	/* Send data to the first intermediate plugin */
 	if (rbuffer_write(preprocessor_out_queue, msg, 1) != 0) {
+		if (preprocessor_perf) {
+			preprocessor_perf->drops++;
+		}
+
 		MSG_WARNING(msg_module, "[%u] Unable to write into Data Manager input queue; skipping data...",
 				input_info->odid);
 		message_free(msg);
@@ -664,5 +702,8 @@ void preprocessor_close()
 {
 	/* output queue will be closed by intermediate process or output manager */
 	data_source_info_destroy();
+
+	perf_stage_remove(preprocessor_perf);
+	preprocessor_perf = NULL;
 	return;
 }
@@ -71,9 +71,11 @@ struct udp_conf {
  * @param[in] len Length of the packet
  * @param[in] input_info Input information from input plugin
  * @param[in] source_status Status of source (new, opened, closed)
+ * @param[in] block Memory block of the packet (NULL if the packet is allocated separately)
  * @return void
  */
-void preprocessor_parse_msg (void* packet, int len, struct input_info* input_info, int source_state);
+void preprocessor_parse_msg (void* packet, int len, struct input_info* input_info, int source_state,
+		struct input_block *block);
 
 /**
  * \brief Returns pointer to preprocessors output queue.
@@ -261,7 +261,7 @@ int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, ui
 				/* free the data */
 				if (rbuffer->data[rbuffer->read_offset]) {
 					if (rbuffer->data[rbuffer->read_offset]->pkt_header) {
-						free(rbuffer->data[rbuffer->read_offset]->pkt_header);
+						message_free_packet(rbuffer->data[rbuffer->read_offset]);
 					}
 
 					/* Decrement reference on templates */
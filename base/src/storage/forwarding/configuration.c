@@ -38,6 +38,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 // IPFIXcol API
 #include <ipfixcol.h>
@@ -57,6 +58,10 @@
 #define DEF_PACKET_SIZE (4096)
 /** Default template refresh timeout         */
 #define DEF_TEMPLATE_REFRESH (300U)
+/** Default flow key (host pair)            */
+#define DEF_HASH_KEY (HKEY_SRC_IP | HKEY_DST_IP)
+/** Default size of a queue of a destination (in packets) */
+#define DEF_QUEUE_SIZE (1024)
 
 static const char *msg_module = "forwarding(config)";
 
@@ -133,11 +138,76 @@ static enum DIST_MODE config_parse_distr(const char *str)
 		return DIST_ALL;
 	} else if (!strcasecmp(str, "roundrobin")) {
 		return DIST_ROUND_ROBIN;
+	} else if (!strcasecmp(str, "hash")) {
+		return DIST_HASH;
 	} else {
 		return DIST_INVALID;
 	}
 }
 
+/**
+ * \brief Parse fields of a flow key
+ *
+ * Fields are separated by commas or white spaces.
+ * \param[in]  str    String (e.g. "srcIP, dstIP, protocol")
+ * \param[out] fields Parsed fields (#HKEY_FIELD flags)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int config_parse_hkey(const char *str, unsigned int *fields)
+{
+	static const struct {
+		const char *name;
+		enum HKEY_FIELD field;
+	} names[] = {
+		{"srcIP",    HKEY_SRC_IP},
+		{"dstIP",    HKEY_DST_IP},
+		{"srcPort",  HKEY_SRC_PORT},
+		{"dstPort",  HKEY_DST_PORT},
+		{"protocol", HKEY_PROTO}
+	};
+	const size_t names_cnt = sizeof(names) / sizeof(names[0]);
+	const char *delim = ", \t\n";
+
+	if (!str) {
+		return 1;
+	}
+
+	char *copy = strdup(str);
+	if (!copy) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return 1;
+	}
+
+	unsigned int result = 0;
+	char *save_ptr = NULL;
+	for (char *token = strtok_r(copy, delim, &save_ptr); token != NULL;
+			token = strtok_r(NULL, delim, &save_ptr)) {
+		size_t i;
+		for (i = 0; i < names_cnt; ++i) {
+			if (!strcasecmp(token, names[i].name)) {
+				result |= names[i].field;
+				break;
+			}
+		}
+
+		if (i == names_cnt) {
+			MSG_ERROR(msg_module, "Unknown field '%s' of the flow key.", token);
+			free(copy);
+			return 1;
+		}
+	}
+
+	free(copy);
+	if (result == 0) {
+		MSG_ERROR(msg_module, "The flow key is empty.");
+		return 1;
+	}
+
+	*fields = result;
+	return 0;
+}
+
 /**
  * \brief Convert string to transport protocol
  * \param[in] str String
@@ -158,6 +228,31 @@ static int config_parse_proto(const char *str)
 	}
 }
 
+/**
+ * \brief Convert string value to integer
+ * \param[in] val String
+ * \param[out] res Result integer
+ * \return On success returns 0 and fill \p res with converted value. Otherwise
+ * returns non-zero value.
+ */
+static int config_parse_int(const char *val, int *res)
+{
+	if (!val) {
+		return 1;
+	}
+
+	char *end_ptr;
+	int tmp_res;
+
+	tmp_res = strtol(val, &end_ptr, 10);
+	if (*end_ptr != '\0') {
+		return 1;
+	}
+
+	*res = tmp_res;
+	return 0;
+}
+
 /**
  * \brief Parse only default values from the plugin configuration
  * \param[in,out] ctx Parser context
@@ -184,6 +279,20 @@ static int config_parse_def_values(struct parser_context *ctx)
 				cur->xmlChildrenNode, 1);
 			cfg->def_proto = config_parse_proto(str_proto);
 			free(str_proto);
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "queueSize")) {
+			// Size of queues of destinations (required for new senders)
+			int result;
+			char *str_size = (char *) xmlNodeListGetString(doc,
+				cur->xmlChildrenNode, 1);
+			int ret = config_parse_int(str_size, &result);
+			free(str_size);
+			if (ret || result < 16) {
+				MSG_ERROR(msg_module, "Failed to parse the 'queueSize' node "
+					"(min: 16).");
+				return 1;
+			}
+
+			cfg->queue_size = (size_t) result;
 		} else {
 			// Other nodes -> skip
 		}
@@ -194,31 +303,6 @@ static int config_parse_def_values(struct parser_context *ctx)
 	return 0;
 }
 
-/**
- * \brief Convert string value to integer
- * \param[in] val String
- * \param[out] res Result integer
- * \return On success returns 0 and fill \p res with converted value. Otherwise
- * returns non-zero value.
- */
-static int config_parse_int(const char *val, int *res)
-{
-	if (!val) {
-		return 1;
-	}
-
-	char *end_ptr;
-	int tmp_res;
-
-	tmp_res = strtol(val, &end_ptr, 10);
-	if (*end_ptr != '\0') {
-		return 1;
-	}
-
-	*res = tmp_res;
-	return 0;
-}
-
 /**
  * \brief Parse a destination node
  * \param[in] ctx Parser context (with destination node)
@@ -272,7 +356,7 @@ static fwd_sender_t *config_parse_destination(struct parser_context *ctx)
 	}
 
 	fwd_sender_t *new_sender;
-	new_sender = sender_create(dst_ip, dst_port, proto);
+	new_sender = sender_create(dst_ip, dst_port, proto, ctx->cfg->queue_size);
 
 	// Clean up
 	if (str_ip)
@@ -308,6 +392,31 @@ static int config_parse_xml(struct parser_context *ctx)
 			// Default values were already processed -> skip
 		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "defaultProtocol")) {
 			// Default values were already processed -> skip
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "queueSize")) {
+			// Default values were already processed -> skip
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "queuePolicy")) {
+			// Policy of full queues
+			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (aux_str && !xmlStrcasecmp(aux_str, (const xmlChar *) "drop")) {
+				ctx->cfg->queue_policy = QUEUE_DROP;
+			} else if (aux_str && !xmlStrcasecmp(aux_str, (const xmlChar *) "block")) {
+				ctx->cfg->queue_policy = QUEUE_BLOCK;
+			} else {
+				MSG_ERROR(msg_module, "Failed to parse the 'queuePolicy' node "
+					"(expected 'drop' or 'block').");
+				failed = true;
+			}
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "queueStatsInterval")) {
+			// Period of queue statistics
+			int result;
+			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (config_parse_int((char *) aux_str, &result) || result < 0) {
+				MSG_ERROR(msg_module, "Failed to parse the 'queueStatsInterval' "
+					"node.");
+				failed = true;
+			} else {
+				ctx->cfg->queue_stats = (unsigned int) result;
+			}
 		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "fileFormat")) {
 			// Useless node -> skip
 		} else if (cur->type == XML_COMMENT_NODE) {
@@ -332,6 +441,28 @@ static int config_parse_xml(struct parser_context *ctx)
 			} else {
 				ctx->cfg->packet_size = (uint16_t) result;
 			}
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "hashKey")) {
+			// Flow key of the hash distribution
+			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (config_parse_hkey((char *) aux_str,
+					&ctx->cfg->hash_key.fields)) {
+				MSG_ERROR(msg_module, "Failed to parse the 'hashKey' node.");
+				failed = true;
+			}
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "hashSymmetric")) {
+			// Same key for both directions of flows
+			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (aux_str && (!xmlStrcasecmp(aux_str, (const xmlChar *) "yes")
+					|| !xmlStrcasecmp(aux_str, (const xmlChar *) "true"))) {
+				ctx->cfg->hash_key.symmetric = true;
+			} else if (aux_str && (!xmlStrcasecmp(aux_str, (const xmlChar *) "no")
+					|| !xmlStrcasecmp(aux_str, (const xmlChar *) "false"))) {
+				ctx->cfg->hash_key.symmetric = false;
+			} else {
+				MSG_ERROR(msg_module, "Failed to parse the 'hashSymmetric' "
+					"node (expected 'yes' or 'no').");
+				failed = true;
+			}
 		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "destination")) {
 			// Destination address & port
 			struct parser_context dst_ctx = {doc, cur->children, ctx->cfg};
@@ -442,6 +573,11 @@ struct plugin_config *config_parse(const char *cfg_string)
 	config->packet_size = DEF_PACKET_SIZE;
 	config->reconn_period = DEF_RECONN_PERIOD; // milliseconds
 	config->udp_refresh_timeout = DEF_TEMPLATE_REFRESH; // seconds
+	config->hash_key.fields = DEF_HASH_KEY;
+	config->hash_key.symmetric = true;
+	config->queue_size = DEF_QUEUE_SIZE;
+	config->queue_policy = QUEUE_DROP;
+	config->queue_stats = 0; // disabled
 
 	config->builder_all = bldr_create();
 	config->builder_tmplt = bldr_create();
@@ -464,6 +600,14 @@ struct plugin_config *config_parse(const char *cfg_string)
 	}
 
 	xmlFreeDoc(doc);
+
+	if (config->mode == DIST_HASH
+			&& dest_hash_init(config->dest_mgr, &config->hash_key)) {
+		MSG_ERROR(msg_module, "Failed to prepare the hash distribution.");
+		config_destroy(config);
+		return NULL;
+	}
+
 	return config;
 }
 
@@ -64,6 +64,10 @@ struct plugin_config {
 	int reconn_period;          /**< Reconnection period (in milliseconds)   */
 	unsigned int udp_refresh_timeout; /**< UDP template refresh timeout
 	                                    * (in seconds)                       */
+	struct hkey_cfg hash_key;   /**< Flow key (only for #DIST_HASH)          */
+	size_t queue_size;          /**< Size of a queue of each destination     */
+	enum QUEUE_POLICY queue_policy; /**< Policy of full queues               */
+	unsigned int queue_stats;   /**< Period of queue statistics (in seconds) */
 
 	fwd_dest_t *dest_mgr;       /**< Destination manager                     */
 
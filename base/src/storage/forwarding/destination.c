@@ -40,9 +40,15 @@
 #include <ipfixcol.h>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <pthread.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <inttypes.h>
 
 #include "destination.h"
 #include "sender.h"
@@ -56,6 +62,14 @@ static const char *msg_module = "forwarding(dst)";
 #define DEF_GRP_SIZE (8)
 /** Default size of an array for sequence numbers of ODIDs                   */
 #define DEF_SEQ_ARRAY_SIZE (8)
+/** Number of virtual nodes of a destination on the hash ring                */
+#define DEF_RING_VNODES (128)
+/** Size of a buffer for records split from one IPFIX message                */
+#define HASH_BUFFER_SIZE (65536)
+/** Period of retries of a full queue with blocking policy (in microseconds) */
+#define QUEUE_BLOCK_WAIT (100)
+/** Period of retries of senders locked by the connector (in milliseconds)   */
+#define IO_RETRY_PERIOD (10)
 
 /** \brief Auxiliary array for sequence number per ODID                      */
 struct seq_per_odid {
@@ -82,6 +96,29 @@ struct group {
 	size_t max;                /**< Max size of the array                    */
 };
 
+/** \brief Destination of the distribution by a flow key                    */
+struct hash_member {
+	fwd_sender_t *sender;  /**< Sender                                       */
+	fwd_bldr_t *bldr;      /**< Packet builder of the destination            */
+	uint8_t *buffer;       /**< Data Sets split from the current message     */
+	size_t buffer_len;     /**< Used size of the buffer                      */
+	size_t set_start;      /**< Offset of the header of the current Data Set */
+	unsigned int set_recs; /**< Records in the current Data Set              */
+};
+
+/** \brief Distribution by a flow key (#DIST_HASH)                          */
+struct dst_hash {
+	struct hkey_cfg key;         /**< Flow key                               */
+	fwd_ring_t *ring;            /**< Consistent hash ring of destinations   */
+	struct hash_member *members; /**< Destinations (indexed as on the ring)  */
+	bool *alive;                 /**< Destinations connected now             */
+	size_t cnt;                  /**< Number of destinations                 */
+
+	struct hkey_plan plan;       /**< Key plan of the current Data Set       */
+	const uint8_t *set_end;      /**< End of the current Data Set            */
+	bool fail;                   /**< Splitting of the Data Set failed       */
+};
+
 /** \brief Main structure for destination manager                            */
 struct _fwd_dest {
 	/** Index of next destination (for RoundRobin)                           */
@@ -115,6 +152,37 @@ struct _fwd_dest {
 
 	/** Template manager                                                     */
 	tmapper_t *tmplt_mgr;
+	/** Distribution by a flow key (only for #DIST_HASH)                     */
+	struct dst_hash *hash;
+
+	/** All destinations (owner of senders, regardless of their group)       */
+	fwd_sender_t **senders;
+	/** Number of destinations                                               */
+	size_t senders_cnt;
+	/** Size of the array of destinations                                    */
+	size_t senders_max;
+
+	/** Policy of full queues                                                */
+	enum QUEUE_POLICY policy;
+	/** I/O thread                                                           */
+	pthread_t thread_io;
+	/** I/O thread status (0 = stopped, 1 = running)                         */
+	int io_enabled;
+	/** Request to stop the I/O thread                                       */
+	int io_stop;
+	/** The I/O thread waits for a wakeup (atomic access)                    */
+	int io_sleeping;
+	/** Wakeup pipe of the I/O thread (read end, write end)                  */
+	int io_pipe[2];
+	/** Period of queue statistics (in seconds, 0 = disabled)                */
+	unsigned int stats_interval;
+};
+
+/** \brief Packets of a packet builder shared by all destinations           */
+struct pkt_batch {
+	fwd_pkt_t **pkts;          /**< Array of packets                         */
+	size_t cnt;                /**< Number of packets                        */
+	uint32_t odid;             /**< Observation Domain ID of the packets     */
 };
 
 /**
@@ -125,6 +193,8 @@ struct tmplts_per_odid {
 	uint32_t      odid;
 	/** A packet builder                                                     */
 	fwd_bldr_t   *odid_packet;
+	/** Packets of the builder                                               */
+	struct pkt_batch odid_batch;
 };
 
 struct tmplts_for_reconnected {
@@ -132,6 +202,8 @@ struct tmplts_for_reconnected {
 	struct tmplts_per_odid *templates;
 	/** A size of the array                                                  */
 	uint32_t cnt;
+	/** Destination manager                                                  */
+	fwd_dest_t *dst_mgr;
 };
 
 /**
@@ -152,8 +224,12 @@ struct udp_template_timeout {
 typedef bool (*group_cb_t) (struct dst_client *dst, void *data);
 
 // Prototypes
-static enum SEND_STATUS dest_packet_sender(struct dst_client *dst,
-	fwd_bldr_t *bldr, bool req_flg);
+static enum SEND_STATUS dest_packet_sender(fwd_dest_t *dst_mgr,
+	struct dst_client *dst, const struct pkt_batch *batch, bool req_flg);
+static int dest_batch_prepare(struct pkt_batch *batch, fwd_bldr_t *bldr);
+static void dest_batch_release(struct pkt_batch *batch);
+static void dest_io_wakeup(fwd_dest_t *dst_mgr);
+static void dest_hash_destroy(struct dst_hash *hash);
 
 /**
  * \brief Get an sequence number for defined Observation Domain ID (ODID)
@@ -254,7 +330,8 @@ static struct group *group_create()
 
 /**
  * \brief Destroy a group of destinations
- * \warning All present senders will be disconnected and freed
+ *
+ * Senders are owned by the destination manager, so they are NOT freed.
  * \param[in,out] grp Group
  */
 static void group_destroy(struct group *grp)
@@ -263,9 +340,7 @@ static void group_destroy(struct group *grp)
 		return;
 	}
 
-	// Disconnect & destroy all senders
 	for (unsigned int i = 0; i < grp->cnt; ++i) {
-		sender_destroy(grp->arr[i].sender);
 		source_odids_remove(&grp->arr[i]);
 	}
 
@@ -401,8 +476,8 @@ static int group_move(struct group *src, struct group *dst, group_cb_t cb,
 		if (group_append(dst, sender)) {
 			MSG_ERROR(msg_module, "Unrecoverable internal error (%s:%d)",
 				__FILE__, __LINE__);
-			// We can only destroy this sender
-			sender_destroy(sender);
+			// We can only drop this sender (it is freed by dest_destroy())
+			sender_close(sender);
 			return 1;
 		}
 
@@ -482,9 +557,9 @@ static bool aux_reconn_tmplt(struct dst_client *client, void *data)
 
 	for (unsigned int i = 0; i < tmplts->cnt; ++i) {
 		// Send templates of defined ODID
-		fwd_bldr_t *packet_builder = tmplts->templates[i].odid_packet;
+		const struct pkt_batch *batch = &tmplts->templates[i].odid_batch;
 
-		ret_val = dest_packet_sender(client, packet_builder, true);
+		ret_val = dest_packet_sender(tmplts->dst_mgr, client, batch, true);
 		if (ret_val == STATUS_OK) {
 			continue;
 		}
@@ -629,6 +704,189 @@ int dest_connector_stop(fwd_dest_t *dst_mgr)
 	return 0;
 }
 
+/**
+ * \brief Wake up the I/O thread (if it is waiting)
+ * \param[in,out] dst_mgr Destination manager
+ */
+static void dest_io_wakeup(fwd_dest_t *dst_mgr)
+{
+	if (__atomic_exchange_n(&dst_mgr->io_sleeping, 0, __ATOMIC_SEQ_CST) == 0) {
+		// Already awake
+		return;
+	}
+
+	const uint8_t byte = 0;
+	if (write(dst_mgr->io_pipe[1], &byte, 1) == -1 && errno != EAGAIN) {
+		MSG_WARNING(msg_module, "Failed to wake up the I/O thread (%s).",
+			strerror(errno));
+	}
+}
+
+/**
+ * \brief Print statistics of queues of all destinations
+ * \param[in] dst_mgr Destination manager
+ */
+static void dest_io_stats(const fwd_dest_t *dst_mgr)
+{
+	struct sender_stats stats;
+
+	for (size_t i = 0; i < dst_mgr->senders_cnt; ++i) {
+		const fwd_sender_t *sndr = dst_mgr->senders[i];
+		sender_get_stats(sndr, &stats);
+		MSG_INFO(msg_module, "Destination '%s:%s': queue %zu/%zu (max. %zu), "
+			"sent %" PRIu64 ", dropped %" PRIu64 ", lost %" PRIu64 " packets.",
+			sender_get_address(sndr), sender_get_port(sndr), stats.depth,
+			stats.size, stats.depth_max, stats.sent, stats.dropped,
+			stats.lost);
+	}
+}
+
+/**
+ * \brief I/O thread that sends queued packets of all destinations
+ *
+ * The thread sends packets until all queues are empty or all sockets with
+ * queued packets are full. Then it waits until a socket is writable or
+ * a producer appends new packets (see dest_io_wakeup()).
+ * \param[in,out] arg Destination manager
+ * \return Nothing
+ */
+static void *dest_io_func(void *arg)
+{
+	fwd_dest_t *dst_mgr = (fwd_dest_t *) arg;
+	const size_t cnt = dst_mgr->senders_cnt;
+	time_t stats_next = time(NULL) + dst_mgr->stats_interval;
+
+	struct pollfd *fds = calloc(cnt + 1, sizeof(*fds));
+	if (!fds) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		pthread_exit(NULL);
+	}
+
+	while (!__atomic_load_n(&dst_mgr->io_stop, __ATOMIC_ACQUIRE)) {
+		nfds_t nfds = 1;
+		bool retry = false;
+		int fd;
+
+		fds[0].fd = dst_mgr->io_pipe[0];
+		fds[0].events = POLLIN;
+
+		// Announce waiting before the last check of the queues
+		__atomic_store_n(&dst_mgr->io_sleeping, 1, __ATOMIC_SEQ_CST);
+
+		for (size_t i = 0; i < cnt; ++i) {
+			switch (sender_flush(dst_mgr->senders[i], &fd)) {
+			case FLUSH_BLOCKED:
+				fds[nfds].fd = fd;
+				fds[nfds].events = POLLOUT;
+				++nfds;
+				break;
+			case FLUSH_LOCKED:
+				retry = true;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (dst_mgr->stats_interval > 0 && time(NULL) >= stats_next) {
+			dest_io_stats(dst_mgr);
+			stats_next = time(NULL) + dst_mgr->stats_interval;
+		}
+
+		int timeout = (retry) ? IO_RETRY_PERIOD : -1;
+		if (dst_mgr->stats_interval > 0 && timeout < 0) {
+			timeout = 1000;
+		}
+
+		if (poll(fds, nfds, timeout) == -1 && errno != EINTR) {
+			MSG_ERROR(msg_module, "poll() failed (%s).", strerror(errno));
+			break;
+		}
+
+		__atomic_store_n(&dst_mgr->io_sleeping, 0, __ATOMIC_SEQ_CST);
+
+		if (fds[0].revents & POLLIN) {
+			// Clear wakeup notifications
+			uint8_t buffer[64];
+			while (read(dst_mgr->io_pipe[0], buffer, sizeof(buffer)) > 0);
+		}
+	}
+
+	// Try to send the rest of the queued packets (without waiting)
+	for (size_t i = 0; i < cnt; ++i) {
+		int fd;
+		sender_flush(dst_mgr->senders[i], &fd);
+	}
+
+	free(fds);
+	pthread_exit(NULL);
+}
+
+/** Start the thread that sends queued packets */
+int dest_io_start(fwd_dest_t *dst_mgr, enum QUEUE_POLICY policy,
+	unsigned int stats_interval)
+{
+	pthread_attr_t attr;
+	int res;
+
+	if (dst_mgr->io_enabled == 1) {
+		MSG_ERROR(msg_module, "I/O thread start failed (already running).");
+		return 1;
+	}
+
+	dst_mgr->policy = policy;
+	dst_mgr->stats_interval = stats_interval;
+	dst_mgr->io_stop = 0;
+
+	res = pthread_attr_init(&attr);
+	if (res != 0) {
+		MSG_ERROR(msg_module, "pthread_attr_init() error (%d)", res);
+		return 1;
+	}
+
+	res = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+	if (res != 0) {
+		MSG_ERROR(msg_module, "pthread_attr_setdetachstate() error (%d)", res);
+		pthread_attr_destroy(&attr);
+		return 1;
+	}
+
+	res = pthread_create(&dst_mgr->thread_io, &attr, dest_io_func, dst_mgr);
+	if (res != 0) {
+		MSG_ERROR(msg_module, "pthread_create() error (%d)", res);
+		pthread_attr_destroy(&attr);
+		return 1;
+	}
+
+	pthread_attr_destroy(&attr);
+	dst_mgr->io_enabled = 1;
+	return 0;
+}
+
+/** Stop the thread that sends queued packets */
+int dest_io_stop(fwd_dest_t *dst_mgr)
+{
+	int res;
+
+	if (dst_mgr->io_enabled == 0) {
+		return 0;
+	}
+
+	__atomic_store_n(&dst_mgr->io_stop, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&dst_mgr->io_sleeping, 1, __ATOMIC_SEQ_CST);
+	dest_io_wakeup(dst_mgr);
+
+	res = pthread_join(dst_mgr->thread_io, NULL);
+	if (res != 0) {
+		MSG_ERROR(msg_module, "pthread_join() error (%d)", res);
+		return 1;
+	}
+
+	dst_mgr->io_enabled = 0;
+	return 0;
+}
+
 /** Create structure for all remote destinations */
 fwd_dest_t *dest_create(tmapper_t *tmplt_mgr)
 {
@@ -650,6 +908,18 @@ fwd_dest_t *dest_create(tmapper_t *tmplt_mgr)
 		return NULL;
 	}
 
+	if (pipe(res->io_pipe) != 0) {
+		MSG_ERROR(msg_module, "Failed to create a pipe (%s).", strerror(errno));
+		pthread_mutex_destroy(&res->group_mtx);
+		free(res);
+		return NULL;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		int flags = fcntl(res->io_pipe[i], F_GETFL, 0);
+		fcntl(res->io_pipe[i], F_SETFL, flags | O_NONBLOCK);
+	}
+
 	// Initialize other values
 	res->ready_empty = true;
 	res->conn = group_create();
@@ -673,13 +943,25 @@ void dest_destroy(fwd_dest_t *dst_mgr)
 		return;
 	}
 
-	// Stop the connector (if running)
+	// Stop the connector and the I/O thread (if running)
 	dest_connector_stop(dst_mgr);
+	dest_io_stop(dst_mgr);
+
+	// Builders of the distribution by a flow key refer to the senders
+	dest_hash_destroy(dst_mgr->hash);
 
 	// Delete all groups & disconnect everyone
 	group_destroy(dst_mgr->conn);
 	group_destroy(dst_mgr->disconn);
 	group_destroy(dst_mgr->ready);
+
+	for (size_t i = 0; i < dst_mgr->senders_cnt; ++i) {
+		sender_destroy(dst_mgr->senders[i]);
+	}
+
+	free(dst_mgr->senders);
+	close(dst_mgr->io_pipe[0]);
+	close(dst_mgr->io_pipe[1]);
 	pthread_mutex_destroy(&dst_mgr->group_mtx);
 	free(dst_mgr);
 }
@@ -691,11 +973,38 @@ int dest_add(fwd_dest_t *dst_mgr, fwd_sender_t *sndr)
 		return 1;
 	}
 
+	if (dst_mgr->io_enabled) {
+		MSG_ERROR(msg_module, "Unable to add a destination (I/O thread is "
+			"running).");
+		return 1;
+	}
+
+	if (dst_mgr->senders_cnt == dst_mgr->senders_max) {
+		size_t new_max = (dst_mgr->senders_max > 0)
+			? 2 * dst_mgr->senders_max : 8;
+		fwd_sender_t **new_arr = realloc(dst_mgr->senders,
+			new_max * sizeof(*new_arr));
+		if (!new_arr) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+
+		dst_mgr->senders = new_arr;
+		dst_mgr->senders_max = new_max;
+	}
+
 	pthread_mutex_lock(&dst_mgr->group_mtx);
 	int res = group_append(dst_mgr->disconn, sndr);
 	pthread_mutex_unlock(&dst_mgr->group_mtx);
 
-	return (res == 0) ? 0 : 1;
+	if (res != 0) {
+		return 1;
+	}
+
+	// From now the sender is owned by the manager
+	dst_mgr->senders[dst_mgr->senders_cnt++] = sndr;
+	return 0;
 }
 
 
@@ -760,6 +1069,7 @@ static void dest_templates_free(struct tmplts_per_odid *templates, uint32_t cnt)
 {
 	for (unsigned int i = 0; i < cnt; ++i) {
 		// Destroy all builders
+		dest_batch_release(&templates[i].odid_batch);
 		bldr_destroy(templates[i].odid_packet);
 	}
 
@@ -832,6 +1142,11 @@ static struct tmplts_per_odid *dest_templates_prepare(
 			failure = true;
 			break;
 		}
+
+		if (dest_batch_prepare(&group->odid_batch, bldr)) {
+			failure = true;
+			break;
+		}
 	}
 
 	if (failure) {
@@ -894,7 +1209,7 @@ void dest_check_reconnected(fwd_dest_t *dst_mgr)
 	}
 
 	free(odid_ids); // We don't need it anymore!
-	struct tmplts_for_reconnected data = {templates, odid_cnt};
+	struct tmplts_for_reconnected data = {templates, odid_cnt, dst_mgr};
 
 	// Send all templates...
 	pthread_mutex_lock(&dst_mgr->group_mtx);
@@ -907,53 +1222,154 @@ void dest_check_reconnected(fwd_dest_t *dst_mgr)
 
 	dst_mgr->ready_empty = true;
 	pthread_mutex_unlock(&dst_mgr->group_mtx);
+	dest_io_wakeup(dst_mgr);
 
-	// Delete templates
+	// Delete templates (queued packets are referenced by the queues)
 	dest_templates_free(templates, odid_cnt);
 }
 
+/**
+ * \brief Copy packets of a builder into packets shared by destinations
+ * \param[out] batch Packets
+ * \param[in]  bldr  Packet builder (with prepared packets)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ * \warning The packets MUST be released by dest_batch_release()
+ */
+static int dest_batch_prepare(struct pkt_batch *batch, fwd_bldr_t *bldr)
+{
+	struct iovec *pkt_parts;
+	size_t size;
+	size_t rec_cnt;
+
+	batch->pkts = NULL;
+	batch->cnt = 0;
+	batch->odid = bldr_pkts_get_odid(bldr);
+
+	int pkt_cnt = bldr_pkts_cnt(bldr);
+	if (pkt_cnt <= 0) {
+		return (pkt_cnt < 0) ? 1 : 0;
+	}
+
+	batch->pkts = calloc(pkt_cnt, sizeof(*batch->pkts));
+	if (!batch->pkts) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	for (int i = 0; i < pkt_cnt; ++i) {
+		// Sequence numbers are filled for each destination by its sender
+		fwd_pkt_t *pkt = NULL;
+		if (bldr_pkts_iovec(bldr, 0, i, &pkt_parts, &size, &rec_cnt) == 0) {
+			pkt = pkt_create(pkt_parts, size, rec_cnt);
+		}
+
+		if (!pkt) {
+			dest_batch_release(batch);
+			return 1;
+		}
+
+		batch->pkts[batch->cnt++] = pkt;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Release packets shared by destinations
+ * \param[in,out] batch Packets
+ */
+static void dest_batch_release(struct pkt_batch *batch)
+{
+	for (size_t i = 0; i < batch->cnt; ++i) {
+		pkt_unref(batch->pkts[i]);
+	}
+
+	free(batch->pkts);
+	batch->pkts = NULL;
+	batch->cnt = 0;
+}
+
+/**
+ * \brief Append a packet to a queue of a destination
+ *
+ * Behaviour on a full queue depends on the queue policy. With the blocking
+ * policy, the function waits until the I/O thread sends some packets.
+ * Otherwise a non-required packet is dropped and a required packet closes
+ * the connection.
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in,out] sndr    Sender
+ * \param[in]     pkt     Packet
+ * \param[in]     seq     Sequence number
+ * \param[in]     req_flg Required delivery
+ * \return Status code
+ */
+static enum SEND_STATUS dest_packet_enqueue(fwd_dest_t *dst_mgr,
+	fwd_sender_t *sndr, fwd_pkt_t *pkt, uint32_t seq, bool req_flg)
+{
+	const struct timespec wait = {0, QUEUE_BLOCK_WAIT * 1000L};
+	enum SEND_STATUS stat;
+
+	while ((stat = sender_enqueue(sndr, pkt, seq)) == STATUS_BUSY) {
+		if (dst_mgr->policy == QUEUE_BLOCK) {
+			// Backpressure -> wait for the I/O thread
+			dest_io_wakeup(dst_mgr);
+			nanosleep(&wait, NULL);
+			continue;
+		}
+
+		if (!req_flg) {
+			return STATUS_BUSY;
+		}
+
+		MSG_WARNING(msg_module, "Unable to queue 'required' message for "
+			"'%s:%s'. Connection must be closed to prevent receiving invalid "
+			"messages.", sender_get_address(sndr), sender_get_port(sndr));
+		sender_close(sndr);
+		return STATUS_CLOSED;
+	}
+
+	return stat;
+}
+
 /**
  * \brief Send all packets to a destination (auxiliary function)
- * \param[in,out] dst  Destination
- * \param[in,out] bldr Packet builder
+ *
+ * Packets are only appended to a queue of the destination. They are sent
+ * by the I/O thread.
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in,out] dst     Destination
+ * \param[in]     batch   Packets
  * \param[in] req_flg  Required delivery (usually for packets with templates)
- * \return Status code. When all packets were sent, returns STATUS_OK.
+ * \return Status code. When all packets were queued, returns STATUS_OK.
  */
-static enum SEND_STATUS dest_packet_sender(struct dst_client *dst,
-	fwd_bldr_t *bldr, bool req_flg)
+static enum SEND_STATUS dest_packet_sender(fwd_dest_t *dst_mgr,
+	struct dst_client *dst, const struct pkt_batch *batch, bool req_flg)
 {
-	int pkt_cnt = bldr_pkts_cnt(bldr);
 	enum SEND_STATUS stat;
 
-	struct iovec *pkt_parts;
-	size_t size;
-	size_t rec_cnt;
+	if (!sender_is_connected(dst->sender)) {
+		// Closed by the I/O thread
+		return STATUS_CLOSED;
+	}
 
 	// Get a sequence number
-	uint32_t odid = bldr_pkts_get_odid(bldr);
-	uint32_t *seq_num = source_odids_get_seq(dst, odid);
+	uint32_t *seq_num = source_odids_get_seq(dst, batch->odid);
 	if (!seq_num) {
 		return STATUS_INVALID;
 	}
 
 	// Send packets
-	for (int i = 0; i < pkt_cnt; ++i) {
-		// Prepare the packet
-		if (bldr_pkts_iovec(bldr, *seq_num, i, &pkt_parts, &size,
-			&rec_cnt)) {
-			// Internal Error
-			return STATUS_INVALID;
-		}
-
-		// Send the packet
-		stat = sender_send_parts(dst->sender, pkt_parts, size,
-			MODE_NON_BLOCKING, req_flg);
+	for (size_t i = 0; i < batch->cnt; ++i) {
+		fwd_pkt_t *pkt = batch->pkts[i];
 
+		stat = dest_packet_enqueue(dst_mgr, dst->sender, pkt, *seq_num,
+			req_flg);
 		if (stat != STATUS_OK) {
 			return stat;
 		}
 
-		*seq_num += rec_cnt;
+		*seq_num += pkt->recs;
 		req_flg = true; // Remaining packets are always required
 	}
 
@@ -981,8 +1397,8 @@ int dest_move_to_dc(fwd_dest_t *dst_mgr, fwd_sender_t *sndr)
 	if (res) {
 		MSG_ERROR(msg_module, "Unrecoverable internal error (%s:%d)",
 			__FILE__, __LINE__);
-		// We can only destroy this sender
-		sender_destroy(sndr);
+		// We can only drop this sender (it is freed by dest_destroy())
+		sender_close(sndr);
 		return 1;
 	}
 
@@ -995,12 +1411,12 @@ int dest_move_to_dc(fwd_dest_t *dst_mgr, fwd_sender_t *sndr)
  * To send the messages to all destinations just use negative index (e.g. -1)
  * of \p except_idx
  * \param[in,out] dst_mgr Destination manager
- * \param[in,out] bldr Packet builder
+ * \param[in] batch Packets
  * \param[in] except_idx Exception index (of the destination)
  * \param[in] req_flg Required delivery
  */
-static void dest_send_except_one(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr,
-	int except_idx, bool req_flg)
+static void dest_send_except_one(fwd_dest_t *dst_mgr,
+	const struct pkt_batch *batch, int except_idx, bool req_flg)
 {
 	enum SEND_STATUS stat;
 	unsigned int idx = 0;
@@ -1014,13 +1430,14 @@ static void dest_send_except_one(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr,
 
 		// Send data to the destination
 		struct dst_client *client = &dst_mgr->conn->arr[idx];
-		stat = dest_packet_sender(client, bldr, req_flg);
+		stat = dest_packet_sender(dst_mgr, client, batch, req_flg);
 
 		switch (stat) {
 		case STATUS_BUSY:
 			// Destination is busy, but still connected.
-			MSG_INFO(msg_module, "Destination '%s:%s' is busy. Unable to "
-				"send some flow data.", sender_get_address(client->sender),
+			MSG_DEBUG(msg_module, "Queue of destination '%s:%s' is full. "
+				"Unable to send some flow data.",
+				sender_get_address(client->sender),
 				sender_get_port(client->sender));
 			// No "break" here!
 
@@ -1056,11 +1473,12 @@ static void dest_send_except_one(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr,
 /**
  * \brief Send to the next destination in the order (RoundRobin distribution)
  * \param[in,out] dst_mgr Destination manager
- * \param[in,out] bldr    Packet builder
+ * \param[in]     batch   Packets
  * \param[in]     req_flg Required delivery
  * \return On error returns -1. Otherwise returns an index of used destination.
  */
-static int dest_send_next(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr, bool req_flg)
+static int dest_send_next(fwd_dest_t *dst_mgr, const struct pkt_batch *batch,
+	bool req_flg)
 {
 	int attempts = dst_mgr->conn->cnt;
 	int idx = dst_mgr->dst_idx;
@@ -1077,7 +1495,7 @@ static int dest_send_next(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr, bool req_flg)
 
 		// Send data to one selected destination
 		struct dst_client *client = &dst_mgr->conn->arr[idx];
-		stat = dest_packet_sender(client, bldr, req_flg);
+		stat = dest_packet_sender(dst_mgr, client, batch, req_flg);
 
 		switch (stat) {
 		case STATUS_BUSY:
@@ -1134,28 +1552,121 @@ static int dest_send_next(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr, bool req_flg)
  * \brief Send using RoundRobin distribution
  *
  * Templates are send to all destinations.
- * \param[in,out] dst_mgr     Destination manager
- * \param[in,out] bldr_all    Packet builder (all parts)
- * \param[in,out] bldr_tmplts Packet builder (only templates)
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in]     all     Packets (all parts)
+ * \param[in]     tmplts  Packets (only templates)
  */
-static void dest_send_rr(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
-	fwd_bldr_t *bldr_tmplts)
+static void dest_send_rr(fwd_dest_t *dst_mgr, const struct pkt_batch *all,
+	const struct pkt_batch *tmplts)
 {
 	// Are there any templates i.e. required delivery?
-	bool new_templates = (bldr_pkts_cnt(bldr_tmplts) > 0);
+	bool new_templates = (tmplts->cnt > 0);
 
 	if (new_templates) {
 		// Send template(s) + data to the destination in the order
-		int index = dest_send_next(dst_mgr, bldr_all, true);
+		int index = dest_send_next(dst_mgr, all, true);
 		if (index < 0) {
 			return;
 		}
 
 		// Send template(s) to remaining destination
-		dest_send_except_one(dst_mgr, bldr_tmplts, index, true);
+		dest_send_except_one(dst_mgr, tmplts, index, true);
 	} else {
 		// No templates -> send to the next destination in the order
-		dest_send_next(dst_mgr, bldr_all, false);
+		dest_send_next(dst_mgr, all, false);
+	}
+}
+
+/**
+ * \brief Find a destination of the distribution by a flow key
+ * \param[in] hash Distribution by a flow key
+ * \param[in] sndr Sender of the destination
+ * \return On success returns an index of the destination. Otherwise returns -1.
+ */
+static int dest_hash_find(const struct dst_hash *hash, const fwd_sender_t *sndr)
+{
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		if (hash->members[i].sender == sndr) {
+			return (int) i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * \brief Send packets of each connected destination (distribution by a flow
+ *   key)
+ * \param[in,out] dst_mgr     Destination manager
+ * \param[in,out] bldr_tmplts Packet builder (only templates)
+ */
+static void dest_send_hash(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_tmplts)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+	bool req_flg = (bldr_pkts_cnt(bldr_tmplts) > 0);
+	enum SEND_STATUS stat;
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		if (!hash->alive[i]) {
+			continue;
+		}
+
+		// Find the destination (its position changes on disconnection)
+		struct hash_member *member = &hash->members[i];
+		struct dst_client *client = NULL;
+		for (size_t idx = 0; idx < dst_mgr->conn->cnt; ++idx) {
+			if (dst_mgr->conn->arr[idx].sender == member->sender) {
+				client = &dst_mgr->conn->arr[idx];
+				break;
+			}
+		}
+
+		if (!client) {
+			continue;
+		}
+
+		struct pkt_batch batch;
+		if (dest_batch_prepare(&batch, member->bldr)) {
+			MSG_ERROR(msg_module, "Failed to prepare packets for '%s:%s'.",
+				sender_get_address(client->sender),
+				sender_get_port(client->sender));
+			continue;
+		}
+
+		stat = dest_packet_sender(dst_mgr, client, &batch, req_flg);
+		dest_batch_release(&batch);
+
+		switch (stat) {
+		case STATUS_OK:
+			// Successfull
+			break;
+
+		case STATUS_BUSY:
+			// Destination is busy, but still connected.
+			MSG_DEBUG(msg_module, "Queue of destination '%s:%s' is full. "
+				"Unable to send some flow data.",
+				sender_get_address(client->sender),
+				sender_get_port(client->sender));
+			break;
+
+		case STATUS_CLOSED:
+			// Destination disconnected
+			hash->alive[i] = false;
+			if (dest_move_to_dc(dst_mgr, member->sender)) {
+				return;
+			}
+
+			if (dst_mgr->conn->cnt == 0) {
+				MSG_WARNING(msg_module, "All destination disconnected! Flow "
+					"data will be lost.");
+			}
+			break;
+
+		default:
+			MSG_ERROR(msg_module, "Internal error (unknown status of sender: "
+				"%d).", (int) stat);
+			break;
+		}
 	}
 }
 
@@ -1163,21 +1674,322 @@ static void dest_send_rr(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
 void dest_send(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
 	fwd_bldr_t *bldr_tmplts, enum DIST_MODE mode)
 {
+	struct pkt_batch all, tmplts;
 	bool res;
 
+	if (mode == DIST_HASH) {
+		// Each destination has its own packets
+		dest_send_hash(dst_mgr, bldr_tmplts);
+		dest_io_wakeup(dst_mgr);
+		return;
+	}
+
+	// Packets are copied only once and shared by all destinations
+	if (dest_batch_prepare(&all, bldr_all)) {
+		MSG_ERROR(msg_module, "Failed to prepare packets. Flow data will be "
+			"lost.");
+		return;
+	}
+
+	if (dest_batch_prepare(&tmplts, bldr_tmplts)) {
+		MSG_ERROR(msg_module, "Failed to prepare packets. Flow data will be "
+			"lost.");
+		dest_batch_release(&all);
+		return;
+	}
+
 	// Distribution
 	switch (mode) {
 	case DIST_ALL:
-		res = (bldr_pkts_cnt(bldr_tmplts) > 0);
-		dest_send_except_one(dst_mgr, bldr_all, -1, res);
+		res = (tmplts.cnt > 0);
+		dest_send_except_one(dst_mgr, &all, -1, res);
 		break;
 
 	case DIST_ROUND_ROBIN:
-		dest_send_rr(dst_mgr, bldr_all, bldr_tmplts);
+		dest_send_rr(dst_mgr, &all, &tmplts);
 		break;
 
 	default:
 		MSG_ERROR(msg_module, "Unknown distribution model.");
 		break;
 	}
+
+	dest_batch_release(&all);
+	dest_batch_release(&tmplts);
+	dest_io_wakeup(dst_mgr);
+}
+
+/**
+ * \brief Destroy the distribution by a flow key
+ * \param[in,out] hash Distribution by a flow key
+ */
+static void dest_hash_destroy(struct dst_hash *hash)
+{
+	if (!hash) {
+		return;
+	}
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		bldr_destroy(hash->members[i].bldr);
+		free(hash->members[i].buffer);
+	}
+
+	ring_destroy(hash->ring);
+	free(hash->members);
+	free(hash->alive);
+	free(hash);
+}
+
+/**
+ * \brief Add a destination to the distribution by a flow key
+ * \param[in,out] hash Distribution by a flow key
+ * \param[in]     sndr Sender of the destination
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int dest_hash_member_add(struct dst_hash *hash, fwd_sender_t *sndr)
+{
+	struct hash_member *member = &hash->members[hash->cnt];
+	member->sender = sndr;
+	member->bldr = bldr_create();
+	member->buffer = malloc(HASH_BUFFER_SIZE);
+	hash->cnt++;
+
+	if (!member->bldr || !member->buffer) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	// Position on the ring depends only on the address of the destination
+	char name[256];
+	snprintf(name, sizeof(name), "%s:%s", sender_get_address(sndr),
+		sender_get_port(sndr));
+	return ring_add(hash->ring, name, hash->cnt - 1);
+}
+
+/* Prepare distribution of records by a flow key */
+int dest_hash_init(fwd_dest_t *dst_mgr, const struct hkey_cfg *key)
+{
+	if (dst_mgr->hash) {
+		MSG_ERROR(msg_module, "Distribution by a flow key is already "
+			"initialized.");
+		return 1;
+	}
+
+	struct dst_hash *hash = calloc(1, sizeof(*hash));
+	if (!hash) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	hash->key = *key;
+	hash->ring = ring_create(DEF_RING_VNODES);
+
+	pthread_mutex_lock(&dst_mgr->group_mtx);
+	struct group *groups[] = {dst_mgr->conn, dst_mgr->ready, dst_mgr->disconn};
+	const size_t groups_cnt = sizeof(groups) / sizeof(groups[0]);
+	size_t total = 0;
+	for (size_t i = 0; i < groups_cnt; ++i) {
+		total += group_cnt(groups[i]);
+	}
+
+	hash->members = calloc(total, sizeof(*hash->members));
+	hash->alive = calloc(total, sizeof(*hash->alive));
+	bool failed = (!hash->ring || !hash->members || !hash->alive);
+	if (failed) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+	}
+
+	for (size_t i = 0; i < groups_cnt && !failed; ++i) {
+		for (size_t idx = 0; idx < groups[i]->cnt && !failed; ++idx) {
+			failed = (dest_hash_member_add(hash, groups[i]->arr[idx].sender) != 0);
+		}
+	}
+	pthread_mutex_unlock(&dst_mgr->group_mtx);
+
+	if (failed) {
+		dest_hash_destroy(hash);
+		return 1;
+	}
+
+	dst_mgr->hash = hash;
+	return 0;
+}
+
+/* Start new packet(s) of all destinations */
+void dest_hash_start(fwd_dest_t *dst_mgr, uint32_t odid, uint32_t exp_time)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		struct hash_member *member = &hash->members[i];
+		bldr_start(member->bldr, odid, exp_time);
+		member->buffer_len = 0;
+		member->set_recs = 0;
+		hash->alive[i] = false;
+	}
+
+	// Only this thread modifies the group of connected destinations
+	for (size_t idx = 0; idx < dst_mgr->conn->cnt; ++idx) {
+		int i = dest_hash_find(hash, dst_mgr->conn->arr[idx].sender);
+		if (i >= 0) {
+			hash->alive[i] = true;
+		}
+	}
+}
+
+/* Add a template to packets of all destinations */
+int dest_hash_add_template(fwd_dest_t *dst_mgr, const void *data, size_t size,
+	uint16_t new_id, int type)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		if (bldr_add_template(hash->members[i].bldr, data, size, new_id, type)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Add a template withdrawal to packets of all destinations */
+int dest_hash_add_withdrawal(fwd_dest_t *dst_mgr, uint16_t id, int type)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		if (bldr_add_template_withdrawal(hash->members[i].bldr, id, type)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Copy a record to the Data Set of its destination
+ * \remark This is a function for a callback
+ * \param[in]     rec     Data record
+ * \param[in]     rec_len Length of the record
+ * \param[in]     tmplt   Template of the record
+ * \param[in,out] data    Distribution by a flow key
+ */
+static void dest_hash_record(uint8_t *rec, int rec_len,
+	struct ipfix_template *tmplt, void *data)
+{
+	(void) tmplt;
+	struct dst_hash *hash = (struct dst_hash *) data;
+
+	if (hash->fail) {
+		return;
+	}
+
+	if (rec_len <= 0 || rec + rec_len > hash->set_end) {
+		MSG_WARNING(msg_module, "Malformed Data record detected and skipped.");
+		hash->fail = true;
+		return;
+	}
+
+	int idx = ring_lookup(hash->ring, hkey_hash(&hash->plan, rec), hash->alive);
+	if (idx < 0) {
+		// All destinations are disconnected -> the record is lost
+		return;
+	}
+
+	struct hash_member *member = &hash->members[idx];
+	size_t need = rec_len;
+	if (member->set_recs == 0) {
+		need += sizeof(struct ipfix_set_header);
+	}
+
+	if (member->buffer_len + need > HASH_BUFFER_SIZE) {
+		MSG_ERROR(msg_module, "Internal error (%s:%d)", __FILE__, __LINE__);
+		hash->fail = true;
+		return;
+	}
+
+	if (member->set_recs == 0) {
+		// Reserve space for a header of a new Data Set
+		member->set_start = member->buffer_len;
+		member->buffer_len += sizeof(struct ipfix_set_header);
+	}
+
+	memcpy(member->buffer + member->buffer_len, rec, rec_len);
+	member->buffer_len += rec_len;
+	member->set_recs++;
+}
+
+/* Split records of a Data set into packets of destinations */
+int dest_hash_add_dataset(fwd_dest_t *dst_mgr, const struct ipfix_data_set *data,
+	struct ipfix_template *tmplt, uint16_t new_id, unsigned int rec)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+
+	if (tmplt->template_type == TM_OPTIONS_TEMPLATE) {
+		// Options (e.g. sampling configuration) are required by everyone
+		for (size_t i = 0; i < hash->cnt; ++i) {
+			if (bldr_add_dataset(hash->members[i].bldr, data, new_id, rec)) {
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	hkey_plan_init(&hash->plan, &hash->key, tmplt);
+	hash->set_end = ((const uint8_t *) data) + ntohs(data->header.length);
+	hash->fail = false;
+
+	// WARNING: const -> non const (ugly)
+	data_set_process_records((struct ipfix_data_set *) data, tmplt,
+		&dest_hash_record, hash);
+
+	// Finish Data Sets of destinations
+	int ret_val = (hash->fail) ? 1 : 0;
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		struct hash_member *member = &hash->members[i];
+		if (member->set_recs == 0) {
+			continue;
+		}
+
+		if (ret_val != 0) {
+			// Drop the incomplete Data Set
+			member->buffer_len = member->set_start;
+			member->set_recs = 0;
+			continue;
+		}
+
+		struct ipfix_set_header header;
+		header.flowset_id = htons(new_id);
+		header.length = htons(member->buffer_len - member->set_start);
+
+		uint8_t *set = member->buffer + member->set_start;
+		memcpy(set, &header, sizeof(header));
+
+		if (bldr_add_dataset(member->bldr, (const struct ipfix_data_set *) set,
+				new_id, member->set_recs)) {
+			ret_val = 1;
+		}
+
+		member->set_recs = 0;
+	}
+
+	return ret_val;
+}
+
+/* End packet(s) of all destinations */
+int dest_hash_end(fwd_dest_t *dst_mgr, uint16_t len)
+{
+	struct dst_hash *hash = dst_mgr->hash;
+
+	for (size_t i = 0; i < hash->cnt; ++i) {
+		if (bldr_end(hash->members[i].bldr, len)) {
+			return 1;
+		}
+	}
+
+	return 0;
 }
@@ -51,6 +51,7 @@
 #include <stdbool.h>
 #include "sender.h"
 #include "packet.h"
+#include "hash.h"
 #include <ipfixcol.h>
 
 /**
@@ -59,7 +60,16 @@
 enum DIST_MODE {
 	DIST_INVALID,           /**< Invalid type                            */
 	DIST_ALL,               /**< Distribute flows to all destinations    */
-	DIST_ROUND_ROBIN        /**< Distribute using Round Robin            */
+	DIST_ROUND_ROBIN,       /**< Distribute using Round Robin            */
+	DIST_HASH               /**< Distribute records by a flow key        */
+};
+
+/**
+ * \brief Policy of a full queue of a destination
+ */
+enum QUEUE_POLICY {
+	QUEUE_DROP,             /**< Drop data (templates close connection)  */
+	QUEUE_BLOCK             /**< Wait until the queue is not full        */
 };
 
 // Structure prototype
@@ -80,9 +90,12 @@ void dest_destroy(fwd_dest_t *dst_mgr);
 
 /**
  * \brief Add new destination
+ *
+ * On success the manager takes ownership of the sender.
  * \param[in,out] dst_mgr Destination manager
  * \param[in] sndr New sender
  * \return On success returns 0. Otherwise returns non-zero value.
+ * \warning Destinations cannot be added while the I/O thread is running.
  */
 int dest_add(fwd_dest_t *dst_mgr, fwd_sender_t *sndr);
 
@@ -113,6 +126,27 @@ int dest_connector_start(fwd_dest_t *dst_mgr, int period);
  */
 int dest_connector_stop(fwd_dest_t *dst_mgr);
 
+/**
+ * \brief Start the thread that sends queued packets
+ *
+ * dest_send() only appends packets to bounded queues of destinations.
+ * The I/O thread sends them, so a slow destination doesn't block others.
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in] policy Policy of full queues
+ * \param[in] stats_interval Period of queue statistics (in seconds,
+ *   0 = disabled)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_io_start(fwd_dest_t *dst_mgr, enum QUEUE_POLICY policy,
+	unsigned int stats_interval);
+
+/**
+ * \brief Stop the thread that sends queued packets
+ * \param[in,out] dst_mgr Destination manager
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_io_stop(fwd_dest_t *dst_mgr);
+
 /**
  * \brief Check UDP connections for expired templates and move them to ready
  *   state
@@ -141,6 +175,77 @@ void dest_check_reconnected(fwd_dest_t *dst_mgr);
 void dest_send(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
 	fwd_bldr_t *bldr_tmplts, enum DIST_MODE mode);
 
+/**
+ * \brief Prepare distribution of records by a flow key (#DIST_HASH)
+ *
+ * All added destinations are placed on a consistent hash ring and each of
+ * them gets its own packet builder. Records are split into the builders by
+ * dest_hash_add_dataset() and the builders are sent by dest_send().
+ * \warning Must be called after all destinations are added and before
+ *   dest_connector_start().
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in]     key     Flow key
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_init(fwd_dest_t *dst_mgr, const struct hkey_cfg *key);
+
+/**
+ * \brief Start new packet(s) of all destinations (#DIST_HASH)
+ *
+ * Records of destinations disconnected at this moment are redistributed
+ * to the next connected destinations on the ring.
+ * \param[in,out] dst_mgr  Destination manager
+ * \param[in]     odid     ODID of the packet
+ * \param[in]     exp_time Export time
+ */
+void dest_hash_start(fwd_dest_t *dst_mgr, uint32_t odid, uint32_t exp_time);
+
+/**
+ * \brief Add a template to packets of all destinations (#DIST_HASH)
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in] data   Pointer to a header of the template
+ * \param[in] size   Size of the template
+ * \param[in] new_id New Template ID (>= 256)
+ * \param[in] type   Type of the template (TM_TEMPLATE or TM_OPTIONS_TEMPLATE)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_add_template(fwd_dest_t *dst_mgr, const void *data, size_t size,
+	uint16_t new_id, int type);
+
+/**
+ * \brief Add a template withdrawal to packets of all destinations
+ *   (#DIST_HASH)
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in] id    Template ID
+ * \param[in] type  Type of the template (TM_TEMPLATE or TM_OPTIONS_TEMPLATE)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_add_withdrawal(fwd_dest_t *dst_mgr, uint16_t id, int type);
+
+/**
+ * \brief Split records of a Data set into packets of destinations
+ *   (#DIST_HASH)
+ *
+ * Each record is added to the destination responsible for the hash of its
+ * flow key. Records of Options Templates are added to all destinations.
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in] data   Data set
+ * \param[in] tmplt  Template of the Data set
+ * \param[in] new_id New Flowset ID (>= 256)
+ * \param[in] rec    Number of data records in the set
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_add_dataset(fwd_dest_t *dst_mgr, const struct ipfix_data_set *data,
+	struct ipfix_template *tmplt, uint16_t new_id, unsigned int rec);
+
+/**
+ * \brief End packet(s) of all destinations (#DIST_HASH)
+ * \param[in,out] dst_mgr Destination manager
+ * \param[in]     len     Maximum size per packet (just recommendation)
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_end(fwd_dest_t *dst_mgr, uint16_t len);
+
 
 #endif // DESTINATION_H
 
@@ -66,35 +66,43 @@ IPFIXCOL_API_VERSION
 static const char* msg_module= "forwarding";
 
 /**
- * \brief Get a number of data records in a Data Set
+ * \brief Get a template of a Data Set
  * \param[in] msg IPFIX message
  * \param[in] header Pointer to Data set header
- * \return On error returns -1. Otherwise returns number of data records.
+ * \return On success returns the template. Otherwise (unknown) returns NULL.
  */
-static int fwd_rec_cnt(const struct ipfix_message *msg,
+static struct ipfix_template *fwd_data_template(const struct ipfix_message *msg,
 	const struct ipfix_set_header *header)
 {
-	// Find template
-	int i;
-	struct ipfix_template *tmplt = NULL;
-
-	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+	for (int i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set;
+			++i) {
 		if (&msg->data_couple[i].data_set->header != header) {
 			continue;
 		}
 
 		// Couple found
-		tmplt = msg->data_couple[i].data_template;
-		break;
+		return msg->data_couple[i].data_template;
 	}
 
+	return NULL;
+}
+
+/**
+ * \brief Get a number of data records in a Data Set
+ * \param[in] tmplt Template of the Data Set (can be NULL)
+ * \param[in] header Pointer to Data set header
+ * \return On error returns -1. Otherwise returns number of data records.
+ */
+static int fwd_rec_cnt(struct ipfix_template *tmplt,
+	const struct ipfix_set_header *header)
+{
 	if (!tmplt) {
 		// Unknown template
 		return -1;
 	}
 
 	// Get number of records
-	return data_set_records_count(msg->data_couple[i].data_set, tmplt);
+	return data_set_records_count((struct ipfix_data_set *) header, tmplt);
 }
 
 /**
@@ -158,6 +166,11 @@ static void fwd_process_template_func(uint8_t *rec, int rec_len, void *data)
 	ret_tmplt = bldr_add_template(ctx->cfg->builder_tmplt, rec, rec_len, new_id,
 		ctx->type);
 
+	if (ctx->cfg->mode == DIST_HASH && ret_all == 0) {
+		ret_all = dest_hash_add_template(ctx->cfg->dest_mgr, rec, rec_len,
+			new_id, ctx->type);
+	}
+
 	if (ret_all != 0 || ret_tmplt != 0) {
 		MSG_ERROR(msg_module, "Failed to add a template (Template ID: "
 			"%" PRIu16 ") into a new packet. Some flows will be probably lost "
@@ -220,8 +233,9 @@ static int fwd_process_data_set(struct plugin_config *cfg,
 	}
 
 	// Get a number of records in the Set
+	struct ipfix_template *tmplt = fwd_data_template(msg, header);
 	int rec_cnt;
-	rec_cnt = fwd_rec_cnt(msg, header);
+	rec_cnt = fwd_rec_cnt(tmplt, header);
 	if (rec_cnt == 0) {
 		// Empty Data set -> skip
 		MSG_WARNING(msg_module, "Skipping a data set (Flowset ID: "
@@ -255,6 +269,12 @@ static int fwd_process_data_set(struct plugin_config *cfg,
 	const struct ipfix_data_set *data_set;
 	data_set = (const struct ipfix_data_set *) header;
 
+	if (cfg->mode == DIST_HASH) {
+		// Split records by their flow keys
+		return dest_hash_add_dataset(cfg->dest_mgr, data_set, tmplt, new_id,
+			rec_cnt);
+	}
+
 	if (bldr_add_dataset(cfg->builder_all, data_set, new_id, rec_cnt)) {
 		return 1;
 	}
@@ -288,6 +308,9 @@ static int fwd_process_withdrawals(struct plugin_config *cfg, uint32_t odid,
 		const uint16_t id = ids_data[i];
 		ret_all =   bldr_add_template_withdrawal(cfg->builder_all,   id, type);
 		ret_tmplt = bldr_add_template_withdrawal(cfg->builder_tmplt, id, type);
+		if (cfg->mode == DIST_HASH && ret_all == 0) {
+			ret_all = dest_hash_add_withdrawal(cfg->dest_mgr, id, type);
+		}
 
 		if (ret_all != 0 || ret_tmplt != 0) {
 			free(ids_data);
@@ -373,6 +396,9 @@ static int fwd_parse_msg(struct plugin_config *cfg,
 	uint32_t pkt_exp_time = ntohl(msg->pkt_header->export_time);
 	bldr_start(cfg->builder_all, pkt_odid, pkt_exp_time);
 	bldr_start(cfg->builder_tmplt, pkt_odid, pkt_exp_time);
+	if (cfg->mode == DIST_HASH) {
+		dest_hash_start(cfg->dest_mgr, pkt_odid, pkt_exp_time);
+	}
 	bool any_templates = false;
 
 	// Process IPFIX message
@@ -435,6 +461,11 @@ static int fwd_parse_msg(struct plugin_config *cfg,
 		return 1;
 	}
 
+	if (cfg->mode == DIST_HASH
+			&& dest_hash_end(cfg->dest_mgr, cfg->packet_size)) {
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -462,6 +493,12 @@ int storage_init (char *params, void **config)
 		return -1;
 	}
 
+	// Start sending of queued packets
+	if (dest_io_start(cfg->dest_mgr, cfg->queue_policy, cfg->queue_stats)) {
+		config_destroy(cfg);
+		return -1;
+	}
+
 	// Save configuration
 	*config = cfg;
 	MSG_DEBUG(msg_module, "Initialization completed successfully.");
@@ -0,0 +1,400 @@
+/**
+ * \file storage/forwarding/hash.c
+ * \brief Flow key hashing and consistent hash ring (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+
+/** Plugin identification string                                             */
+static const char *msg_module = "forwarding(hash)";
+
+/** Offset basis of FNV-1a hash                                              */
+#define HASH_SEED (2166136261U)
+/** Prime of FNV-1a hash                                                     */
+#define HASH_PRIME (16777619U)
+/** Max. size of an endpoint of a flow key (IPv6 address + port)             */
+#define HKEY_EP_SIZE (16 + 2)
+/** Max. length of a name of a virtual node                                  */
+#define RING_NAME_SIZE (256)
+
+/** IPFIX Information Elements of key fields                                 */
+#define IE_PROTOCOL     (4)
+#define IE_SRC_PORT     (7)
+#define IE_SRC_IPV4     (8)
+#define IE_DST_PORT     (11)
+#define IE_DST_IPV4     (12)
+#define IE_SRC_IPV6     (27)
+#define IE_DST_IPV6     (28)
+
+/** \brief Point of a virtual node on the ring                               */
+struct ring_point {
+	uint32_t hash;          /**< Position on the ring                    */
+	unsigned int member;    /**< Index of the member                     */
+};
+
+/** \brief Consistent hash ring                                              */
+struct _fwd_ring {
+	struct ring_point *points; /**< Points sorted by position            */
+	size_t cnt;                /**< Number of points                     */
+	unsigned int vnodes;       /**< Virtual nodes per member             */
+};
+
+/**
+ * \brief Add bytes to a hash (FNV-1a)
+ * \param[in] hash Current hash
+ * \param[in] data Data
+ * \param[in] len  Size of the data
+ * \return New hash
+ */
+static inline uint32_t hash_bytes(uint32_t hash, const uint8_t *data,
+	size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= data[i];
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+ * \brief Final mixing of a hash (spreads small differences over all bits)
+ * \param[in] hash Hash
+ * \return Mixed hash
+ */
+static inline uint32_t hash_final(uint32_t hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * \brief Find a location of a field in records of a template
+ * \param[in]  plan  Plan (with template)
+ * \param[out] field Location of the field
+ * \param[in]  id    Information Element ID
+ * \return If the field is present returns true. Otherwise returns false.
+ */
+static bool hkey_plan_field(const struct hkey_plan *plan,
+	struct hkey_field *field, uint16_t id)
+{
+	struct ipfix_template_row *row;
+	int offset = 0;
+
+	field->id = id;
+	field->offset = -1;
+	field->length = 0;
+
+	row = template_get_field(plan->tmplt, 0, id, &offset);
+	if (!row) {
+		field->id = 0;
+		return false;
+	}
+
+	if (plan->fixed) {
+		field->offset = offset;
+		field->length = row->length;
+	}
+
+	return true;
+}
+
+/* Prepare a plan for records of a template */
+void hkey_plan_init(struct hkey_plan *plan, const struct hkey_cfg *cfg,
+	struct ipfix_template *tmplt)
+{
+	const unsigned int fields = cfg->fields;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->cfg = cfg;
+	plan->tmplt = tmplt;
+	plan->fixed = !(tmplt->data_length & 0x80000000);
+
+	if (fields & HKEY_SRC_IP) {
+		if (!hkey_plan_field(plan, &plan->src_ip, IE_SRC_IPV4)) {
+			hkey_plan_field(plan, &plan->src_ip, IE_SRC_IPV6);
+		}
+	}
+
+	if (fields & HKEY_DST_IP) {
+		if (!hkey_plan_field(plan, &plan->dst_ip, IE_DST_IPV4)) {
+			hkey_plan_field(plan, &plan->dst_ip, IE_DST_IPV6);
+		}
+	}
+
+	if (fields & HKEY_SRC_PORT) {
+		hkey_plan_field(plan, &plan->src_port, IE_SRC_PORT);
+	}
+
+	if (fields & HKEY_DST_PORT) {
+		hkey_plan_field(plan, &plan->dst_port, IE_DST_PORT);
+	}
+
+	if (fields & HKEY_PROTO) {
+		hkey_plan_field(plan, &plan->proto, IE_PROTOCOL);
+	}
+}
+
+/**
+ * \brief Get a value of a key field in a record
+ * \param[in]  plan  Plan
+ * \param[in]  field Location of the field
+ * \param[in]  rec   Data record
+ * \param[in]  max   Max. size of the value
+ * \param[out] len   Size of the value
+ * \return Pointer to the value or NULL (not present)
+ */
+static inline const uint8_t *hkey_field_get(const struct hkey_plan *plan,
+	const struct hkey_field *field, uint8_t *rec, int max, int *len)
+{
+	const uint8_t *ptr;
+
+	if (field->id == 0) {
+		return NULL;
+	}
+
+	if (field->offset >= 0) {
+		ptr = rec + field->offset;
+		*len = field->length;
+	} else {
+		// Record with variable-length fields
+		ptr = data_record_get_field(rec, plan->tmplt, 0, field->id, len);
+		if (!ptr) {
+			return NULL;
+		}
+	}
+
+	if (*len > max) {
+		*len = max;
+	}
+
+	return ptr;
+}
+
+/**
+ * \brief Copy an endpoint (address and port) of a flow into a buffer
+ * \param[in]  plan Plan
+ * \param[in]  ip   Location of the address
+ * \param[in]  port Location of the port
+ * \param[in]  rec  Data record
+ * \param[out] buf  Buffer (at least #HKEY_EP_SIZE bytes)
+ * \return Size of the endpoint
+ */
+static inline size_t hkey_endpoint(const struct hkey_plan *plan,
+	const struct hkey_field *ip, const struct hkey_field *port, uint8_t *rec,
+	uint8_t *buf)
+{
+	const uint8_t *ptr;
+	size_t size = 0;
+	int len;
+
+	ptr = hkey_field_get(plan, ip, rec, 16, &len);
+	if (ptr) {
+		memcpy(buf, ptr, len);
+		size += len;
+	}
+
+	ptr = hkey_field_get(plan, port, rec, 2, &len);
+	if (ptr) {
+		memcpy(buf + size, ptr, len);
+		size += len;
+	}
+
+	return size;
+}
+
+/* Calculate a hash of a flow key of a data record */
+uint32_t hkey_hash(const struct hkey_plan *plan, uint8_t *rec)
+{
+	uint8_t src[HKEY_EP_SIZE], dst[HKEY_EP_SIZE];
+	size_t src_len, dst_len;
+	const uint8_t *first = src, *second = dst;
+	size_t first_len, second_len;
+
+	src_len = hkey_endpoint(plan, &plan->src_ip, &plan->src_port, rec, src);
+	dst_len = hkey_endpoint(plan, &plan->dst_ip, &plan->dst_port, rec, dst);
+	first_len = src_len;
+	second_len = dst_len;
+
+	if (plan->cfg->symmetric) {
+		// Order endpoints so that both directions give the same key
+		int cmp = (src_len == dst_len)
+			? memcmp(src, dst, src_len)
+			: (int) src_len - (int) dst_len;
+		if (cmp > 0) {
+			first = dst;
+			first_len = dst_len;
+			second = src;
+			second_len = src_len;
+		}
+	}
+
+	uint32_t hash = HASH_SEED;
+	hash = hash_bytes(hash, first, first_len);
+	hash = hash_bytes(hash, second, second_len);
+
+	int len;
+	const uint8_t *proto = hkey_field_get(plan, &plan->proto, rec, 1, &len);
+	if (proto) {
+		hash = hash_bytes(hash, proto, len);
+	}
+
+	return hash_final(hash);
+}
+
+/* Create an empty consistent hash ring */
+fwd_ring_t *ring_create(unsigned int vnodes)
+{
+	if (vnodes == 0) {
+		return NULL;
+	}
+
+	fwd_ring_t *ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return NULL;
+	}
+
+	ring->vnodes = vnodes;
+	return ring;
+}
+
+/* Destroy a ring */
+void ring_destroy(fwd_ring_t *ring)
+{
+	if (!ring) {
+		return;
+	}
+
+	free(ring->points);
+	free(ring);
+}
+
+/**
+ * \brief Compare points of the ring (for qsort)
+ */
+static int ring_point_cmp(const void *a, const void *b)
+{
+	const struct ring_point *p1 = a;
+	const struct ring_point *p2 = b;
+
+	if (p1->hash != p2->hash) {
+		return (p1->hash < p2->hash) ? -1 : 1;
+	}
+
+	// Collision of positions -> order by members to stay deterministic
+	if (p1->member != p2->member) {
+		return (p1->member < p2->member) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* Add a member to the ring */
+int ring_add(fwd_ring_t *ring, const char *name, unsigned int member)
+{
+	if (!ring || !name) {
+		return 1;
+	}
+
+	struct ring_point *new_arr;
+	new_arr = realloc(ring->points,
+		(ring->cnt + ring->vnodes) * sizeof(*new_arr));
+	if (!new_arr) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	ring->points = new_arr;
+
+	char buffer[RING_NAME_SIZE];
+	for (unsigned int i = 0; i < ring->vnodes; ++i) {
+		int len = snprintf(buffer, sizeof(buffer), "%s#%u", name, i);
+		if (len < 0 || (size_t) len >= sizeof(buffer)) {
+			MSG_ERROR(msg_module, "Name of a ring member is too long.");
+			return 1;
+		}
+
+		struct ring_point *point = &ring->points[ring->cnt++];
+		point->hash = hash_final(hash_bytes(HASH_SEED, (uint8_t *) buffer, len));
+		point->member = member;
+	}
+
+	qsort(ring->points, ring->cnt, sizeof(*ring->points), &ring_point_cmp);
+	return 0;
+}
+
+/* Find a member responsible for a hash */
+int ring_lookup(const fwd_ring_t *ring, uint32_t hash, const bool *alive)
+{
+	if (ring->cnt == 0) {
+		return -1;
+	}
+
+	// Find the first point with position >= hash
+	size_t low = 0;
+	size_t high = ring->cnt;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (ring->points[mid].hash < hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	// Walk clockwise to the first available member
+	for (size_t i = 0; i < ring->cnt; ++i) {
+		const struct ring_point *point = &ring->points[(low + i) % ring->cnt];
+		if (alive[point->member]) {
+			return (int) point->member;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,160 @@
+/**
+ * \file storage/forwarding/hash.h
+ * \brief Flow key hashing and consistent hash ring (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/**
+ * \defgroup hash Flow key hashing and consistent hash ring
+ * \ingroup forwardingStoragePlugin
+ *
+ * @{
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <ipfixcol.h>
+
+/**
+ * \brief Fields of a flow key
+ */
+enum HKEY_FIELD {
+	HKEY_SRC_IP   = 0x01,   /**< Source IPv4/IPv6 address                */
+	HKEY_DST_IP   = 0x02,   /**< Destination IPv4/IPv6 address           */
+	HKEY_SRC_PORT = 0x04,   /**< Source transport port                   */
+	HKEY_DST_PORT = 0x08,   /**< Destination transport port              */
+	HKEY_PROTO    = 0x10    /**< Protocol identifier                     */
+};
+
+/**
+ * \brief Configuration of a flow key
+ */
+struct hkey_cfg {
+	unsigned int fields;    /**< Selected fields (#HKEY_FIELD flags)     */
+	/** Both directions of a flow have the same key (source and destination
+	 *  endpoints are ordered before hashing)                               */
+	bool symmetric;
+};
+
+/** \brief Location of a key field in data records of one template */
+struct hkey_field {
+	uint16_t id;            /**< Information Element ID (0 = not present)*/
+	int offset;             /**< Offset in a record (-1 = unknown)       */
+	int length;             /**< Size of the field                       */
+};
+
+/**
+ * \brief Plan for extraction of a flow key from records of one template
+ *
+ * For templates without variable-length fields, offsets are resolved once
+ * by hkey_plan_init(). Otherwise they are looked up in each record.
+ */
+struct hkey_plan {
+	const struct hkey_cfg *cfg;    /**< Key configuration                */
+	struct ipfix_template *tmplt;  /**< Template of records              */
+	bool fixed;                    /**< Offsets are valid for all records*/
+	struct hkey_field src_ip;      /**< Source address                   */
+	struct hkey_field dst_ip;      /**< Destination address              */
+	struct hkey_field src_port;    /**< Source port                      */
+	struct hkey_field dst_port;    /**< Destination port                 */
+	struct hkey_field proto;       /**< Protocol                         */
+};
+
+/**
+ * \brief Prepare a plan for records of a template
+ * \param[out] plan  Plan
+ * \param[in]  cfg   Key configuration (must exist while the plan is used)
+ * \param[in]  tmplt Template of the records
+ */
+void hkey_plan_init(struct hkey_plan *plan, const struct hkey_cfg *cfg,
+	struct ipfix_template *tmplt);
+
+/**
+ * \brief Calculate a hash of a flow key of a data record
+ *
+ * Fields missing in the record are skipped, i.e. all records without any
+ * key field have the same hash.
+ * \param[in] plan Plan of the record's template
+ * \param[in] rec  Data record
+ * \return Hash value
+ */
+uint32_t hkey_hash(const struct hkey_plan *plan, uint8_t *rec);
+
+// Structure prototype
+typedef struct _fwd_ring fwd_ring_t;
+
+/**
+ * \brief Create an empty consistent hash ring
+ * \param[in] vnodes Number of virtual nodes per member
+ * \return Pointer or NULL
+ */
+fwd_ring_t *ring_create(unsigned int vnodes);
+
+/**
+ * \brief Destroy a ring
+ * \param[in,out] ring Ring
+ */
+void ring_destroy(fwd_ring_t *ring);
+
+/**
+ * \brief Add a member to the ring
+ *
+ * Positions of the member's virtual nodes depend only on its name, so
+ * adding or removing a member remaps only the keys of its own arcs.
+ * \param[in,out] ring   Ring
+ * \param[in]     name   Unique name of the member (e.g. "address:port")
+ * \param[in]     member Index of the member
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int ring_add(fwd_ring_t *ring, const char *name, unsigned int member);
+
+/**
+ * \brief Find a member responsible for a hash
+ *
+ * The first member clockwise from the hash that is marked as alive is
+ * returned, so keys of unavailable members are spread over the others.
+ * \param[in] ring  Ring
+ * \param[in] hash  Hash of a key
+ * \param[in] alive Availability of members (indexed by member index)
+ * \return Index of the member or -1 (no member available)
+ */
+int ring_lookup(const fwd_ring_t *ring, uint32_t hash, const bool *alive);
+
+#endif // HASH_H
+
+/**@}*/
@@ -0,0 +1,207 @@
+/**
+ * \file storage/forwarding/queue.c
+ * \brief Queue of packets for a destination (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+
+/** Plugin identification string                                             */
+static const char *msg_module = "forwarding(queue)";
+
+/** \brief Single producer, single consumer ring of items                    */
+struct _fwd_queue {
+	struct queue_item *items; /**< Ring of items                         */
+	size_t size;              /**< Capacity                              */
+	/** Number of pushed items (written only by the producer)                */
+	size_t tail;
+	/** Number of popped items (written only by the consumer)                */
+	size_t head;
+};
+
+/* Create a packet from its parts */
+fwd_pkt_t *pkt_create(const struct iovec *io, size_t parts, uint32_t recs)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < parts; ++i) {
+		len += io[i].iov_len;
+	}
+
+	fwd_pkt_t *pkt = malloc(sizeof(*pkt) + len);
+	if (!pkt) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return NULL;
+	}
+
+	pkt->refs = 1;
+	pkt->recs = recs;
+	pkt->len = len;
+
+	uint8_t *pos = pkt->data;
+	for (size_t i = 0; i < parts; ++i) {
+		memcpy(pos, io[i].iov_base, io[i].iov_len);
+		pos += io[i].iov_len;
+	}
+
+	return pkt;
+}
+
+/* Release a reference to a packet */
+void pkt_unref(fwd_pkt_t *pkt)
+{
+	if (!pkt) {
+		return;
+	}
+
+	if (__sync_sub_and_fetch(&pkt->refs, 1) == 0) {
+		free(pkt);
+	}
+}
+
+/* Create a queue */
+fwd_queue_t *queue_create(size_t size)
+{
+	if (size == 0) {
+		return NULL;
+	}
+
+	fwd_queue_t *queue = calloc(1, sizeof(*queue));
+	if (!queue) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return NULL;
+	}
+
+	queue->items = calloc(size, sizeof(*queue->items));
+	if (!queue->items) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		free(queue);
+		return NULL;
+	}
+
+	queue->size = size;
+	return queue;
+}
+
+/* Destroy a queue and release all queued packets */
+void queue_destroy(fwd_queue_t *queue)
+{
+	if (!queue) {
+		return;
+	}
+
+	while (queue_front(queue) != NULL) {
+		queue_pop(queue);
+	}
+
+	free(queue->items);
+	free(queue);
+}
+
+/* Append an item */
+bool queue_push(fwd_queue_t *queue, const struct queue_item *item)
+{
+	const size_t tail = queue->tail;
+	const size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if (tail - head == queue->size) {
+		// Full
+		return false;
+	}
+
+	queue->items[tail % queue->size] = *item;
+	// Publish the item to the consumer
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/* Get the first item */
+struct queue_item *queue_front(fwd_queue_t *queue)
+{
+	const size_t head = queue->head;
+	const size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		// Empty
+		return NULL;
+	}
+
+	return &queue->items[head % queue->size];
+}
+
+/* Get an item at a given position */
+struct queue_item *queue_peek(fwd_queue_t *queue, size_t idx)
+{
+	const size_t head = queue->head;
+	const size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if (tail - head <= idx) {
+		return NULL;
+	}
+
+	return &queue->items[(head + idx) % queue->size];
+}
+
+/* Remove the first item */
+void queue_pop(fwd_queue_t *queue)
+{
+	const size_t head = queue->head;
+
+	pkt_unref(queue->items[head % queue->size].pkt);
+	queue->items[head % queue->size].pkt = NULL;
+	// Return the slot to the producer
+	__atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Get a number of queued items */
+size_t queue_depth(const fwd_queue_t *queue)
+{
+	const size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	const size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	return tail - head;
+}
+
+/* Get a capacity of a queue */
+size_t queue_size(const fwd_queue_t *queue)
+{
+	return queue->size;
+}
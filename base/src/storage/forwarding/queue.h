@@ -0,0 +1,168 @@
+/**
+ * \file storage/forwarding/queue.h
+ * \brief Queue of packets for a destination (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/**
+ * \defgroup queue Queue of shared packets
+ * \ingroup forwardingStoragePlugin
+ *
+ * Packets are created once per distribution and shared (by reference
+ * counting) by queues of all destinations. Each queue has exactly one
+ * producer (the storage thread) and one consumer (the I/O thread), so it
+ * doesn't need any locks.
+ *
+ * @{
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>   // struct iovec
+
+/** \brief Packet shared by queues of destinations */
+typedef struct fwd_pkt {
+	unsigned int refs;    /**< Reference counter                         */
+	uint32_t recs;        /**< Number of data records in the packet      */
+	size_t len;           /**< Size of the packet                        */
+	uint8_t data[];       /**< IPFIX packet (with a sequence number 0)   */
+} fwd_pkt_t;
+
+/**
+ * \brief Create a packet from its parts
+ *
+ * The reference counter of the new packet is 1.
+ * \param[in] io    Array of packet parts
+ * \param[in] parts Number of parts
+ * \param[in] recs  Number of data records in the packet
+ * \return Pointer or NULL
+ */
+fwd_pkt_t *pkt_create(const struct iovec *io, size_t parts, uint32_t recs);
+
+/**
+ * \brief Get a new reference to a packet
+ * \param[in,out] pkt Packet
+ * \return The packet
+ */
+static inline fwd_pkt_t *pkt_ref(fwd_pkt_t *pkt)
+{
+	__sync_fetch_and_add(&pkt->refs, 1);
+	return pkt;
+}
+
+/**
+ * \brief Release a reference to a packet
+ *
+ * The packet is freed when the last reference is released.
+ * \param[in,out] pkt Packet (can be NULL)
+ */
+void pkt_unref(fwd_pkt_t *pkt);
+
+/** \brief Item of a queue */
+struct queue_item {
+	fwd_pkt_t *pkt;       /**< Packet                                    */
+	uint32_t seq;         /**< Sequence number of the packet             */
+	uint32_t gen;         /**< Connection for which the item is intended */
+};
+
+// Structure prototype
+typedef struct _fwd_queue fwd_queue_t;
+
+/**
+ * \brief Create a queue
+ * \param[in] size Max. number of items
+ * \return Pointer or NULL
+ */
+fwd_queue_t *queue_create(size_t size);
+
+/**
+ * \brief Destroy a queue and release all queued packets
+ * \param[in,out] queue Queue (can be NULL)
+ */
+void queue_destroy(fwd_queue_t *queue);
+
+/**
+ * \brief Append an item (producer only)
+ *
+ * On success, the queue takes over the reference to the packet of the item.
+ * \param[in,out] queue Queue
+ * \param[in]     item  Item
+ * \return On success returns true. Otherwise (full) returns false.
+ */
+bool queue_push(fwd_queue_t *queue, const struct queue_item *item);
+
+/**
+ * \brief Get the first item (consumer only)
+ * \param[in] queue Queue
+ * \return Pointer to the item or NULL (empty)
+ */
+struct queue_item *queue_front(fwd_queue_t *queue);
+
+/**
+ * \brief Get an item at a given position from the beginning
+ * \note Only for the consumer.
+ * \param[in] queue Queue
+ * \param[in] idx   Position (0 = the first item)
+ * \return Pointer to the item or NULL (the queue is shorter)
+ */
+struct queue_item *queue_peek(fwd_queue_t *queue, size_t idx);
+
+/**
+ * \brief Remove the first item and release its packet (consumer only)
+ * \param[in,out] queue Queue
+ */
+void queue_pop(fwd_queue_t *queue);
+
+/**
+ * \brief Get a number of queued items
+ * \param[in] queue Queue
+ * \return Number of items
+ */
+size_t queue_depth(const fwd_queue_t *queue);
+
+/**
+ * \brief Get a capacity of a queue
+ * \param[in] queue Queue
+ * \return Max. number of items
+ */
+size_t queue_size(const fwd_queue_t *queue);
+
+#endif // QUEUE_H
+
+/**@}*/
@@ -37,14 +37,20 @@
  *
  */
 
+#define _GNU_SOURCE // sendmmsg()
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <pthread.h>
 // Network API
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
 // IPFIXcol API
 #include <ipfixcol.h>
 
@@ -52,26 +58,78 @@
 
 /** Invalid socket value */
 #define SOCKET_INVALID (-1)
-/** Maximum size of internal buffer (2^19) */
-#define BUFFER_SIZE (524288)
+/** Max. number of packets sent by one sendmmsg() call */
+#define BATCH_PKTS (64)
+/** Max. number of segments of one UDP GSO message */
+#define GSO_MAX_SEGS (64)
+/** Max. size of one UDP GSO message (65535 - IPv6 and UDP header) */
+#define GSO_MAX_BYTES (65487)
+
+/**
+ * \brief Buffers for batched transmission of UDP packets
+ *
+ * Consecutive packets of the same size are merged into one message and
+ * segmented by the kernel (UDP GSO). Other packets are sent as separate
+ * messages of one sendmmsg() call.
+ */
+struct udp_batch {
+	/** Copies of IPFIX headers (with sequence numbers)                      */
+	uint8_t headers[BATCH_PKTS][IPFIX_HEADER_LENGTH];
+	/** Parts of packets (header + rest of the packet)                       */
+	struct iovec iov[2 * BATCH_PKTS];
+	/** Messages                                                             */
+	struct mmsghdr msgs[BATCH_PKTS];
+	/** Number of packets in each message                                    */
+	unsigned int pkts[BATCH_PKTS];
+	/** Control messages with GSO segment size                               */
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} ctrl[BATCH_PKTS];
+};
 
 /** Module description */
 static const char *msg_module = "forwarding(sender)";
 
 /**
  * \brief Sender to destination node
+ *
+ * The socket is shared by the thread that (re)connects the destination and
+ * the I/O thread that sends queued packets, so it is protected by a mutex.
+ * The storage thread only appends packets to the queue.
  */
 struct _fwd_sender {
 	char *dst_addr;       /**< Destination IP address     */
 	char *dst_port;       /**< Destination port           */
 	int proto;            /**< Transport protocol         */
-	int socket_fd;        /**< Socket                     */
 	time_t tmpl_time;     /**< Last time all templates were sent */
 
-	uint8_t *buffer_data; /**< Buffer for unsent parts of messsages */
-	size_t buffer_valid;  /**< Valid part of the buffer             */
+	pthread_mutex_t lock; /**< Lock of the socket         */
+	int socket_fd;        /**< Socket                     */
+	int connected;        /**< Socket is connected (atomic access) */
+	uint32_t gen;         /**< Connection number (atomic access)   */
+
+	fwd_queue_t *queue;   /**< Packets to send            */
+	size_t offset;        /**< Sent part of the first packet in the queue */
+	struct udp_batch *batch; /**< Batch buffers (only UDP)  */
+	bool gso;             /**< UDP GSO is available       */
+
+	size_t depth_max;     /**< Max. number of queued packets          */
+	uint64_t sent;        /**< Sent packets (written by I/O thread)   */
+	uint64_t dropped;     /**< Dropped packets (full queue)           */
+	uint64_t lost;        /**< Lost packets (closed connection)       */
 };
 
+/**
+ * \brief Increment a statistic counter written only by one thread
+ * \param[in,out] cnt Counter
+ */
+static inline void sender_stat_inc(uint64_t *cnt)
+{
+	__atomic_store_n(cnt, __atomic_load_n(cnt, __ATOMIC_RELAXED) + 1,
+		__ATOMIC_RELAXED);
+}
+
 /**
  * \brief Network address and service translation
  * \param[in] addr Destination address
@@ -105,6 +163,7 @@ static struct addrinfo *sender_getaddrinfo(const char *addr, const char *port, i
 
 /**
  * \brief Close a socket connection
+ * \warning The lock of the sender MUST be held.
  * \param[in,out] s Sender structure
  */
 static void sender_socket_close(fwd_sender_t *s)
@@ -114,15 +173,14 @@ static void sender_socket_close(fwd_sender_t *s)
 		return;
 	}
 
+	__atomic_store_n(&s->connected, 0, __ATOMIC_RELEASE);
 	close(s->socket_fd);
 	s->socket_fd = SOCKET_INVALID;
-
-	// Clear the buffer
-	s->buffer_valid = 0;
 }
 
 /** Create a new sender */
-fwd_sender_t *sender_create(const char *addr, const char *port, int proto)
+fwd_sender_t *sender_create(const char *addr, const char *port, int proto,
+	size_t queue_size)
 {
 	// Check parameters
 	if (!addr || !port) {
@@ -146,15 +204,24 @@ fwd_sender_t *sender_create(const char *addr, const char *port, int proto)
 		return NULL;
 	}
 
-	res->buffer_data = NULL;
-	res->buffer_valid = 0;
-	res->socket_fd = SOCKET_INVALID;
+	if (pthread_mutex_init(&res->lock, NULL) != 0) {
+		MSG_ERROR(msg_module, "Failed to initialize a mutex.");
+		free(res);
+		return NULL;
+	}
 
+	res->socket_fd = SOCKET_INVALID;
 	res->dst_addr = strdup(addr);
 	res->dst_port = strdup(port);
 	res->proto = proto;
 	res->tmpl_time = time(NULL);
-	if (!res->dst_addr || !res->dst_port) {
+	res->queue = queue_create(queue_size);
+	if (proto == IPPROTO_UDP) {
+		res->batch = malloc(sizeof(*res->batch));
+	}
+
+	if (!res->dst_addr || !res->dst_port || !res->queue
+			|| (proto == IPPROTO_UDP && !res->batch)) {
 		// Failed to copy parameters
 		sender_destroy(res);
 		return NULL;
@@ -173,10 +240,12 @@ void sender_destroy(fwd_sender_t *s)
 	// Address & port
 	free(s->dst_addr);
 	free(s->dst_port);
-	free(s->buffer_data);
 
 	// Socket
 	sender_socket_close(s);
+	queue_destroy(s->queue);
+	free(s->batch);
+	pthread_mutex_destroy(&s->lock);
 	free(s);
 }
 
@@ -213,6 +282,7 @@ void sender_set_tmpl_time(fwd_sender_t *s, time_t time)
 /** (Re)connect to the destination */
 int sender_connect(fwd_sender_t *s)
 {
+	pthread_mutex_lock(&s->lock);
 	if (s->socket_fd != SOCKET_INVALID) {
 		// Socket already connected -> close
 		sender_socket_close(s);
@@ -222,6 +292,7 @@ int sender_connect(fwd_sender_t *s)
 	struct addrinfo *dst_info;
 	dst_info = sender_getaddrinfo(s->dst_addr, s->dst_port, s->proto);
 	if (!dst_info) {
+		pthread_mutex_unlock(&s->lock);
 		return 1;
 	}
 
@@ -250,369 +321,327 @@ int sender_connect(fwd_sender_t *s)
 	freeaddrinfo(dst_info);
 	if (p == NULL) {
 		// Failed to create the socket & connect
+		pthread_mutex_unlock(&s->lock);
 		return 1;
 	}
 
+	s->gso = false;
+#ifdef UDP_SEGMENT
+	if (s->proto == IPPROTO_UDP) {
+		// Check whether the kernel supports UDP GSO (default is disabled)
+		int gso_size = 0;
+		s->gso = (setsockopt(new_fd, SOL_UDP, UDP_SEGMENT, &gso_size,
+			sizeof(gso_size)) == 0);
+	}
+#endif
+
+	// Packets queued for the previous connection will be dropped
 	s->socket_fd = new_fd;
+	__atomic_store_n(&s->gen, s->gen + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&s->connected, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&s->lock);
 	return 0;
 }
 
-/**
- * \brief Get a new memory in the internal buffer of unsent messages
- * \param[in,out] s Sender structure
- * \param[in] len Required size of the memory
- * \return Pointer or NULL
- */
-static uint8_t *sender_prepare_buffer(fwd_sender_t *s, size_t size)
+/** Close the connection */
+void sender_close(fwd_sender_t *s)
 {
-	if (!s->buffer_data) {
-		// Not initialized yet
-		s->buffer_data = (uint8_t *) malloc(BUFFER_SIZE);
-		if (!s->buffer_data) {
-			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
-				__FILE__, __LINE__);
-			return NULL;
-		}
-
-		s->buffer_valid = 0;
-	}
-
-	if (size + s->buffer_valid > BUFFER_SIZE) {
-		// Not enought memory
-		return NULL;
-	}
-
-	uint8_t *ptr = s->buffer_data + s->buffer_valid;
-	s->buffer_valid += size;
-
-	return ptr;
+	pthread_mutex_lock(&s->lock);
+	sender_socket_close(s);
+	pthread_mutex_unlock(&s->lock);
 }
 
-/**
- * \brief Store a packet (or a part of a packet) into internal structures
- * \param[in,out] s Sender structure
- * \param[in] data Data
- * \param[in] len Size of data
- * \return On success returns 0. Otherwise returns non-zero value.
- */
-static int sender_buffer_store(fwd_sender_t *s, const uint8_t *data, size_t size)
+/** Check whether the destination is connected */
+bool sender_is_connected(const fwd_sender_t *s)
 {
-	uint8_t *buffer = sender_prepare_buffer(s, size);
-	if (!buffer) {
-		return 1;
-	}
-
-	memcpy(buffer, data, size);
-	return 0;
+	return __atomic_load_n(&s->connected, __ATOMIC_ACQUIRE) != 0;
 }
 
-/**
- * \brief Store a packet (or a part of a packet) into internal structures
- * \param[in,out] s Sender structure
- * \param[in] io Array of packet parts
- * \param[in] parts Number of packet parts
- * \param[in] offset Drop first N bytes
- * \return On success return 0. Otherwise returns non-zero value.
- */
-static int sender_buffer_store_io(fwd_sender_t *s, const struct iovec *io,
-	size_t parts, size_t offset)
+/** Append a packet to the queue of the destination */
+enum SEND_STATUS sender_enqueue(fwd_sender_t *s, fwd_pkt_t *pkt, uint32_t seq)
 {
-	// Get length of the packet
-	size_t total_len = 0;
-	for (unsigned int i = 0; i < parts; ++i) {
-		total_len += io[i].iov_len;
+	if (!sender_is_connected(s)) {
+		return STATUS_CLOSED;
 	}
 
-	if (total_len <= offset) {
-		// Out of range
-		return 1;
-	}
+	struct queue_item item;
+	item.pkt = pkt_ref(pkt);
+	item.seq = seq;
+	item.gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
 
-	total_len -= offset; // Size of required memory
-	uint8_t *buffer = sender_prepare_buffer(s, total_len);
-	if (!buffer) {
-		return 1;
+	if (!queue_push(s->queue, &item)) {
+		// The queue is full
+		pkt_unref(pkt);
+		sender_stat_inc(&s->dropped);
+		return STATUS_BUSY;
 	}
 
-	// Copy data
-	unsigned int pos_total = 0;
-	unsigned int pos_copy = 0;
-
-	for (unsigned int i = 0; i < parts; ++i) {
-		uint8_t *begin = (uint8_t *) io[i].iov_base;
-		size_t len = io[i].iov_len;
-
-		if (pos_total < offset) {
-			// Skip parts within offset area
-			if (pos_total + len <= offset) {
-				pos_total += len;
-				continue;
-			}
-
-			// Move pointers to the end of the offset
-			unsigned int diff = offset - pos_total;
-			begin += diff;
-			len -= diff;
-			pos_total += diff;
-		}
-
-		memcpy(buffer + pos_copy, begin, len);
-		pos_copy += len;
-		pos_total += len;
+	size_t depth = queue_depth(s->queue);
+	if (depth > __atomic_load_n(&s->depth_max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&s->depth_max, depth, __ATOMIC_RELAXED);
 	}
 
-	return 0;
+	return STATUS_OK;
 }
 
 /**
- * \brief Send a content of the internal buffer
+ * \brief Send (the rest of) the first packet in the queue
+ * \warning The lock of the sender MUST be held.
  * \param[in,out] s    Sender structure
- * \param[in]     mode Mode (blocking or non-blocking)
- * \return When the buffer is empty returns 0. Otherwise (something is still
- * in the buffer) returns non-zero value.
+ * \param[in]     item The first item of the queue
+ * \return When the packet was sent returns 0. When the operation would
+ *   block returns a positive value. On failure returns a negative value.
  */
-int sender_send_buffer(fwd_sender_t *s, enum SEND_MODE mode)
+static int sender_send_item(fwd_sender_t *s, const struct queue_item *item)
 {
-	if (s->socket_fd == SOCKET_INVALID) {
-		return 1;
-	}
-
-	if (s->buffer_valid == 0) {
-		// Buffer is empty
+	const fwd_pkt_t *pkt = item->pkt;
+	if (pkt->len < IPFIX_HEADER_LENGTH) {
+		// Invalid packet -> skip
 		return 0;
 	}
 
-	// Something is in the buffer
-	const uint8_t *ptr = s->buffer_data;
-	size_t todo = s->buffer_valid;
-
-	int flags = MSG_NOSIGNAL;
-	flags |= (mode == MODE_NON_BLOCKING) ? MSG_DONTWAIT : 0;
+	// Set the sequence number of the destination
+	uint8_t header[IPFIX_HEADER_LENGTH];
+	uint32_t seq = htonl(item->seq);
+	memcpy(header, pkt->data, IPFIX_HEADER_LENGTH);
+	memcpy(header + offsetof(struct ipfix_header, sequence_number), &seq,
+		sizeof(seq));
 
-	while (todo > 0) {
-		// Send
-		ssize_t ret;
-		ret = send(s->socket_fd, ptr, todo, flags);
+	struct iovec io[2];
+	io[0].iov_base = header;
+	io[0].iov_len = IPFIX_HEADER_LENGTH;
+	io[1].iov_base = (void *) (pkt->data + IPFIX_HEADER_LENGTH);
+	io[1].iov_len = pkt->len - IPFIX_HEADER_LENGTH;
 
-		if (ret != -1) {
-			// Skip successfully sent data
-			ptr  += ret;
-			todo -= ret;
-			continue;
-		}
+	// Skip already sent data (only stream sockets)
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = io;
+	msg.msg_iovlen = 2;
 
-		if (errno != EAGAIN && errno != EWOULDBLOCK) {
-			// Unexpected type of error
-			MSG_WARNING(msg_module, "Connection to \"%s:%s\" closed (%s).",
-				s->dst_addr, s->dst_port, strerror(errno));
-			sender_socket_close(s);
-			return 1;
-		}
+	size_t skip = s->offset;
+	if (skip >= io[0].iov_len) {
+		skip -= io[0].iov_len;
+		msg.msg_iov = &io[1];
+		msg.msg_iovlen = 1;
+	}
 
-		// Operation would block
-		if (mode == MODE_BLOCKING) {
-			continue;
-		}
+	msg.msg_iov[0].iov_base = ((uint8_t *) msg.msg_iov[0].iov_base) + skip;
+	msg.msg_iov[0].iov_len -= skip;
 
-		// Only non-blocking mode can get here
-		if (todo == s->buffer_valid) {
-			// Nothing was sent
+	ssize_t ret = sendmsg(s->socket_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
 			return 1;
 		}
 
-		// A part of the buffer was sent
-		memmove(s->buffer_data, ptr, todo);
-		s->buffer_valid = todo;
+		// Unexpected type of error
+		MSG_WARNING(msg_module, "Connection to \"%s:%s\" closed (%s).",
+			s->dst_addr, s->dst_port, strerror(errno));
+		return -1;
+	}
+
+	s->offset += (size_t) ret;
+	if (s->offset < pkt->len) {
+		// Only a part of the packet was sent
+		MSG_DEBUG(msg_module, "Packet partially sent (%u of %u)",
+			(unsigned int) s->offset, (unsigned int) pkt->len);
 		return 1;
 	}
 
-	s->buffer_valid = 0;
 	return 0;
 }
 
-
-/** Send data to the destination */
-enum SEND_STATUS sender_send(fwd_sender_t *s, const void *buf, size_t len,
-	enum SEND_MODE mode, bool required)
+/**
+ * \brief Prepare a batch of UDP messages from the beginning of the queue
+ * \warning The lock of the sender MUST be held.
+ * \param[in,out] s   Sender structure
+ * \param[in]     gso Merge packets of the same size into GSO messages
+ * \return Number of prepared messages
+ */
+static unsigned int sender_batch_prepare(fwd_sender_t *s, bool gso)
 {
-	// Send a content of the internal buffery (if any)
-	if (sender_send_buffer(s, mode)) {
-		if (s->socket_fd == SOCKET_INVALID) {
-			// Socket closed
-			return STATUS_CLOSED;
+	struct udp_batch *b = s->batch;
+	struct queue_item *item;
+	unsigned int msg_cnt = 0;
+	size_t seg_size = 0;    // Segment size of the last message
+	size_t msg_size = 0;    // Total size of the last message
+	bool msg_open = false;  // Another segment can be added to the last msg.
+
+	for (unsigned int i = 0; i < BATCH_PKTS; ++i) {
+		item = queue_peek(s->queue, i);
+		if (!item || item->gen != s->gen) {
+			// Empty queue or packets for the next connection
+			break;
 		}
 
-		// Still connected, but busy
-		if (!required) {
-			return STATUS_BUSY;
+		// Set the sequence number of the destination
+		const fwd_pkt_t *pkt = item->pkt;
+		uint32_t seq = htonl(item->seq);
+		memcpy(b->headers[i], pkt->data, IPFIX_HEADER_LENGTH);
+		memcpy(b->headers[i] + offsetof(struct ipfix_header, sequence_number),
+			&seq, sizeof(seq));
+
+		b->iov[2 * i].iov_base = b->headers[i];
+		b->iov[2 * i].iov_len = IPFIX_HEADER_LENGTH;
+		b->iov[2 * i + 1].iov_base = (void *) (pkt->data + IPFIX_HEADER_LENGTH);
+		b->iov[2 * i + 1].iov_len = pkt->len - IPFIX_HEADER_LENGTH;
+
+		if (msg_open && pkt->len <= seg_size
+				&& msg_size + pkt->len <= GSO_MAX_BYTES
+				&& b->pkts[msg_cnt - 1] < GSO_MAX_SEGS) {
+			// Append the packet as a segment of the last message
+			struct msghdr *hdr = &b->msgs[msg_cnt - 1].msg_hdr;
+			hdr->msg_iovlen += 2;
+			b->pkts[msg_cnt - 1]++;
+			msg_size += pkt->len;
+			// Only the last segment can be shorter
+			msg_open = (pkt->len == seg_size);
+			continue;
 		}
 
-		// Required delivery
-		if (sender_buffer_store(s, buf, len)) {
-			MSG_WARNING(msg_module, "Unable to store 'required' message for "
-				"'%s:%s' into the internal buffer. Connection must be closed to"
-				" prevent receiving invalid messages.", sender_get_address(s),
-				sender_get_port(s));
-			sender_socket_close(s);
-			return STATUS_CLOSED;
+		// New message
+		struct msghdr *hdr = &b->msgs[msg_cnt].msg_hdr;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_iov = &b->iov[2 * i];
+		hdr->msg_iovlen = 2;
+		b->pkts[msg_cnt] = 1;
+		++msg_cnt;
+
+		seg_size = pkt->len;
+		msg_size = pkt->len;
+		msg_open = gso;
+	}
+
+#ifdef UDP_SEGMENT
+	// Set the segment size of merged messages
+	for (unsigned int i = 0; gso && i < msg_cnt; ++i) {
+		if (b->pkts[i] < 2) {
+			continue;
 		}
 
-		return STATUS_OK;
+		struct msghdr *hdr = &b->msgs[i].msg_hdr;
+		hdr->msg_control = b->ctrl[i].buf;
+		hdr->msg_controllen = sizeof(b->ctrl[i].buf);
+
+		struct cmsghdr *cm = CMSG_FIRSTHDR(hdr);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		uint16_t size = (uint16_t) (hdr->msg_iov[0].iov_len
+			+ hdr->msg_iov[1].iov_len);
+		memcpy(CMSG_DATA(cm), &size, sizeof(size));
 	}
+#endif
 
-	const uint8_t *ptr = (const uint8_t *) buf;
-	size_t todo = len;
-
-	int flags = MSG_NOSIGNAL; // Never use signals
-	flags |= (mode == MODE_NON_BLOCKING) ? MSG_DONTWAIT : 0;
+	return msg_cnt;
+}
 
-	while (todo > 0) {
-		// Send
-		ssize_t ret;
-		ret = send(s->socket_fd, ptr, todo, flags);
+/**
+ * \brief Send queued packets of a UDP destination in batches
+ * \warning The lock of the sender MUST be held.
+ * \param[in,out] s Sender structure
+ * \return When all packets were sent returns 0. When the operation would
+ *   block returns a positive value. On failure returns a negative value.
+ */
+static int sender_send_batch(fwd_sender_t *s)
+{
+	struct udp_batch *b = s->batch;
 
-		if (ret != -1) {
-			// Skip successfully sent data
-			ptr  += ret;
-			todo -= ret;
-			continue;
+	while (1) {
+		unsigned int msg_cnt = sender_batch_prepare(s, s->gso);
+		if (msg_cnt == 0) {
+			return 0;
 		}
 
-		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+		int ret = sendmmsg(s->socket_fd, b->msgs, msg_cnt,
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 1;
+			}
+
+			if (s->gso && (errno == EIO || errno == EINVAL)) {
+				// Segmentation is not supported by the route/device
+				MSG_INFO(msg_module, "UDP GSO disabled for \"%s:%s\" (%s).",
+					s->dst_addr, s->dst_port, strerror(errno));
+				s->gso = false;
+				continue;
+			}
+
 			// Unexpected type of error
 			MSG_WARNING(msg_module, "Connection to \"%s:%s\" closed (%s).",
 				s->dst_addr, s->dst_port, strerror(errno));
-			sender_socket_close(s);
-			return STATUS_CLOSED;
-		}
-
-		// Operation would block
-		if (mode == MODE_BLOCKING) {
-			continue;
+			return -1;
 		}
 
-		// Only non-blocking mode can get here
-		if (todo == len && !required) {
-			// Nothing sent & not required data -> skip
-			return STATUS_BUSY;
-		}
-
-		// Required data or partially sent -> store
-		if (sender_buffer_store(s, ptr, todo)) {
-			MSG_WARNING(msg_module, "Unable to store a rest of the message for "
-				"'%s:%s̈́'. Connection must be closed to prevent receiving "
-				"invalid messages.", sender_get_address(s), sender_get_port(s));
-			sender_socket_close(s);
-			return STATUS_CLOSED;
+		// Remove sent packets (an error of the next message is reported later)
+		for (int i = 0; i < ret; ++i) {
+			for (unsigned int j = 0; j < b->pkts[i]; ++j) {
+				sender_stat_inc(&s->sent);
+				queue_pop(s->queue);
+			}
 		}
-
-		return STATUS_OK;
 	}
-
-	// The whole message was sucessfully sent
-	return STATUS_OK;
 }
 
-/** Send data to the destination */
-enum SEND_STATUS sender_send_parts(fwd_sender_t *s, struct iovec *io,
-	size_t parts, enum SEND_MODE mode, bool required)
+/** Send queued packets to the destination */
+enum FLUSH_STATUS sender_flush(fwd_sender_t *s, int *fd)
 {
-	// Send the content of the internal buffery (if any)
-	if (sender_send_buffer(s, mode)) {
-		if (s->socket_fd == SOCKET_INVALID) {
-			// Socket closed
-			return STATUS_CLOSED;
-		}
+	if (pthread_mutex_trylock(&s->lock) != 0) {
+		// The connector thread is (re)connecting the destination
+		return FLUSH_LOCKED;
+	}
 
-		// Still connected, but busy
-		if (!required) {
-			return STATUS_BUSY;
-		}
+	enum FLUSH_STATUS status = FLUSH_EMPTY;
+	struct queue_item *item;
 
-		// Required delivery
-		if (sender_buffer_store_io(s, io, parts, 0)) {
-			MSG_WARNING(msg_module, "Unable to store 'required' message for "
-				"'%s:%s' into the internal buffer. Connection must be closed to"
-				" prevent receiving invalid messages.", sender_get_address(s),
-				sender_get_port(s));
-			sender_socket_close(s);
-			return STATUS_CLOSED;
+	while ((item = queue_front(s->queue)) != NULL) {
+		if (s->socket_fd == SOCKET_INVALID || item->gen != s->gen) {
+			// Packet for a closed connection
+			sender_stat_inc(&s->lost);
+			s->offset = 0;
+			queue_pop(s->queue);
+			continue;
 		}
 
-		return STATUS_OK;
-	}
-
-	// Get length of the message
-	size_t total_len = 0;
-	for (unsigned int i = 0; i < parts; ++i) {
-		total_len += io[i].iov_len;
-	}
-
-	// Prepare the message
-	struct msghdr msg;
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = io;
-	msg.msg_iovlen = parts;
-
-	int flags = MSG_NOSIGNAL; // Never use signals
-	flags |= (mode == MODE_NON_BLOCKING) ? MSG_DONTWAIT : 0;
-
-	// Try to send
-	ssize_t ret;
-before_sendmsg:
-	ret = sendmsg(s->socket_fd, &msg, flags);
-
-	if (ret != -1) {
-		// No error
-		size_t sent = (size_t) ret;
-		if (sent == total_len) {
-			// Everything successfully sent
-			return STATUS_OK;
+		int ret = (s->batch != NULL)
+			? sender_send_batch(s)
+			: sender_send_item(s, item);
+		if (ret == 0 && s->batch != NULL) {
+			// All current packets sent (the queue may contain new ones)
+			continue;
 		}
 
-		// Only a part of the message was sent -> store the rest
-		MSG_DEBUG(msg_module, "Packet partially sent (%u of %u)",
-			(unsigned int) sent, (unsigned int) total_len);
+		if (ret > 0) {
+			// Wait until the socket is writable
+			*fd = s->socket_fd;
+			status = FLUSH_BLOCKED;
+			break;
+		}
 
-		if (sender_buffer_store_io(s, io, parts, sent)) {
-			// Failed to store the rest of the message -> disconnect
-			MSG_WARNING(msg_module, "Unable to store a rest of the message for "
-				"'%s:%s̈́'. Connection must be closed to prevent receiving "
-				"invalid messages.", sender_get_address(s), sender_get_port(s));
+		if (ret < 0) {
+			// Remaining packets will be dropped
 			sender_socket_close(s);
-			return STATUS_CLOSED;
+			continue;
 		}
 
-		return STATUS_OK;
+		sender_stat_inc(&s->sent);
+		s->offset = 0;
+		queue_pop(s->queue);
 	}
 
-	// Return value is "-1" i.e. nothing was sent
-	if (errno != EAGAIN && errno != EWOULDBLOCK) {
-		// Unexpected type of error
-		MSG_WARNING(msg_module, "Connection to \"%s:%s\" closed (%s).",
-			s->dst_addr, s->dst_port, strerror(errno));
-		sender_socket_close(s);
-		return STATUS_CLOSED;
-	}
-
-	// Nothing sent, but send operation would block
-	if (mode == MODE_BLOCKING) {
-		goto before_sendmsg;
-	}
-
-	// Only non-blocking mode can get here
-	if (!required) {
-		return STATUS_BUSY;
-	}
-
-	// Required message must be stored !!!
-	if (sender_buffer_store_io(s, io, parts, 0)) {
-		MSG_WARNING(msg_module, "Unable to send 'required' message to "
-			"'%s:%s'. Connection must be close to prevent receiving "
-			"invalid messages.", sender_get_address(s), sender_get_port(s));
-		sender_socket_close(s);
-		return STATUS_CLOSED;
-	}
+	pthread_mutex_unlock(&s->lock);
+	return status;
+}
 
-	return STATUS_OK;
+/** Get statistics of the queue */
+void sender_get_stats(const fwd_sender_t *s, struct sender_stats *stats)
+{
+	stats->depth = queue_depth(s->queue);
+	stats->depth_max = __atomic_load_n(&s->depth_max, __ATOMIC_RELAXED);
+	stats->size = queue_size(s->queue);
+	stats->sent = __atomic_load_n(&s->sent, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+	stats->lost = __atomic_load_n(&s->lost, __ATOMIC_RELAXED);
 }
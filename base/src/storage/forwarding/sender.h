@@ -50,21 +50,35 @@
 #include <sys/socket.h>
 #include <stdbool.h>
 #include <stdlib.h>
-
-/** \brief Mode of sending operation */
-enum SEND_MODE {
-	MODE_BLOCKING,        /**< Blocking send operation     */
-	MODE_NON_BLOCKING     /**< Non-blocking send operation */
-};
+#include <inttypes.h>
+#include <time.h>
+#include "queue.h"
 
 /** \brief Return status of sending operation */
 enum SEND_STATUS {
 	STATUS_INVALID,   /**< Invalid arguments                                 */
-	STATUS_OK,        /**< All data successfully sent                        */
-	STATUS_BUSY,      /**< Nothing was sent. The operation would block.      */
+	STATUS_OK,        /**< All data successfully queued                      */
+	STATUS_BUSY,      /**< Nothing was queued. The queue is full.            */
 	STATUS_CLOSED     /**< Socket is closed or broken. Use sender_connect(). */
 };
 
+/** \brief Return status of flushing of a queue */
+enum FLUSH_STATUS {
+	FLUSH_EMPTY,      /**< All queued packets sent (or dropped)              */
+	FLUSH_BLOCKED,    /**< Socket is full. Wait until it is writable.        */
+	FLUSH_LOCKED      /**< Connection is being changed. Try again later.     */
+};
+
+/** \brief Statistics of a queue of a sender */
+struct sender_stats {
+	size_t depth;          /**< Queued packets                               */
+	size_t depth_max;      /**< Max. number of queued packets                */
+	size_t size;           /**< Capacity of the queue                        */
+	uint64_t sent;         /**< Sent packets                                 */
+	uint64_t dropped;      /**< Packets dropped due to the full queue        */
+	uint64_t lost;         /**< Queued packets lost due to disconnection     */
+};
+
 /* Prototypes */
 typedef struct _fwd_sender fwd_sender_t;
 
@@ -73,9 +87,11 @@ typedef struct _fwd_sender fwd_sender_t;
  * \param[in] addr  Destination IP address
  * \param[in] port  Destination port
  * \param[in] proto Transport protocol
+ * \param[in] queue_size Max. number of queued packets
  * \return On success returns pointer to new sender. Otherwise returns NULL.
  */
-fwd_sender_t *sender_create(const char *addr, const char *port, int proto);
+fwd_sender_t *sender_create(const char *addr, const char *port, int proto,
+	size_t queue_size);
 
 /**
  * \brief Destroy a sender
@@ -128,36 +144,53 @@ void sender_set_tmpl_time(fwd_sender_t *s, time_t time);
 int sender_connect(fwd_sender_t *s);
 
 /**
- * \brief Send data to the destination
+ * \brief Close the connection
  *
- * When \p required is True and the destination is busy, record will be stored
- * into internal structures and send during next call of any sending function.
- * In this case (i.e. \p required == True) return value is never STATUS_BUSY.
+ * Packets which are still in the queue will be dropped.
  * \param[in,out] s Sender structure
- * \param[in] buf Data
- * \param[in] len Length of data
- * \param[in] mode Mode of sending operation
- * \param[in] required Required delivery
- * \return Status of the operation
  */
-enum SEND_STATUS sender_send(fwd_sender_t *s, const void *buf, size_t len,
-	enum SEND_MODE mode, bool required);
+void sender_close(fwd_sender_t *s);
 
 /**
- * \brief Send data to the destination
+ * \brief Check whether the destination is connected
  *
- * When \p required is True and the destination is busy, record will be stored
- * into internal structures and send during next call of any sending function.
- * In this case (i.e. \p required == True) return value is never STATUS_BUSY.
- * \param[in,out] s Sender structure
- * \param[in] io Array of packet parts
- * \param[in] parts Number of parts
- * \param[in] mode Mode of sending operation
- * \param[in] required Required delivery
+ * A connection can be closed by the I/O thread at any time.
+ * \param[in] s Sender structure
+ * \return True or False
+ */
+bool sender_is_connected(const fwd_sender_t *s);
+
+/**
+ * \brief Append a packet to the queue of the destination
+ *
+ * The packet is actually sent later by sender_flush() (usually by the
+ * I/O thread). The queue gets its own reference to the packet.
+ * \warning Only one thread can append packets to the queue.
+ * \param[in,out] s   Sender structure
+ * \param[in]     pkt Packet
+ * \param[in]     seq Sequence number of the packet
+ * \return Status of the operation (#STATUS_BUSY if the queue is full)
+ */
+enum SEND_STATUS sender_enqueue(fwd_sender_t *s, fwd_pkt_t *pkt, uint32_t seq);
+
+/**
+ * \brief Send queued packets to the destination (non-blocking)
+ *
+ * Packets queued for previous connections are dropped. When the connection
+ * fails, it is closed and all queued packets are dropped.
+ * \warning Only one thread can flush the queue.
+ * \param[in,out] s  Sender structure
+ * \param[out]    fd Socket to wait for (only for #FLUSH_BLOCKED)
  * \return Status of the operation
  */
-enum SEND_STATUS sender_send_parts(fwd_sender_t *s, struct iovec *io,
-	size_t parts, enum SEND_MODE mode, bool required);
+enum FLUSH_STATUS sender_flush(fwd_sender_t *s, int *fd);
+
+/**
+ * \brief Get statistics of the queue
+ * \param[in]  s     Sender structure
+ * \param[out] stats Statistics
+ */
+void sender_get_stats(const fwd_sender_t *s, struct sender_stats *stats);
 
 #endif // SENDER_H
 
@@ -57,16 +57,21 @@
 #include <errno.h>
 #include <libgen.h>
 #include <ctype.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
 #include <time.h>
 
 #include "ipfixcol.h"
+#include "ipfix_writer.h"
 
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
+/** Default size of the buffer of messages (in KiB) */
+#define DEF_BUFFER_SIZE (1024)
+
 /** Identifier to MSG_* macros */
 static char *msg_module = "ipfix storage";
 
@@ -76,65 +81,367 @@ static char *msg_module = "ipfix storage";
  * \brief IPFIX storage plugin specific "config" structure
  */
 struct ipfix_config {
-	int fd;                     /**< file descriptor of an output file */
+	ipfix_writer_t *writer;     /**< writer of output files */
 	uint32_t fcounter;          /**< number of created files */
 	uint64_t bcounter;          /**< bytes written into a current output
 	                             * file */
 	xmlChar *xml_file;          /**< URI from XML configuration file */
 	char *file;                 /**< actual path where to store messages */
+	char *path;                 /**< path template (strftime sequences) */
+	const char *suffix;         /**< suffix of compressed files */
+
+	uint32_t window_size;       /**< time window of a file (0 = infinite) */
+	int window_align;           /**< align windows to multiples of the size */
+	time_t window_start;        /**< start of the current window */
+	uint64_t size_limit;        /**< max. size of a file (0 = unlimited) */
+	uint32_t name_cnt;          /**< files with the same name in a window */
 };
 
+/**
+ * \brief Create all directories of a path to a file
+ *
+ * \param[in] file  path to a file
+ * \return  0 on success, negative value otherwise.
+ */
+static int create_directories(const char *file)
+{
+	char tmp[PATH_MAX];
+	strncpy_safe(tmp, file, sizeof(tmp));
+
+	char *dir = dirname(tmp);
+	for (char *p = dir + 1; *p != '\0'; ++p) {
+		if (*p != '/') {
+			continue;
+		}
+
+		*p = '\0';
+		if (mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == -1
+				&& errno != EEXIST) {
+			MSG_ERROR(msg_module, "Unable to create directory '%s' (%s)",
+				dir, strerror(errno));
+			return -1;
+		}
+		*p = '/';
+	}
+
+	if (mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == -1
+			&& errno != EEXIST) {
+		MSG_ERROR(msg_module, "Unable to create directory '%s' (%s)",
+			dir, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Create a name of a new output file
+ *
+ * Time specifiers in the path template are replaced using strftime() and
+ * a timestamp of the file is appended (e.g. "/path/to/file.1109131509").
+ * Files created during one second get another suffix "_<number>".
+ *
+ * \param[in,out] conf  output plugin config structure
+ * \param[in] start  start time of the file
+ * \return  0 on success, negative value otherwise.
+ */
+static int create_file_name(struct ipfix_config *config, time_t start)
+{
+	char name[PATH_MAX];
+	struct tm tm;
+	size_t len;
+
+	memset(&tm, 0, sizeof(tm));
+	localtime_r(&start, &tm);
+
+	len = strftime(name, sizeof(name) - 32, config->path, &tm);
+	if (len == 0) {
+		MSG_ERROR(msg_module, "Unable to create the name of output file");
+		return -1;
+	}
+
+	/* add timestamp at the end of the file name */
+	strftime(name + len, 14, ".%y%m%d%H%M%S", &tm);
+	len = strlen(name);
+
+	if (config->file && strncmp(config->file, name, len) == 0
+			&& (config->file[len] == '\0' || config->file[len] == '_'
+			|| config->file[len] == '.')) {
+		/* the same time as the previous file */
+		config->name_cnt += 1;
+		snprintf(name + len, 12, "_%u", config->name_cnt);
+		len = strlen(name);
+	} else {
+		config->name_cnt = 0;
+	}
+
+	snprintf(name + len, sizeof(name) - len, "%s", config->suffix);
+
+	char *new_file = strdup(name);
+	if (new_file == NULL) {
+		MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__, __LINE__);
+		return -1;
+	}
+
+	free(config->file);
+	config->file = new_file;
+	return 0;
+}
 
 /**
  * \brief Open/create output file
  *
  * \param[in] conf  output plugin config structure
+ * \param[in] start  start time of the file
  * \return  0 on success, negative value otherwise.
  */
-static int prepare_output_file(struct ipfix_config *config)
+static int prepare_output_file(struct ipfix_config *config, time_t start)
 {
-	int fd;
+	if (create_file_name(config, start) || create_directories(config->file)) {
+		return -1;
+	}
 
 	/* file counter */
 	config->fcounter += 1;
 	/* byte counter */
 	config->bcounter = 0;
 
-
-	fd = open(config->file, O_WRONLY | O_CREAT | O_TRUNC,
-	          S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd == -1) {
+	if (writer_open(config->writer, config->file)) {
 		config->fcounter -= 1;
 		MSG_ERROR(msg_module, "Unable to open output file");
 		return -1;
 	}
 
-	config->fd = fd;
-
+	MSG_DEBUG(msg_module, "New output file: %s", config->file);
 	return 0;
 }
 
 /**
  * \brief Close output file
  *
+ * Empty files are removed.
+ *
  * \param[in] conf  output plugin config structure
  * \return  0 on success, negative value otherwise
  */
 static int close_output_file(struct ipfix_config *config)
 {
-	int ret;
+	if (writer_fd(config->writer) == -1) {
+		return 0;
+	}
 
-	ret = close(config->fd);
-	if (ret == -1) {
+	int ret = writer_close(config->writer);
+	if (ret) {
 		MSG_ERROR(msg_module, "Error when closing output file");
+	}
+
+	if (config->bcounter == 0) {
+		/* current output file is empty, get rid of it */
+		unlink(config->file);
+	}
+
+	return (ret == 0) ? 0 : -1;
+}
+
+/**
+ * \brief Get start of a time window
+ *
+ * \param[in] conf  output plugin config structure
+ * \param[in] now  current time
+ * \return  start of the window
+ */
+static time_t window_start(const struct ipfix_config *config, time_t now)
+{
+	if (config->window_size == 0 || !config->window_align) {
+		return now;
+	}
+
+	return (now / config->window_size) * config->window_size;
+}
+
+/**
+ * \brief Replace the output file if its window or size limit is exceeded
+ *
+ * \param[in] conf  output plugin config structure
+ * \param[in] len  length of the next message
+ * \return  0 on success, negative value otherwise
+ */
+static int rotate_output_file(struct ipfix_config *config, uint16_t len)
+{
+	time_t now = time(NULL);
+	time_t start;
+
+	if (config->window_size > 0
+			&& now >= config->window_start + (time_t) config->window_size) {
+		/* new time window */
+		start = window_start(config, now);
+		config->window_start = start;
+	} else if (config->size_limit > 0 && config->bcounter > 0
+			&& config->bcounter + len > config->size_limit) {
+		/* size limit exceeded, continue in the same window */
+		start = now;
+	} else if (writer_fd(config->writer) == -1) {
+		/* previous attempt to create a file failed */
+		start = now;
+	} else {
+		return 0;
+	}
+
+	close_output_file(config);
+	return prepare_output_file(config, start);
+}
+
+/**
+ * \brief Parse a non-negative integer value of a node
+ *
+ * \param[in] doc  XML document
+ * \param[in] node  XML node
+ * \param[out] res  parsed value
+ * \return  0 on success, negative value otherwise
+ */
+static int parse_uint(xmlDocPtr doc, xmlNodePtr node, uint64_t *res)
+{
+	xmlChar *str = xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+	if (str == NULL) {
 		return -1;
 	}
 
-	config->fd = -1;
+	char *end_ptr;
+	errno = 0;
+	unsigned long long value = strtoull((char *) str, &end_ptr, 10);
+	int ret = (errno != 0 || *end_ptr != '\0' || end_ptr == (char *) str
+		|| str[0] == '-') ? -1 : 0;
+	xmlFree(str);
+
+	*res = value;
+	return ret;
+}
+
+/**
+ * \brief Parse a configuration of rotation by time
+ *
+ * \param[in] doc  XML document
+ * \param[in] cur  dumpInterval node
+ * \param[out] conf  output plugin config structure
+ * \return  0 on success, negative value otherwise
+ */
+static int parse_dump_interval(xmlDocPtr doc, xmlNodePtr cur,
+	struct ipfix_config *conf)
+{
+	uint64_t value;
+
+	for (cur = cur->xmlChildrenNode; cur != NULL; cur = cur->next) {
+		if (!xmlStrcmp(cur->name, (const xmlChar *) "timeWindow")) {
+			if (parse_uint(doc, cur, &value) || value > UINT32_MAX) {
+				MSG_ERROR(msg_module, "Element \"timeWindow\": invalid value");
+				return -1;
+			}
+			conf->window_size = (uint32_t) value;
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "timeAlignment")) {
+			xmlChar *str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			conf->window_align = (str != NULL
+				&& (!xmlStrcasecmp(str, (const xmlChar *) "yes")
+				|| !xmlStrcmp(str, (const xmlChar *) "1")));
+			xmlFree(str);
+		}
+	}
 
 	return 0;
 }
 
+/**
+ * \brief Parse plugin configuration
+ *
+ * \param[in] doc  XML document
+ * \param[out] conf  output plugin config structure
+ * \param[out] buffer_size  size of the buffer (in bytes)
+ * \param[out] comp  compression method
+ * \param[out] level  compression level
+ * \return  0 on success, negative value otherwise
+ */
+static int parse_config(xmlDocPtr doc, struct ipfix_config *conf,
+	size_t *buffer_size, enum WRITER_COMP *comp, int *level)
+{
+	xmlNodePtr cur;
+	uint64_t value;
+
+	cur = xmlDocGetRootElement(doc);
+	if (cur == NULL) {
+		MSG_ERROR(msg_module, "Empty configuration");
+		return -1;
+	}
+	if (xmlStrcmp(cur->name, (const xmlChar *) "fileWriter")) {
+		MSG_ERROR(msg_module, "Root node != fileWriter");
+		return -1;
+	}
+
+	for (cur = cur->xmlChildrenNode; cur != NULL; cur = cur->next) {
+		if (!xmlStrcmp(cur->name, (const xmlChar *) "file")) {
+			/* find out where to store output files */
+			xmlFree(conf->xml_file);
+			conf->xml_file = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "dumpInterval")) {
+			if (parse_dump_interval(doc, cur, conf)) {
+				return -1;
+			}
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "sizeLimit")) {
+			/* in MiB */
+			if (parse_uint(doc, cur, &value) || value > (UINT64_MAX >> 20)) {
+				MSG_ERROR(msg_module, "Element \"sizeLimit\": invalid value");
+				return -1;
+			}
+			conf->size_limit = value << 20;
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "bufferSize")) {
+			/* in KiB */
+			if (parse_uint(doc, cur, &value) || value < 64
+					|| value > (SIZE_MAX >> 10)) {
+				MSG_ERROR(msg_module, "Element \"bufferSize\": invalid value "
+					"(min. 64 KiB)");
+				return -1;
+			}
+			*buffer_size = (size_t) value << 10;
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "compression")) {
+			xmlChar *str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (str == NULL || !xmlStrcasecmp(str, (const xmlChar *) "none")) {
+				*comp = WRITER_COMP_NONE;
+			} else if (!xmlStrcasecmp(str, (const xmlChar *) "lz4")) {
+				*comp = WRITER_COMP_LZ4;
+			} else if (!xmlStrcasecmp(str, (const xmlChar *) "zstd")) {
+				*comp = WRITER_COMP_ZSTD;
+			} else {
+				MSG_ERROR(msg_module, "Element \"compression\": unknown method "
+					"\"%s\"", (char *) str);
+				xmlFree(str);
+				return -1;
+			}
+			xmlFree(str);
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "compressionLevel")) {
+			if (parse_uint(doc, cur, &value) || value > 22) {
+				MSG_ERROR(msg_module, "Element \"compressionLevel\": invalid "
+					"value");
+				return -1;
+			}
+			*level = (int) value;
+		}
+	}
+
+	/* check whether we have found "file" element in configuration file */
+	if (conf->xml_file == NULL) {
+		MSG_ERROR(msg_module, "Configuration file doesn't specify where "
+		                        "to store output files (\"file\" element "
+								"is missing)");
+		return -1;
+	}
+
+	/* we only support local files */
+	if (strncmp((char *) conf->xml_file, "file:", 5)) {
+		MSG_ERROR(msg_module, "Element \"file\": invalid URI - "
+								"only allowed scheme is \"file:\"");
+		return -1;
+	}
+
+	return 0;
+}
 
 /*
  * * * * * Storage Plugin API implementation
@@ -154,20 +461,19 @@ static int close_output_file(struct ipfix_config *config)
 int storage_init(char *params, void **config)
 {
 	struct ipfix_config *conf;
-
 	xmlDocPtr doc;
-	xmlNodePtr cur;
 
-	time_t t;
-	struct tm tm;
+	size_t buffer_size = DEF_BUFFER_SIZE << 10;
+	enum WRITER_COMP comp = WRITER_COMP_NONE;
+	int level = 0;
 
  	/* allocate space for config structure */
-	conf = (struct ipfix_config *) malloc(sizeof(*conf));
+	conf = (struct ipfix_config *) calloc(1, sizeof(*conf));
 	if (conf == NULL) {
 		MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__, __LINE__);
 		return -1;
 	}
-	memset(conf, '\0', sizeof(*conf));
+	conf->window_align = 1;
 
 	/* try to parse configuration file */
 	doc = xmlReadMemory(params, strlen(params), "nobase.xml", NULL, 0);
@@ -175,65 +481,36 @@ int storage_init(char *params, void **config)
 		MSG_ERROR(msg_module, "Plugin configuration not parsed successfully");
 		goto err_init;
 	}
-	cur = xmlDocGetRootElement(doc);
-	if (cur == NULL) {
-		MSG_ERROR(msg_module, "Empty configuration");
-		goto err_init;
-	}
-	if (xmlStrcmp(cur->name, (const xmlChar *) "fileWriter")) {
-		MSG_ERROR(msg_module, "Root node != fileWriter");
+
+	if (parse_config(doc, conf, &buffer_size, &comp, &level)) {
+		xmlFreeDoc(doc);
 		goto err_init;
 	}
-	cur = cur->xmlChildrenNode;
-	while (cur != NULL) {
-		/* find out where to store output files */
-		if ((!xmlStrcmp(cur->name, (const xmlChar *) "file"))) {
-			conf->xml_file = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-			break;
-		}
-		cur = cur->next;
-	}
 
-	/* check whether we have found "file" element in configuration file */
-	if (conf->xml_file == NULL) {
-		MSG_ERROR(msg_module, "Configuration file doesn't specify where "
-		                        "to store output files (\"file\" element "
-								"is missing)");
-		goto err_init;
+	/* we don't need this xml tree anymore */
+	xmlFreeDoc(doc);
+
+	if (!writer_comp_available(comp)) {
+		MSG_WARNING(msg_module, "Compression method is not supported by this "
+			"build. Files will not be compressed.");
+		comp = WRITER_COMP_NONE;
 	}
 
-	/* we only support local files */
-	if (strncmp((char *) conf->xml_file, "file:", 5)) {
-		MSG_ERROR(msg_module, "Element \"file\": invalid URI - "
-								"only allowed scheme is \"file:\"");
+	conf->suffix = (comp == WRITER_COMP_LZ4) ? ".lz4"
+		: (comp == WRITER_COMP_ZSTD) ? ".zst" : "";
+
+	/* copy file path, skip "file:" at the beginning of the URI */
+	conf->path = strdup((char *) conf->xml_file + 5);
+	conf->writer = writer_create(comp, level, buffer_size);
+	if (conf->path == NULL || conf->writer == NULL) {
+		MSG_ERROR(msg_module, "Unable to initialize the writer");
 		goto err_init;
 	}
 
-	/* output file path + timestamp */
-	uint16_t path_len = strlen((char *) conf->xml_file) + 13;
-	conf->file = (char *) malloc(path_len);
-	if (conf->file == NULL) {
-		MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__, __LINE__);
+	conf->window_start = window_start(conf, time(NULL));
+	if (prepare_output_file(conf, conf->window_start)) {
 		goto err_init;
 	}
-	memset(conf->file, 0, path_len);
-
-	/* copy file path, skip "file:" at the beginning of the URI */
-	strncpy_safe(conf->file, (char *) conf->xml_file + 5, path_len);
-
-	/* add timestamp at the end of the file name */
-	memset(&tm, 0, sizeof(tm));
-	t = time(NULL);
-
-	localtime_r(&t, &tm);
-
-	strftime(conf->file+strlen((char *) conf->file), 14, ".%y%m%d%H%M%S", &tm);
-	/* conf->file now looks like: "/path/to/file.1109131509" */
-
-	prepare_output_file(conf);
-
-	/* we don't need this xml tree anymore */
-	xmlFreeDoc(doc);
 
 	*config = conf;
 
@@ -241,6 +518,10 @@ int storage_init(char *params, void **config)
 
 
 err_init:
+	writer_destroy(conf->writer);
+	xmlFree(conf->xml_file);
+	free(conf->path);
+	free(conf->file);
 	free(conf);
 	return -1;
 }
@@ -259,31 +540,21 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
                  const struct ipfix_template_mgr *template_mgr)
 {
 	(void) template_mgr;
-	ssize_t count = 0;
-	uint16_t wbytes = 0;
 	struct ipfix_config *conf;
 	conf = (struct ipfix_config *) config;
+	uint16_t len = ntohs(ipfix_msg->pkt_header->length);
 
-	/* write IPFIX message into an output file */
-	while (wbytes < ntohs(ipfix_msg->pkt_header->length)) {
-		count = write(conf->fd, (ipfix_msg->pkt_header)+wbytes,
-		              ntohs(ipfix_msg->pkt_header->length)-wbytes);
-		if (count == -1) {
-			if (errno == EINTR) {
-				/* interrupted by signal, try again */
-				break;
-			} else {
-				/* serious error occurs */
-				MSG_ERROR(msg_module, "Error while writing into the "
-				                        "output file");
-				return -1;
-			}
-		} else {
-			wbytes += count;
-		}
+	if (rotate_output_file(conf, len)) {
+		return -1;
+	}
+
+	/* append IPFIX message into the buffer of the output file */
+	if (writer_write(conf->writer, ipfix_msg->pkt_header, len)) {
+		MSG_ERROR(msg_module, "Error while writing into the output file");
+		return -1;
 	}
 
-	conf->bcounter += wbytes;
+	conf->bcounter += len;
 
 	return 0;
 }
@@ -301,7 +572,13 @@ int store_now(const void *config)
 	struct ipfix_config *conf;
 	conf = (struct ipfix_config *) config;
 
-	fsync(conf->fd);
+	if (writer_flush(conf->writer)) {
+		return -1;
+	}
+
+	if (writer_fd(conf->writer) != -1) {
+		fsync(writer_fd(conf->writer));
+	}
 
 	return 0;
 }
@@ -322,13 +599,10 @@ int storage_close(void **config)
 	conf = (struct ipfix_config *) *config;
 
 	close_output_file(conf);
-
-	if (conf->bcounter == 0) {
-		/* current output file is empty, get rid of it */
-		unlink(conf->file);
-	}
+	writer_destroy(conf->writer);
 
 	xmlFree(conf->xml_file);
+	free(conf->path);
 	free(conf->file);
 	free(conf);
 
@@ -338,4 +612,3 @@ int storage_close(void **config)
 }
 
 /**@}*/
-
@@ -0,0 +1,438 @@
+/**
+ * \file src/storage/ipfix/ipfix_writer.c
+ * \brief Buffered writer of IPFIX files
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <ipfixcol.h>
+#include <ipfixcol/ipfix_file.h>
+#include "ipfix_writer.h"
+
+/** Minimal size of the buffer (max. size of an IPFIX message) */
+#define WRITER_MIN_SIZE (65536)
+/** Initial size of the index (number of frames) */
+#define WRITER_IDX_SIZE (64)
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "ipfix storage";
+
+/** \brief Writer of IPFIX files */
+struct ipfix_writer {
+	enum WRITER_COMP comp;        /**< Compression method                    */
+	int level;                    /**< Compression level                     */
+	int fd;                       /**< Output file                           */
+	uint64_t size;                /**< Written IPFIX messages (bytes)        */
+
+	uint8_t *buffer;              /**< Buffered IPFIX messages               */
+	size_t buffer_size;           /**< Size of the buffer                    */
+	size_t buffer_len;            /**< Used part of the buffer               */
+
+	uint8_t *comp_buffer;         /**< Compressed frame                      */
+	size_t comp_size;             /**< Size of the compressed frame buffer   */
+	struct ipfix_file_frame frame;/**< Index entry of the buffered frame     */
+
+	struct ipfix_file_frame *idx; /**< Index of written frames (LE)          */
+	size_t idx_cnt;               /**< Number of written frames              */
+	size_t idx_max;               /**< Size of the index                     */
+
+#ifdef HAVE_LZ4
+	LZ4F_preferences_t lz4_prefs; /**< LZ4 frame parameters                  */
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zstd;              /**< zstd context                          */
+#endif
+};
+
+/**
+ * \brief Write whole buffer into a file
+ * \param[in] fd   File descriptor
+ * \param[in] data Data
+ * \param[in] len  Size of the data
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int writer_write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, data, len);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				/* interrupted by signal, try again */
+				continue;
+			}
+
+			MSG_ERROR(msg_module, "Error while writing into the output file "
+				"(%s)", strerror(errno));
+			return 1;
+		}
+
+		data += ret;
+		len -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+/* Check whether a compression method is available */
+int writer_comp_available(enum WRITER_COMP comp)
+{
+	switch (comp) {
+	case WRITER_COMP_NONE:
+		return 1;
+#ifdef HAVE_LZ4
+	case WRITER_COMP_LZ4:
+		return 1;
+#endif
+#ifdef HAVE_ZSTD
+	case WRITER_COMP_ZSTD:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* Create a writer */
+ipfix_writer_t *writer_create(enum WRITER_COMP comp, int level, size_t size)
+{
+	if (!writer_comp_available(comp)) {
+		MSG_ERROR(msg_module, "Compression method is not supported by this "
+			"build");
+		return NULL;
+	}
+
+	ipfix_writer_t *writer = calloc(1, sizeof(*writer));
+	if (!writer) {
+		MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	writer->comp = comp;
+	writer->level = level;
+	writer->fd = -1;
+	writer->buffer_size = (size < WRITER_MIN_SIZE) ? WRITER_MIN_SIZE : size;
+	writer->buffer = malloc(writer->buffer_size);
+
+	switch (comp) {
+#ifdef HAVE_LZ4
+	case WRITER_COMP_LZ4:
+		// Checksums let the reader recognize damaged frames
+		writer->lz4_prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+		writer->lz4_prefs.frameInfo.contentChecksumFlag =
+			LZ4F_contentChecksumEnabled;
+		writer->lz4_prefs.compressionLevel = level;
+		writer->comp_size = LZ4F_compressFrameBound(writer->buffer_size,
+			&writer->lz4_prefs);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case WRITER_COMP_ZSTD:
+		writer->comp_size = ZSTD_compressBound(writer->buffer_size);
+		writer->zstd = ZSTD_createCCtx();
+		if (!writer->zstd) {
+			writer_destroy(writer);
+			return NULL;
+		}
+
+		// Checksums let the reader recognize damaged frames
+		ZSTD_CCtx_setParameter(writer->zstd, ZSTD_c_compressionLevel,
+			(level != 0) ? level : 3);
+		ZSTD_CCtx_setParameter(writer->zstd, ZSTD_c_checksumFlag, 1);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (writer->comp_size > 0) {
+		writer->comp_buffer = malloc(writer->comp_size);
+	}
+
+	if (!writer->buffer || (writer->comp_size > 0 && !writer->comp_buffer)) {
+		MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__, __LINE__);
+		writer_destroy(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+/* Destroy a writer */
+void writer_destroy(ipfix_writer_t *writer)
+{
+	if (!writer) {
+		return;
+	}
+
+	writer_close(writer);
+#ifdef HAVE_ZSTD
+	ZSTD_freeCCtx(writer->zstd);
+#endif
+	free(writer->comp_buffer);
+	free(writer->buffer);
+	free(writer->idx);
+	free(writer);
+}
+
+/* Create a new output file */
+int writer_open(ipfix_writer_t *writer, const char *path)
+{
+	if (writer->fd != -1) {
+		MSG_ERROR(msg_module, "Output file is already opened");
+		return 1;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC,
+	              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd == -1) {
+		MSG_ERROR(msg_module, "Unable to open output file '%s' (%s)", path,
+			strerror(errno));
+		return 1;
+	}
+
+	writer->fd = fd;
+	writer->size = 0;
+	writer->buffer_len = 0;
+	writer->idx_cnt = 0;
+	memset(&writer->frame, 0, sizeof(writer->frame));
+	return 0;
+}
+
+/**
+ * \brief Compress the buffer into one frame
+ * \param[in,out] writer Writer
+ * \return On success returns size of the frame. Otherwise returns 0.
+ */
+static size_t writer_compress(ipfix_writer_t *writer)
+{
+	size_t ret = 0;
+
+	switch (writer->comp) {
+#ifdef HAVE_LZ4
+	case WRITER_COMP_LZ4: {
+		LZ4F_preferences_t *prefs = &writer->lz4_prefs;
+		prefs->frameInfo.contentSize = writer->buffer_len;
+
+		ret = LZ4F_compressFrame(writer->comp_buffer, writer->comp_size,
+			writer->buffer, writer->buffer_len, prefs);
+		if (LZ4F_isError(ret)) {
+			MSG_ERROR(msg_module, "LZ4 compression failed (%s)",
+				LZ4F_getErrorName(ret));
+			return 0;
+		}
+		}
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case WRITER_COMP_ZSTD:
+		ret = ZSTD_compress2(writer->zstd, writer->comp_buffer,
+			writer->comp_size, writer->buffer, writer->buffer_len);
+		if (ZSTD_isError(ret)) {
+			MSG_ERROR(msg_module, "zstd compression failed (%s)",
+				ZSTD_getErrorName(ret));
+			return 0;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Append an entry of a written frame to the index
+ * \param[in,out] writer Writer
+ * \param[in]     frame  Entry
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int writer_idx_add(ipfix_writer_t *writer,
+	const struct ipfix_file_frame *frame)
+{
+	if (writer->idx_cnt == writer->idx_max) {
+		size_t new_max = (writer->idx_max > 0)
+			? 2 * writer->idx_max : WRITER_IDX_SIZE;
+		struct ipfix_file_frame *new_idx = realloc(writer->idx,
+			new_max * sizeof(*new_idx));
+		if (!new_idx) {
+			MSG_ERROR(msg_module, "Not enough memory (%s:%d)", __FILE__,
+				__LINE__);
+			return 1;
+		}
+
+		writer->idx = new_idx;
+		writer->idx_max = new_max;
+	}
+
+	struct ipfix_file_frame *entry = &writer->idx[writer->idx_cnt++];
+	entry->comp_size = htole32(frame->comp_size);
+	entry->data_size = htole32(frame->data_size);
+	entry->msg_cnt = htole32(frame->msg_cnt);
+	entry->export_time = htole32(frame->export_time);
+	return 0;
+}
+
+/* Write buffered messages into the file */
+int writer_flush(ipfix_writer_t *writer)
+{
+	if (writer->fd == -1 || writer->buffer_len == 0) {
+		return 0;
+	}
+
+	int ret;
+	if (writer->comp == WRITER_COMP_NONE) {
+		ret = writer_write_all(writer->fd, writer->buffer, writer->buffer_len);
+	} else {
+		size_t size = writer_compress(writer);
+		ret = (size == 0);
+		if (!ret) {
+			ret = writer_write_all(writer->fd, writer->comp_buffer, size);
+		}
+
+		if (!ret) {
+			writer->frame.comp_size = (uint32_t) size;
+			writer->frame.data_size = (uint32_t) writer->buffer_len;
+			ret = writer_idx_add(writer, &writer->frame);
+		}
+	}
+
+	// Messages are dropped even on failure (the file is probably broken)
+	writer->buffer_len = 0;
+	memset(&writer->frame, 0, sizeof(writer->frame));
+	return ret;
+}
+
+/* Append an IPFIX message */
+int writer_write(ipfix_writer_t *writer, const void *msg, uint16_t len)
+{
+	if (writer->fd == -1) {
+		return 1;
+	}
+
+	if (writer->buffer_len + len > writer->buffer_size) {
+		if (writer_flush(writer)) {
+			return 1;
+		}
+	}
+
+	if (writer->frame.msg_cnt == 0) {
+		// Export time of the first message in the frame
+		const struct ipfix_header *hdr = msg;
+		writer->frame.export_time = ntohl(hdr->export_time);
+	}
+
+	memcpy(writer->buffer + writer->buffer_len, msg, len);
+	writer->buffer_len += len;
+	writer->frame.msg_cnt++;
+	writer->size += len;
+	return 0;
+}
+
+/**
+ * \brief Write the index of frames
+ * \param[in,out] writer Writer
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int writer_idx_write(ipfix_writer_t *writer)
+{
+	size_t entries = writer->idx_cnt * sizeof(*writer->idx);
+	struct ipfix_file_footer footer;
+	uint32_t header[2];
+
+	header[0] = htole32(IPFIX_FILE_SKIP_MAGIC);
+	header[1] = htole32((uint32_t) (entries + sizeof(footer)));
+	footer.frame_cnt = htole32((uint32_t) writer->idx_cnt);
+	footer.version = htole32(IPFIX_FILE_IDX_VERSION);
+	footer.magic = htole32(IPFIX_FILE_IDX_MAGIC);
+
+	if (writer_write_all(writer->fd, (uint8_t *) header, sizeof(header))
+			|| writer_write_all(writer->fd, (uint8_t *) writer->idx, entries)
+			|| writer_write_all(writer->fd, (uint8_t *) &footer,
+				sizeof(footer))) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Flush buffered messages, write the index and close the file */
+int writer_close(ipfix_writer_t *writer)
+{
+	if (writer->fd == -1) {
+		return 0;
+	}
+
+	int ret = writer_flush(writer);
+	if (writer->comp != WRITER_COMP_NONE && writer->idx_cnt > 0
+			&& writer_idx_write(writer)) {
+		ret = 1;
+	}
+
+	if (close(writer->fd) == -1) {
+		MSG_ERROR(msg_module, "Error when closing output file");
+		ret = 1;
+	}
+
+	writer->fd = -1;
+	return ret;
+}
+
+/* Get a file descriptor of the opened file */
+int writer_fd(const ipfix_writer_t *writer)
+{
+	return writer->fd;
+}
+
+/* Get a size of IPFIX messages written to the opened file */
+uint64_t writer_size(const ipfix_writer_t *writer)
+{
+	return writer->size;
+}
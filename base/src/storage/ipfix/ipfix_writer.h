@@ -0,0 +1,136 @@
+/**
+ * \file src/storage/ipfix/ipfix_writer.h
+ * \brief Buffered writer of IPFIX files (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef IPFIX_WRITER_H
+#define IPFIX_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup ipfixWriter Buffered writer of IPFIX files
+ * \ingroup ipfixFileFormat
+ *
+ * IPFIX messages are collected in a large buffer. A full buffer is written
+ * by one write() call or compressed into one frame (see ipfixcol/ipfix_file.h).
+ *
+ * @{
+ */
+
+/** Compression of an output file */
+enum WRITER_COMP {
+	WRITER_COMP_NONE,       /**< Plain IPFIX messages                    */
+	WRITER_COMP_LZ4,        /**< LZ4 frames                              */
+	WRITER_COMP_ZSTD        /**< zstd frames                             */
+};
+
+// Structure prototype
+typedef struct ipfix_writer ipfix_writer_t;
+
+/**
+ * \brief Check whether a compression method is available
+ * \param[in] comp Compression method
+ * \return True or false
+ */
+int writer_comp_available(enum WRITER_COMP comp);
+
+/**
+ * \brief Create a writer
+ * \param[in] comp  Compression method
+ * \param[in] level Compression level (0 = default of the method)
+ * \param[in] size  Size of the buffer (min. 64 KiB)
+ * \return Pointer or NULL
+ */
+ipfix_writer_t *writer_create(enum WRITER_COMP comp, int level, size_t size);
+
+/**
+ * \brief Destroy a writer (an opened file is closed)
+ * \param[in,out] writer Writer
+ */
+void writer_destroy(ipfix_writer_t *writer);
+
+/**
+ * \brief Create a new output file
+ * \param[in,out] writer Writer (without an opened file)
+ * \param[in]     path   Path of the file
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int writer_open(ipfix_writer_t *writer, const char *path);
+
+/**
+ * \brief Append an IPFIX message
+ * \param[in,out] writer Writer
+ * \param[in]     msg    IPFIX message
+ * \param[in]     len    Length of the message
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int writer_write(ipfix_writer_t *writer, const void *msg, uint16_t len);
+
+/**
+ * \brief Write buffered messages into the file
+ *
+ * For compressed files, the buffered messages form a new frame.
+ * \param[in,out] writer Writer
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int writer_flush(ipfix_writer_t *writer);
+
+/**
+ * \brief Flush buffered messages, write the index and close the file
+ * \param[in,out] writer Writer
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int writer_close(ipfix_writer_t *writer);
+
+/**
+ * \brief Get a file descriptor of the opened file
+ * \param[in] writer Writer
+ * \return File descriptor or -1
+ */
+int writer_fd(const ipfix_writer_t *writer);
+
+/**
+ * \brief Get a size of IPFIX messages written to the opened file
+ * \param[in] writer Writer
+ * \return Size in bytes (uncompressed)
+ */
+uint64_t writer_size(const ipfix_writer_t *writer);
+
+/**@}*/
+
+#endif /* IPFIX_WRITER_H */
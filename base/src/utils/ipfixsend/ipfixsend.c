@@ -55,12 +55,13 @@
 #include "ipfixsend.h"
 #include "reader.h"
 #include "sender.h"
+#include "replay.h"
 
 #ifdef HAVE_SCTP
 #include <netinet/sctp.h>
 #endif
 
-#define OPTSTRING "hci:d:p:t:n:s:S:R:"
+#define OPTSTRING "hci:d:p:t:n:s:S:R:T:E:O:"
 #define DEFAULT_IP "127.0.0.1"
 #define DEFAULT_PORT "4739"
 #define DEFAULT_TYPE "UDP"
@@ -100,6 +101,11 @@ void usage()
 	printf("  -S packets Speed limit in packets/s\n");
 	printf("  -R num     Real-time sending\n");
 	printf("             Allow speed-up sending 'num' times (realtime: 1.0)\n");
+	printf("  -T num     Number of sending threads (UDP or TCP, default: 1)\n");
+	printf("  -E num     Number of emulated exporters, each with its own socket\n");
+	printf("             (default: number of threads)\n");
+	printf("  -O odid    Rewrite ODIDs of exporters, the first one is 'odid'\n");
+	printf("             Speed limits of more threads/exporters apply to the sum\n");
 	printf("\n");
 }
 
@@ -107,6 +113,7 @@ void handler(int signal)
 {
 	(void) signal; // skip compiler warning
 	sender_stop();
+	replay_stop();
 	stop = 1;
 }
 
@@ -125,6 +132,9 @@ int main(int argc, char** argv)
 	int     packets_s = 0;
 	double  realtime_s = 0.0;
 	bool    precache = false;
+	int     threads = 1;
+	int     exporters = 0;
+	char   *odid = NULL;
 
 	if (argc == 1) {
 		usage();
@@ -165,6 +175,15 @@ int main(int argc, char** argv)
 		case 'R':
 			realtime_s = atof(optarg);
 			break;
+		case 'T':
+			threads = atoi(optarg);
+			break;
+		case 'E':
+			exporters = atoi(optarg);
+			break;
+		case 'O':
+			odid = optarg;
+			break;
 		default:
 			fprintf(stderr, "Unknown option.\n");
 			return 1;
@@ -193,10 +212,68 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (threads < 1 || exporters < 0) {
+		fprintf(stderr, "Invalid number of threads or exporters.\n");
+		return 1;
+	}
+
+	if (exporters == 0) {
+		exporters = threads;
+	}
+
 	/* Check whether everything is set */
 	CHECK_SET(input, "Input file");
 	signal(SIGINT, handler);
 
+	if (threads > 1 || exporters > 1 || odid) {
+		/* Replay engine */
+		if (realtime_s > 0.0) {
+			fprintf(stderr, "Real-time sending is not supported by more "
+				"threads/exporters.\n");
+			return 1;
+		}
+
+		if (threads > exporters) {
+			threads = exporters;
+		}
+
+		struct replay_conf conf = {
+			.ip = ip, .port = port, .type = type,
+			.threads = threads, .exporters = exporters, .loops = loops,
+			.packets_s = packets_s, .bytes_s = 0,
+			.odid_rewrite = (odid != NULL),
+			.odid_base = odid ? strtoul(odid, NULL, 10) : 0
+		};
+
+		if (speed) {
+			/* Same format as siso_set_speed_str() */
+			conf.bytes_s = strtoull(speed, NULL, 10);
+			switch (speed[strlen(speed) - 1]) {
+			case 'k': case 'K':
+				conf.bytes_s *= 1024;
+				break;
+			case 'm': case 'M':
+				conf.bytes_s *= 1024 * 1024;
+				break;
+			case 'g': case 'G':
+				conf.bytes_s *= 1024 * 1024 * 1024;
+				break;
+			default:
+				break;
+			}
+		}
+
+		/* Packets must stay in memory */
+		reader_t *reader = reader_create(input, true);
+		if (!reader) {
+			return 1;
+		}
+
+		int ret = replay_run(reader, &conf);
+		reader_destroy(reader);
+		return ret;
+	}
+
 	/* Get collector's address */
 	sisoconf *sender = siso_create();
 	if (!sender) {
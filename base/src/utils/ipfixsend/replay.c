@@ -0,0 +1,773 @@
+/**
+ * \file ipfixsend/replay.c
+ * \brief Multi-threaded replay engine
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <ipfixcol.h>
+
+#include "ipfixsend.h"
+#include "replay.h"
+
+/** Number of packets sent to an exporter at once */
+#define REPLAY_BATCH 32
+/** Size of the send buffer of sockets */
+#define REPLAY_SNDBUF (4 * 1024 * 1024)
+/** Pacing: sleep only when the next batch is due later (nanoseconds)  */
+#define REPLAY_SPIN_NS 50000LL
+/** Pacing: maximal lag before the schedule is reset (nanoseconds)     */
+#define REPLAY_MAX_LAG_NS 100000000LL
+/** Maximal number of Observation Domains in the file */
+#define REPLAY_MAX_ODIDS 256
+
+// 1 second in nanoseconds
+#define NANO_SEC 1000000000LL
+
+/** Length of a field with variable length */
+#define VAR_LEN 65535
+
+static volatile int stop_replay = 0;
+
+/** \brief Template (only what is necessary to count records) */
+struct replay_tmplt {
+	uint16_t fixed_len;      /**< Length of a record (0 = variable length)   */
+	uint16_t field_cnt;      /**< Number of fields                           */
+	uint16_t fields[];       /**< Lengths of fields                          */
+};
+
+/** \brief Packet of the input file */
+struct replay_pkt {
+	const uint8_t *data;     /**< IPFIX message                              */
+	uint16_t len;            /**< Length of the message                      */
+	uint16_t odid_idx;       /**< Index of the Observation Domain            */
+	uint32_t records;        /**< Number of Data Records                     */
+};
+
+/** \brief Emulated exporter */
+struct replay_exporter {
+	int fd;                  /**< Socket                                     */
+	uint32_t id;             /**< Index of the exporter                      */
+	uint32_t *seq;           /**< Sequence numbers of Observation Domains    */
+};
+
+/** \brief Shared context of sending threads */
+struct replay_ctx {
+	const struct replay_conf *conf; /**< Configuration                      */
+	struct replay_pkt *pkts;        /**< Packets of the file                */
+	size_t pkt_cnt;                 /**< Number of packets                  */
+	uint32_t odids[REPLAY_MAX_ODIDS]; /**< Observation Domains of the file  */
+	uint16_t odid_cnt;              /**< Number of Observation Domains      */
+};
+
+/** \brief Sending thread */
+struct replay_thread {
+	pthread_t thread;               /**< Thread                             */
+	struct replay_ctx *ctx;         /**< Shared context                     */
+	struct replay_exporter *exps;   /**< Exporters of the thread            */
+	int exp_cnt;                    /**< Number of exporters                */
+	double ns_per_pkt;              /**< Pacing of packets (0 = unlimited)  */
+	double ns_per_byte;             /**< Pacing of bytes (0 = unlimited)    */
+	double deadline;                /**< Time of the next batch             */
+	uint64_t packets;               /**< Sent packets                       */
+	uint64_t bytes;                 /**< Sent bytes                         */
+	int error;                      /**< Sending failed                     */
+
+	struct ipfix_header hdrs[REPLAY_BATCH];   /**< Rewritten headers        */
+	struct iovec iov[2 * REPLAY_BATCH];       /**< Parts of packets         */
+	struct mmsghdr msgs[REPLAY_BATCH];        /**< Messages (UDP)           */
+};
+
+void replay_stop()
+{
+	stop_replay = 1;
+}
+
+/**
+ * \brief Get monotonic time
+ * \return Time in nanoseconds
+ */
+static int64_t replay_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * NANO_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Wait until the next batch can be sent
+ *
+ * The schedule is absolute, so errors of sleeps do not accumulate. The thread
+ * sleeps by clock_nanosleep() and spins for the last few microseconds.
+ * \param[in,out] thr  Thread
+ * \param[in]     pkts Number of packets of the sent batch
+ * \param[in]     len  Size of the sent batch
+ */
+static void replay_pace(struct replay_thread *thr, size_t pkts, size_t len)
+{
+	double cost_pkts = pkts * thr->ns_per_pkt;
+	double cost_bytes = len * thr->ns_per_byte;
+	thr->deadline += (cost_pkts > cost_bytes) ? cost_pkts : cost_bytes;
+
+	int64_t deadline = (int64_t) thr->deadline;
+	int64_t now = replay_now();
+	if (now - deadline > REPLAY_MAX_LAG_NS) {
+		// Too late (e.g. full socket buffers), do not try to catch up
+		thr->deadline = now;
+		return;
+	}
+
+	if (deadline - now > REPLAY_SPIN_NS) {
+		int64_t wake = deadline - REPLAY_SPIN_NS;
+		struct timespec ts = {wake / NANO_SEC, wake % NANO_SEC};
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR
+			&& !stop_replay);
+	}
+
+	while (replay_now() < deadline && !stop_replay);
+}
+
+/**
+ * \brief Read a 16bit value in network byte order
+ * \param[in] ptr Unaligned pointer
+ * \return Value in host byte order
+ */
+static inline uint16_t replay_read16(const uint8_t *ptr)
+{
+	uint16_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return ntohs(val);
+}
+
+/**
+ * \brief Add a (Options) Template to the table of templates
+ * \param[in,out] tmplts Table of templates of an Observation Domain
+ * \param[in]     rec    Template record
+ * \param[in]     max    Remaining length of the set
+ * \param[in]     opts   Options Template flag
+ * \return Length of the template record or 0 (malformed record)
+ */
+static size_t replay_tmplt_add(struct replay_tmplt **tmplts, const uint8_t *rec,
+	size_t max, bool opts)
+{
+	size_t hdr_len = opts ? 6 : 4;
+	if (max < 4) {
+		return 0;
+	}
+
+	uint16_t id = replay_read16(rec);
+	uint16_t cnt = replay_read16(rec + 2);
+
+	free(tmplts[id]);
+	tmplts[id] = NULL;
+	if (cnt == 0) {
+		// Withdrawal
+		return 4;
+	}
+
+	if (max < hdr_len) {
+		return 0;
+	}
+
+	struct replay_tmplt *tmplt = malloc(sizeof(*tmplt) + cnt * sizeof(uint16_t));
+	if (!tmplt) {
+		ERR_MEM;
+		return 0;
+	}
+
+	size_t pos = hdr_len;
+	uint32_t fixed_len = 0;
+	bool var = false;
+	for (uint16_t i = 0; i < cnt; ++i) {
+		if (pos + 4 > max) {
+			free(tmplt);
+			return 0;
+		}
+
+		uint16_t field_id = replay_read16(rec + pos);
+		uint16_t field_len = replay_read16(rec + pos + 2);
+		pos += (field_id & 0x8000) ? 8 : 4;
+
+		tmplt->fields[i] = field_len;
+		if (field_len == VAR_LEN) {
+			var = true;
+		} else {
+			fixed_len += field_len;
+		}
+	}
+
+	if (pos > max) {
+		free(tmplt);
+		return 0;
+	}
+
+	tmplt->field_cnt = cnt;
+	tmplt->fixed_len = (var || fixed_len > UINT16_MAX) ? 0 : fixed_len;
+	tmplts[id] = tmplt;
+	return pos;
+}
+
+/**
+ * \brief Count Data Records in a Data Set
+ * \param[in] tmplt Template of the set
+ * \param[in] data  Content of the set
+ * \param[in] len   Length of the content
+ * \return Number of records
+ */
+static uint32_t replay_set_records(const struct replay_tmplt *tmplt,
+	const uint8_t *data, size_t len)
+{
+	if (tmplt->fixed_len > 0) {
+		return len / tmplt->fixed_len;
+	}
+
+	uint32_t cnt = 0;
+	size_t pos = 0;
+	while (pos < len) {
+		size_t start = pos;
+		for (uint16_t i = 0; i < tmplt->field_cnt; ++i) {
+			size_t field_len = tmplt->fields[i];
+			if (field_len == VAR_LEN) {
+				if (pos + 1 > len) {
+					return cnt;
+				}
+
+				field_len = data[pos++];
+				if (field_len == 255) {
+					if (pos + 2 > len) {
+						return cnt;
+					}
+
+					field_len = replay_read16(data + pos);
+					pos += 2;
+				}
+			}
+
+			pos += field_len;
+		}
+
+		if (pos > len || pos == start) {
+			// Padding (or only zero-length fields)
+			break;
+		}
+
+		++cnt;
+	}
+
+	return cnt;
+}
+
+/**
+ * \brief Count Data Records in a packet and update templates
+ * \param[in,out] tmplts Table of templates of the Observation Domain
+ * \param[in]     pkt    Packet
+ * \return Number of Data Records
+ */
+static uint32_t replay_pkt_records(struct replay_tmplt **tmplts,
+	const struct replay_pkt *pkt)
+{
+	uint32_t records = 0;
+	size_t pos = IPFIX_HEADER_LENGTH;
+
+	while (pos + 4 <= pkt->len) {
+		uint16_t set_id = replay_read16(pkt->data + pos);
+		size_t set_len = replay_read16(pkt->data + pos + 2);
+		if (set_len < 4 || pos + set_len > pkt->len) {
+			break;
+		}
+
+		const uint8_t *data = pkt->data + pos + 4;
+		size_t data_len = set_len - 4;
+
+		if (set_id == IPFIX_TEMPLATE_FLOWSET_ID
+				|| set_id == IPFIX_OPTION_FLOWSET_ID) {
+			size_t rec_pos = 0;
+			while (data_len - rec_pos >= 4) {
+				size_t ret = replay_tmplt_add(tmplts, data + rec_pos,
+					data_len - rec_pos, set_id == IPFIX_OPTION_FLOWSET_ID);
+				if (ret == 0) {
+					break;
+				}
+				rec_pos += ret;
+			}
+		} else if (set_id >= IPFIX_MIN_RECORD_FLOWSET_ID && tmplts[set_id]) {
+			records += replay_set_records(tmplts[set_id], data, data_len);
+		}
+
+		pos += set_len;
+	}
+
+	return records;
+}
+
+/**
+ * \brief Load packets of the file and count their records
+ * \param[in,out] ctx    Context
+ * \param[in]     reader Preloaded input file
+ * \return On success returns 0. Otherwise returns nonzero value.
+ */
+static int replay_load(struct replay_ctx *ctx, reader_t *reader)
+{
+	struct replay_tmplt **tmplts[REPLAY_MAX_ODIDS] = {NULL};
+	struct ipfix_header *header;
+	enum READER_STATUS status;
+	size_t max = 0;
+	uint16_t len;
+	int ret = 1;
+
+	reader_rewind(reader);
+	while ((status = reader_get_next_packet(reader, &header, &len)) == READER_OK) {
+		if (ctx->pkt_cnt == max) {
+			max = (max == 0) ? 1024 : 2 * max;
+			struct replay_pkt *new_pkts = realloc(ctx->pkts, max * sizeof(*new_pkts));
+			if (!new_pkts) {
+				ERR_MEM;
+				goto cleanup;
+			}
+			ctx->pkts = new_pkts;
+		}
+
+		struct replay_pkt *pkt = &ctx->pkts[ctx->pkt_cnt++];
+		uint32_t odid = ntohl(header->observation_domain_id);
+		uint16_t idx;
+		for (idx = 0; idx < ctx->odid_cnt && ctx->odids[idx] != odid; ++idx);
+
+		if (idx == ctx->odid_cnt) {
+			// New Observation Domain
+			if (idx == REPLAY_MAX_ODIDS) {
+				fprintf(stderr, "Too many Observation Domains in the file (max. "
+					"%d)\n", REPLAY_MAX_ODIDS);
+				goto cleanup;
+			}
+
+			tmplts[idx] = calloc(UINT16_MAX + 1, sizeof(struct replay_tmplt *));
+			if (!tmplts[idx]) {
+				ERR_MEM;
+				goto cleanup;
+			}
+
+			ctx->odids[ctx->odid_cnt++] = odid;
+		}
+
+		pkt->data = (const uint8_t *) header;
+		pkt->len = len;
+		pkt->odid_idx = idx;
+		pkt->records = replay_pkt_records(tmplts[idx], pkt);
+	}
+
+	if (status == READER_ERROR) {
+		fprintf(stderr, "Malformed input file\n");
+		goto cleanup;
+	}
+
+	if (ctx->pkt_cnt == 0) {
+		fprintf(stderr, "Input file is empty\n");
+		goto cleanup;
+	}
+
+	ret = 0;
+
+cleanup:
+	for (int i = 0; i < ctx->odid_cnt; ++i) {
+		if (!tmplts[i]) {
+			continue;
+		}
+
+		for (size_t id = 0; id <= UINT16_MAX; ++id) {
+			free(tmplts[i][id]);
+		}
+		free(tmplts[i]);
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Create a socket of an exporter connected to the collector
+ * \param[in] addr Address of the collector
+ * \return On success returns the socket. Otherwise returns -1.
+ */
+static int replay_connect(const struct addrinfo *addr)
+{
+	int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (fd == -1) {
+		fprintf(stderr, "Unable to create a socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	int size = REPLAY_SNDBUF;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	// Connected UDP socket gets its own source port
+	if (connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
+		fprintf(stderr, "Unable to connect to the collector: %s\n",
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * \brief Prepare a batch of packets for an exporter
+ *
+ * Headers are copied and rewritten, the rest of packets is referenced.
+ * \param[in,out] thr   Thread
+ * \param[in,out] exp   Exporter
+ * \param[in]     start Index of the first packet
+ * \param[in]     cnt   Number of packets
+ * \return Size of the batch
+ */
+static size_t replay_batch_prepare(struct replay_thread *thr,
+	struct replay_exporter *exp, size_t start, size_t cnt)
+{
+	const struct replay_ctx *ctx = thr->ctx;
+	const struct replay_conf *conf = ctx->conf;
+	size_t len = 0;
+
+	for (size_t i = 0; i < cnt; ++i) {
+		const struct replay_pkt *pkt = &ctx->pkts[start + i];
+		struct ipfix_header *hdr = &thr->hdrs[i];
+
+		memcpy(hdr, pkt->data, IPFIX_HEADER_LENGTH);
+		hdr->sequence_number = htonl(exp->seq[pkt->odid_idx]);
+		exp->seq[pkt->odid_idx] += pkt->records;
+		if (conf->odid_rewrite) {
+			hdr->observation_domain_id = htonl(conf->odid_base
+				+ exp->id * ctx->odid_cnt + pkt->odid_idx);
+		}
+
+		thr->iov[2 * i].iov_base = hdr;
+		thr->iov[2 * i].iov_len = IPFIX_HEADER_LENGTH;
+		thr->iov[2 * i + 1].iov_base = (void *) (pkt->data + IPFIX_HEADER_LENGTH);
+		thr->iov[2 * i + 1].iov_len = pkt->len - IPFIX_HEADER_LENGTH;
+		len += pkt->len;
+	}
+
+	return len;
+}
+
+/**
+ * \brief Send a prepared batch over UDP
+ * \param[in,out] thr Thread
+ * \param[in]     fd  Socket
+ * \param[in]     cnt Number of packets
+ * \return On success returns 0. Otherwise returns nonzero value.
+ */
+static int replay_send_udp(struct replay_thread *thr, int fd, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; ++i) {
+		memset(&thr->msgs[i], 0, sizeof(thr->msgs[i]));
+		thr->msgs[i].msg_hdr.msg_iov = &thr->iov[2 * i];
+		thr->msgs[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	size_t sent = 0;
+	while (sent < cnt && !stop_replay) {
+		int ret = sendmmsg(fd, &thr->msgs[sent], cnt - sent, 0);
+		if (ret == -1) {
+			if (errno == EINTR || errno == ENOBUFS || errno == EAGAIN) {
+				continue;
+			}
+
+			if (errno == ECONNREFUSED) {
+				// Nobody listens at the moment, the datagrams are lost
+				sent++;
+				continue;
+			}
+
+			fprintf(stderr, "Network error: %s\n", strerror(errno));
+			return 1;
+		}
+
+		sent += ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Send a prepared batch over TCP
+ * \param[in,out] thr Thread
+ * \param[in]     fd  Socket
+ * \param[in]     cnt Number of packets
+ * \return On success returns 0. Otherwise returns nonzero value.
+ */
+static int replay_send_tcp(struct replay_thread *thr, int fd, size_t cnt)
+{
+	struct iovec *iov = thr->iov;
+	size_t iov_cnt = 2 * cnt;
+
+	while (iov_cnt > 0 && !stop_replay) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_cnt;
+
+		ssize_t ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (ret == -1) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+
+			fprintf(stderr, "Network error: %s\n", strerror(errno));
+			return 1;
+		}
+
+		// Skip sent parts
+		size_t done = (size_t) ret;
+		while (iov_cnt > 0 && done >= iov->iov_len) {
+			done -= iov->iov_len;
+			iov++;
+			iov_cnt--;
+		}
+
+		if (iov_cnt > 0) {
+			iov->iov_base = (uint8_t *) iov->iov_base + done;
+			iov->iov_len -= done;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Main function of a sending thread
+ * \param[in] arg Thread
+ * \return NULL
+ */
+static void *replay_thread_main(void *arg)
+{
+	struct replay_thread *thr = arg;
+	const struct replay_ctx *ctx = thr->ctx;
+	const struct replay_conf *conf = ctx->conf;
+	bool udp = (strcasecmp(conf->type, "UDP") == 0);
+
+	thr->deadline = replay_now();
+	for (int loop = 0; !stop_replay && (conf->loops < 0 || loop < conf->loops); ++loop) {
+		for (size_t start = 0; start < ctx->pkt_cnt && !stop_replay; start += REPLAY_BATCH) {
+			size_t cnt = ctx->pkt_cnt - start;
+			if (cnt > REPLAY_BATCH) {
+				cnt = REPLAY_BATCH;
+			}
+
+			for (int e = 0; e < thr->exp_cnt && !stop_replay; ++e) {
+				struct replay_exporter *exp = &thr->exps[e];
+				size_t len = replay_batch_prepare(thr, exp, start, cnt);
+				int ret = udp ? replay_send_udp(thr, exp->fd, cnt)
+					: replay_send_tcp(thr, exp->fd, cnt);
+				if (ret != 0) {
+					thr->error = 1;
+					replay_stop();
+					return NULL;
+				}
+
+				thr->packets += cnt;
+				thr->bytes += len;
+
+				if (thr->ns_per_pkt > 0.0 || thr->ns_per_byte > 0.0) {
+					replay_pace(thr, cnt, len);
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Close sockets and free exporters of threads
+ * \param[in] thrs Threads
+ * \param[in] cnt  Number of threads
+ */
+static void replay_threads_free(struct replay_thread *thrs, int cnt)
+{
+	for (int t = 0; t < cnt; ++t) {
+		for (int e = 0; e < thrs[t].exp_cnt; ++e) {
+			if (thrs[t].exps[e].fd != -1) {
+				close(thrs[t].exps[e].fd);
+			}
+			free(thrs[t].exps[e].seq);
+		}
+		free(thrs[t].exps);
+	}
+
+	free(thrs);
+}
+
+/**
+ * \brief Create threads and sockets of their exporters
+ * \param[in] ctx  Context
+ * \param[in] addr Address of the collector
+ * \return On success returns the threads. Otherwise returns NULL.
+ */
+static struct replay_thread *replay_threads_create(struct replay_ctx *ctx,
+	const struct addrinfo *addr)
+{
+	const struct replay_conf *conf = ctx->conf;
+	struct replay_thread *thrs = calloc(conf->threads, sizeof(*thrs));
+	if (!thrs) {
+		ERR_MEM;
+		return NULL;
+	}
+
+	int exp_id = 0;
+	for (int t = 0; t < conf->threads; ++t) {
+		struct replay_thread *thr = &thrs[t];
+		thr->ctx = ctx;
+		thr->exp_cnt = conf->exporters / conf->threads
+			+ (t < conf->exporters % conf->threads);
+		thr->exps = calloc(thr->exp_cnt, sizeof(*thr->exps));
+		if (!thr->exps) {
+			ERR_MEM;
+			thr->exp_cnt = 0;
+			replay_threads_free(thrs, t + 1);
+			return NULL;
+		}
+
+		for (int e = 0; e < thr->exp_cnt; ++e) {
+			struct replay_exporter *exp = &thr->exps[e];
+			exp->id = exp_id++;
+			exp->fd = -1;
+			exp->seq = calloc(ctx->odid_cnt, sizeof(uint32_t));
+			if (!exp->seq || (exp->fd = replay_connect(addr)) == -1) {
+				if (!exp->seq) {
+					ERR_MEM;
+				}
+				replay_threads_free(thrs, t + 1);
+				return NULL;
+			}
+		}
+
+		// Each thread has its share of the limits (by number of exporters)
+		double share = (double) thr->exp_cnt / conf->exporters;
+		if (conf->packets_s > 0) {
+			thr->ns_per_pkt = NANO_SEC / (share * conf->packets_s);
+		}
+		if (conf->bytes_s > 0) {
+			thr->ns_per_byte = NANO_SEC / (share * conf->bytes_s);
+		}
+	}
+
+	return thrs;
+}
+
+// Send packets of a file by more threads
+int replay_run(reader_t *reader, const struct replay_conf *conf)
+{
+	struct replay_ctx ctx;
+	struct addrinfo hints, *addr;
+	int ret = 1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.conf = conf;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	if (strcasecmp(conf->type, "UDP") == 0) {
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_protocol = IPPROTO_UDP;
+	} else if (strcasecmp(conf->type, "TCP") == 0) {
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+	} else {
+		fprintf(stderr, "Only UDP and TCP are supported by more threads\n");
+		return 1;
+	}
+
+	int gai = getaddrinfo(conf->ip, conf->port, &hints, &addr);
+	if (gai != 0) {
+		fprintf(stderr, "Unable to resolve %s:%s: %s\n", conf->ip, conf->port,
+			gai_strerror(gai));
+		return 1;
+	}
+
+	if (replay_load(&ctx, reader) != 0) {
+		goto cleanup_addr;
+	}
+
+	struct replay_thread *thrs = replay_threads_create(&ctx, addr);
+	if (!thrs) {
+		goto cleanup_pkts;
+	}
+
+	int64_t start = replay_now();
+	int started;
+	for (started = 0; started < conf->threads; ++started) {
+		if (pthread_create(&thrs[started].thread, NULL, replay_thread_main,
+				&thrs[started]) != 0) {
+			fprintf(stderr, "Unable to create a sending thread\n");
+			replay_stop();
+			break;
+		}
+	}
+
+	uint64_t packets = 0, bytes = 0;
+	ret = (started == conf->threads) ? 0 : 1;
+	for (int t = 0; t < started; ++t) {
+		pthread_join(thrs[t].thread, NULL);
+		packets += thrs[t].packets;
+		bytes += thrs[t].bytes;
+		ret |= thrs[t].error;
+	}
+
+	double elapsed = (double) (replay_now() - start) / NANO_SEC;
+	if (elapsed > 0.0) {
+		printf("Sent %" PRIu64 " packets (%" PRIu64 " bytes) in %.3f s: "
+			"%.0f packets/s, %.3f Mbit/s\n", packets, bytes, elapsed,
+			packets / elapsed, bytes * 8.0 / elapsed / 1000000.0);
+	}
+
+	replay_threads_free(thrs, conf->threads);
+cleanup_pkts:
+	free(ctx.pkts);
+cleanup_addr:
+	freeaddrinfo(addr);
+	return ret;
+}
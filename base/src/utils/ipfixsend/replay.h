@@ -0,0 +1,85 @@
+/**
+ * \file ipfixsend/replay.h
+ * \brief Multi-threaded replay engine (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "reader.h"
+
+/**
+ * \brief Configuration of the replay engine
+ *
+ * Every emulated exporter has its own socket (i.e. a distinct source port)
+ * and sends all packets of the input file with its own sequence numbers.
+ * Exporters are evenly distributed among sending threads.
+ */
+struct replay_conf {
+	const char *ip;          /**< Destination IP address                     */
+	const char *port;        /**< Destination port                           */
+	const char *type;        /**< Connection type (UDP or TCP)               */
+	int threads;             /**< Number of sending threads                  */
+	int exporters;           /**< Number of emulated exporters               */
+	int loops;               /**< Number of loops (negative = infinity)      */
+	uint64_t packets_s;      /**< Limit of packets/s (0 = unlimited)         */
+	uint64_t bytes_s;        /**< Limit of bytes/s (0 = unlimited)           */
+	bool odid_rewrite;       /**< Assign new ODIDs to exporters              */
+	uint32_t odid_base;      /**< The first assigned ODID                    */
+};
+
+/**
+ * \brief Send packets of a file by more threads
+ *
+ * Packets of each exporter are sent in batches (sendmmsg() for UDP, one
+ * sendmsg() for TCP). Sequence numbers are recalculated for each exporter
+ * and Observation Domain, so the exporters can replay the file in loops.
+ * If ODID rewriting is enabled, the N-th Observation Domain of the file
+ * sent by the E-th exporter gets ODID (odid_base + E * number of ODIDs + N).
+ * \param[in] reader Preloaded input file
+ * \param[in] conf   Configuration
+ * \return On success returns 0. Otherwise returns nonzero value.
+ */
+int replay_run(reader_t *reader, const struct replay_conf *conf);
+
+/**
+ * \brief Stop sending data
+ */
+void replay_stop();
+
+#endif /* REPLAY_H */
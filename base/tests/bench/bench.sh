@@ -0,0 +1,296 @@
+#!/usr/bin/env bash
+
+# ipfixcol Benchmark Tool
+# 
+# Copyright (C) 2026 CESNET, z.s.p.o.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in
+#    the documentation and/or other materials provided with the
+#    distribution.
+# 3. Neither the name of the Company nor the names of its contributors
+#    may be used to endorse or promote products derived from this
+#    software without specific prior written permission.
+# 
+# ALTERNATIVELY, provided that this notice is retained in full, this
+# product may be distributed under the terms of the GNU General Public
+# License (GPL) version 2 or later, in which case the provisions
+# of the GPL apply INSTEAD OF those given above.
+# 
+# This software is provided ``as is, and any express or implied
+# warranties, including, but not limited to, the implied warranties of
+# merchantability and fitness for a particular purpose are disclaimed.
+# In no event shall the company or contributors be liable for any
+# direct, indirect, incidental, special, exemplary, or consequential
+# damages (including, but not limited to, procurement of substitute
+# goods or services; loss of use, data, or profits; or business
+# interruption) however caused and on any theory of liability, whether
+# in contract, strict liability, or tort (including negligence or
+# otherwise) arising in any way out of the use of this software, even
+# if advised of the possibility of such damage.
+#
+
+BASE="$PWD"
+
+cd ../../src/
+SRC="$PWD"
+IPFIXCOL="$SRC/ipfixcol"
+IPFIXCONF="$SRC/utils/ipfixconf/ipfixconf"
+cd ../../plugins/
+PLUGINS="$PWD"
+cd "$BASE"
+
+IPFIXBENCH="$BASE/ipfixbench"
+ELEMENTS="`realpath ../../config/ipfix-elements.xml`"
+INTERNAL="$BASE/configs/internalcfg.xml"
+WORK="$BASE/work"
+RESULTS="$BASE/results.jsonl"
+
+# Benchmark matrix
+INPUTS="udp tcp"
+STORAGES="dummy json fastbit forwarding"
+CHAINS="none filter profiler"
+
+# Generator
+DURATION=10
+RATE=0
+EXPORTERS=4
+TEMPLATES=4
+RECORDS=30
+VARLEN=0.25
+
+PORT=4799
+PROBE_PORT=4798
+
+declare -A plugins
+plugins["udp"]="$SRC/input/udp/.libs/ipfixcol-udp-input.so"
+plugins["tcp"]="$SRC/input/tcp/.libs/ipfixcol-tcp-input.so"
+plugins["dummy"]="$SRC/storage/dummy/.libs/ipfixcol-dummy-output.so"
+plugins["forwarding"]="$SRC/storage/forwarding/.libs/ipfixcol-forwarding-output.so"
+plugins["fastbit"]="$PLUGINS/storage/fastbit/.libs/ipfixcol-fastbit-output.so"
+plugins["json"]="$PLUGINS/storage/json/.libs/ipfixcol-json-output.so"
+plugins["filter"]="$SRC/intermediate/filter/.libs/ipfixcol-filter-inter.so"
+plugins["profiler"]="$PLUGINS/intermediate/profiler/.libs/ipfixcol-profiler-inter.so"
+
+function usage()
+{
+	echo -e "Usage: $0 [options]"
+	echo -e "  -i list    Input plugins (default: $INPUTS)"
+	echo -e "  -s list    Storage plugins (default: $STORAGES)"
+	echo -e "  -c list    Intermediate chains (default: $CHAINS)"
+	echo -e "  -d sec     Duration of each run (default: $DURATION)"
+	echo -e "  -r num     Records/s of all exporters, 0 = unlimited (default: $RATE)"
+	echo -e "  -e num     Number of exporters (default: $EXPORTERS)"
+	echo -e "  -m num     Number of template variants per exporter (default: $TEMPLATES)"
+	echo -e "  -n num     Data records per message (default: $RECORDS)"
+	echo -e "  -V ratio   Ratio of records with variable-length fields (default: $VARLEN)"
+	echo -e "  -o file    Output file (default: $RESULTS)"
+	exit 1
+}
+
+while getopts "hi:s:c:d:r:e:m:n:V:o:" opt; do
+	case $opt in
+	i) INPUTS="$OPTARG" ;;
+	s) STORAGES="$OPTARG" ;;
+	c) CHAINS="$OPTARG" ;;
+	d) DURATION="$OPTARG" ;;
+	r) RATE="$OPTARG" ;;
+	e) EXPORTERS="$OPTARG" ;;
+	m) TEMPLATES="$OPTARG" ;;
+	n) RECORDS="$OPTARG" ;;
+	V) VARLEN="$OPTARG" ;;
+	o) RESULTS="$OPTARG" ;;
+	*) usage ;;
+	esac
+done
+
+if [ ! -x "$IPFIXCOL" -o ! -x "$IPFIXBENCH" ]; then
+	echo "Build ipfixcol and ipfixbench first (make bench)"
+	exit 1
+fi
+
+# Internal configuration with paths to the build folders
+../ipfixcol_test/create_internal.sh || exit 1
+for plugin in json profiler; do
+	if [ -f "${plugins[$plugin]}" ]; then
+		type="o"
+		[ "$plugin" = "profiler" ] && type="m"
+		"$IPFIXCONF" add -c "$INTERNAL" -p $type -n $plugin -t $plugin -s "${plugins[$plugin]}" -f > /dev/null
+	fi
+done
+
+# Print configuration of the benchmarked storage plugin
+function storage_config()
+{
+	case $1 in
+	dummy)
+		echo "				<fileFormat>dummy</fileFormat>"
+		;;
+	json)
+		echo "				<fileFormat>json</fileFormat>"
+		echo "				<output><type>file</type><path>$2/json/</path><prefix>json.</prefix></output>"
+		;;
+	fastbit)
+		echo "				<fileFormat>fastbit</fileFormat>"
+		echo "				<path>$2/fastbit/%o/</path>"
+		echo "				<dumpInterval><timeWindow>300</timeWindow><timeAlignment>yes</timeAlignment></dumpInterval>"
+		echo "				<namingStrategy><type>time</type><prefix>ic</prefix></namingStrategy>"
+		;;
+	forwarding)
+		echo "				<fileFormat>forwarding</fileFormat>"
+		echo "				<defaultPort>$PROBE_PORT</defaultPort><defaultProtocol>udp</defaultProtocol>"
+		echo "				<destination><ip>127.0.0.1</ip></destination>"
+		;;
+	esac
+}
+
+# Create startup.xml of a run
+# The latency probe is a forwarding destination next to the benchmarked storage
+function startup_config()
+{
+	local input=$1 storage=$2 chain=$3 dir=$4
+
+	cat << END
+<?xml version="1.0" encoding="UTF-8"?>
+<ipfix xmlns="urn:ietf:params:xml:ns:yang:ietf-ipfix-psamp">
+	<collectingProcess>
+		<name>Benchmark collector</name>
+		<${input}Collector>
+			<name>Listening port $PORT</name>
+			<localPort>$PORT</localPort>
+			<localIPAddress>127.0.0.1</localIPAddress>
+		</${input}Collector>
+		<exportingProcess>Benchmark storage</exportingProcess>
+		<statisticsFile>$dir/stats</statisticsFile>
+END
+	[ "$chain" = "profiler" ] && echo "		<profiles>$dir/profiles.xml</profiles>"
+	cat << END
+	</collectingProcess>
+
+	<exportingProcess>
+		<name>Benchmark storage</name>
+		<destination>
+			<name>Benchmarked storage</name>
+			<fileWriter>
+$(storage_config $storage $dir)
+			</fileWriter>
+		</destination>
+END
+	if [ "$storage" != "forwarding" ]; then
+		cat << END
+		<destination>
+			<name>Latency probe</name>
+			<fileWriter>
+$(storage_config forwarding $dir)
+			</fileWriter>
+		</destination>
+END
+	fi
+	echo "	</exportingProcess>"
+
+	case $chain in
+	filter)
+		cat << END
+	<intermediatePlugins>
+		<filter>
+			<default to="1000">
+				<filterString>octetDeltaCount > 0 or packetDeltaCount > 0 or ipVersion = 6</filterString>
+			</default>
+			<removeOriginal>true</removeOriginal>
+		</filter>
+	</intermediatePlugins>
+END
+		;;
+	profiler)
+		cat << END
+	<intermediatePlugins>
+		<profiler>
+		</profiler>
+	</intermediatePlugins>
+END
+		cat > "$dir/profiles.xml" << END
+<profile name="live">
+	<type>normal</type>
+	<directory>$dir/profiles/live/</directory>
+	<channelList>
+		<channel name="ipv4">
+			<sourceList><source>*</source></sourceList>
+			<filter>ipVersion = 4</filter>
+		</channel>
+		<channel name="ipv6">
+			<sourceList><source>*</source></sourceList>
+			<filter>ipVersion = 6</filter>
+		</channel>
+	</channelList>
+</profile>
+END
+		;;
+	esac
+	echo "</ipfix>"
+}
+
+rm -rf "$WORK"
+> "$RESULTS"
+failed=0
+
+for input in $INPUTS; do
+for storage in $STORAGES; do
+for chain in $CHAINS; do
+	name="$input-$storage-$chain"
+	dir="$WORK/$name"
+	mkdir -p "$dir"
+
+	# Skip runs with plugins that are not built
+	missing=""
+	for plugin in $input $storage forwarding $chain; do
+		if [ "$plugin" != "none" -a ! -f "${plugins[$plugin]}" ]; then
+			missing="$plugin"
+		fi
+	done
+	if [ -n "$missing" ]; then
+		echo "Benchmark '$name': skipped ($missing plugin not built)"
+		echo "{\"label\": \"$name\", \"skipped\": \"$missing plugin not built\"}" >> "$RESULTS"
+		continue
+	fi
+
+	echo -n "Benchmark '$name': "
+	startup_config $input $storage $chain "$dir" > "$dir/startup.xml"
+	"$IPFIXCOL" -v -1 -S 1 -c "$dir/startup.xml" -i "$INTERNAL" -e "$ELEMENTS" > "$dir/ipfixcol.log" 2>&1 &
+	pid=$!
+	sleep 1 # ipfixcol initialization
+
+	if ! kill -0 $pid 2> /dev/null; then
+		echo "FAIL (see $dir/ipfixcol.log)"
+		echo "{\"label\": \"$name\", \"error\": \"collector failed to start\"}" >> "$RESULTS"
+		failed=$(( failed + 1 ))
+		continue
+	fi
+
+	"$IPFIXBENCH" -t $input -p $PORT -P $PROBE_PORT -e $EXPORTERS -m $TEMPLATES \
+		-n $RECORDS -V $VARLEN -r $RATE -s $DURATION -S "$dir/stats.$pid" \
+		-l "$name" > "$dir/result.json"
+	ret=$?
+
+	kill $pid
+	wait $pid
+
+	if [ $ret -ne 0 -o ! -s "$dir/result.json" ]; then
+		echo "FAIL"
+		echo "{\"label\": \"$name\", \"error\": \"benchmark failed\"}" >> "$RESULTS"
+		failed=$(( failed + 1 ))
+		continue
+	fi
+
+	cat "$dir/result.json" >> "$RESULTS"
+	sed 's/.*"delivered": {"records": [0-9]*, "records_per_s": \([0-9]*\)}.*"drops": \([0-9]*\).*"p50": \([0-9.]*\), "p99": \([0-9.]*\).*/\1 records\/s, \2 drops, p50 \3 us, p99 \4 us/' "$dir/result.json"
+done
+done
+done
+
+echo -e "\nResults saved to $RESULTS"
+[ $failed -eq 0 ]
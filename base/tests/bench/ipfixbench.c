@@ -0,0 +1,1166 @@
+/**
+ * \file ipfixbench.c
+ * \brief End-to-end benchmark of the collector: synthetic exporters and latency probe
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/**
+ * \defgroup benchTest ipfixcol benchmark
+ * \ingroup tests
+ *
+ * Synthetic exporters and a latency probe for end-to-end benchmarks of
+ * a running collector (see bench.sh).
+ *
+ * Every generated Data Record starts with flowStartNanoseconds that holds
+ * the time of the export. The collector forwards the records back to the
+ * probe, which computes latency and counts delivered records.
+ *
+ * @{
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <ipfixcol.h>
+
+/* accepted program arguments */
+#define ARGUMENTS "hd:p:t:e:j:m:n:V:r:s:w:P:S:l:"
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT "4739"
+#define DEFAULT_PROBE_PORT 4798
+
+/* 1 second in nanoseconds */
+#define NANO_SEC 1000000000LL
+/* seconds between 1900 (NTP epoch) and 1970 (UNIX epoch) */
+#define NTP_OFFSET 2208988800ULL
+
+/* maximal number of template variants (fixed + varlen) per exporter */
+#define MAX_VARIANTS 64
+/* maximal size of a generated message */
+#define MAX_MSG_LEN 65000
+/* UDP exporters resend templates after this number of messages */
+#define TMPL_REFRESH 1024
+/* maximal length of generated applicationName */
+#define MAX_NAME_LEN 32
+/* length of a field with variable length */
+#define VAR_LEN 65535
+/* maximal number of queues reported by the collector */
+#define MAX_QUEUES 32
+/* buckets of latency histogram: 16 sub-buckets per power of two */
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+/* templates tracked by the probe (open addressing) */
+#define PROBE_TMPLTS 65536
+
+/** \brief Benchmark configuration */
+struct bench_conf {
+	const char *host;       /**< Collector address */
+	const char *port;       /**< Collector port */
+	bool tcp;               /**< Use TCP instead of UDP */
+	int exporters;          /**< Number of exporters */
+	int threads;            /**< Number of generator threads */
+	int templates;          /**< Number of template variants per exporter */
+	int records;            /**< Data Records per message */
+	double varlen;          /**< Ratio of records with variable-length fields */
+	uint64_t rate;          /**< Records/s of all exporters (0 = unlimited) */
+	double duration;        /**< Duration of generating (seconds) */
+	double drain;           /**< Time to wait for delayed records (seconds) */
+	int probe_port;         /**< UDP port of the latency probe */
+	const char *stat_file;  /**< Statistics file of the collector */
+	const char *label;      /**< Label of the results */
+};
+
+/** \brief Field of a template */
+struct field {
+	uint16_t id;            /**< Information Element ID */
+	uint16_t len;           /**< Length */
+};
+
+/** \brief Template variant */
+struct variant {
+	uint16_t id;            /**< Template ID */
+	uint16_t cnt;           /**< Number of fields */
+	uint16_t max_len;       /**< Maximal length of a record */
+	bool ipv6;              /**< IPv6 addresses */
+	struct field fields[16];/**< Fields */
+};
+
+/** \brief Synthetic exporter */
+struct exporter {
+	int fd;                 /**< Socket */
+	uint32_t odid;          /**< Observation Domain ID */
+	uint32_t seq;           /**< Sequence number */
+	uint64_t msgs;          /**< Sent messages */
+	uint64_t rand;          /**< State of the random generator */
+	double varlen_acc;      /**< Accumulated ratio of varlen records */
+};
+
+/** \brief Generator thread */
+struct generator {
+	pthread_t thread;       /**< Thread */
+	struct exporter *exps;  /**< Exporters of the thread */
+	int exp_cnt;            /**< Number of exporters */
+	double ns_per_rec;      /**< Pacing (0 = unlimited) */
+	uint64_t packets;       /**< Sent messages */
+	uint64_t records;       /**< Sent Data Records */
+	uint64_t bytes;         /**< Sent bytes */
+	int error;              /**< Sending failed */
+};
+
+/** \brief Template known to the probe */
+struct probe_tmplt {
+	uint64_t key;           /**< (ODID, Template ID) + 1, 0 = empty */
+	uint16_t fixed_len;     /**< Record length (0 = variable) */
+	uint16_t cnt;           /**< Number of fields */
+	uint16_t *lens;         /**< Lengths of fields */
+};
+
+/** \brief Latency probe */
+struct probe {
+	pthread_t thread;       /**< Thread */
+	int fd;                 /**< Socket */
+	uint64_t records;       /**< Delivered Data Records */
+	uint64_t hist[HIST_BUCKETS]; /**< Latency histogram (ns) */
+	uint64_t max;           /**< Maximal latency (ns) */
+	struct probe_tmplt *tmplts; /**< Templates */
+};
+
+/** \brief Occupancy of a queue of the collector */
+struct queue_stat {
+	char name[64];          /**< Name */
+	uint32_t size;          /**< Size */
+	uint32_t max;           /**< Maximal number of waiting messages */
+	uint64_t sum;           /**< Sum of samples */
+	uint32_t samples;       /**< Number of samples */
+};
+
+static volatile int stop_gen = 0;
+static volatile int stop_probe = 0;
+
+static struct bench_conf conf;
+static struct variant variants[MAX_VARIANTS];
+static int variant_cnt;
+
+static struct queue_stat queues[MAX_QUEUES];
+static int queue_cnt;
+
+/**
+ * \brief Get time
+ * \param[in] clk Clock
+ * \return Time in nanoseconds
+ */
+static int64_t now_ns(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return (int64_t) ts.tv_sec * NANO_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Convert UNIX time to NTP timestamp (dateTimeNanoseconds)
+ * \param[in] ns Nanoseconds since UNIX epoch
+ * \return NTP timestamp
+ */
+static uint64_t ns_to_ntp(int64_t ns)
+{
+	uint64_t sec = ns / NANO_SEC + NTP_OFFSET;
+	uint64_t frac = ((uint64_t) (ns % NANO_SEC) << 32) / NANO_SEC;
+	return (sec << 32) | frac;
+}
+
+/**
+ * \brief Convert NTP timestamp (dateTimeNanoseconds) to UNIX time
+ * \param[in] ntp NTP timestamp
+ * \return Nanoseconds since UNIX epoch
+ */
+static int64_t ntp_to_ns(uint64_t ntp)
+{
+	int64_t sec = (int64_t) (ntp >> 32) - (int64_t) NTP_OFFSET;
+	return sec * NANO_SEC + (int64_t) (((ntp & 0xFFFFFFFF) * NANO_SEC) >> 32);
+}
+
+/**
+ * \brief Next pseudo-random number (xorshift64)
+ * \param[in,out] state State of the generator
+ * \return Random number
+ */
+static uint64_t next_rand(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+/**
+ * \brief Write value in network byte order
+ * \param[out] ptr Destination
+ * \param[in]  val Value
+ * \param[in]  len Length of the field (1 - 8 bytes)
+ */
+static void put_uint(uint8_t *ptr, uint64_t val, int len)
+{
+	for (int i = len - 1; i >= 0; --i) {
+		ptr[i] = val & 0xFF;
+		val >>= 8;
+	}
+}
+
+/**
+ * \brief Read value in network byte order
+ * \param[in] ptr Source
+ * \param[in] len Length of the field (1 - 8 bytes)
+ * \return Value
+ */
+static uint64_t get_uint(const uint8_t *ptr, int len)
+{
+	uint64_t val = 0;
+	for (int i = 0; i < len; ++i) {
+		val = (val << 8) | ptr[i];
+	}
+	return val;
+}
+
+/**
+ * \brief Prepare template variants
+ *
+ * The first half of variants has only fixed-length fields, the second half
+ * adds applicationName. Variants differ in IP version, presence of the end
+ * timestamp and interfaces. flowStartNanoseconds is always the first field.
+ */
+static void variants_init()
+{
+	variant_cnt = 2 * conf.templates;
+	for (int i = 0; i < variant_cnt; ++i) {
+		struct variant *var = &variants[i];
+		int k = i % conf.templates;
+		int cnt = 0;
+
+		var->id = IPFIX_MIN_RECORD_FLOWSET_ID + i;
+		var->ipv6 = (k % 2 == 1);
+		var->fields[cnt++] = (struct field) {156, 8};  /* flowStartNanoseconds */
+		if (var->ipv6) {
+			var->fields[cnt++] = (struct field) {27, 16}; /* sourceIPv6Address */
+			var->fields[cnt++] = (struct field) {28, 16}; /* destinationIPv6Address */
+		} else {
+			var->fields[cnt++] = (struct field) {8, 4};   /* sourceIPv4Address */
+			var->fields[cnt++] = (struct field) {12, 4};  /* destinationIPv4Address */
+		}
+		var->fields[cnt++] = (struct field) {7, 2};    /* sourceTransportPort */
+		var->fields[cnt++] = (struct field) {11, 2};   /* destinationTransportPort */
+		var->fields[cnt++] = (struct field) {4, 1};    /* protocolIdentifier */
+		var->fields[cnt++] = (struct field) {6, 1};    /* tcpControlBits */
+		var->fields[cnt++] = (struct field) {2, 8};    /* packetDeltaCount */
+		var->fields[cnt++] = (struct field) {1, 8};    /* octetDeltaCount */
+		var->fields[cnt++] = (struct field) {60, 1};   /* ipVersion */
+		if (k % 4 >= 2) {
+			var->fields[cnt++] = (struct field) {157, 8}; /* flowEndNanoseconds */
+		}
+		if ((k / 4) % 2 == 1) {
+			var->fields[cnt++] = (struct field) {10, 4};  /* ingressInterface */
+			var->fields[cnt++] = (struct field) {14, 4};  /* egressInterface */
+		}
+		if (i >= conf.templates) {
+			var->fields[cnt++] = (struct field) {96, VAR_LEN}; /* applicationName */
+		}
+		var->cnt = cnt;
+
+		var->max_len = 0;
+		for (int f = 0; f < cnt; ++f) {
+			var->max_len += (var->fields[f].len == VAR_LEN) ? 1 + MAX_NAME_LEN
+				: var->fields[f].len;
+		}
+	}
+}
+
+/**
+ * \brief Fill IPFIX message header
+ * \param[out] msg  Message
+ * \param[in]  len  Length of the message
+ * \param[in]  exp  Exporter
+ * \param[in]  now  Current UNIX time (ns)
+ */
+static void msg_header(uint8_t *msg, uint16_t len, const struct exporter *exp,
+	int64_t now)
+{
+	put_uint(msg, IPFIX_VERSION, 2);
+	put_uint(msg + 2, len, 2);
+	put_uint(msg + 4, now / NANO_SEC, 4);
+	put_uint(msg + 8, exp->seq, 4);
+	put_uint(msg + 12, exp->odid, 4);
+}
+
+/**
+ * \brief Build a message with all templates
+ * \param[out] msg Buffer
+ * \param[in]  exp Exporter
+ * \return Length of the message
+ */
+static size_t msg_templates(uint8_t *msg, const struct exporter *exp)
+{
+	size_t pos = IPFIX_HEADER_LENGTH + 4;
+	for (int i = 0; i < variant_cnt; ++i) {
+		put_uint(msg + pos, variants[i].id, 2);
+		put_uint(msg + pos + 2, variants[i].cnt, 2);
+		pos += 4;
+		for (int f = 0; f < variants[i].cnt; ++f) {
+			put_uint(msg + pos, variants[i].fields[f].id, 2);
+			put_uint(msg + pos + 2, variants[i].fields[f].len, 2);
+			pos += 4;
+		}
+	}
+
+	put_uint(msg + IPFIX_HEADER_LENGTH, IPFIX_TEMPLATE_FLOWSET_ID, 2);
+	put_uint(msg + IPFIX_HEADER_LENGTH + 2, pos - IPFIX_HEADER_LENGTH, 2);
+	msg_header(msg, pos, exp, now_ns(CLOCK_REALTIME));
+	return pos;
+}
+
+/**
+ * \brief Build a message with Data Records
+ * \param[out] msg     Buffer
+ * \param[in]  exp     Exporter
+ * \param[out] records Number of Data Records
+ * \return Length of the message
+ */
+static size_t msg_data(uint8_t *msg, struct exporter *exp, int *records)
+{
+	/* Choose a template, varlen variants keep the configured ratio */
+	int idx = exp->msgs % conf.templates;
+	exp->varlen_acc += conf.varlen;
+	if (exp->varlen_acc >= 1.0) {
+		exp->varlen_acc -= 1.0;
+		idx += conf.templates;
+	}
+
+	const struct variant *var = &variants[idx];
+	int64_t now = now_ns(CLOCK_REALTIME);
+	uint64_t ntp = ns_to_ntp(now);
+	size_t pos = IPFIX_HEADER_LENGTH + 4;
+	int cnt;
+
+	for (cnt = 0; cnt < conf.records && pos + var->max_len <= MAX_MSG_LEN; ++cnt) {
+		uint64_t rnd = next_rand(&exp->rand);
+		size_t name_len = 4 + rnd % (MAX_NAME_LEN - 3);
+
+		for (int f = 0; f < var->cnt; ++f) {
+			const struct field *field = &var->fields[f];
+			uint8_t *ptr = msg + pos;
+			switch (field->id) {
+			case 156:
+				put_uint(ptr, ntp, 8);
+				break;
+			case 157:
+				put_uint(ptr, ntp + (rnd & 0xFFFFFFFF), 8);
+				break;
+			case 8: case 12:
+				put_uint(ptr, 0x0A000000 | (rnd >> (field->id * 2) & 0xFFFFFF), 4);
+				break;
+			case 27: case 28:
+				put_uint(ptr, 0x20010DB800000000ULL, 8);
+				put_uint(ptr + 8, rnd >> field->id, 8);
+				break;
+			case 4:
+				*ptr = (rnd & 1) ? 6 : 17;
+				break;
+			case 60:
+				*ptr = var->ipv6 ? 6 : 4;
+				break;
+			case 96:
+				*ptr = name_len;
+				memset(ptr + 1, 'a' + rnd % 26, name_len);
+				pos += 1 + name_len;
+				continue;
+			default:
+				put_uint(ptr, rnd >> (field->id % 32), field->len);
+				break;
+			}
+			pos += field->len;
+		}
+	}
+
+	put_uint(msg + IPFIX_HEADER_LENGTH, var->id, 2);
+	put_uint(msg + IPFIX_HEADER_LENGTH + 2, pos - IPFIX_HEADER_LENGTH, 2);
+	msg_header(msg, pos, exp, now);
+	*records = cnt;
+	return pos;
+}
+
+/**
+ * \brief Send a message
+ * \param[in] fd  Socket
+ * \param[in] msg Message
+ * \param[in] len Length of the message
+ * \return 0 on success, 1 on failure
+ */
+static int msg_send(int fd, const uint8_t *msg, size_t len)
+{
+	size_t sent = 0;
+	while (sent < len) {
+		ssize_t ret = send(fd, msg + sent, len - sent, MSG_NOSIGNAL);
+		if (ret == -1) {
+			if (errno == EINTR || errno == ENOBUFS || errno == EAGAIN) {
+				if (stop_gen) {
+					return 0;
+				}
+				continue;
+			}
+			if (errno == ECONNREFUSED && !conf.tcp) {
+				/* UDP: the collector is not listening yet */
+				return 0;
+			}
+			fprintf(stderr, "Unable to send data: %s\n", strerror(errno));
+			return 1;
+		}
+		sent += ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Generator thread
+ * \param[in] arg Generator
+ * \return NULL
+ */
+static void *generator_main(void *arg)
+{
+	struct generator *gen = arg;
+	uint8_t *msg = malloc(MAX_MSG_LEN);
+	if (!msg) {
+		fprintf(stderr, "Memory allocation error\n");
+		gen->error = 1;
+		return NULL;
+	}
+
+	double deadline = now_ns(CLOCK_MONOTONIC);
+	while (!stop_gen) {
+		for (int e = 0; e < gen->exp_cnt && !stop_gen; ++e) {
+			struct exporter *exp = &gen->exps[e];
+			size_t len;
+			int records;
+
+			if ((exp->msgs == 0) || (!conf.tcp && exp->msgs % TMPL_REFRESH == 0)) {
+				len = msg_templates(msg, exp);
+				if (msg_send(exp->fd, msg, len) != 0) {
+					gen->error = 1;
+					goto end;
+				}
+			}
+
+			len = msg_data(msg, exp, &records);
+			if (msg_send(exp->fd, msg, len) != 0) {
+				gen->error = 1;
+				goto end;
+			}
+
+			exp->msgs++;
+			exp->seq += records;
+			gen->packets++;
+			gen->records += records;
+			gen->bytes += len;
+
+			if (gen->ns_per_rec > 0.0) {
+				deadline += records * gen->ns_per_rec;
+				int64_t wake = (int64_t) deadline;
+				if (now_ns(CLOCK_MONOTONIC) - wake > NANO_SEC / 10) {
+					/* Too late, do not try to catch up */
+					deadline = now_ns(CLOCK_MONOTONIC);
+				} else {
+					struct timespec ts = {wake / NANO_SEC, wake % NANO_SEC};
+					while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR
+						&& !stop_gen);
+				}
+			}
+		}
+	}
+
+end:
+	free(msg);
+	return NULL;
+}
+
+/**
+ * \brief Connect an exporter to the collector
+ * \return Socket or -1
+ */
+static int exporter_connect()
+{
+	struct addrinfo hints, *addr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = conf.tcp ? SOCK_STREAM : SOCK_DGRAM;
+
+	int ret = getaddrinfo(conf.host, conf.port, &hints, &addr);
+	if (ret != 0) {
+		fprintf(stderr, "Cannot get collector address: %s\n", gai_strerror(ret));
+		return -1;
+	}
+
+	int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (fd == -1 || connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
+		fprintf(stderr, "Cannot connect to the collector: %s\n", strerror(errno));
+		if (fd != -1) {
+			close(fd);
+		}
+		fd = -1;
+	}
+
+	freeaddrinfo(addr);
+	return fd;
+}
+
+/**
+ * \brief Add latency of records to the histogram
+ * \param[in,out] probe Probe
+ * \param[in]     lat   Latency (ns)
+ * \param[in]     cnt   Number of records
+ */
+static void hist_add(struct probe *probe, uint64_t lat, uint64_t cnt)
+{
+	int idx;
+	if (lat < (1 << HIST_SUB_BITS)) {
+		idx = lat;
+	} else {
+		int msb = 63 - __builtin_clzll(lat);
+		int sub = (lat >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+		idx = ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+	}
+
+	probe->hist[idx] += cnt;
+	if (lat > probe->max) {
+		probe->max = lat;
+	}
+}
+
+/**
+ * \brief Get upper bound of a histogram bucket
+ * \param[in] idx Bucket
+ * \return Latency (ns)
+ */
+static uint64_t hist_bound(int idx)
+{
+	if (idx < (1 << HIST_SUB_BITS)) {
+		return idx;
+	}
+
+	int msb = (idx >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	uint64_t sub = idx & ((1 << HIST_SUB_BITS) - 1);
+	uint64_t base = (1ULL << msb) | (sub << (msb - HIST_SUB_BITS));
+	return base + (1ULL << (msb - HIST_SUB_BITS)) - 1;
+}
+
+/**
+ * \brief Get percentile of latency
+ * \param[in] probe Probe
+ * \param[in] perc  Percentile (0 - 1)
+ * \return Latency (ns)
+ */
+static uint64_t hist_percentile(const struct probe *probe, double perc)
+{
+	uint64_t total = 0, sum = 0;
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		total += probe->hist[i];
+	}
+
+	uint64_t limit = (uint64_t) (perc * total);
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		sum += probe->hist[i];
+		if (sum > limit) {
+			uint64_t bound = hist_bound(i);
+			return (bound < probe->max) ? bound : probe->max;
+		}
+	}
+
+	return probe->max;
+}
+
+/**
+ * \brief Get the key of a template of the probe (never 0)
+ * \param[in] odid Observation Domain ID
+ * \param[in] id   Template ID
+ */
+static inline uint64_t probe_key(uint32_t odid, uint16_t id)
+{
+	return (((uint64_t) odid << 16) | id) + 1;
+}
+
+/**
+ * \brief Find a template of the probe
+ * \param[in] probe Probe
+ * \param[in] key   Key of the template (see probe_key())
+ * \return Slot of the template (empty slot if not found)
+ */
+static struct probe_tmplt *probe_tmplt_find(struct probe *probe, uint64_t key)
+{
+	uint32_t idx = ((key * 0x9E3779B97F4A7C15ULL) >> 32) % PROBE_TMPLTS;
+	while (probe->tmplts[idx].key != 0 && probe->tmplts[idx].key != key) {
+		idx = (idx + 1) % PROBE_TMPLTS;
+	}
+	return &probe->tmplts[idx];
+}
+
+/**
+ * \brief Process templates received by the probe
+ * \param[in,out] probe Probe
+ * \param[in]     odid  Observation Domain ID
+ * \param[in]     data  Content of the Template Set
+ * \param[in]     len   Length of the content
+ * \param[in]     opts  Options Template Set
+ */
+static void probe_templates(struct probe *probe, uint32_t odid,
+	const uint8_t *data, size_t len, bool opts)
+{
+	size_t pos = 0;
+	while (pos + 4 <= len) {
+		uint16_t id = get_uint(data + pos, 2);
+		uint16_t cnt = get_uint(data + pos + 2, 2);
+		pos += (opts && cnt > 0) ? 6 : 4;
+
+		uint64_t key = probe_key(odid, id);
+		struct probe_tmplt *tmplt = probe_tmplt_find(probe, key);
+		if (tmplt->key != 0 && cnt != 0) {
+			free(tmplt->lens);
+		} else if (tmplt->key == 0 && cnt == 0) {
+			continue;
+		}
+
+		if (cnt == 0) {
+			/* Withdrawal, keep the slot with no fields */
+			free(tmplt->lens);
+			tmplt->lens = NULL;
+			tmplt->cnt = 0;
+			continue;
+		}
+
+		tmplt->key = key;
+		tmplt->cnt = 0;
+		tmplt->fixed_len = 0;
+		tmplt->lens = malloc(cnt * sizeof(uint16_t));
+		if (!tmplt->lens) {
+			return;
+		}
+
+		uint32_t fixed = 0;
+		bool var = false;
+		for (uint16_t i = 0; i < cnt; ++i) {
+			if (pos + 4 > len) {
+				return;
+			}
+			uint16_t field_id = get_uint(data + pos, 2);
+			tmplt->lens[i] = get_uint(data + pos + 2, 2);
+			pos += (field_id & 0x8000) ? 8 : 4;
+			if (tmplt->lens[i] == VAR_LEN) {
+				var = true;
+			} else {
+				fixed += tmplt->lens[i];
+			}
+		}
+
+		tmplt->cnt = cnt;
+		tmplt->fixed_len = var ? 0 : fixed;
+	}
+}
+
+/**
+ * \brief Process a Data Set received by the probe
+ *
+ * The first field of every record is the time of the export.
+ * \param[in,out] probe Probe
+ * \param[in]     tmplt Template of the set
+ * \param[in]     data  Content of the set
+ * \param[in]     len   Length of the content
+ * \param[in]     now   Current UNIX time (ns)
+ */
+static void probe_data(struct probe *probe, const struct probe_tmplt *tmplt,
+	const uint8_t *data, size_t len, int64_t now)
+{
+	uint64_t cnt = 0;
+	size_t pos = 0;
+
+	if (tmplt->cnt == 0 || tmplt->lens[0] != 8) {
+		return;
+	}
+
+	while (pos < len) {
+		size_t start = pos;
+		if (tmplt->fixed_len > 0) {
+			pos += tmplt->fixed_len;
+		} else {
+			for (uint16_t i = 0; i < tmplt->cnt && pos < len; ++i) {
+				size_t field_len = tmplt->lens[i];
+				if (field_len == VAR_LEN) {
+					field_len = data[pos++];
+					if (field_len == 255 && pos + 2 <= len) {
+						field_len = get_uint(data + pos, 2);
+						pos += 2;
+					}
+				}
+				pos += field_len;
+			}
+		}
+
+		if (pos > len || pos == start) {
+			/* Padding */
+			break;
+		}
+
+		++cnt;
+	}
+
+	if (cnt > 0) {
+		int64_t lat = now - ntp_to_ns(get_uint(data, 8));
+		hist_add(probe, lat > 0 ? lat : 0, cnt);
+		probe->records += cnt;
+	}
+}
+
+/**
+ * \brief Latency probe thread
+ * \param[in] arg Probe
+ * \return NULL
+ */
+static void *probe_main(void *arg)
+{
+	struct probe *probe = arg;
+	uint8_t *msg = malloc(UINT16_MAX + 1);
+	if (!msg) {
+		fprintf(stderr, "Memory allocation error\n");
+		return NULL;
+	}
+
+	while (!stop_probe) {
+		ssize_t len = recv(probe->fd, msg, UINT16_MAX + 1, 0);
+		if (len < IPFIX_HEADER_LENGTH) {
+			continue;
+		}
+
+		int64_t now = now_ns(CLOCK_REALTIME);
+		uint32_t odid = get_uint(msg + 12, 4);
+		size_t pos = IPFIX_HEADER_LENGTH;
+		while (pos + 4 <= (size_t) len) {
+			uint16_t set_id = get_uint(msg + pos, 2);
+			size_t set_len = get_uint(msg + pos + 2, 2);
+			if (set_len < 4 || pos + set_len > (size_t) len) {
+				break;
+			}
+
+			if (set_id == IPFIX_TEMPLATE_FLOWSET_ID || set_id == IPFIX_OPTION_FLOWSET_ID) {
+				probe_templates(probe, odid, msg + pos + 4, set_len - 4,
+					set_id == IPFIX_OPTION_FLOWSET_ID);
+			} else if (set_id >= IPFIX_MIN_RECORD_FLOWSET_ID) {
+				struct probe_tmplt *tmplt = probe_tmplt_find(probe, probe_key(odid, set_id));
+				if (tmplt->key != 0) {
+					probe_data(probe, tmplt, msg + pos + 4, set_len - 4, now);
+				}
+			}
+			pos += set_len;
+		}
+	}
+
+	free(msg);
+	return NULL;
+}
+
+/**
+ * \brief Open the socket of the probe
+ * \return Socket or -1
+ */
+static int probe_open()
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int size = 64 * 1024 * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	struct timeval tv = {0, 100000};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(conf.probe_port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Cannot bind the probe to port %d: %s\n", conf.probe_port,
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * \brief Read the statistics file of the collector
+ *
+ * Samples occupancy of queues (QUEUE_*) and sums processed and lost
+ * records of all ODIDs.
+ * \param[in]  sample  Add a sample of queue occupancy
+ * \param[out] records Data records processed by the collector
+ * \param[out] lost    Data records lost (sequence numbers)
+ * \return 0 on success, 1 if the file is not available
+ */
+static int stat_read(bool sample, uint64_t *records, uint64_t *lost)
+{
+	char line[256], key[64];
+	uint64_t val;
+
+	FILE *f = conf.stat_file ? fopen(conf.stat_file, "r") : NULL;
+	if (!f) {
+		return 1;
+	}
+
+	*records = 0;
+	*lost = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%63[^=]=%" SCNu64, key, &val) != 2) {
+			continue;
+		}
+
+		if (strncmp(key, "DATA_REC_", 9) == 0 && strncmp(key, "DATA_REC_SEC", 12) != 0) {
+			*records += val;
+		} else if (strncmp(key, "LOST_DATA_REC_", 14) == 0 && strncmp(key, "LOST_DATA_REC_SEC", 17) != 0) {
+			*lost += val;
+		} else if (sample && strncmp(key, "QUEUE_", 6) == 0) {
+			size_t key_len = strlen(key);
+			bool is_size = (key_len > 5 && strcmp(key + key_len - 5, "_SIZE") == 0);
+			if (is_size) {
+				key[key_len - 5] = '\0';
+			}
+
+			int i;
+			for (i = 0; i < queue_cnt && strcmp(queues[i].name, key + 6) != 0; ++i);
+			if (i == queue_cnt) {
+				if (queue_cnt == MAX_QUEUES) {
+					continue;
+				}
+				snprintf(queues[queue_cnt++].name, sizeof(queues[i].name), "%s", key + 6);
+			}
+
+			if (is_size) {
+				queues[i].size = val;
+			} else {
+				queues[i].sum += val;
+				queues[i].samples++;
+				if (val > queues[i].max) {
+					queues[i].max = val;
+				}
+			}
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/**
+ * \brief Print results as one JSON object
+ */
+static void print_results(const struct generator *gens, const struct probe *probe,
+	double elapsed, int stat_ok, uint64_t col_records, uint64_t col_lost)
+{
+	uint64_t packets = 0, records = 0, bytes = 0;
+	for (int i = 0; i < conf.threads; ++i) {
+		packets += gens[i].packets;
+		records += gens[i].records;
+		bytes += gens[i].bytes;
+	}
+
+	uint64_t drops = (records > probe->records) ? records - probe->records : 0;
+
+	printf("{\"label\": \"%s\", \"transport\": \"%s\", \"exporters\": %d, "
+		"\"templates\": %d, \"records_per_packet\": %d, \"varlen_ratio\": %.3f, "
+		"\"rate_limit\": %" PRIu64 ", \"duration_s\": %.3f, ",
+		conf.label, conf.tcp ? "tcp" : "udp", conf.exporters, conf.templates,
+		conf.records, conf.varlen, conf.rate, elapsed);
+	printf("\"sent\": {\"packets\": %" PRIu64 ", \"records\": %" PRIu64 ", "
+		"\"bytes\": %" PRIu64 ", \"records_per_s\": %.0f}, ",
+		packets, records, bytes, records / elapsed);
+	printf("\"delivered\": {\"records\": %" PRIu64 ", \"records_per_s\": %.0f}, ",
+		probe->records, probe->records / elapsed);
+	if (stat_ok == 0) {
+		printf("\"collector\": {\"records\": %" PRIu64 ", \"lost_records\": %" PRIu64 "}, ",
+			col_records, col_lost);
+	} else {
+		printf("\"collector\": null, ");
+	}
+	printf("\"drops\": %" PRIu64 ", \"drop_ratio\": %.6f, ", drops,
+		records ? (double) drops / records : 0.0);
+	printf("\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, ",
+		hist_percentile(probe, 0.50) / 1000.0, hist_percentile(probe, 0.99) / 1000.0,
+		probe->max / 1000.0);
+
+	printf("\"queues\": {");
+	for (int i = 0; i < queue_cnt; ++i) {
+		printf("%s\"%s\": {\"size\": %u, \"mean\": %.1f, \"max\": %u}", i ? ", " : "",
+			queues[i].name, queues[i].size,
+			queues[i].samples ? (double) queues[i].sum / queues[i].samples : 0.0,
+			queues[i].max);
+	}
+	printf("}}\n");
+	fflush(stdout);
+}
+
+/**
+ * \brief Signal handler
+ */
+static void handler(int sig)
+{
+	(void) sig;
+	stop_gen = 1;
+}
+
+/**
+ * \brief Prints how to use the program
+ * \param[in] name Program name
+ */
+void usage(char *name)
+{
+	printf("Usage: %s [options]\n\n", name);
+	printf("Options:\n");
+	printf("  -d host    collector address [%s]\n", DEFAULT_HOST);
+	printf("  -p port    collector port [%s]\n", DEFAULT_PORT);
+	printf("  -t type    transport protocol, udp or tcp [udp]\n");
+	printf("  -e num     number of exporters (each has its own socket and ODID) [1]\n");
+	printf("  -j num     number of generator threads [min(exporters, 4)]\n");
+	printf("  -m num     number of template variants per exporter (1 - %d) [4]\n", MAX_VARIANTS / 2);
+	printf("  -n num     data records per message [30]\n");
+	printf("  -V ratio   ratio of records with variable-length fields (0 - 1) [0.25]\n");
+	printf("  -r num     records/s of all exporters, 0 = unlimited [0]\n");
+	printf("  -s sec     duration of the test [10]\n");
+	printf("  -w sec     time to wait for delayed records [2]\n");
+	printf("  -P port    UDP port of the latency probe [%d]\n", DEFAULT_PROBE_PORT);
+	printf("  -S file    statistics file of the collector (<statisticsFile>.<pid>)\n");
+	printf("  -l label   label of the results\n");
+	printf("  -h         print usage info\n");
+	printf("\nResults are printed to the standard output as one JSON object.\n");
+}
+
+/**
+ * \brief Main function
+ */
+int main(int argc, char *argv[])
+{
+	int c, ret = 0;
+
+	conf.host = DEFAULT_HOST;
+	conf.port = DEFAULT_PORT;
+	conf.exporters = 1;
+	conf.templates = 4;
+	conf.records = 30;
+	conf.varlen = 0.25;
+	conf.duration = 10.0;
+	conf.drain = 2.0;
+	conf.probe_port = DEFAULT_PROBE_PORT;
+	conf.label = "";
+
+	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
+		switch (c) {
+		case 'd':
+			conf.host = optarg;
+			break;
+		case 'p':
+			conf.port = optarg;
+			break;
+		case 't':
+			conf.tcp = (strcasecmp(optarg, "tcp") == 0);
+			break;
+		case 'e':
+			conf.exporters = atoi(optarg);
+			break;
+		case 'j':
+			conf.threads = atoi(optarg);
+			break;
+		case 'm':
+			conf.templates = atoi(optarg);
+			break;
+		case 'n':
+			conf.records = atoi(optarg);
+			break;
+		case 'V':
+			conf.varlen = atof(optarg);
+			break;
+		case 'r':
+			conf.rate = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			conf.duration = atof(optarg);
+			break;
+		case 'w':
+			conf.drain = atof(optarg);
+			break;
+		case 'P':
+			conf.probe_port = atoi(optarg);
+			break;
+		case 'S':
+			conf.stat_file = optarg;
+			break;
+		case 'l':
+			conf.label = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (conf.threads <= 0) {
+		conf.threads = (conf.exporters < 4) ? conf.exporters : 4;
+	}
+
+	if (conf.exporters < 1 || conf.threads > conf.exporters || conf.templates < 1
+			|| conf.templates > MAX_VARIANTS / 2 || conf.records < 1
+			|| conf.varlen < 0.0 || conf.varlen > 1.0 || conf.duration <= 0.0) {
+		fprintf(stderr, "Invalid arguments\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, handler);
+	signal(SIGTERM, handler);
+	variants_init();
+
+	/* Start the probe */
+	struct probe *probe = calloc(1, sizeof(*probe));
+	if (!probe || !(probe->tmplts = calloc(PROBE_TMPLTS, sizeof(struct probe_tmplt)))) {
+		fprintf(stderr, "Memory allocation error\n");
+		return 1;
+	}
+
+	probe->fd = probe_open();
+	if (probe->fd == -1 || pthread_create(&probe->thread, NULL, probe_main, probe) != 0) {
+		return 1;
+	}
+
+	/* Create exporters */
+	struct exporter *exps = calloc(conf.exporters, sizeof(*exps));
+	struct generator *gens = calloc(conf.threads, sizeof(*gens));
+	if (!exps || !gens) {
+		fprintf(stderr, "Memory allocation error\n");
+		return 1;
+	}
+
+	for (int e = 0; e < conf.exporters; ++e) {
+		exps[e].odid = e + 1;
+		exps[e].rand = 0x9E3779B97F4A7C15ULL * (e + 1);
+		exps[e].fd = exporter_connect();
+		if (exps[e].fd == -1) {
+			return 1;
+		}
+	}
+
+	int first = 0;
+	for (int t = 0; t < conf.threads; ++t) {
+		gens[t].exps = &exps[first];
+		gens[t].exp_cnt = conf.exporters / conf.threads + (t < conf.exporters % conf.threads);
+		first += gens[t].exp_cnt;
+		if (conf.rate > 0) {
+			gens[t].ns_per_rec = (double) NANO_SEC * conf.exporters
+				/ (gens[t].exp_cnt * (double) conf.rate);
+		}
+	}
+
+	/* Run */
+	int64_t start = now_ns(CLOCK_MONOTONIC);
+	int started;
+	for (started = 0; started < conf.threads; ++started) {
+		if (pthread_create(&gens[started].thread, NULL, generator_main, &gens[started]) != 0) {
+			fprintf(stderr, "Unable to create a generator thread\n");
+			stop_gen = 1;
+			break;
+		}
+	}
+
+	uint64_t col_records = 0, col_lost = 0;
+	int64_t end = start + (int64_t) (conf.duration * NANO_SEC);
+	while (!stop_gen && now_ns(CLOCK_MONOTONIC) < end) {
+		struct timespec ts = {1, 0};
+		nanosleep(&ts, NULL);
+		stat_read(true, &col_records, &col_lost);
+	}
+
+	stop_gen = 1;
+	for (int t = 0; t < started; ++t) {
+		pthread_join(gens[t].thread, NULL);
+		ret |= gens[t].error;
+	}
+	double elapsed = (double) (now_ns(CLOCK_MONOTONIC) - start) / NANO_SEC;
+
+	/* Wait for delayed records and final statistics */
+	struct timespec ts = {(time_t) conf.drain, (long) ((conf.drain - (time_t) conf.drain) * NANO_SEC)};
+	nanosleep(&ts, NULL);
+	stop_probe = 1;
+	pthread_join(probe->thread, NULL);
+	int stat_ret = stat_read(false, &col_records, &col_lost);
+
+	print_results(gens, probe, elapsed, stat_ret, col_records, col_lost);
+
+	for (int e = 0; e < conf.exporters; ++e) {
+		close(exps[e].fd);
+	}
+	for (int i = 0; i < PROBE_TMPLTS; ++i) {
+		free(probe->tmplts[i].lens);
+	}
+	close(probe->fd);
+	free(probe->tmplts);
+	free(probe);
+	free(exps);
+	free(gens);
+	return ret;
+}
+
+/**@}*/
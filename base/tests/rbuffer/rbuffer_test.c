@@ -105,7 +105,7 @@ int main()
 
 	for (int i=0; i<WRITE_COUNT; i++) {
 
-		struct ipfix_message *record = malloc(sizeof(struct ipfix_message));
+		struct ipfix_message *record = calloc(1, sizeof(struct ipfix_message));
 		record->pkt_header = malloc(sizeof(struct ipfix_header));
 		record->pkt_header->observation_domain_id = i;
 		rbuffer_write(rb, record, THREAD_NUM);
@@ -0,0 +1,189 @@
+/**
+ * \file WorkQueue.cpp
+ * \brief Bounded job queue served by a pool of threads
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+extern "C" {
+	#include <ipfixcol/verbose.h>
+}
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "fastbit.h"
+#include "WorkQueue.h"
+
+static uint64_t now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+WorkQueue::WorkQueue(const char *name, unsigned int threads, size_t capacity):
+	_name(name), _capacity(capacity ? capacity : 1), _running(0), _stop(false)
+{
+	memset(&_stats, 0, sizeof(_stats));
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_cond_job, NULL);
+	pthread_cond_init(&_cond_space, NULL);
+	pthread_cond_init(&_cond_done, NULL);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, worker, this) != 0) {
+			MSG_ERROR(msg_module, "Unable to start a thread of the %s queue", _name);
+			break;
+		}
+
+		_threads.push_back(thread);
+	}
+
+	if (threads > 0 && _threads.empty()) {
+		MSG_WARNING(msg_module, "Jobs of the %s queue will be processed synchronously", _name);
+	}
+}
+
+WorkQueue::~WorkQueue()
+{
+	drain();
+
+	pthread_mutex_lock(&_mutex);
+	_stop = true;
+	pthread_cond_broadcast(&_cond_job);
+	pthread_mutex_unlock(&_mutex);
+
+	for (size_t i = 0; i < _threads.size(); i++) {
+		pthread_join(_threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&_cond_done);
+	pthread_cond_destroy(&_cond_space);
+	pthread_cond_destroy(&_cond_job);
+	pthread_mutex_destroy(&_mutex);
+}
+
+void WorkQueue::submit(const job_t &job)
+{
+	if (_threads.empty()) {
+		/* Synchronous mode */
+		job();
+		pthread_mutex_lock(&_mutex);
+		_stats.submitted++;
+		_stats.completed++;
+		pthread_mutex_unlock(&_mutex);
+		return;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	if (_jobs.size() >= _capacity) {
+		uint64_t start = now_us();
+		while (_jobs.size() >= _capacity) {
+			pthread_cond_wait(&_cond_space, &_mutex);
+		}
+
+		_stats.stalls++;
+		_stats.stall_us += now_us() - start;
+	}
+
+	_jobs.push_back(job);
+	_stats.submitted++;
+	_stats.depth = _jobs.size() + _running;
+	if (_stats.depth > _stats.peak) {
+		_stats.peak = _stats.depth;
+	}
+
+	pthread_cond_signal(&_cond_job);
+	pthread_mutex_unlock(&_mutex);
+}
+
+void WorkQueue::drain()
+{
+	pthread_mutex_lock(&_mutex);
+	while (!_jobs.empty() || _running > 0) {
+		pthread_cond_wait(&_cond_done, &_mutex);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void WorkQueue::get_stats(struct stats &out, bool reset)
+{
+	pthread_mutex_lock(&_mutex);
+	_stats.depth = _jobs.size() + _running;
+	out = _stats;
+	if (reset) {
+		_stats.peak = _stats.depth;
+		_stats.stalls = 0;
+		_stats.stall_us = 0;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void *WorkQueue::worker(void *arg)
+{
+	WorkQueue *queue = static_cast<WorkQueue *>(arg);
+
+	pthread_mutex_lock(&queue->_mutex);
+	while (true) {
+		while (queue->_jobs.empty() && !queue->_stop) {
+			pthread_cond_wait(&queue->_cond_job, &queue->_mutex);
+		}
+
+		if (queue->_jobs.empty()) {
+			/* Stop requested and nothing left to do */
+			break;
+		}
+
+		job_t job = queue->_jobs.front();
+		queue->_jobs.pop_front();
+		queue->_running++;
+		pthread_cond_signal(&queue->_cond_space);
+		pthread_mutex_unlock(&queue->_mutex);
+
+		job();
+
+		pthread_mutex_lock(&queue->_mutex);
+		queue->_running--;
+		queue->_stats.completed++;
+		pthread_cond_broadcast(&queue->_cond_done);
+	}
+	pthread_mutex_unlock(&queue->_mutex);
+
+	return NULL;
+}
@@ -0,0 +1,106 @@
+/**
+ * \file WorkQueue.h
+ * \brief Bounded job queue served by a pool of threads
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef WORKQUEUE_H_
+#define WORKQUEUE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+#include <functional>
+
+/**
+ * \brief Bounded job queue served by a pool of threads
+ *
+ * A producer that submits a job to a full queue is blocked until a worker
+ * takes a job out of it (backpressure). The number and duration of these
+ * stalls are counted together with the queue depth.
+ * With zero threads, jobs are run synchronously by the producer.
+ */
+class WorkQueue {
+public:
+	typedef std::function<void()> job_t;
+
+	/** Counters of the queue */
+	struct stats {
+		uint64_t submitted;   /**< Number of submitted jobs                */
+		uint64_t completed;   /**< Number of completed jobs                */
+		size_t depth;         /**< Number of waiting and running jobs      */
+		size_t peak;          /**< Max. depth since the last reset         */
+		uint64_t stalls;      /**< Producers blocked on a full queue       */
+		uint64_t stall_us;    /**< Time spent by blocked producers (us)    */
+	};
+
+	WorkQueue(const char *name, unsigned int threads, size_t capacity);
+	~WorkQueue();
+
+	/** Append a job; blocks while the queue is full */
+	void submit(const job_t &job);
+
+	/** Wait until all submitted jobs are completed */
+	void drain();
+
+	/** Get counters; \p reset starts a new period of peak and stalls */
+	void get_stats(struct stats &out, bool reset);
+
+	/** Get number of threads */
+	unsigned int threads() const { return _threads.size(); }
+
+	/** Get name of the queue */
+	const char *name() const { return _name; }
+
+private:
+	const char *_name;
+	size_t _capacity;
+	std::vector<pthread_t> _threads;
+	std::deque<job_t> _jobs;
+	size_t _running;
+	bool _stop;
+	struct stats _stats;
+
+	pthread_mutex_t _mutex;
+	pthread_cond_t _cond_job;      /**< Job submitted or stop requested */
+	pthread_cond_t _cond_space;    /**< Job taken out of the queue      */
+	pthread_cond_t _cond_done;     /**< Job completed                   */
+
+	static void *worker(void *arg);
+};
+
+#endif /* WORKQUEUE_H_ */
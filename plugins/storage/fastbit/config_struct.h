@@ -40,16 +40,42 @@
 #ifndef CONFIG_STRUCT_H_
 #define CONFIG_STRUCT_H_
 
-extern "C" {
-	#include <semaphore.h>
-}
+#include <pthread.h>
 
 #include <string>
+#include <atomic>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "fastbit.h"
 
+class WorkQueue;
+
+/* Source of messages: input information and ODID */
+typedef std::pair<const struct input_info *, uint32_t> source_key;
+
+struct source_key_hash {
+	size_t operator()(const source_key &key) const
+	{
+		return std::hash<const void *>()(key.first) ^ ((size_t) key.second * 0x9e3779b97f4a7c15ULL);
+	}
+};
+
+/* Observation domain resolved for a source */
+struct source_entry {
+	uint8_t l3_proto;
+	uint8_t src_addr[16]; /* Exporter address to detect reuse of input information */
+	struct od_info *info;
+};
+
+/* Time spent on building indexes of a column */
+struct index_timing {
+	uint64_t count;    /* Number of processed partitions */
+	uint64_t total_us;
+	uint64_t max_us;
+};
+
 struct fastbit_config {
 	/* Stores information on templates per flow data source (identified by
 	 * exporter IP address and ODID).
@@ -58,12 +84,12 @@ struct fastbit_config {
 			std::map<uint32_t, /* ODID */
 					struct od_info>*> *od_infos;
 
+	/* Observation domains by source (cache of od_infos lookups) */
+	std::unordered_map<source_key, struct source_entry, source_key_hash> *sources;
+
 	/* Stores elements that should be indexed */
 	std::vector<std::string> *index_en_id;
 
-	/* Directories for index & reorder thread */
-	std::vector<std::string> *dirs;
-
 	/* Specifies time interval for storage directory rotation
 	 * (0 = no time based rotation)
 	 */
@@ -110,8 +136,70 @@ struct fastbit_config {
 	/* size of buffer (number of values)*/
 	int buff_size;
 
-	/* semaphore for index building thread */
-	sem_t sem;
+	/* Number of threads writing buffers to disk (0 = write synchronously) */
+	int writer_threads;
+
+	/* Maximal number of flushed windows waiting for reorder & index thread */
+	int index_queue_size;
+
+	/* Number of threads building indexes of columns in parallel */
+	int index_threads;
+
+	/* Number of threads storing data sets (0 = store in the storage thread) */
+	int store_threads;
+
+	/* Store workers; data sets of a table are always stored by the same one */
+	std::vector<WorkQueue *> *store_workers;
+
+	/* Number of records stored in the current window */
+	uint64_t window_records;
+
+	/* Protects flow statistics of observation domains updated by store workers */
+	pthread_mutex_t flows_mutex;
+
+	/* Writer pool, reorder & index thread and pool of index workers */
+	WorkQueue *writers;
+	WorkQueue *index_queue;
+	WorkQueue *index_workers;
+
+	/* Index building time per column and reorder time since the last report */
+	std::map<std::string, struct index_timing> *index_timings;
+	struct index_timing reorder_timing;
+	pthread_mutex_t timings_mutex;
+
+	/* Number of pending reorder & index jobs per directory; tables do not
+	 * write into a directory before its jobs are done */
+	std::map<std::string, int> *index_dirs;
+	pthread_mutex_t index_dirs_mutex;
+	pthread_cond_t index_dirs_cond;
+
+	/* Directory of hot window snapshots for fbitdump (empty = disabled) */
+	std::string hot_path;
+
+	/* Interval of hot window snapshots (seconds) */
+	int hot_interval;
+
+	/* Generation of the last snapshot and time when it was started */
+	uint64_t hot_generation;
+	time_t hot_last;
+
+	/* Snapshot is being written by the store workers */
+	std::atomic<bool> hot_busy;
+
+	/* Write column files using io_uring */
+	bool io_uring;
+
+	/* Sync column files to disk when a window is closed */
+	bool sync_files;
+
+	/* Number of open column files and the limit (files of a table are
+	 * closed after each write when exceeded) */
+	std::atomic<int> open_files;
+	int max_open_files;
+
+	/* Time spent waiting for a buffer being written (since last report) */
+	std::atomic<uint64_t> buffer_stalls;
+	std::atomic<uint64_t> buffer_stall_us;
 };
 
 #endif /* CONFIG_STRUCT_H_ */
@@ -40,19 +40,29 @@
 extern "C" {
 	#include <ipfixcol/storage.h>
 	#include <ipfixcol/verbose.h>
+	#include <ipfixcol/ipfix_message.h>
 
 	/* API version constant */
 	IPFIXCOL_API_VERSION;
 }
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <netinet/in.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -66,6 +76,22 @@ extern "C" {
 #include "fastbit_table.h"
 #include "fastbit_element.h"
 #include "config_struct.h"
+#include "WorkQueue.h"
+
+/* Maximal number of buffers waiting for a writer thread */
+const size_t WRITER_QUEUE_SIZE = 64;
+
+/* Maximal number of columns waiting for an index worker */
+const size_t INDEX_WORKER_QUEUE_SIZE = 256;
+
+/* Maximal number of data sets waiting for a store worker */
+const size_t STORE_QUEUE_SIZE = 64;
+
+/* Maximal number of cached sources (input information and ODID) */
+const size_t SOURCE_CACHE_SIZE = 4096;
+
+/* File with the name of the current generation of the hot window */
+const char *HOT_CURRENT = "current";
 
 void ipv6_addr_non_canonical(char *str, const struct in6_addr *addr)
 {
@@ -130,51 +156,249 @@ int get_len_from_type(ELEMENT_TYPE type)
     return len;
 }
 
-void *reorder_index(void *config)
+/* Index of one column of a partition */
+struct index_job {
+	ibis::table *table;
+	const std::string *dir;
+	const char *column;
+	uint64_t us; /* Time of building */
+};
+
+static uint64_t elapsed_us(const struct timespec &start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/**
+ * \brief Reorders and indexes flushed table directories
+ *
+ * Runs in the index queue thread. Each partition is reordered first, then
+ * indexes of all columns are built in parallel by the index workers.
+ * @param conf Plugin configuration data structure
+ * @param dirs Table directories
+ */
+void reorder_index(struct fastbit_config *conf, const std::vector<std::string> &dirs)
 {
-	struct fastbit_config *conf = static_cast<struct fastbit_config*>(config);
 	ibis::table *index_table;
-	std::string dir;
 	ibis::part *reorder_part;
 	ibis::table::stringArray ibis_columns;
+	std::vector<ibis::table *> tables;
+	std::vector<struct index_job> jobs;
 
-	sem_wait(&(conf->sem));
-
-	for (unsigned int i = 0; i < conf->dirs->size(); i++) {
-		dir = (*conf->dirs)[i];
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		const std::string &dir = dirs[i];
 		/* Reorder partitions */
 		if (conf->reorder) {
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
 			MSG_DEBUG(msg_module, "Reordering: %s", dir.c_str());
 			reorder_part = new ibis::part(dir.c_str(), NULL, false);
 			reorder_part->reorder(); /* TODO return value */
 			delete reorder_part;
+
+			uint64_t us = elapsed_us(start);
+			pthread_mutex_lock(&conf->timings_mutex);
+			conf->reorder_timing.count++;
+			conf->reorder_timing.total_us += us;
+			conf->reorder_timing.max_us = std::max(conf->reorder_timing.max_us, us);
+			pthread_mutex_unlock(&conf->timings_mutex);
 		}
 
-		/* Build indexes */
-		if (conf->indexes == 1) { /* Build all indexes */
-			MSG_DEBUG(msg_module, "Creating indexes: %s", dir.c_str());
-			index_table = ibis::table::create(dir.c_str());
-			index_table->buildIndexes(NULL);
-			delete index_table;
-		} else if (conf->indexes == 2) { /* Build selected indexes */
-			index_table = ibis::table::create(dir.c_str());
-			ibis_columns = index_table->columnNames();
-			for (unsigned int i = 0; i < conf->index_en_id->size(); i++) {
-				for (unsigned int j = 0; j < ibis_columns.size(); j++) {
-					if ((*conf->index_en_id)[i] == std::string(ibis_columns[j])) {
-						MSG_DEBUG(msg_module, "Creating indexes: %s%s", dir.c_str(), (*conf->index_en_id)[i].c_str());
-						index_table->buildIndex(ibis_columns[j]);
-					}
-				}
+		if (!conf->indexes) {
+			continue;
+		}
+
+		index_table = ibis::table::create(dir.c_str());
+		if (index_table == NULL) {
+			MSG_ERROR(msg_module, "Unable to open table for indexing: %s", dir.c_str());
+			continue;
+		}
+
+		tables.push_back(index_table);
+
+		/* Select columns; indexes == 1 means all, 2 only marked elements */
+		ibis_columns = index_table->columnNames();
+		for (unsigned int j = 0; j < ibis_columns.size(); j++) {
+			if (conf->indexes == 2 && std::find(conf->index_en_id->begin(), conf->index_en_id->end(),
+					std::string(ibis_columns[j])) == conf->index_en_id->end()) {
+				continue;
 			}
-			delete index_table;
+
+			struct index_job job = {index_table, &dir, ibis_columns[j], 0};
+			jobs.push_back(job);
 		}
+	}
+
+	/* Build indexes of all columns in parallel */
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		struct index_job *job = &jobs[i];
+		conf->index_workers->submit([job]() {
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
+			MSG_DEBUG(msg_module, "Creating indexes: %s%s", job->dir->c_str(), job->column);
+			job->table->buildIndex(job->column);
+			job->us = elapsed_us(start);
+		});
+	}
+
+	conf->index_workers->drain();
+
+	/* Account time per column */
+	pthread_mutex_lock(&conf->timings_mutex);
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		struct index_timing &timing = (*conf->index_timings)[jobs[i].column];
+		timing.count++;
+		timing.total_us += jobs[i].us;
+		timing.max_us = std::max(timing.max_us, jobs[i].us);
+
+		MSG_DEBUG(msg_module, "Index %s%s built in %" PRIu64 " us", jobs[i].dir->c_str(),
+				jobs[i].column, jobs[i].us);
+	}
+	pthread_mutex_unlock(&conf->timings_mutex);
 
-		ibis::fileManager::instance().flushDir(dir.c_str());
+	for (unsigned int i = 0; i < tables.size(); i++) {
+		delete tables[i];
 	}
 
-	sem_post(&(conf->sem));
-	return NULL;
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		ibis::fileManager::instance().flushDir(dirs[i].c_str());
+	}
+
+	/* Tables of the next windows can write into the directories again */
+	pthread_mutex_lock(&conf->index_dirs_mutex);
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		std::map<std::string, int>::iterator it = conf->index_dirs->find(dirs[i]);
+		if (it != conf->index_dirs->end() && --it->second == 0) {
+			conf->index_dirs->erase(it);
+		}
+	}
+	pthread_cond_broadcast(&conf->index_dirs_cond);
+	pthread_mutex_unlock(&conf->index_dirs_mutex);
+}
+
+void index_wait_dir(struct fastbit_config *conf, const std::string &dir)
+{
+	pthread_mutex_lock(&conf->index_dirs_mutex);
+	while (conf->index_dirs->count(dir) > 0) {
+		pthread_cond_wait(&conf->index_dirs_cond, &conf->index_dirs_mutex);
+	}
+	pthread_mutex_unlock(&conf->index_dirs_mutex);
+}
+
+/**
+ * \brief Reports time spent on reordering and building indexes of each column
+ *
+ * Covers partitions processed since the last report; the accumulators are reset.
+ * Columns are sorted from the most expensive one.
+ * @param conf Plugin configuration data structure
+ */
+void report_index_timings(struct fastbit_config *conf)
+{
+	std::map<std::string, struct index_timing> timings;
+	std::map<std::string, struct index_timing>::const_iterator it;
+	std::vector<std::pair<uint64_t, std::string> > order;
+	struct index_timing reorder;
+
+	/* Take accumulated values; the index thread may still be running */
+	pthread_mutex_lock(&conf->timings_mutex);
+	timings.swap(*conf->index_timings);
+	reorder = conf->reorder_timing;
+	memset(&conf->reorder_timing, 0, sizeof(conf->reorder_timing));
+	pthread_mutex_unlock(&conf->timings_mutex);
+
+	if (reorder.count > 0) {
+		MSG_INFO(msg_module, "Reordering time: %" PRIu64 " partitions, total %" PRIu64 " us, avg %"
+				PRIu64 " us, max %" PRIu64 " us", reorder.count, reorder.total_us,
+				reorder.total_us / reorder.count, reorder.max_us);
+	}
+
+	for (it = timings.begin(); it != timings.end(); ++it) {
+		order.push_back(std::make_pair(it->second.total_us, it->first));
+	}
+
+	if (order.empty()) {
+		return;
+	}
+
+	std::sort(order.rbegin(), order.rend());
+
+	MSG_INFO(msg_module, "Index building time per column (%d threads):", conf->index_threads);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		const struct index_timing &timing = timings[order[i].second];
+		MSG_INFO(msg_module, "    > %s: %" PRIu64 " partitions, total %" PRIu64 " us, avg %" PRIu64
+				" us, max %" PRIu64 " us", order[i].second.c_str(), timing.count, timing.total_us,
+				timing.total_us / timing.count, timing.max_us);
+	}
+}
+
+void flush_group_release(struct flush_group *group)
+{
+	if (--group->pending > 0) {
+		return;
+	}
+
+	/* All buffers of the group are on disk; blocks when the index queue is full */
+	struct fastbit_config *conf = group->config;
+	std::vector<std::string> dirs;
+	dirs.swap(group->dirs);
+	delete group;
+
+	if (dirs.empty()) {
+		return;
+	}
+
+	pthread_mutex_lock(&conf->index_dirs_mutex);
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		(*conf->index_dirs)[dirs[i]]++;
+	}
+	pthread_mutex_unlock(&conf->index_dirs_mutex);
+
+	conf->index_queue->submit([conf, dirs]() {
+		reorder_index(conf, dirs);
+	});
+}
+
+/**
+ * \brief Reports statistics of the flush pipeline
+ *
+ * @param conf Plugin configuration data structure
+ */
+void report_pipeline_stats(struct fastbit_config *conf)
+{
+	WorkQueue::stats store, writers, index;
+	conf->writers->get_stats(writers, true);
+	conf->index_queue->get_stats(index, true);
+
+	/* Sum counters of store workers */
+	memset(&store, 0, sizeof(store));
+	for (unsigned int i = 0; i < conf->store_workers->size(); i++) {
+		WorkQueue::stats worker;
+		(*conf->store_workers)[i]->get_stats(worker, true);
+		store.completed += worker.completed;
+		store.peak = std::max(store.peak, worker.peak);
+		store.stalls += worker.stalls;
+		store.stall_us += worker.stall_us;
+	}
+
+	uint64_t buffer_stalls = conf->buffer_stalls.exchange(0);
+	uint64_t buffer_stall_us = conf->buffer_stall_us.exchange(0);
+
+	uint64_t stalls = store.stalls + buffer_stalls + writers.stalls + index.stalls;
+	if (stalls > 0) {
+		MSG_INFO(msg_module, "Flush pipeline stalled: store %" PRIu64 "x (%" PRIu64 " us), "
+				"buffers %" PRIu64 "x (%" PRIu64 " us), writers %" PRIu64 "x (%" PRIu64 " us), "
+				"index %" PRIu64 "x (%" PRIu64 " us)", store.stalls, store.stall_us,
+				buffer_stalls, buffer_stall_us, writers.stalls, writers.stall_us,
+				index.stalls, index.stall_us);
+	}
+
+	MSG_DEBUG(msg_module, "Flush pipeline: %" PRIu64 " data sets stored by workers (peak queue %zu), "
+			"%" PRIu64 " buffers written (peak queue %zu), %" PRIu64 " index jobs (peak queue %zu)",
+			store.completed, store.peak, writers.completed, writers.peak, index.completed, index.peak);
 }
 
 std::string generate_path(struct fastbit_config *config, std::string exporter_ip_addr, uint32_t odid)
@@ -232,15 +456,13 @@ void update_window_name(struct fastbit_config *conf)
  * @param conf Plugin configuration data structure
  * @param exporter_ip_addr Exporter IP address, as String
  * @param odid Observation domain ID
- * @param close Indicates whether plugin/thread should be closed after flushing all data
+ * @param templates Tables to flush
  */
 void flush_data(struct fastbit_config *conf, std::string exporter_ip_addr, uint32_t odid,
-		std::map<uint16_t,template_table*> *templates, bool close)
+		std::map<uint16_t,template_table*> *templates)
 {
 	std::map<uint16_t, template_table*>::iterator table;
-	int s;
-	std::stringstream ss;
-	pthread_t index_thread;
+	struct flush_group *group = NULL;
 
 	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
 	std::map<uint32_t, od_info>::iterator odid_it;
@@ -259,51 +481,41 @@ void flush_data(struct fastbit_config *conf, std::string exporter_ip_addr, uint3
 
 	std::string path = odid_it->second.path;
 
-	sem_wait(&(conf->sem));
-	{
-		conf->dirs->clear();
-
-		MSG_DEBUG(msg_module, "Flushing data to disk (exporter: %s, ODID: %u)",
-				odid_it->second.exporter_ip_addr.c_str(), odid);
-		MSG_DEBUG(msg_module, "    > Exported: %u", odid_it->second.flow_watch.exported_flows());
-		MSG_DEBUG(msg_module, "    > Received: %u", odid_it->second.flow_watch.received_flows());
-
-		for (table = templates->begin(); table != templates->end(); table++) {
-			conf->dirs->push_back(path + ((*table).second)->name() + "/");
-			(*table).second->flush(path);
-			(*table).second->reset_rows();
-		}
+	/* Directories are reordered/indexed once all their buffers are written */
+	if (conf->reorder || conf->indexes) {
+		group = new struct flush_group;
+		group->config = conf;
+		group->pending = 1;
+	}
 
-		if (odid_it->second.flow_watch.write(path) == -1) {
-			MSG_ERROR(msg_module, "Unable to write flow statistics: %s", path.c_str());
-		}
+	MSG_DEBUG(msg_module, "Flushing data to disk (exporter: %s, ODID: %u)",
+			odid_it->second.exporter_ip_addr.c_str(), odid);
+	MSG_DEBUG(msg_module, "    > Exported: %u", odid_it->second.flow_watch.exported_flows());
+	MSG_DEBUG(msg_module, "    > Received: %u", odid_it->second.flow_watch.received_flows());
 
-		odid_it->second.flow_watch.reset_state();
+	for (table = templates->begin(); table != templates->end(); table++) {
+		(*table).second->flush(path, group);
+		(*table).second->reset_rows();
 	}
-	sem_post(&(conf->sem));
 
-	if ((s = pthread_create(&index_thread, NULL, reorder_index, conf)) != 0) {
-		MSG_ERROR(msg_module, "pthread_create");
+	if (odid_it->second.flow_watch.write(path) == -1) {
+		MSG_ERROR(msg_module, "Unable to write flow statistics: %s", path.c_str());
 	}
 
-	if (close) {
-		if ((s = pthread_join(index_thread, NULL)) != 0) {
-			MSG_ERROR(msg_module, "pthread_join");
-		}
-	} else {
-		if ((s = pthread_detach(index_thread)) != 0) {
-			MSG_ERROR(msg_module, "pthread_detach");
-		}
+	odid_it->second.flow_watch.reset_state();
+
+	if (group) {
+		flush_group_release(group);
 	}
 }
 
 /**
  * \brief Flushes the data for *all* exporters and ODIDs
  *
+ * Store workers must be idle (see store_barrier()).
  * @param conf Plugin configuration data structure
- * @param close Indicates whether plugin/thread should be closed after flushing all data
  */
-void flush_all_data(struct fastbit_config *conf, bool close)
+void flush_all_data(struct fastbit_config *conf)
 {
 	std::map<std::string, std::map<uint32_t, od_info>*> *od_infos = conf->od_infos;
 	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
@@ -312,9 +524,137 @@ void flush_all_data(struct fastbit_config *conf, bool close)
 	/* Iterate over all exporters and ODIDs and flush data */
 	for (exporter_it = od_infos->begin(); exporter_it != od_infos->end(); ++exporter_it) {
 		for (odid_it = exporter_it->second->begin(); odid_it != exporter_it->second->end(); ++odid_it) {
-			flush_data(conf, exporter_it->first, odid_it->first, &(odid_it->second.template_info), close);
+			flush_data(conf, exporter_it->first, odid_it->first, &(odid_it->second.template_info));
+		}
+	}
+}
+
+/**
+ * \brief Create a directory if it does not exist
+ *
+ * @return 0 on success, otherwise non-zero
+ */
+static int make_dir(const std::string &path)
+{
+	if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+		MSG_ERROR(msg_module, "Cannot create directory '%s': %s", path.c_str(), strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	(void) sb;
+	(void) flag;
+	(void) ftw;
+	return remove(path);
+}
+
+/**
+ * \brief Remove generations of the hot window
+ *
+ * Only directories named by a generation number are removed.
+ * @param conf Plugin configuration data structure
+ * @param all Remove all generations, otherwise keep the current and the
+ * previous one (it can still be read by fbitdump)
+ * @param current Current generation
+ */
+void hot_cleanup(const struct fastbit_config *conf, bool all, uint64_t current)
+{
+	DIR *d = opendir(conf->hot_path.c_str());
+	if (d == NULL) {
+		return;
+	}
+
+	struct dirent *dent;
+	while ((dent = readdir(d)) != NULL) {
+		if (dent->d_name[0] == '\0' || strspn(dent->d_name, "0123456789") != strlen(dent->d_name)) {
+			continue;
+		}
+
+		uint64_t generation = strtoull(dent->d_name, NULL, 10);
+		if (all || generation + 1 < current) {
+			nftw((conf->hot_path + dent->d_name).c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
 		}
 	}
+
+	closedir(d);
+}
+
+/* Table of a hot window generation and its observation domain directory */
+struct hot_table {
+	template_table *table;
+	std::string exporter_dir;
+	std::string odid_dir;
+};
+
+/* Hot window generation written by the store workers */
+struct hot_generation {
+	struct fastbit_config *config;
+	std::string name;
+	uint64_t generation;
+	std::atomic<int> pending;       /* Number of unfinished snapshot jobs + 1 */
+};
+
+/**
+ * \brief Release one reference of a hot window generation
+ *
+ * The last release makes the generation current. Generations are completed
+ * in order as each store worker processes its jobs in order.
+ */
+static void hot_generation_release(struct hot_generation *gen)
+{
+	if (--gen->pending > 0) {
+		return;
+	}
+
+	struct fastbit_config *conf = gen->config;
+
+	/* Switch to the new generation atomically */
+	std::string current = conf->hot_path + HOT_CURRENT;
+	FILE *f = fopen((current + ".tmp").c_str(), "w");
+	if (f == NULL) {
+		MSG_ERROR(msg_module, "Cannot write '%s.tmp': %s", current.c_str(), strerror(errno));
+	} else {
+		fprintf(f, "%s\n", gen->name.c_str());
+		if (fclose(f) != 0 || rename((current + ".tmp").c_str(), current.c_str()) != 0) {
+			MSG_ERROR(msg_module, "Cannot publish hot window '%s': %s", current.c_str(), strerror(errno));
+		} else {
+			MSG_DEBUG(msg_module, "Published hot window generation %s", gen->name.c_str());
+			hot_cleanup(conf, false, gen->generation);
+		}
+	}
+
+	conf->hot_busy = false;
+	delete gen;
+}
+
+/**
+ * \brief Write snapshots of tables to a hot window generation
+ *
+ * Runs in the thread that stores data sets of the tables.
+ * @param gen Hot window generation
+ * @param tables Tables of the generation
+ */
+static void hot_snapshot(struct hot_generation *gen, const std::vector<struct hot_table> &tables)
+{
+	for (unsigned int i = 0; i < tables.size(); i++) {
+		const struct hot_table &hot = tables[i];
+		if (hot.table->rows() == 0) {
+			continue;
+		}
+
+		/* Directories of the observation domain can be created by another worker */
+		if (make_dir(hot.exporter_dir) != 0 || make_dir(hot.odid_dir) != 0) {
+			break;
+		}
+
+		hot.table->snapshot(hot.odid_dir + hot.table->name());
+	}
+
+	hot_generation_release(gen);
 }
 
 int process_startup_xml(char *params, struct fastbit_config *c)
@@ -322,7 +662,9 @@ int process_startup_xml(char *params, struct fastbit_config *c)
 	struct tm *timeinfo;
 	char formated_time[17];
 	std::string path, time_window, record_limit, name_type, name_prefix,
-			indexes, reorder, create_sp_files, test, template_field_lengths, time_alignment;
+			indexes, reorder, create_sp_files, test, template_field_lengths, time_alignment,
+			writer_threads, index_queue_size, index_threads, store_threads, io_uring, sync_files,
+			max_open_files, hot_path, hot_interval;
 	pugi::xml_document doc;
 	doc.load(params);
 
@@ -346,6 +688,66 @@ int process_startup_xml(char *params, struct fastbit_config *c)
 		reorder = ie.node().child_value("reorder");
 		c->reorder = (reorder == "yes");
 
+		writer_threads = ie.node().child_value("writerThreads");
+		c->writer_threads = (writer_threads.empty()) ? DEF_WRITER_THREADS : atoi(writer_threads.c_str());
+
+		index_queue_size = ie.node().child_value("indexQueueSize");
+		c->index_queue_size = (index_queue_size.empty()) ? DEF_INDEX_QUEUE_SIZE : atoi(index_queue_size.c_str());
+
+		/* By default, use all online processors for building indexes */
+		index_threads = ie.node().child_value("indexThreads");
+		c->index_threads = (index_threads.empty()) ? sysconf(_SC_NPROCESSORS_ONLN) : atoi(index_threads.c_str());
+		if (c->index_threads < 0) {
+			c->index_threads = DEF_INDEX_THREADS;
+		}
+
+		store_threads = ie.node().child_value("storeThreads");
+		c->store_threads = (store_threads.empty()) ? DEF_STORE_THREADS : atoi(store_threads.c_str());
+
+		if (c->writer_threads < 0 || c->index_queue_size < 1 || c->store_threads < 0) {
+			MSG_ERROR(msg_module, "Invalid writerThreads, indexQueueSize or storeThreads value");
+			return 1;
+		}
+
+		io_uring = ie.node().child_value("ioUring");
+		c->io_uring = (io_uring == "yes");
+#ifndef HAVE_LIBURING
+		if (c->io_uring) {
+			MSG_WARNING(msg_module, "Plugin was built without io_uring support; using pwrite()");
+			c->io_uring = false;
+		}
+#endif
+
+		sync_files = ie.node().child_value("syncOnClose");
+		c->sync_files = (!ie.node().child("syncOnClose") || sync_files == "yes");
+
+		/* By default, keep open at most half of the allowed file descriptors */
+		max_open_files = ie.node().child_value("maxOpenFiles");
+		if (max_open_files.empty()) {
+			struct rlimit limit;
+			c->max_open_files = DEF_MAX_OPEN_FILES;
+			if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+				c->max_open_files = limit.rlim_cur / 2;
+			}
+		} else {
+			c->max_open_files = atoi(max_open_files.c_str());
+		}
+
+		/* Snapshots of buffers for fbitdump are written only when hotPath is set */
+		hot_path = ie.node().child_value("hotPath");
+		if (!hot_path.empty() && hot_path.at(hot_path.size() - 1) != '/') {
+			hot_path += "/";
+		}
+
+		c->hot_path = hot_path;
+
+		hot_interval = ie.node().child_value("hotInterval");
+		c->hot_interval = (hot_interval.empty()) ? DEF_HOT_INTERVAL : atoi(hot_interval.c_str());
+		if (c->hot_interval < 1) {
+			MSG_ERROR(msg_module, "Invalid hotInterval value");
+			return 1;
+		}
+
 		template_field_lengths = ie.node().child_value("useTemplateFieldLengths");
 		c->use_template_field_lengths =
 				(!ie.node().child("useTemplateFieldLengths") || template_field_lengths == "yes");
@@ -429,11 +831,6 @@ int process_startup_xml(char *params, struct fastbit_config *c)
 
 			c->window_dir = c->prefix + "/";
 		}
-
-		if (sem_init(&(c->sem), 0, 1)) {
-			MSG_ERROR(msg_module, "Semaphore initialization error");
-			return 1;
-		}
 	} else {
 		return 1;
 	}
@@ -467,45 +864,125 @@ int storage_init(char *params, void **config)
 		return 1;
 	}
 
-	c->dirs = new std::vector<std::string>;
-	if (c->dirs == NULL) {
-		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
-		return 1;
-	}
-
 	/* Parse configuration xml and updated configure structure according to it */
 	if (process_startup_xml(params, c)) {
 		MSG_ERROR(msg_module, "Unable to parse plugin configuration");
 		return 1;
 	}
-	
+
+	/* Buffers are written by a pool of writers, indexes are built by a single thread */
+	c->writers = new WorkQueue("writer", c->writer_threads, WRITER_QUEUE_SIZE);
+	c->index_queue = new WorkQueue("index", 1, c->index_queue_size);
+	c->index_workers = new WorkQueue("index worker", c->index_threads, INDEX_WORKER_QUEUE_SIZE);
+	c->index_timings = new std::map<std::string, struct index_timing>;
+	c->index_dirs = new std::map<std::string, int>;
+	memset(&c->reorder_timing, 0, sizeof(c->reorder_timing));
+	c->sources = new std::unordered_map<source_key, struct source_entry, source_key_hash>;
+	c->buffer_stalls = 0;
+	c->buffer_stall_us = 0;
+	c->open_files = 0;
+
+	/* Each store worker has its own queue to keep order of data sets of a table */
+	c->store_workers = new std::vector<WorkQueue *>;
+	for (int i = 0; i < c->store_threads; i++) {
+		c->store_workers->push_back(new WorkQueue("store", 1, STORE_QUEUE_SIZE));
+	}
+
+	c->window_records = 0;
+	pthread_mutex_init(&c->flows_mutex, NULL);
+	pthread_mutex_init(&c->timings_mutex, NULL);
+	pthread_mutex_init(&c->index_dirs_mutex, NULL);
+	pthread_cond_init(&c->index_dirs_cond, NULL);
+
+	/* Remove hot window of a previous run */
+	c->hot_generation = 0;
+	c->hot_busy = false;
+	time(&(c->hot_last));
+	if (!c->hot_path.empty()) {
+		if (make_dir(c->hot_path) != 0) {
+			return 1;
+		}
+
+		unlink((c->hot_path + HOT_CURRENT).c_str());
+		hot_cleanup(c, true, 0);
+	}
+
 	/* On startup we expect to write to new directory */
 	c->new_dir = true;
 	return 0;
 }
 
-extern "C"
-int store_packet(void *config, const struct ipfix_message *ipfix_msg,
-		const struct ipfix_template_mgr *template_mgr)
+/**
+ * \brief Find template table by template ID
+ *
+ * @param info Observation domain
+ * @param template_id Template ID
+ * @return Table or NULL
+ */
+static inline template_table *find_table(struct od_info *info, uint16_t template_id)
 {
-	(void) template_mgr;
-	std::map<uint16_t, template_table*>::iterator table;
-	struct fastbit_config *conf = (struct fastbit_config *) config;
-	std::map<uint16_t, template_table*> *templates = NULL;
-	std::map<uint16_t, template_table*> *old_templates = NULL; /* Templates to be removed */
+	return (template_id < info->template_index.size()) ? info->template_index[template_id] : NULL;
+}
 
-	std::map<std::string, std::map<uint32_t, od_info>*> *od_infos = conf->od_infos;
-	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
-	std::map<uint32_t, od_info>::iterator odid_it;
+/**
+ * \brief Add a template table to an observation domain (replaces the old one)
+ *
+ * @param info Observation domain
+ * @param template_id Template ID
+ * @param table Table or NULL to remove the table
+ */
+static void set_table(struct od_info *info, uint16_t template_id, template_table *table)
+{
+	if (table == NULL) {
+		info->template_info.erase(template_id);
+	} else {
+		info->template_info[template_id] = table;
+	}
 
-	static int rcnt = 0;
+	if (template_id >= info->template_index.size()) {
+		info->template_index.resize(template_id + 1, NULL);
+	}
 
-	uint16_t template_id;
-	uint32_t odid = ntohl(ipfix_msg->pkt_header->observation_domain_id);
-	struct input_info_network *input = (struct input_info_network *) ipfix_msg->input_info;
+	info->template_index[template_id] = table;
+}
 
-	int rc_flows = 0;
-	uint64_t rc_flows_sum = 0;
+/**
+ * \brief Get size of the exporter address of an input
+ */
+static inline size_t source_addr_size(const struct input_info_network *input)
+{
+	return (input->l3_proto == 6) ? sizeof(input->src_addr.ipv6) : sizeof(input->src_addr.ipv4);
+}
+
+/**
+ * \brief Find observation domain of a message
+ *
+ * Sources are cached by their input information and ODID, so the exporter
+ * address is formatted and looked up in od_infos only for the first
+ * message of a source.
+ *
+ * @param conf Plugin configuration data structure
+ * @param input_info Input information of the message
+ * @param odid Observation domain ID
+ * @return Observation domain
+ */
+static struct od_info *resolve_source(struct fastbit_config *conf, const struct input_info *input_info,
+		uint32_t odid)
+{
+	struct input_info_network *input = (struct input_info_network *) input_info;
+	source_key key(input_info, odid);
+
+	/* The input information may be reused by another exporter; check the address */
+	std::unordered_map<source_key, struct source_entry, source_key_hash>::iterator cached;
+	cached = conf->sources->find(key);
+	if (cached != conf->sources->end() && cached->second.l3_proto == input->l3_proto
+			&& memcmp(cached->second.src_addr, &(input->src_addr), source_addr_size(input)) == 0) {
+		return cached->second.info;
+	}
+
+	std::map<std::string, std::map<uint32_t, od_info>*> *od_infos = conf->od_infos;
+	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
+	std::map<uint32_t, od_info>::iterator odid_it;
 
 	char exporter_ip_addr_tmp[INET6_ADDRSTRLEN];
 	if (input->l3_proto == 6) { /* IPv6 */
@@ -540,7 +1017,258 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 		odid_it = exporter_it->second->find(odid);
 	}
 
-	templates = &(odid_it->second.template_info);
+	/* Entries of closed sources are never removed; keep the cache bounded */
+	if (conf->sources->size() >= SOURCE_CACHE_SIZE) {
+		conf->sources->clear();
+	}
+
+	struct source_entry entry;
+	entry.l3_proto = input->l3_proto;
+	memcpy(entry.src_addr, &(input->src_addr), source_addr_size(input));
+	entry.info = &(odid_it->second);
+	(*conf->sources)[key] = entry;
+
+	return entry.info;
+}
+
+/* Data sets of one message stored by the store workers */
+struct store_batch {
+	struct fastbit_config *config;
+	struct od_info *info;
+	uint32_t seq_no;
+	std::vector<uint8_t> data;      /* Copies of the data sets */
+	std::atomic<uint64_t> flows;    /* Number of stored records */
+	std::atomic<int> pending;       /* Number of unfinished data sets + 1 */
+};
+
+/**
+ * \brief Release one reference of a store batch
+ *
+ * The last release updates flow statistics of the observation domain.
+ */
+static void store_batch_release(struct store_batch *batch)
+{
+	if (--batch->pending > 0) {
+		return;
+	}
+
+	struct fastbit_config *conf = batch->config;
+	pthread_mutex_lock(&conf->flows_mutex);
+	if (batch->flows) {
+		batch->info->flow_watch.add_flows(batch->flows);
+	}
+
+	batch->info->flow_watch.update_seq_no(batch->seq_no);
+	pthread_mutex_unlock(&conf->flows_mutex);
+
+	delete batch;
+}
+
+/**
+ * \brief Get index of the store worker of a table
+ *
+ * Tables are sharded by observation domain and template ID.
+ */
+static inline size_t store_worker_index(struct fastbit_config *conf, const struct od_info *info,
+		uint16_t template_id)
+{
+	size_t hash = ((uintptr_t) info >> 4) ^ template_id;
+	return hash % conf->store_workers->size();
+}
+
+/**
+ * \brief Get store worker of a table
+ */
+static inline WorkQueue *store_worker(struct fastbit_config *conf, const struct od_info *info,
+		uint16_t template_id)
+{
+	return (*conf->store_workers)[store_worker_index(conf, info, template_id)];
+}
+
+/**
+ * \brief Wait until store workers store all submitted data sets
+ *
+ * Tables can be flushed or removed only when store workers are idle.
+ * @param conf Plugin configuration data structure
+ */
+static void store_barrier(struct fastbit_config *conf)
+{
+	for (unsigned int i = 0; i < conf->store_workers->size(); i++) {
+		(*conf->store_workers)[i]->drain();
+	}
+}
+
+/**
+ * \brief Publish records of all tables that are not written yet
+ *
+ * Buffers of the tables are written as partitions to a new generation
+ * directory of the hot window, which then becomes current. fbitdump reads
+ * the current generation as additional partitions (-H).
+ * Snapshots are queued to the store workers after data sets already
+ * submitted, so the storage thread does not wait for them. A new generation
+ * is not started until the previous one is published.
+ * @param conf Plugin configuration data structure
+ */
+static void hot_publish(struct fastbit_config *conf)
+{
+	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
+	std::map<uint32_t, od_info>::iterator odid_it;
+	std::map<uint16_t, template_table*>::iterator table;
+
+	time(&(conf->hot_last));
+	if (conf->hot_busy) {
+		MSG_DEBUG(msg_module, "Hot window generation %" PRIu64 " is still being written",
+				conf->hot_generation);
+		return;
+	}
+
+	conf->hot_generation++;
+
+	std::stringstream ss;
+	ss << conf->hot_generation;
+	std::string generation_dir = conf->hot_path + ss.str() + "/";
+	if (make_dir(generation_dir) != 0) {
+		return;
+	}
+
+	/* Tables are grouped by the thread that stores their data sets */
+	size_t workers = std::max((size_t) 1, conf->store_workers->size());
+	std::vector<std::vector<struct hot_table> > tables(workers);
+
+	for (exporter_it = conf->od_infos->begin(); exporter_it != conf->od_infos->end(); ++exporter_it) {
+		for (odid_it = exporter_it->second->begin(); odid_it != exporter_it->second->end(); ++odid_it) {
+			std::map<uint16_t, template_table*> &templates = odid_it->second.template_info;
+			std::stringstream odid;
+			odid << odid_it->first;
+
+			struct hot_table hot;
+			hot.exporter_dir = generation_dir + exporter_it->first + "/";
+			hot.odid_dir = hot.exporter_dir + odid.str() + "/";
+
+			for (table = templates.begin(); table != templates.end(); ++table) {
+				size_t worker = 0;
+				if (!conf->store_workers->empty()) {
+					worker = store_worker_index(conf, &(odid_it->second), table->first);
+				}
+
+				hot.table = table->second;
+				tables[worker].push_back(hot);
+			}
+		}
+	}
+
+	struct hot_generation *gen = new struct hot_generation;
+	gen->config = conf;
+	gen->name = ss.str();
+	gen->generation = conf->hot_generation;
+	gen->pending = 1;
+	conf->hot_busy = true;
+
+	if (conf->store_workers->empty()) {
+		/* Tables are stored by this thread */
+		gen->pending++;
+		hot_snapshot(gen, tables[0]);
+	} else {
+		for (unsigned int i = 0; i < workers; i++) {
+			std::vector<struct hot_table> worker_tables;
+			worker_tables.swap(tables[i]);
+
+			gen->pending++;
+			(*conf->store_workers)[i]->submit([gen, worker_tables]() {
+				hot_snapshot(gen, worker_tables);
+			});
+		}
+	}
+
+	hot_generation_release(gen);
+}
+
+/**
+ * \brief Switch all observation domains to a new window
+ *
+ * @param conf Plugin configuration data structure
+ * @param flush_records Rotation is caused by record limit
+ * @param now Current time (time based rotation)
+ */
+static void rotate_window(struct fastbit_config *conf, bool flush_records, time_t now)
+{
+	std::map<std::string, std::map<uint32_t, od_info>*>::iterator exporter_it;
+	std::map<uint32_t, od_info>::iterator odid_it;
+
+	/* Flush data for all exporters and ODIDs */
+	store_barrier(conf);
+	flush_all_data(conf);
+	report_pipeline_stats(conf);
+	report_index_timings(conf);
+
+	/* Records of the hot window are in the closed window now */
+	if (!conf->hot_path.empty()) {
+		hot_publish(conf);
+	}
+
+	/* Time management differs between flush policies (records vs. time) */
+	if (flush_records) {
+		time(&(conf->last_flush));
+	} else {
+		while (difftime(now, conf->last_flush) > conf->time_window) {
+			conf->last_flush = conf->last_flush + conf->time_window;
+		}
+	}
+
+	/* Update window name and paths */
+	update_window_name(conf);
+	for (exporter_it = conf->od_infos->begin(); exporter_it != conf->od_infos->end(); ++exporter_it) {
+		for (odid_it = exporter_it->second->begin(); odid_it != exporter_it->second->end(); ++odid_it) {
+			odid_it->second.path = generate_path(conf, exporter_it->first, odid_it->first);
+		}
+	}
+
+	conf->window_records = 0;
+	conf->new_dir = true;
+}
+
+extern "C"
+int store_packet(void *config, const struct ipfix_message *ipfix_msg,
+		const struct ipfix_template_mgr *template_mgr)
+{
+	(void) template_mgr;
+	template_table *table;
+	struct fastbit_config *conf = (struct fastbit_config *) config;
+	std::map<uint16_t, template_table*> old_templates; /* Templates to be removed */
+
+	uint16_t template_id;
+	uint32_t odid = ntohl(ipfix_msg->pkt_header->observation_domain_id);
+	struct od_info *info = resolve_source(conf, ipfix_msg->input_info, odid);
+
+	int rc_flows = 0;
+	uint64_t rc_flows_sum = 0;
+
+	/* Publish records waiting in buffers for fbitdump */
+	if (!conf->hot_path.empty() && difftime(time(NULL), conf->hot_last) >= conf->hot_interval) {
+		hot_publish(conf);
+	}
+
+	/* With store workers, data sets are copied as the message is released on return */
+	struct store_batch *batch = NULL;
+	size_t offsets[MSG_MAX_DATA_COUPLES];
+
+	if (!conf->store_workers->empty()) {
+		batch = new struct store_batch;
+		batch->config = conf;
+		batch->info = info;
+		batch->seq_no = ntohl(ipfix_msg->pkt_header->sequence_number);
+		batch->flows = 0;
+		batch->pending = 1;
+
+		for (int i = 0; i < MSG_MAX_DATA_COUPLES && ipfix_msg->data_couple[i].data_set; i++) {
+			struct ipfix_data_set *data_set = ipfix_msg->data_couple[i].data_set;
+			offsets[i] = batch->data.size();
+			if (ipfix_msg->data_couple[i].data_template != NULL) {
+				batch->data.insert(batch->data.end(), (uint8_t *) data_set,
+						(uint8_t *) data_set + ntohs(data_set->header.length));
+			}
+		}
+	}
 
 	/* Process all datasets in message */
 	int i;
@@ -553,7 +1281,7 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 		template_id = ipfix_msg->data_couple[i].data_template->template_id;
 
 		/* If template (ID) is unknown, add it to the template map */
-		if ((table = templates->find(template_id)) == templates->end()) {
+		if ((table = find_table(info, template_id)) == NULL) {
 			MSG_DEBUG(msg_module, "Received new template: %hu", template_id);
 			template_table *table_tmp = new template_table(template_id, conf->buff_size);
 			if (table_tmp->parse_template(ipfix_msg->data_couple[i].data_template, conf) != 0) {
@@ -562,31 +1290,26 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 				continue;
 			}
 			
-			templates->insert(std::pair<uint16_t, template_table*>(template_id, table_tmp));
-			table = templates->find(template_id);
+			set_table(info, template_id, table_tmp);
+			table = table_tmp;
 		} else {
 			/* Check template time. On reception of a new template it is crucial to rewrite the old one. */
-			if (ipfix_msg->data_couple[i].data_template->first_transmission > table->second->get_first_transmission()) {
+			if (ipfix_msg->data_couple[i].data_template->first_transmission > table->get_first_transmission()) {
 				MSG_DEBUG(msg_module, "Received new template with already used template ID: %hu", template_id);
 
-				/* Init map for old template if necessary */
-				if (old_templates == NULL) {
-					old_templates = new std::map<uint16_t,template_table*>;
-				}
-
 				/* Store old template */
-				old_templates->insert(std::pair<uint16_t, template_table*>(table->first, table->second));
+				old_templates.insert(std::pair<uint16_t, template_table*>(template_id, table));
 
 				/* Flush data */
-				flush_data(conf, exporter_ip_addr, odid, old_templates, false);
+				store_barrier(conf);
+				flush_data(conf, info->exporter_ip_addr, odid, &old_templates);
 
 				/* Remove rewritten template */
-				delete table->second;
-				delete old_templates;
-				old_templates = NULL;
+				delete table;
+				old_templates.clear();
 
 				/* Remove old template from current list */
-				templates->erase(table);
+				set_table(info, template_id, NULL);
 
 				/* Add the new template */
 				template_table *table_tmp = new template_table(template_id, conf->buff_size);
@@ -596,14 +1319,15 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 					continue;
 				}
 
-				templates->insert(std::pair<uint16_t, template_table*>(template_id, table_tmp));
-				table = templates->find(template_id);
+				set_table(info, template_id, table_tmp);
+				table = table_tmp;
 				/* New template was created; create new directory if necessary */
 			}
 		}
 
 		/* Check whether data has to be flushed before storing data record */
-		bool flush_records = conf->records_window > 0 && rcnt > conf->records_window;
+		bool flush_records = conf->records_window > 0
+				&& conf->window_records > (uint64_t) conf->records_window;
 		bool flush_time = false;
 		time_t now;
 		if (conf->time_window > 0) {
@@ -612,31 +1336,37 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 		}
 
 		if (flush_records || flush_time) {
-			/* Flush data for all exporters and ODIDs */
-			flush_all_data(conf, false);
-
-			/* Time management differs between flush policies (records vs. time) */
-			if (flush_records) {
-				time(&(conf->last_flush));
-			} else if (flush_time) {
-				while (difftime(now, conf->last_flush) > conf->time_window) {
-					conf->last_flush = conf->last_flush + conf->time_window;
-				}
-			}
+			/* All store workers switch to the new window together */
+			rotate_window(conf, flush_records, now);
+		}
 
-			/* Update window name and path */
-			update_window_name(conf);
-			odid_it->second.path = generate_path(conf, exporter_ip_addr, (*odid_it).first);
+		if (batch) {
+			/* Store this data set by the worker of the table. Records are counted
+			 * here so that windows are rotated at the same records as without workers. */
+			ipfix_data_set *data_set = (ipfix_data_set *) &(batch->data[offsets[i]]);
+			std::string path = info->path;
+			bool new_dir = conf->new_dir;
+
+			conf->window_records += data_set_records_count(ipfix_msg->data_couple[i].data_set,
+					ipfix_msg->data_couple[i].data_template);
+
+			batch->pending++;
+			store_worker(conf, info, template_id)->submit([batch, table, data_set, path, new_dir]() {
+				int rc = table->store(data_set, path, new_dir);
+				if (rc > 0) {
+					batch->flows += rc;
+				}
 
-			rcnt = 0;
-			conf->new_dir = true;
+				store_batch_release(batch);
+			});
+			continue;
 		}
 
 		/* Store this data record */
-		rc_flows = (*table).second->store(ipfix_msg->data_couple[i].data_set, odid_it->second.path, conf->new_dir);
+		rc_flows = table->store(ipfix_msg->data_couple[i].data_set, info->path, conf->new_dir);
 		if (rc_flows >= 0) {
 			rc_flows_sum += rc_flows;
-			rcnt += rc_flows;
+			conf->window_records += rc_flows;
 		} else {
 			/* No need for showing error message here, since it is already done 
 			 * by store() in case of an error */
@@ -647,11 +1377,17 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 	/* We've told all tables that the directory has changed */
 	conf->new_dir = false;
 
+	if (batch) {
+		/* Flow statistics are updated when all data sets are stored */
+		store_batch_release(batch);
+		return 0;
+	}
+
 	if (rc_flows_sum) {
-		odid_it->second.flow_watch.add_flows(rc_flows_sum);
+		info->flow_watch.add_flows(rc_flows_sum);
 	}
 
-	odid_it->second.flow_watch.update_seq_no(ntohl(ipfix_msg->pkt_header->sequence_number));
+	info->flow_watch.update_seq_no(ntohl(ipfix_msg->pkt_header->sequence_number));
 	return 0;
 }
 
@@ -674,13 +1410,20 @@ int storage_close(void **config)
 	std::map<uint16_t, template_table*> *templates;
 	std::map<uint16_t, template_table*>::iterator table;
 
+	/* Store remaining data sets */
+	for (unsigned int i = 0; i < conf->store_workers->size(); i++) {
+		delete (*conf->store_workers)[i];
+	}
+
+	conf->store_workers->clear();
+
 	/* Iterate over all exporters and ODIDs, flush data and release templates */
 	for (exporter_it = od_infos->begin(); exporter_it != od_infos->end(); ++exporter_it) {
 		for (odid_it = exporter_it->second->begin(); odid_it != exporter_it->second->end(); ++odid_it) {
 			templates = &(odid_it->second.template_info);
-			flush_data(conf, exporter_it->first, odid_it->first, templates, true);
+			flush_data(conf, exporter_it->first, odid_it->first, templates);
 
-			/* Free templates */
+			/* Free templates (waits for pending writes) */
 			for (table = templates->begin(); table != templates->end(); table++) {
 				delete (*table).second;
 			}
@@ -689,10 +1432,29 @@ int storage_close(void **config)
 		delete (*exporter_it).second;
 	}
 
+	/* Wait for writers first; they can still submit index jobs */
+	delete conf->writers;
+	delete conf->index_queue;
+	delete conf->index_workers;
+	report_index_timings(conf);
+
+	/* All records are in windows */
+	if (!conf->hot_path.empty()) {
+		unlink((conf->hot_path + HOT_CURRENT).c_str());
+		hot_cleanup(conf, true, 0);
+	}
+
 	/* Free config structure */
 	delete od_infos;
 	delete conf->index_en_id;
-	delete conf->dirs;
+	delete conf->index_timings;
+	delete conf->index_dirs;
+	delete conf->sources;
+	delete conf->store_workers;
+	pthread_mutex_destroy(&conf->flows_mutex);
+	pthread_mutex_destroy(&conf->timings_mutex);
+	pthread_cond_destroy(&conf->index_dirs_cond);
+	pthread_mutex_destroy(&conf->index_dirs_mutex);
 	delete conf;
 	return 0;
 }
@@ -59,6 +59,24 @@
 /* size of elements buffer (number of stored elements) */
 const unsigned int RESERVED_SPACE = 75000;
 
+/* Default number of threads writing buffers to disk */
+const int DEF_WRITER_THREADS = 2;
+
+/* Default number of windows waiting for reorder & index thread */
+const int DEF_INDEX_QUEUE_SIZE = 4;
+
+/* Number of threads building indexes when number of processors is unknown */
+const int DEF_INDEX_THREADS = 1;
+
+/* Default number of threads storing data sets (0 = the storage thread only) */
+const int DEF_STORE_THREADS = 0;
+
+/* Default interval of hot window snapshots (seconds) */
+const int DEF_HOT_INTERVAL = 10;
+
+/* Maximal number of open column files when the limit of descriptors is unknown */
+const int DEF_MAX_OPEN_FILES = 512;
+
 /** Identifier to MSG_* macros */
 #define msg_module "fastbit storage"
 
@@ -80,6 +98,9 @@ struct od_info {
 	/* template_table by template ID */
 	std::map<uint16_t, template_table*> template_info;
 
+	/* template_info indexed directly by template ID (NULL = unknown template) */
+	std::vector<template_table*> template_index;
+
 	/* String representation of exporter IP address in non-canonical */
 	std::string exporter_ip_addr;
 
@@ -0,0 +1,201 @@
+/**
+ * \file fastbit_decoder.cpp
+ * \brief Row decoder of fixed-length templates
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+extern "C" {
+	#include <ipfixcol/verbose.h>
+}
+
+#include <string.h>
+#include <endian.h>
+#include <algorithm>
+
+#include "fastbit_element.h"
+#include "fastbit_decoder.h"
+
+/* Read big-endian unsigned integer of SRC bytes */
+template <int SRC>
+static inline uint64_t load_be(const uint8_t *src)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < SRC; i++) {
+		value = (value << 8) | src[i];
+	}
+
+	return value;
+}
+
+template <>
+inline uint64_t load_be<2>(const uint8_t *src)
+{
+	uint16_t value;
+	memcpy(&value, src, sizeof(value));
+	return be16toh(value);
+}
+
+template <>
+inline uint64_t load_be<4>(const uint8_t *src)
+{
+	uint32_t value;
+	memcpy(&value, src, sizeof(value));
+	return be32toh(value);
+}
+
+template <>
+inline uint64_t load_be<8>(const uint8_t *src)
+{
+	uint64_t value;
+	memcpy(&value, src, sizeof(value));
+	return be64toh(value);
+}
+
+/* Convert values of SRC bytes to host order integers of type DST
+ * (zero extended or truncated as by el_uint::fill()) */
+template <int SRC, typename DST>
+static void convert(uint8_t *dst, const uint8_t *src, uint32_t stride, uint32_t count)
+{
+	DST *out = reinterpret_cast<DST *>(dst);
+	for (uint32_t i = 0; i < count; i++, src += stride) {
+		out[i] = static_cast<DST>(load_be<SRC>(src));
+	}
+}
+
+template <int SRC>
+static column_convert_fn get_convert_src(uint16_t dst_size)
+{
+	switch (dst_size) {
+	case 1: return convert<SRC, uint8_t>;
+	case 2: return convert<SRC, uint16_t>;
+	case 4: return convert<SRC, uint32_t>;
+	case 8: return convert<SRC, uint64_t>;
+	default: return NULL;
+	}
+}
+
+/* Get conversion of a big-endian integer of src_size bytes to dst_size bytes */
+static column_convert_fn get_convert(uint16_t src_size, uint16_t dst_size)
+{
+	switch (src_size) {
+	case 1: return get_convert_src<1>(dst_size);
+	case 2: return get_convert_src<2>(dst_size);
+	case 3: return get_convert_src<3>(dst_size);
+	case 4: return get_convert_src<4>(dst_size);
+	case 5: return get_convert_src<5>(dst_size);
+	case 6: return get_convert_src<6>(dst_size);
+	case 7: return get_convert_src<7>(dst_size);
+	case 8: return get_convert_src<8>(dst_size);
+	default: return NULL;
+	}
+}
+
+row_decoder *row_decoder::create(const std::vector<element *> &set)
+{
+	row_decoder *decoder = new row_decoder();
+	uint32_t offset = 0;
+	uint16_t src_size, dst_size;
+
+	for (element *el : set) {
+		struct column_op op = {el, (uint16_t) offset, NULL};
+
+		switch (el->get_conversion(src_size, dst_size)) {
+		case element::CONV_INTEGER:
+			op.convert = get_convert(src_size, dst_size);
+			if (op.convert == NULL) {
+				delete decoder;
+				return NULL;
+			}
+
+			decoder->_ops.push_back(op);
+			break;
+		case element::CONV_FILL:
+			decoder->_ops.push_back(op);
+			break;
+		case element::CONV_SKIP:
+			break;
+		default:
+			/* Variable-length field; offsets differ between records */
+			delete decoder;
+			return NULL;
+		}
+
+		offset += src_size;
+	}
+
+	if (offset == 0 || offset > UINT16_MAX) {
+		delete decoder;
+		return NULL;
+	}
+
+	decoder->_record_size = offset;
+	return decoder;
+}
+
+uint32_t row_decoder::capacity() const
+{
+	uint32_t capacity = UINT32_MAX;
+
+	/* Other columns grow their buffers */
+	for (const struct column_op &op : _ops) {
+		if (op.convert) {
+			capacity = std::min(capacity, op.el->free_space());
+		}
+	}
+
+	return capacity;
+}
+
+int row_decoder::decode(uint8_t *data, uint32_t count)
+{
+	/* All columns must take the records, otherwise their lengths would differ */
+	if (count > capacity()) {
+		return 1;
+	}
+
+	for (const struct column_op &op : _ops) {
+		if (op.convert) {
+			op.convert(op.el->reserve(count), data + op.offset, _record_size, count);
+			continue;
+		}
+
+		uint8_t *src = data + op.offset;
+		for (uint32_t i = 0; i < count; i++, src += _record_size) {
+			op.el->fill(src);
+		}
+	}
+
+	return 0;
+}
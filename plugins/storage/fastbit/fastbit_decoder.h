@@ -0,0 +1,102 @@
+/**
+ * \file fastbit_decoder.h
+ * \brief Row decoder of fixed-length templates
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef FASTBIT_DECODER_H_
+#define FASTBIT_DECODER_H_
+
+#include <stdint.h>
+#include <vector>
+
+class element;
+
+/* Convert \p count values of a column from records to a buffer */
+typedef void (*column_convert_fn)(uint8_t *dst, const uint8_t *src, uint32_t stride, uint32_t count);
+
+/**
+ * \brief Row decoder of a fixed-length template
+ *
+ * Offsets and conversions of all fields are computed once when the
+ * template is parsed. Records of a data set are then transposed column by
+ * column: each integer column is filled by a loop specialized for its
+ * source and destination width, without a virtual call per value.
+ * Columns that cannot be converted directly (fixed-length strings and
+ * octet arrays) are filled by element::fill().
+ */
+class row_decoder
+{
+public:
+	/**
+	 * \brief Create decoder for a set of columns
+	 *
+	 * @param set Columns created from the template
+	 * @return Decoder or NULL when the template has a variable-length field
+	 */
+	static row_decoder *create(const std::vector<element *> &set);
+
+	/** Size of a record */
+	uint16_t record_size() const { return _record_size; }
+
+	/**
+	 * \brief Number of records that the columns can still hold
+	 */
+	uint32_t capacity() const;
+
+	/**
+	 * \brief Append records to the columns
+	 *
+	 * Nothing is appended when the columns do not have space for all the records.
+	 * @param data First record
+	 * @param count Number of records (at most capacity())
+	 * @return 0 on success, 1 when the columns are full
+	 */
+	int decode(uint8_t *data, uint32_t count);
+
+private:
+	struct column_op {
+		element *el;               /* Column */
+		uint16_t offset;           /* Offset of the value in a record */
+		column_convert_fn convert; /* NULL = use element::fill() */
+	};
+
+	std::vector<column_op> _ops;
+	uint16_t _record_size;
+
+	row_decoder(): _record_size(0) {}
+};
+
+#endif /* FASTBIT_DECODER_H_ */
@@ -73,6 +73,7 @@ void element::allocate_buffer(uint32_t count)
 	_buf_max = count;
 	_buffer = (char *) realloc(_buffer, _size * count);
 	if (_buffer == NULL) {
+		_buf_max = 0;
 		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
 	}
 }
@@ -93,32 +94,15 @@ int element::append(void *data)
 	return 0;
 }
 
-int element::flush(std::string path)
+int element::flush(column_files &files, const std::string &path)
 {
-	FILE *f;
-	size_t check;
 	if (_filled > 0) {
-		f = fopen((path + "/" + _name).c_str(), "a+");
-		if (f == NULL) {
-			MSG_ERROR(msg_module, "Error while writing data (fopen)");
-			return 1;
-		}
-
 		if (_buffer == NULL) {
 			MSG_ERROR(msg_module, "Error while writing data (buffer)");
-			fclose(f);
 			return 1;
 		}
 
-		check = fwrite(_buffer, size(), _filled, f);
-		if (check != (size_t) _filled) {
-			MSG_ERROR(msg_module, "Error while writing data (fwrite)");
-			fclose(f);
-			return 1;
-		}
-
-		_filled = 0;
-		fclose(f);
+		return files.append(path, _name, _buffer, (size_t) size() * _filled);
 	}
 
 	return 0;
@@ -210,6 +194,16 @@ uint16_t el_float::fill(uint8_t *data)
 	return _size;
 }
 
+enum element::conversion el_float::get_conversion(uint16_t &src_size, uint16_t &dst_size)
+{
+	if (_size != 4 && _size != 8) {
+		return CONV_VAR;
+	}
+
+	src_size = dst_size = _size;
+	return CONV_INTEGER;
+}
+
 int el_float::set_type()
 {
 	switch (_size) {
@@ -325,27 +319,22 @@ uint16_t el_text::fill(uint8_t *data)
 	return _true_size + _offset;
 }
 
-int el_text::flush(std::string path)
+enum element::conversion el_text::get_conversion(uint16_t &src_size, uint16_t &dst_size)
 {
-	FILE *f;
-	size_t check;
+	src_size = _true_size;
+	dst_size = 0;
+	return _var_size ? CONV_VAR : CONV_FILL;
+}
 
+int el_text::flush(column_files &files, const std::string &path)
+{
 	/* Flush sp buffer */
 	if (_config->create_sp_files && _filled > 0 && _sp_buffer != NULL) {
-		f = fopen((path + "/" + _name + ".sp").c_str(), "a+");
-		if (f == NULL) {
-			MSG_ERROR(msg_module, "Error while writing data (fopen)");
-			return 1;
-		}
-
-		/* Get file offset */
-		struct stat stat_buf;
-		int rc = stat((path + "/" + _name).c_str(), &stat_buf);
+		/* Get file offset (before the data buffer is appended) */
+		uint64_t file_offset = files.size(path, _name);
 
 		/* Adjust the _sp_buffer values */
-		if (rc == 0 && stat_buf.st_size != 0) {
-			uint64_t file_offset = stat_buf.st_size;
-
+		if (file_offset != 0) {
 			/* We will ignore the first zero offset. The .sp file aready contains offset
 			 * pointing just after the file */
 			for (uint32_t i = 8; i < _sp_buffer_offset; i+=8) {
@@ -354,25 +343,26 @@ int el_text::flush(std::string path)
 			_sp_buffer_offset -= 8;
 		}
 
-		check = fwrite(_sp_buffer, 1 , _sp_buffer_offset, f);
-		if (check != (size_t) _sp_buffer_offset) {
-			MSG_ERROR(msg_module, "Error while writing data (fwrite)");
-			fclose(f);
+		if (files.append(path, std::string(_name) + ".sp", _sp_buffer, _sp_buffer_offset) != 0) {
 			return 1;
 		}
+	}
 
-		/* Close the file */
-		fclose(f);
+	/* Call parent function to write the data buffer */
+	element::flush(files, path);
 
-		/* Reset buffer */
+	return 0;
+}
+
+void el_text::reset()
+{
+	/* Reset sp buffer */
+	if (_sp_buffer != NULL) {
 		_sp_buffer_offset = 8;
 		*(uint64_t *) _sp_buffer = 0;
 	}
 
-	/* Call parent function to write the data buffer */
-	element::flush(path);
-
-	return 0;
+	element::reset();
 }
 
 el_text::~el_text()
@@ -408,6 +398,12 @@ uint16_t el_ipv6::fill(uint8_t *data)
 	return _size;
 }
 
+enum element::conversion el_ipv6::get_conversion(uint16_t &src_size, uint16_t &dst_size)
+{
+	src_size = dst_size = _size;
+	return CONV_INTEGER;
+}
+
 int el_ipv6::set_type()
 {
 	/* ulong */
@@ -503,26 +499,21 @@ uint16_t el_blob::fill(uint8_t *data)
 	return _true_size  + _offset;
 }
 
-int el_blob::flush(std::string path)
+enum element::conversion el_blob::get_conversion(uint16_t &src_size, uint16_t &dst_size)
 {
-	FILE *f;
-	size_t check;
-	
-	if (_filled > 0 && _sp_buffer != NULL) {
-		f = fopen((path + "/" + _name + ".sp").c_str(), "a+");
-		if (f == NULL) {
-			MSG_ERROR(msg_module, "Error while writing data (fopen)");
-			return 1;
-		}
+	src_size = _true_size;
+	dst_size = 0;
+	return _var_size ? CONV_VAR : CONV_FILL;
+}
 
-		/* Get file offset */
-		struct stat stat_buf;
-		int rc = stat((path + "/" + _name).c_str(), &stat_buf);
+int el_blob::flush(column_files &files, const std::string &path)
+{
+	if (_filled > 0 && _sp_buffer != NULL) {
+		/* Get file offset (before the data buffer is appended) */
+		uint64_t file_offset = files.size(path, _name);
 
 		/* Adjust the _sp_buffer values */
-		if (rc == 0 && stat_buf.st_size != 0) {
-			uint64_t file_offset = stat_buf.st_size;
-
+		if (file_offset != 0) {
 			/* We will ignore the first zero offset. The .sp file aready contains offset
 			 * pointing just after the file */
 			for (uint32_t i = 8; i < _sp_buffer_offset; i+=8) {
@@ -531,25 +522,26 @@ int el_blob::flush(std::string path)
 			_sp_buffer_offset -= 8;
 		}
 
-		check = fwrite(_sp_buffer, 1 , _sp_buffer_offset, f);
-		if (check != (size_t) _sp_buffer_offset) {
-			MSG_ERROR(msg_module, "Error while writing data (fwrite)");
-			fclose(f);
+		if (files.append(path, std::string(_name) + ".sp", _sp_buffer, _sp_buffer_offset) != 0) {
 			return 1;
 		}
+	}
 
-		/* Close the file */
-		fclose(f);
+	/* Call parent function to write the data buffer */
+	element::flush(files, path);
+
+	return 0;
+}
 
-		/* Reset buffer */
+void el_blob::reset()
+{
+	/* Reset sp buffer */
+	if (_sp_buffer != NULL) {
 		_sp_buffer_offset = 8;
 		*(uint64_t *) _sp_buffer = 0;
 	}
 
-	/* Call parent function to write the data buffer */
-	element::flush(path);
-
-	return 0;
+	element::reset();
 }
 
 el_blob::~el_blob()
@@ -620,6 +612,17 @@ uint16_t el_uint::fill(uint8_t *data) {
 	return _real_size;
 }
 
+enum element::conversion el_uint::get_conversion(uint16_t &src_size, uint16_t &dst_size)
+{
+	if (_real_size < 1 || _real_size > 8) {
+		return CONV_VAR;
+	}
+
+	src_size = _real_size;
+	dst_size = _size;
+	return CONV_INTEGER;
+}
+
 int el_uint::set_type()
 {
 	int target_size;
@@ -743,8 +746,9 @@ int el_unknown::append(void *data)
 	return 0;
 }
 
-int el_unknown::flush(std::string path)
+int el_unknown::flush(column_files &files, const std::string &path)
 {
+	(void) files;
 	(void) path;
 	return 0;
 }
@@ -772,6 +776,13 @@ uint16_t el_unknown::fill(uint8_t *data)
 	return _size;
 }
 
+enum element::conversion el_unknown::get_conversion(uint16_t &src_size, uint16_t &dst_size)
+{
+	src_size = _size;
+	dst_size = 0;
+	return _var_size ? CONV_VAR : CONV_SKIP;
+}
+
 std::string el_unknown::get_part_info()
 {
 	return  std::string("");
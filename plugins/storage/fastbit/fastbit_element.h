@@ -56,6 +56,7 @@ extern "C" {
 
 #include "fastbit.h"
 #include "config_struct.h"
+#include "fastbit_files.h"
 
 #define NFv9_CONVERSION_ENTERPRISE_NUMBER (~((uint32_t) 0))
 
@@ -136,8 +137,52 @@ protected:
 	int append(void *data);
 
 public:
+	/* Conversion of a value by the row decoder */
+	enum conversion {
+		CONV_VAR,     /* Variable length, the decoder cannot be used */
+		CONV_INTEGER, /* Big-endian integer (or float bits) to host order */
+		CONV_FILL,    /* Fixed length, converted by fill() */
+		CONV_SKIP     /* Fixed length, not stored */
+	};
+
 	virtual ~element() { free_buffer(); };
 
+	/**
+	 * \brief Get conversion of the value for the row decoder
+	 *
+	 * @param[out] src_size Size of the value in a record
+	 * @param[out] dst_size Size of the value in the buffer
+	 * @return Type of the conversion
+	 */
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size)
+	{
+		(void) src_size;
+		(void) dst_size;
+		return CONV_VAR;
+	}
+
+	/**
+	 * \brief Number of values that can still be reserved
+	 */
+	uint32_t free_space() const { return _buf_max - _filled; }
+
+	/**
+	 * \brief Reserve space for values at the end of the buffer
+	 *
+	 * @param count Number of values
+	 * @return Pointer to the first value or NULL when the buffer is full
+	 */
+	uint8_t *reserve(uint32_t count)
+	{
+		if (_filled + count > _buf_max) {
+			return NULL;
+		}
+
+		uint8_t *values = (uint8_t *) &(_buffer[size() * _filled]);
+		_filled += count;
+		return values;
+	}
+
 	/**
 	 * \brief Fill internal element value according to given data
 	 *
@@ -151,12 +196,20 @@ public:
 	virtual uint16_t fill(uint8_t *data) = 0;
 
 	/**
-	 * \brief Flush buffer content to file
+	 * \brief Queue buffer content to be appended to the column file
 	 *
-	 * @param path of the file to write to
+	 * The buffer must not be changed until the files are submitted.
+	 *
+	 * @param files Open files of the table
+	 * @param path Directory of the table
 	 * @return 0 on success, 1 otherwise
 	 */
-	virtual int flush(std::string path);
+	virtual int flush(column_files &files, const std::string &path);
+
+	/**
+	 * \brief Empty the buffer after its content was written
+	 */
+	virtual void reset() { _filled = 0; }
 
 	/**
 	 * \brief Return string with par information for -part.txt FastBit file
@@ -210,6 +263,8 @@ public:
 	el_float(struct fastbit_config *config = NULL, int size = 1, uint32_t en = 0, uint16_t id = 0,
 			uint32_t buf_size = RESERVED_SPACE);
 
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
+
 	/**
 	 * \brief Fill internal element value according to given data
 	 *
@@ -242,16 +297,19 @@ public:
 			uint32_t buf_size = RESERVED_SPACE);
 
 	virtual uint16_t fill(uint8_t *data);
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
 	virtual ~el_text();
 
 	/**
 	 * \brief Overloaded flush function to write the sp buffer.
 	 * Calls parent funtion flush
 	 *
-	 * @param path to write the file to
+	 * @param files Open files of the table
+	 * @param path Directory of the table
 	 * @return 0 on success, 1 otherwise
 	 */
-	virtual int flush(std::string path);
+	virtual int flush(column_files &files, const std::string &path);
+	virtual void reset();
 
 protected:
 	int set_type() {
@@ -275,6 +333,8 @@ public:
 	el_ipv6(struct fastbit_config *config = NULL, int size = 1, uint32_t en = 0, uint16_t id = 0, int part = 0,
 			uint32_t buf_size = RESERVED_SPACE);
 
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
+
 	/**
 	 * \brief fill internal element value according to given data
 	 *
@@ -299,6 +359,7 @@ public:
 			uint32_t buf_size = RESERVED_SPACE);
 
 	virtual uint16_t fill(uint8_t *data);
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
 	virtual ~el_blob();
 
 	/**
@@ -306,10 +367,12 @@ public:
 	 *
 	 * Calls parent funtion flush
 	 *
-	 * @param path to write the file to
+	 * @param files Open files of the table
+	 * @param path Directory of the table
 	 * @return 0 on success, 1 otherwise
 	 */
-	virtual int flush(std::string path);
+	virtual int flush(column_files &files, const std::string &path);
+	virtual void reset();
 
 protected:
 	bool _var_size;
@@ -340,6 +403,8 @@ public:
 	el_uint(struct fastbit_config *config, int size = 1, uint32_t en = 0, uint16_t id = 0,
 			uint32_t buf_size = RESERVED_SPACE);
 
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
+
 	/**
 	 * \brief fill internal element value according to given data
 	 *
@@ -386,6 +451,8 @@ public:
 	el_unknown(struct fastbit_config *config, int size = 0, uint32_t en = 0, uint16_t id = 0, int part = 0,
 			uint32_t buf_size = 0);
 
+	virtual enum conversion get_conversion(uint16_t &src_size, uint16_t &dst_size);
+
 	/**
 	 * \brief fill internal element value according to given data
 	 *
@@ -401,10 +468,11 @@ public:
 	/**
 	 * \brief Flush buffer content to file
 	 *
-	 * @param path of the file to write to
+	 * @param files Open files of the table
+	 * @param path Directory of the table
 	 * @return 0 on success, 1 otherwise
 	 */
-	virtual int flush(std::string path);
+	virtual int flush(column_files &files, const std::string &path);
 
 	/**
 	 * \brief Return string with par information for -part.txt FastBit file
@@ -0,0 +1,284 @@
+/**
+ * \file fastbit_files.cpp
+ * \brief Open column files of a table
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+extern "C" {
+	#include <ipfixcol/verbose.h>
+}
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "fastbit.h"
+#include "config_struct.h"
+#include "fastbit_files.h"
+
+#ifdef HAVE_LIBURING
+/* Number of entries of submission queue of a ring */
+const unsigned int URING_ENTRIES = 256;
+
+/* io_uring instance of a writer thread */
+struct thread_ring {
+	struct io_uring ring;
+	bool ready;
+
+	thread_ring()
+	{
+		int rc = io_uring_queue_init(URING_ENTRIES, &ring, 0);
+		ready = (rc == 0);
+		if (!ready) {
+			MSG_WARNING(msg_module, "Unable to initialize io_uring (%s); using pwrite()", strerror(-rc));
+		}
+	}
+
+	~thread_ring()
+	{
+		if (ready) {
+			io_uring_queue_exit(&ring);
+		}
+	}
+};
+#endif
+
+/* Write whole data at an offset */
+static int pwrite_all(int fd, const uint8_t *data, size_t size, uint64_t offset)
+{
+	while (size > 0) {
+		ssize_t written = pwrite(fd, data, size, offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return 1;
+		}
+
+		data += written;
+		size -= written;
+		offset += written;
+	}
+
+	return 0;
+}
+
+column_files::column_files(struct fastbit_config *config): _config(config)
+{
+}
+
+column_files::~column_files()
+{
+	close(false);
+}
+
+struct column_files::file *column_files::get_file(const std::string &dir, const std::string &name)
+{
+	/* Files of a previous window must not stay open */
+	if (dir != _dir) {
+		close(false);
+		_dir = dir;
+	}
+
+	std::map<std::string, struct file>::iterator it = _files.find(name);
+	if (it != _files.end()) {
+		return &(it->second);
+	}
+
+	std::string path = dir + "/" + name;
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		MSG_ERROR(msg_module, "Error while writing data (open %s): %s", path.c_str(), strerror(errno));
+		return NULL;
+	}
+
+	struct stat stat_buf;
+	if (fstat(fd, &stat_buf) != 0) {
+		MSG_ERROR(msg_module, "Error while writing data (fstat %s): %s", path.c_str(), strerror(errno));
+		::close(fd);
+		return NULL;
+	}
+
+	_config->open_files++;
+
+	struct file &f = _files[name];
+	f.fd = fd;
+	f.offset = stat_buf.st_size;
+	return &f;
+}
+
+int column_files::append(const std::string &dir, const std::string &name, const void *data, size_t size)
+{
+	struct file *f = get_file(dir, name);
+	if (f == NULL) {
+		return 1;
+	}
+
+	struct request req = {f->fd, (const uint8_t *) data, size, f->offset};
+	_requests.push_back(req);
+	f->offset += size;
+	return 0;
+}
+
+uint64_t column_files::size(const std::string &dir, const std::string &name)
+{
+	struct file *f = get_file(dir, name);
+	return (f == NULL) ? 0 : f->offset;
+}
+
+int column_files::write_requests()
+{
+	int rc = 0;
+
+	for (const struct request &req : _requests) {
+		if (pwrite_all(req.fd, req.data, req.size, req.offset) != 0) {
+			MSG_ERROR(msg_module, "Error while writing data (pwrite): %s", strerror(errno));
+			rc = 1;
+		}
+	}
+
+	return rc;
+}
+
+#ifdef HAVE_LIBURING
+int column_files::write_requests_uring()
+{
+	static thread_local struct thread_ring tr;
+	if (!tr.ready) {
+		return write_requests();
+	}
+
+	int rc = 0;
+	size_t start = 0;
+
+	while (start < _requests.size()) {
+		/* One io_uring_enter per URING_ENTRIES writes */
+		unsigned int count = 0;
+		while (start + count < _requests.size() && count < URING_ENTRIES) {
+			struct io_uring_sqe *sqe = io_uring_get_sqe(&tr.ring);
+			if (sqe == NULL) {
+				break;
+			}
+
+			struct request *req = &(_requests[start + count]);
+			io_uring_prep_write(sqe, req->fd, req->data, req->size, req->offset);
+			io_uring_sqe_set_data(sqe, req);
+			count++;
+		}
+
+		int submitted = io_uring_submit_and_wait(&tr.ring, count);
+		if (submitted < 0) {
+			MSG_ERROR(msg_module, "io_uring submission failed: %s", strerror(-submitted));
+			return write_requests();
+		}
+
+		for (unsigned int i = 0; i < count; i++) {
+			struct io_uring_cqe *cqe;
+			if (io_uring_wait_cqe(&tr.ring, &cqe) != 0) {
+				MSG_ERROR(msg_module, "io_uring completion failed");
+				return 1;
+			}
+
+			/* Finish short or failed writes synchronously */
+			struct request *req = (struct request *) io_uring_cqe_get_data(cqe);
+			size_t written = (cqe->res > 0) ? cqe->res : 0;
+			io_uring_cqe_seen(&tr.ring, cqe);
+
+			if (written < req->size && pwrite_all(req->fd, req->data + written,
+					req->size - written, req->offset + written) != 0) {
+				MSG_ERROR(msg_module, "Error while writing data (pwrite): %s", strerror(errno));
+				rc = 1;
+			}
+		}
+
+		start += count;
+	}
+
+	return rc;
+}
+#endif
+
+int column_files::submit()
+{
+	int rc;
+
+#ifdef HAVE_LIBURING
+	if (_config->io_uring) {
+		rc = write_requests_uring();
+	} else {
+		rc = write_requests();
+	}
+#else
+	rc = write_requests();
+#endif
+
+	_requests.clear();
+
+	/* Do not run out of file descriptors with too many tables */
+	if (_config->open_files > _config->max_open_files) {
+		close(_config->sync_files);
+	}
+
+	return rc;
+}
+
+void column_files::close(bool sync)
+{
+	if (!_requests.empty()) {
+		submit();
+	}
+
+	for (auto &it : _files) {
+		if (sync && fdatasync(it.second.fd) != 0) {
+			MSG_WARNING(msg_module, "Unable to sync %s/%s: %s", _dir.c_str(), it.first.c_str(),
+					strerror(errno));
+		}
+
+		::close(it.second.fd);
+		_config->open_files--;
+	}
+
+	_files.clear();
+}
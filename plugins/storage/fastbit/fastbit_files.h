@@ -0,0 +1,126 @@
+/**
+ * \file fastbit_files.h
+ * \brief Open column files of a table
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef FASTBIT_FILES_H_
+#define FASTBIT_FILES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct fastbit_config;
+
+/**
+ * \brief Open column files of a table in the current window
+ *
+ * Files are opened on the first write and kept open until the window is
+ * closed. Writes of all columns of a flush are queued and submitted
+ * together, either by pwrite() or, when enabled, in one io_uring
+ * submission.
+ */
+class column_files
+{
+public:
+	column_files(struct fastbit_config *config);
+	~column_files();
+
+	/**
+	 * \brief Queue data to be appended to a file
+	 *
+	 * The data must not be changed until submit() returns.
+	 *
+	 * @param dir Directory of the table
+	 * @param name Name of the file
+	 * @param data Data
+	 * @param size Size of the data
+	 * @return 0 on success, 1 otherwise
+	 */
+	int append(const std::string &dir, const std::string &name, const void *data, size_t size);
+
+	/**
+	 * \brief Get size of a file including queued data
+	 *
+	 * @param dir Directory of the table
+	 * @param name Name of the file
+	 * @return Size of the file (0 if it does not exist)
+	 */
+	uint64_t size(const std::string &dir, const std::string &name);
+
+	/**
+	 * \brief Write queued data
+	 *
+	 * @return 0 on success, 1 otherwise
+	 */
+	int submit();
+
+	/**
+	 * \brief Close all files
+	 *
+	 * @param sync Flush data of the files to disk (fdatasync)
+	 */
+	void close(bool sync);
+
+private:
+	struct file {
+		int fd;
+		uint64_t offset; /* End of file including queued data */
+	};
+
+	struct request {
+		int fd;
+		const uint8_t *data;
+		size_t size;
+		uint64_t offset;
+	};
+
+	struct fastbit_config *_config;
+	std::string _dir; /* Directory of the open files */
+	std::map<std::string, struct file> _files;
+	std::vector<struct request> _requests;
+
+	struct file *get_file(const std::string &dir, const std::string &name);
+	int write_requests();
+#ifdef HAVE_LIBURING
+	int write_requests_uring();
+#endif
+};
+
+#endif /* FASTBIT_FILES_H_ */
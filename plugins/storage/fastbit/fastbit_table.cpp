@@ -39,11 +39,14 @@
 
 extern "C" {
 #include <ipfixcol/verbose.h>
+#include <unistd.h>
 }
 
+#include <algorithm>
 #include <vector>
 
 #include "fastbit_table.h"
+#include "WorkQueue.h"
 
 #define ROW_LINE "Number_of_rows="
 
@@ -85,16 +88,40 @@ template_table::template_table(uint16_t template_id, uint32_t buff_size): _rows_
 
 	_buff_size = buff_size;
 	_first_transmission = 0;
+	_config = NULL;
+	_busy = false;
+	_written = false;
+	_decoder = NULL;
+	_flushing_decoder = NULL;
+	_files = NULL;
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_cond, NULL);
 }
 
 template_table::~template_table()
 {
+	/* Buffers must not be released while being written */
+	wait_idle();
+
 	for (el_it = elements.begin(); el_it != elements.end(); ++el_it) {
 		delete (*el_it);
 	}
+
+	for (element *el : _flushing) {
+		delete el;
+	}
+
+	delete _decoder;
+	delete _flushing_decoder;
+	delete _files;
+
+	pthread_cond_destroy(&_cond);
+	pthread_mutex_destroy(&_mutex);
 }
 
-int template_table::update_part(std::string path)
+int template_table::update_part(std::string path, std::string name, uint64_t rows,
+		const std::vector<element *> &set)
 {
 	FILE *f;
 	std::stringstream ss;
@@ -111,7 +138,7 @@ int template_table::update_part(std::string path)
 
 	/* Count only real elements, not unknown
 	 * Unknown elements have empty name */
-	for (element *el : elements) {
+	for (element *el : set) {
 		if (strlen(el->getName()) != 0) {
 			columns++;
 		}
@@ -119,16 +146,16 @@ int template_table::update_part(std::string path)
 
 	/* Insert header */
 	ss << "BEGIN HEADER\n";
-	ss << "Name=" << std::string(this->_name) << "\n";
+	ss << "Name=" << name << "\n";
 	ss << "Description=Generated by FastBit plugin for IPFIXcol\n";
-	ss << "Number_of_rows=" << _rows_in_window + rows_in_part << "\n";
+	ss << "Number_of_rows=" << rows + rows_in_part << "\n";
 	ss << "Number_of_columns=" << columns << "\n";
 	ss << "Timestamp=" << time(NULL) << "\n";
 	ss << "END HEADER\n";
 
 	/* Insert row info */
-	for (el_it = elements.begin(); el_it != elements.end(); ++el_it) {
-		ss << (*el_it)->get_part_info();
+	for (element *el : set) {
+		ss << el->get_part_info();
 	}
 
 	part = ss.str();
@@ -186,6 +213,11 @@ int template_table::dir_check(std::string path, bool new_dir)
 
 			/* Try to create the dir again */
 			if (mkdir(path.c_str(), 0777) != 0) {
+				if (errno == EEXIST) {
+					/* Created by a table of another store worker meanwhile */
+					return this->dir_check(path, new_dir);
+				}
+
 				MSG_ERROR(msg_module, "Cannot create directory '%s'", path.c_str());
 				return 2;
 			}
@@ -228,6 +260,30 @@ int template_table::store(ipfix_data_set *data_set, std::string path, bool new_d
 	/* Count how many records data_set contains */
 	uint16_t data_size = (ntohs(data_set->header.length) - (sizeof(struct ipfix_set_header)));
 	uint16_t read_data = 0;
+
+	if (_decoder) {
+		/* Fixed-length records; decode as many as the buffers can hold at once */
+		uint32_t records = data_size / _decoder->record_size();
+		while (record_cnt < records) {
+			uint32_t count = std::min<uint64_t>(records - record_cnt, _buff_size - _rows_count);
+			count = std::min(count, _decoder->capacity());
+			if (count == 0 || _decoder->decode(data, count) != 0) {
+				MSG_ERROR(msg_module, "Buffers of template %u are full; skipping data set", _template_id);
+				return -1;
+			}
+
+			data += count * _decoder->record_size();
+			record_cnt += count;
+			_rows_count += count;
+			if (_rows_count >= _buff_size) {
+				if (this->submit(path, NULL, false) != 0) {
+					return -1;
+				}
+			}
+		}
+
+		return record_cnt;
+	}
 	while (read_data < data_size) {
 		if ((data_size - read_data) < _min_record_size) {
 			break;
@@ -243,48 +299,163 @@ int template_table::store(ipfix_data_set *data_set, std::string path, bool new_d
 
 		_rows_count++;
 		if (_rows_count >= _buff_size) {
-			_rows_in_window += _rows_count;
-
-			if (this->dir_check(path + _name, this->_new_dir) != 0) {
+			if (this->submit(path, NULL, false) != 0) {
 				return -1;
 			}
+		}
+	}
 
-			for (el_it = elements.begin(); el_it != elements.end(); ++el_it) {
-				(*el_it)->flush(path + _name);
-			}
+	return record_cnt;
+}
+
+void template_table::wait_idle()
+{
+	pthread_mutex_lock(&_mutex);
+	if (_busy) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		while (_busy) {
+			pthread_cond_wait(&_cond, &_mutex);
+		}
 
-			/* Update -part.txt so that the data is ready for processing */
-			this->update_part(path + _name);
-			_rows_count = 0;
-			_rows_in_window = 0;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (_config) {
+			_config->buffer_stalls++;
+			_config->buffer_stall_us += (end.tv_sec - start.tv_sec) * 1000000
+					+ (end.tv_nsec - start.tv_nsec) / 1000;
 		}
 	}
+	pthread_mutex_unlock(&_mutex);
+}
 
-	return record_cnt;
+int template_table::submit(std::string path, struct flush_group *group, bool close)
+{
+	/* Records of the hot snapshot are going to be written to the window */
+	if (!_hot_dir.empty()) {
+		unlink((_hot_dir + "/-part.txt").c_str());
+		_hot_dir.clear();
+	}
+
+	/* Check directory (only once per window) */
+	_rows_in_window += _rows_count;
+	if (this->_new_dir || _dir != path + _name) {
+		if (this->dir_check(path + _name, this->_new_dir) != 0) {
+			return 1;
+		}
+
+		_dir = path + _name;
+	}
+
+	/* First write of the window; the directory may still be indexed */
+	if (!_written) {
+		index_wait_dir(_config, _dir + "/");
+	}
+
+	/* The second set of buffers must be written before it can be reused */
+	wait_idle();
+	elements.swap(_flushing);
+	std::swap(_decoder, _flushing_decoder);
+
+	pthread_mutex_lock(&_mutex);
+	_busy = true;
+	pthread_mutex_unlock(&_mutex);
+
+	std::string dir = _dir;
+	std::string name = _name;
+	uint64_t rows = _rows_count;
+	if (group) {
+		group->pending++;
+	}
+
+	_config->writers->submit([this, dir, name, rows, group, close]() {
+		this->write(dir, name, rows, group, close);
+	});
+
+	_written = true;
+	_rows_count = 0;
+	_rows_in_window = 0;
+	return 0;
+}
+
+void template_table::write(const std::string &dir, const std::string &name, uint64_t rows,
+		struct flush_group *group, bool close)
+{
+	/* Write all columns at once */
+	for (element *el : _flushing) {
+		el->flush(*_files, dir);
+	}
+
+	_files->submit();
+
+	for (element *el : _flushing) {
+		el->reset();
+	}
+
+	/* Update -part.txt so that the data is ready for processing */
+	if (rows > 0) {
+		this->update_part(dir, name, rows, _flushing);
+	}
+
+	if (close) {
+		_files->close(_config->sync_files);
+	}
+
+	/* The table can be destroyed once it is not busy */
+	pthread_mutex_lock(&_mutex);
+	_busy = false;
+	pthread_cond_signal(&_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	if (group) {
+		flush_group_release(group);
+	}
 }
 
-void template_table::flush(std::string path)
+int template_table::snapshot(const std::string &dir)
+{
+	if (_rows_count == 0) {
+		return 0;
+	}
+
+	if (mkdir(dir.c_str(), 0777) != 0) {
+		MSG_ERROR(msg_module, "Cannot create directory '%s'", dir.c_str());
+		return 1;
+	}
+
+	/* The files are new, so values of .sp buffers are not changed by flush() */
+	column_files files(_config);
+	for (element *el : elements) {
+		el->flush(files, dir);
+	}
+
+	int ret = files.submit();
+	files.close(false);
+	if (ret != 0 || this->update_part(dir, _name, _rows_count, elements) != 0) {
+		return 1;
+	}
+
+	_hot_dir = dir;
+	return 0;
+}
+
+void template_table::flush(std::string path, struct flush_group *group)
 {
 	/* Check whether there is something to flush */
-	if (_rows_count <= 0) {
+	if (_rows_count <= 0 && !_written) {
 		return;
 	}
 
-	/* Check directory */
-	_rows_in_window += _rows_count;
-	if (this->dir_check(path + _name, this->_new_dir) != 0) {
+	/* Write remaining data and close files of the window */
+	if (this->submit(path, group, true) != 0) {
 		return;
 	}
 
-	/* Flush data */
-	for (el_it = elements.begin(); el_it != elements.end(); ++el_it) {
-		(*el_it)->flush(path + _name);
+	if (group) {
+		group->dirs.push_back(_dir + "/");
 	}
 
-	/* Create/update -part.txt file */
-	this->update_part(path + _name);
-	_rows_count = 0;
-	_rows_in_window = 0;
+	_written = false;
 
 	/* Data on disk is consistent; try to go back to original name */
 	if (this->_orig_name[0] != '\0') {
@@ -295,13 +466,6 @@ void template_table::flush(std::string path)
 
 int template_table::parse_template(struct ipfix_template *tmp, struct fastbit_config *config)
 {
-	int i;
-	uint32_t en = 0; /* Enterprise number (0 = IANA elements) */
-	uint16_t id;
-	int en_offset = 0;
-	template_ie *field;
-	element *new_element;
-
 	/* Is there anything to parse? */
 	if (tmp == NULL) {
 		MSG_WARNING(msg_module, "Received data without template; skipping data...");
@@ -318,6 +482,35 @@ int template_table::parse_template(struct ipfix_template *tmp, struct fastbit_co
 
 	/* Save template transmission time */
 	_first_transmission = tmp->first_transmission;
+	_config = config;
+	_files = new column_files(config);
+
+	/* Two sets of columns for double buffering */
+	if (create_elements(tmp, config, elements) != 0 ||
+			create_elements(tmp, config, _flushing) != 0) {
+		return 1;
+	}
+
+	/* Fixed-length records are decoded column by column */
+	_decoder = row_decoder::create(elements);
+	if (_decoder) {
+		_flushing_decoder = row_decoder::create(_flushing);
+	}
+
+	return 0;
+}
+
+int template_table::create_elements(struct ipfix_template *tmp, struct fastbit_config *config,
+		std::vector<element *> &set)
+{
+	int i;
+	uint32_t en = 0; /* Enterprise number (0 = IANA elements) */
+	uint16_t id;
+	int en_offset = 0;
+	template_ie *field;
+	element *new_element;
+
+	_min_record_size = 0;
 
 	/* Find elements */
 	for (i = 0; i < tmp->field_count + en_offset; i++) {
@@ -374,7 +567,7 @@ int template_table::parse_template(struct ipfix_template *tmp, struct fastbit_co
 				}
 
 				new_element = new el_ipv6(config, sizeof(uint64_t), en, id, 0, _buff_size);
-				elements.push_back(new_element);
+				set.push_back(new_element);
 
 				new_element = new el_ipv6(config, sizeof(uint64_t), en, id, 1, _buff_size);
 				break;
@@ -414,7 +607,7 @@ int template_table::parse_template(struct ipfix_template *tmp, struct fastbit_co
 		}
 
 		/* Check that this element does not already exist */
-		for (element *e : elements) {
+		for (element *e : set) {
 			if (strncmp(new_element->getName(), e->getName(), IE_NAME_LENGTH) == 0) {
 				/* This element already exists; replace it with UNKNOWN type */
 				delete new_element;
@@ -423,7 +616,7 @@ int template_table::parse_template(struct ipfix_template *tmp, struct fastbit_co
 			}
 		}
 
-		elements.push_back(new_element);
+		set.push_back(new_element);
 	}
 
 	return 0;
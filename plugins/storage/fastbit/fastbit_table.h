@@ -53,15 +53,43 @@ extern "C" {
 #include <vector>
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <pthread.h>
 
 #include <fastbit/ibis.h>
 
 #include "fastbit_element.h"
+#include "fastbit_decoder.h"
+#include "fastbit_files.h"
 
 class element; /* Needed because of circular dependency */
 
 uint64_t get_rows_from_part(const char *);
 
+/* Tables flushed at the end of a window. Reorder and indexes are built when
+ * columns of all the tables are written.
+ */
+struct flush_group {
+	struct fastbit_config *config;
+	std::vector<std::string> dirs; /* Directories of the tables */
+	std::atomic<int> pending;      /* Number of unfinished writes + 1 */
+};
+
+/**
+ * \brief Release one reference of a flush group
+ *
+ * The last release queues reorder and index building of the group.
+ */
+void flush_group_release(struct flush_group *group);
+
+/**
+ * \brief Wait for reorder and index jobs of a directory
+ *
+ * A directory can be reused by the next window (prefix naming, rotation
+ * within the same second), it must not be appended to while being indexed.
+ */
+void index_wait_dir(struct fastbit_config *conf, const std::string &dir);
+
 /* For each uniq template is created instance of template_table object.
  * The object is used to parse data records belonging to the template
  * */
@@ -78,6 +106,51 @@ private:
 	bool _new_dir; /* Remember that the directory is supposed to be new */
 	char _index;
 	time_t _first_transmission; /* First transmission of the template. Used to detect changes. */
+	struct fastbit_config *_config;
+
+	/* Second set of column buffers. It is written by a writer thread while
+	 * the storage thread fills the first one.
+	 */
+	std::vector<element *> _flushing;
+	bool _busy; /* _flushing is being written */
+
+	/* Row decoders of both sets (NULL for templates with variable-length fields) */
+	row_decoder *_decoder;
+	row_decoder *_flushing_decoder;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _cond;
+
+	/* Column files open in the current window (used by one writer at a time) */
+	column_files *_files;
+
+	std::string _dir; /* Directory checked in the current window */
+	bool _written; /* Some data were written to _dir */
+
+	/* Hot snapshot of the buffers (see snapshot()), empty if there is none */
+	std::string _hot_dir;
+
+	/* Create elements (columns) of the template */
+	int create_elements(struct ipfix_template *tmp, struct fastbit_config *config,
+			std::vector<element *> &set);
+
+	/**
+	 * \brief Hand over the filled buffers to a writer thread
+	 *
+	 * Waits only if the previous buffers of this table are still being written.
+	 *
+	 * @param path path to direcotry where should be data flushed
+	 * @param group flush group of the window (can be NULL)
+	 * @param close close files of the table after writing
+	 * @return 0 on success, otherwise non-zero
+	 */
+	int submit(std::string path, struct flush_group *group, bool close);
+
+	/* Write the second set of buffers (writer thread) */
+	void write(const std::string &dir, const std::string &name, uint64_t rows,
+			struct flush_group *group, bool close);
+
+	/* Wait until the second set of buffers is written */
+	void wait_idle();
 
 public:
 	/* Vector of elements stored in data record (based on template)
@@ -103,7 +176,20 @@ public:
 	 */
 	int store(ipfix_data_set *data_set, std::string path, bool new_dir);
 
-	int update_part(std::string path);
+	int update_part(std::string path, std::string name, uint64_t rows, const std::vector<element *> &set);
+
+	/**
+	 * \brief Write records that are not handed over to a writer yet
+	 *
+	 * The records are written as a regular partition, so that they can be
+	 * queried before the buffers are full. The partition is invalidated
+	 * (its -part.txt removed) when the buffers are handed over to a writer.
+	 * Must not be called concurrently with store().
+	 *
+	 * @param dir Directory of the partition (parent directory must exist)
+	 * @return 0 on success, otherwise non-zero
+	 */
+	int snapshot(const std::string &dir);
 
 	/**
 	 * \brief Checks whether specified directory exists and creates it if not
@@ -126,11 +212,15 @@ public:
 	}
 
 	/**
-	 * \brief Flush data to disk and clean memory
+	 * \brief Hand over remaining data to a writer thread at the end of a window
+	 *
+	 * Directory of the table is added to the \p group, if the table stored
+	 * any data in the window.
 	 *
 	 * @param path path to direcotry where should be data flushed
+	 * @param group flush group of the window (can be NULL)
 	 */
-	void flush(std::string path);
+	void flush(std::string path, struct flush_group *group);
 
 	time_t get_first_transmission() {
 		return _first_transmission;
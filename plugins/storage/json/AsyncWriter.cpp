@@ -0,0 +1,433 @@
+/**
+ * \file AsyncWriter.cpp
+ * \brief Double-buffered background writer of the file output (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include "AsyncWriter.h"
+#include "File.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/** Alignment of the buffers */
+#define BUFFER_ALIGN (4096)
+
+static const char *msg_module = "json_storage(file-async)";
+
+/**
+ * \brief Class constructor
+ *
+ * Allocate buffers, create the first file and start the writer thread.
+ * \param[in] cfg Configuration
+ */
+AsyncWriter::AsyncWriter(const cfg_t &cfg) : _cfg(cfg), _comp(NULL),
+	_active(NULL), _pending(NULL), _free(NULL), _stop(false),
+	_event_fd(-1), _window_fd(-1), _flush_fd(-1),
+	_file(NULL)
+{
+	_bufs[0].data = NULL;
+	_bufs[1].data = NULL;
+
+	// Round the size of buffers up to the alignment
+	_cfg.buffer_size = ((_cfg.buffer_size + BUFFER_ALIGN - 1) / BUFFER_ALIGN)
+		* BUFFER_ALIGN;
+
+	// Throws invalid_argument on unknown method
+	_comp = Compressor::create(_cfg.compression, _cfg.level);
+
+	for (int i = 0; i < 2; ++i) {
+		void *mem;
+		if (posix_memalign(&mem, BUFFER_ALIGN, _cfg.buffer_size) != 0) {
+			cleanup();
+			throw std::runtime_error("Memory allocation failed.");
+		}
+
+		_bufs[i].data = (char *) mem;
+		_bufs[i].used = 0;
+	}
+
+	_active = &_bufs[0];
+	_free = &_bufs[1];
+
+	// Event notification and timers for the writer thread
+	_event_fd = eventfd(0, EFD_CLOEXEC);
+	_window_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+	_flush_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (_event_fd < 0 || _window_fd < 0 || _flush_fd < 0) {
+		std::string err = strerror(errno);
+		cleanup();
+		throw std::runtime_error("Failed to create event descriptors (" + err
+			+ ").");
+	}
+
+	// Expire at the end of the current window and then periodically
+	struct itimerspec win;
+	std::memset(&win, 0, sizeof(win));
+	win.it_value.tv_sec = _cfg.window_time + _cfg.window_size;
+	win.it_interval.tv_sec = _cfg.window_size;
+
+	struct itimerspec flush;
+	std::memset(&flush, 0, sizeof(flush));
+	flush.it_value.tv_sec = _cfg.flush_interval;
+	flush.it_interval.tv_sec = _cfg.flush_interval;
+
+	if (timerfd_settime(_window_fd, TFD_TIMER_ABSTIME, &win, NULL) != 0 ||
+			timerfd_settime(_flush_fd, 0, &flush, NULL) != 0) {
+		std::string err = strerror(errno);
+		cleanup();
+		throw std::runtime_error("Failed to set up timers (" + err + ").");
+	}
+
+	// First file
+	_file = File::file_create(_cfg.storage_path, _cfg.file_prefix,
+		_cfg.window_time, _comp ? _comp->suffix() : "");
+	if (!_file) {
+		cleanup();
+		throw std::runtime_error("Failed to create a time window file.");
+	}
+
+	if (pthread_mutex_init(&_mutex, NULL) != 0) {
+		cleanup();
+		throw std::runtime_error("Mutex initialization failed");
+	}
+
+	if (pthread_cond_init(&_cond, NULL) != 0) {
+		pthread_mutex_destroy(&_mutex);
+		cleanup();
+		throw std::runtime_error("Condition variable initialization failed");
+	}
+
+	if (pthread_create(&_thread, NULL, &AsyncWriter::thread_writer, this) != 0) {
+		pthread_cond_destroy(&_cond);
+		pthread_mutex_destroy(&_mutex);
+		cleanup();
+		throw std::runtime_error("Failed to start a writer thread.");
+	}
+}
+
+/**
+ * \brief Class destructor
+ *
+ * Hand over remaining data, stop the writer thread and close the file
+ */
+AsyncWriter::~AsyncWriter()
+{
+	pthread_mutex_lock(&_mutex);
+	if (_active->used > 0) {
+		swap();
+	}
+
+	_stop = true;
+	pthread_mutex_unlock(&_mutex);
+
+	uint64_t one = 1;
+	if (::write(_event_fd, &one, sizeof(one)) != sizeof(one)) {
+		MSG_ERROR(msg_module, "Failed to notify the writer thread.");
+	}
+
+	pthread_join(_thread, NULL);
+	pthread_cond_destroy(&_cond);
+	pthread_mutex_destroy(&_mutex);
+	cleanup();
+}
+
+/**
+ * \brief Release all resources (except the thread and synchronization)
+ */
+void AsyncWriter::cleanup()
+{
+	if (_file) {
+		fclose(_file);
+		_file = NULL;
+	}
+
+	if (_event_fd >= 0) {
+		close(_event_fd);
+	}
+
+	if (_window_fd >= 0) {
+		close(_window_fd);
+	}
+
+	if (_flush_fd >= 0) {
+		close(_flush_fd);
+	}
+
+	free(_bufs[0].data);
+	free(_bufs[1].data);
+	delete _comp;
+}
+
+/**
+ * \brief Append a record to the active buffer
+ *
+ * Records are never split between buffers unless they are bigger than
+ * the buffer itself. The mutex is held during the copy because the writer
+ * thread can take over the active buffer on a timer tick.
+ * \param[in] data Record
+ * \param[in] len Length of the record
+ */
+void AsyncWriter::write(const char *data, size_t len)
+{
+	pthread_mutex_lock(&_mutex);
+	if (_active->used > 0 && _active->used + len > _cfg.buffer_size) {
+		swap();
+	}
+
+	while (len > 0) {
+		size_t space = _cfg.buffer_size - _active->used;
+		if (space == 0) {
+			swap();
+			continue;
+		}
+
+		size_t size = (len < space) ? len : space;
+		std::memcpy(_active->data + _active->used, data, size);
+		_active->used += size;
+		data += size;
+		len -= size;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+ * \brief Hand over the active buffer to the writer thread
+ *
+ * Must be called with _mutex locked. Blocks only if the writer thread has
+ * not finished the previous buffer yet.
+ */
+void AsyncWriter::swap()
+{
+	while (_free == NULL) {
+		pthread_cond_wait(&_cond, &_mutex);
+	}
+
+	_pending = _active;
+	_active = _free;
+	_free = NULL;
+
+	uint64_t one = 1;
+	if (::write(_event_fd, &one, sizeof(one)) != sizeof(one)) {
+		MSG_ERROR(msg_module, "Failed to notify the writer thread.");
+	}
+}
+
+/**
+ * \brief Write all data to the current file
+ * \param[in] data Data
+ * \param[in] len Length of the data
+ */
+void AsyncWriter::write_all(const char *data, size_t len)
+{
+	int fd = fileno(_file);
+
+	while (len > 0) {
+		ssize_t ret = ::write(fd, data, len);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			MSG_ERROR(msg_module, "Failed to write data (%s).", strerror(errno));
+			return;
+		}
+
+		data += ret;
+		len -= ret;
+	}
+}
+
+/**
+ * \brief Compress and write a buffer to the current file
+ * \param[in] buf Buffer
+ */
+void AsyncWriter::flush_buffer(buffer_t *buf)
+{
+	if (!_file || buf->used == 0) {
+		return;
+	}
+
+	if (!_comp) {
+		write_all(buf->data, buf->used);
+		return;
+	}
+
+	try {
+		_out.clear();
+		_comp->compress(buf->data, buf->used, _out);
+		write_all(_out.data(), _out.size());
+	} catch (std::exception &e) {
+		MSG_ERROR(msg_module, "%s", e.what());
+	}
+}
+
+/**
+ * \brief Write the pending buffer and optionally the partial active buffer
+ *
+ * When no buffer is pending, the other buffer is free, so the active one
+ * can be exchanged without waiting for the storage thread.
+ * \param[in] partial Take over also the active buffer
+ */
+void AsyncWriter::flush_buffers(bool partial)
+{
+	pthread_mutex_lock(&_mutex);
+	while (true) {
+		buffer_t *buf = _pending;
+		if (buf) {
+			_pending = NULL;
+		} else if (partial && _active->used > 0) {
+			buf = _active;
+			_active = _free;
+			_free = NULL;
+			partial = false;
+		} else {
+			break;
+		}
+		pthread_mutex_unlock(&_mutex);
+
+		flush_buffer(buf);
+
+		pthread_mutex_lock(&_mutex);
+		buf->used = 0;
+		_free = buf;
+		pthread_cond_signal(&_cond);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+ * \brief Finish the current file and create a file for the next window
+ * \param[in] last Do not create a new file
+ */
+void AsyncWriter::rotate(bool last)
+{
+	if (_file) {
+		if (_comp) {
+			try {
+				_out.clear();
+				_comp->finish(_out);
+				write_all(_out.data(), _out.size());
+			} catch (std::exception &e) {
+				MSG_ERROR(msg_module, "%s", e.what());
+			}
+		}
+
+		fclose(_file);
+		_file = NULL;
+	}
+
+	if (last) {
+		return;
+	}
+
+	// Null pointer is also valid...
+	_file = File::file_create(_cfg.storage_path, _cfg.file_prefix,
+		_cfg.window_time, _comp ? _comp->suffix() : "");
+	if (!_file) {
+		MSG_ERROR(msg_module, "Failed to create a time window file.");
+	}
+}
+
+/**
+ * \brief Writer thread function
+ *
+ * Waits for full buffers and timer expirations.
+ * \param[in,out] context Instance of the writer
+ * \return Nothing
+ */
+void *AsyncWriter::thread_writer(void *context)
+{
+	AsyncWriter *wr = (AsyncWriter *) context;
+	MSG_DEBUG(msg_module, "Thread started...");
+
+	struct pollfd fds[3];
+	fds[0].fd = wr->_event_fd;
+	fds[1].fd = wr->_window_fd;
+	fds[2].fd = wr->_flush_fd;
+	for (int i = 0; i < 3; ++i) {
+		fds[i].events = POLLIN;
+	}
+
+	bool stop = false;
+	while (!stop) {
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			MSG_ERROR(msg_module, "poll() failed (%s).", strerror(errno));
+			break;
+		}
+
+		uint64_t cnt;
+		if ((fds[0].revents & POLLIN) &&
+				read(wr->_event_fd, &cnt, sizeof(cnt)) != sizeof(cnt)) {
+			MSG_WARNING(msg_module, "Failed to read an event counter.");
+		}
+
+		bool flush = (fds[2].revents & POLLIN) &&
+			read(wr->_flush_fd, &cnt, sizeof(cnt)) == sizeof(cnt);
+
+		// Stop flag is always set after the last buffer is pending
+		pthread_mutex_lock(&wr->_mutex);
+		stop = wr->_stop;
+		pthread_mutex_unlock(&wr->_mutex);
+
+		bool window = (fds[1].revents & POLLIN) && !stop &&
+			read(wr->_window_fd, &cnt, sizeof(cnt)) == sizeof(cnt);
+
+		// Records of the current window must not get into the next file
+		wr->flush_buffers(flush || window);
+
+		if (window) {
+			// New time window (skip missed windows, if any)
+			wr->_cfg.window_time += cnt * wr->_cfg.window_size;
+			wr->rotate(false);
+		}
+	}
+
+	wr->rotate(true);
+	MSG_DEBUG(msg_module, "Thread terminated.");
+	return NULL;
+}
@@ -0,0 +1,124 @@
+/**
+ * \file AsyncWriter.h
+ * \brief Double-buffered background writer of the file output (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include "Compressor.h"
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdio>
+
+#include <pthread.h>
+
+/**
+ * \brief Double-buffered file writer with an own writer thread
+ *
+ * The storage thread only copies records into the active buffer. When the
+ * buffer is full, it is swapped with the second one and the writer thread
+ * compresses (optionally) and writes it with one large write. The writer
+ * thread also rotates time windows, driven by a timerfd. On each tick of
+ * the flush or window timer, it takes over the partial active buffer too.
+ */
+class AsyncWriter {
+public:
+	/** Configuration of the writer */
+	typedef struct cfg_s {
+		std::string storage_path;    /**< Storage path (template)    */
+		std::string file_prefix;     /**< File prefix                */
+		unsigned int window_size;    /**< Size of a time window      */
+		time_t window_time;          /**< First time window          */
+		size_t buffer_size;          /**< Size of each buffer        */
+		unsigned int flush_interval; /**< Max. age of buffered data  */
+		std::string compression;     /**< Compression method         */
+		int level;                   /**< Compression level          */
+	} cfg_t;
+
+	AsyncWriter(const cfg_t &cfg);
+	~AsyncWriter();
+
+	// Append a record (called only from the storage thread)
+	void write(const char *data, size_t len);
+
+private:
+	/** Data buffer (aligned to the page size) */
+	typedef struct buffer_s {
+		char *data;                  /**< Memory                     */
+		size_t used;                 /**< Used bytes                 */
+	} buffer_t;
+
+	cfg_t _cfg;
+	Compressor *_comp;               /**< Compressor (can be NULL)   */
+	std::vector<char> _out;          /**< Compressed data            */
+
+	buffer_t _bufs[2];               /**< Both buffers               */
+	buffer_t *_active;               /**< Filled by storage thread   */
+	buffer_t *_pending;              /**< Waiting for writer thread  */
+	buffer_t *_free;                 /**< Ready to be activated      */
+
+	pthread_t _thread;               /**< Writer thread              */
+	pthread_mutex_t _mutex;          /**< Protects the buffers       */
+	pthread_cond_t _cond;            /**< Signals a free buffer      */
+	bool _stop;                      /**< Stop flag                  */
+
+	int _event_fd;                   /**< New pending buffer         */
+	int _window_fd;                  /**< Time window timer          */
+	int _flush_fd;                   /**< Flush timer                */
+
+	FILE *_file;                     /**< Current output file        */
+
+	// Hand over the active buffer to the writer thread (_mutex locked)
+	void swap();
+	// Write a buffer to the current file (writer thread)
+	void flush_buffer(buffer_t *buf);
+	// Write the pending and optionally the active buffer (writer thread)
+	void flush_buffers(bool partial);
+	// Finish the current file and create a new one (writer thread)
+	void rotate(bool last);
+	// Write all data to the current file
+	void write_all(const char *data, size_t len);
+	// Release all resources
+	void cleanup();
+
+	// Writer thread
+	static void *thread_writer(void *context);
+};
+
+#endif // ASYNC_WRITER_H
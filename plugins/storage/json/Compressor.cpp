@@ -0,0 +1,311 @@
+/**
+ * \file Compressor.cpp
+ * \brief Streaming compressors for the file output (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Compressor.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <strings.h>
+
+#include <zlib.h>
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/** Size of a chunk appended to the output vector by zlib */
+#define GZIP_CHUNK (64 * 1024)
+
+/**
+ * \brief gzip compressor (zlib deflate with gzip wrapper)
+ */
+class GzipCompressor : public Compressor
+{
+public:
+	GzipCompressor(int level)
+	{
+		std::memset(&_strm, 0, sizeof(_strm));
+		if (level < 0 || level > 9) {
+			level = Z_DEFAULT_COMPRESSION;
+		}
+
+		// 15 bits window + 16 for the gzip header and trailer
+		if (deflateInit2(&_strm, level, Z_DEFLATED, 15 + 16, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error("Failed to initialize gzip compressor.");
+		}
+	}
+
+	~GzipCompressor()
+	{
+		deflateEnd(&_strm);
+	}
+
+	void compress(const char *data, size_t len, std::vector<char> &out)
+	{
+		_strm.next_in = (Bytef *) data;
+		_strm.avail_in = len;
+		deflate_all(Z_NO_FLUSH, out);
+	}
+
+	void finish(std::vector<char> &out)
+	{
+		_strm.next_in = NULL;
+		_strm.avail_in = 0;
+		deflate_all(Z_FINISH, out);
+		deflateReset(&_strm);
+	}
+
+	const char *suffix() const { return ".gz"; }
+
+private:
+	z_stream _strm;
+
+	void deflate_all(int flush, std::vector<char> &out)
+	{
+		int ret;
+		do {
+			size_t pos = out.size();
+			out.resize(pos + GZIP_CHUNK);
+			_strm.next_out = (Bytef *) &out[pos];
+			_strm.avail_out = GZIP_CHUNK;
+
+			ret = deflate(&_strm, flush);
+			out.resize(pos + GZIP_CHUNK - _strm.avail_out);
+			if (ret == Z_STREAM_ERROR) {
+				throw std::runtime_error("gzip compression failed.");
+			}
+		} while (_strm.avail_out == 0 || (flush == Z_FINISH &&
+			ret != Z_STREAM_END));
+	}
+};
+
+#ifdef HAVE_LZ4
+/**
+ * \brief LZ4 frame compressor
+ */
+class Lz4Compressor : public Compressor
+{
+public:
+	Lz4Compressor(int level)
+	{
+		if (LZ4F_isError(LZ4F_createCompressionContext(&_ctx, LZ4F_VERSION))) {
+			throw std::runtime_error("Failed to initialize LZ4 compressor.");
+		}
+
+		std::memset(&_prefs, 0, sizeof(_prefs));
+		_prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+		_prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+		_prefs.compressionLevel = (level < 0) ? 0 : level;
+		_started = false;
+	}
+
+	~Lz4Compressor()
+	{
+		LZ4F_freeCompressionContext(_ctx);
+	}
+
+	void compress(const char *data, size_t len, std::vector<char> &out)
+	{
+		begin(out);
+
+		size_t pos = out.size();
+		out.resize(pos + LZ4F_compressBound(len, &_prefs));
+		size_t ret = LZ4F_compressUpdate(_ctx, &out[pos], out.size() - pos,
+			data, len, NULL);
+		check(ret);
+		out.resize(pos + ret);
+	}
+
+	void finish(std::vector<char> &out)
+	{
+		begin(out);
+
+		size_t pos = out.size();
+		out.resize(pos + LZ4F_compressBound(0, &_prefs));
+		size_t ret = LZ4F_compressEnd(_ctx, &out[pos], out.size() - pos, NULL);
+		check(ret);
+		out.resize(pos + ret);
+		_started = false;
+	}
+
+	const char *suffix() const { return ".lz4"; }
+
+private:
+	LZ4F_compressionContext_t _ctx;
+	LZ4F_preferences_t _prefs;
+	bool _started;
+
+	void begin(std::vector<char> &out)
+	{
+		if (_started) {
+			return;
+		}
+
+		size_t pos = out.size();
+		out.resize(pos + LZ4F_HEADER_SIZE_MAX);
+		size_t ret = LZ4F_compressBegin(_ctx, &out[pos], LZ4F_HEADER_SIZE_MAX,
+			&_prefs);
+		check(ret);
+		out.resize(pos + ret);
+		_started = true;
+	}
+
+	void check(size_t ret)
+	{
+		if (LZ4F_isError(ret)) {
+			throw std::runtime_error(std::string("LZ4 compression failed: ") +
+				LZ4F_getErrorName(ret));
+		}
+	}
+};
+#endif // HAVE_LZ4
+
+#ifdef HAVE_ZSTD
+/**
+ * \brief Zstandard compressor
+ */
+class ZstdCompressor : public Compressor
+{
+public:
+	ZstdCompressor(int level)
+	{
+		_ctx = ZSTD_createCCtx();
+		if (!_ctx) {
+			throw std::runtime_error("Failed to initialize zstd compressor.");
+		}
+
+		if (level < 0) {
+			level = ZSTD_CLEVEL_DEFAULT;
+		}
+
+		ZSTD_CCtx_setParameter(_ctx, ZSTD_c_compressionLevel, level);
+		ZSTD_CCtx_setParameter(_ctx, ZSTD_c_checksumFlag, 1);
+	}
+
+	~ZstdCompressor()
+	{
+		ZSTD_freeCCtx(_ctx);
+	}
+
+	void compress(const char *data, size_t len, std::vector<char> &out)
+	{
+		ZSTD_inBuffer in = {data, len, 0};
+		stream(in, ZSTD_e_continue, out);
+	}
+
+	void finish(std::vector<char> &out)
+	{
+		ZSTD_inBuffer in = {NULL, 0, 0};
+		stream(in, ZSTD_e_end, out);
+	}
+
+	const char *suffix() const { return ".zst"; }
+
+private:
+	ZSTD_CCtx *_ctx;
+
+	void stream(ZSTD_inBuffer &in, ZSTD_EndDirective mode,
+		std::vector<char> &out)
+	{
+		const size_t chunk = ZSTD_CStreamOutSize();
+		size_t remaining;
+
+		do {
+			size_t pos = out.size();
+			out.resize(pos + chunk);
+			ZSTD_outBuffer dst = {&out[pos], chunk, 0};
+
+			remaining = ZSTD_compressStream2(_ctx, &dst, &in, mode);
+			if (ZSTD_isError(remaining)) {
+				throw std::runtime_error(std::string("zstd compression failed: ")
+					+ ZSTD_getErrorName(remaining));
+			}
+
+			out.resize(pos + dst.pos);
+		} while (in.pos < in.size || (mode == ZSTD_e_end && remaining != 0));
+	}
+};
+#endif // HAVE_ZSTD
+
+/**
+ * \brief Create a compressor
+ *
+ * \param[in] name Name of the compression algorithm (none/gzip/lz4/zstd)
+ * \param[in] level Compression level (meaning depends on the algorithm)
+ * \return Pointer to the new compressor or NULL (no compression)
+ * \throw invalid_argument if the algorithm is unknown or not compiled in
+ */
+Compressor *Compressor::create(const std::string &name, int level)
+{
+	if (name.empty() || strcasecmp(name.c_str(), "none") == 0) {
+		return NULL;
+	}
+
+	if (strcasecmp(name.c_str(), "gzip") == 0) {
+		return new GzipCompressor(level);
+	}
+
+	if (strcasecmp(name.c_str(), "lz4") == 0) {
+#ifdef HAVE_LZ4
+		return new Lz4Compressor(level);
+#else
+		throw std::invalid_argument("LZ4 compression is not supported (the "
+			"plugin was built without liblz4).");
+#endif
+	}
+
+	if (strcasecmp(name.c_str(), "zstd") == 0) {
+#ifdef HAVE_ZSTD
+		return new ZstdCompressor(level);
+#else
+		throw std::invalid_argument("zstd compression is not supported (the "
+			"plugin was built without libzstd).");
+#endif
+	}
+
+	throw std::invalid_argument("Unknown compression method \"" + name + "\".");
+}
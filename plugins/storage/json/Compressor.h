@@ -0,0 +1,71 @@
+/**
+ * \file Compressor.h
+ * \brief Streaming compressors for the file output (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+ * \brief Base class for streaming compressors
+ *
+ * Every output file is one independent compressed stream (gzip member,
+ * LZ4 frame or zstd frame). Compressed data are appended to the output
+ * vector, which is never cleared by the compressor.
+ */
+class Compressor
+{
+public:
+	virtual ~Compressor() {}
+
+	// Compress a block of data
+	virtual void compress(const char *data, size_t len,
+		std::vector<char> &out) = 0;
+	// Finish the current stream and prepare the compressor for a new one
+	virtual void finish(std::vector<char> &out) = 0;
+
+	// File name suffix of the compressed stream (e.g. ".gz")
+	virtual const char *suffix() const = 0;
+
+	// Create a compressor by name ("none" returns NULL)
+	static Compressor *create(const std::string &name, int level);
+};
+
+#endif // COMPRESSOR_H
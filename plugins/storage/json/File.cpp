@@ -38,6 +38,7 @@
  */
 
 #include "File.h"
+#include "AsyncWriter.h"
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -53,6 +54,8 @@
 
 #define DEF_WINDOW_SIZE (300)
 #define DEF_WINDOW_ALIGN (true)
+#define DEF_BUFFER_SIZE (4 * 1024 * 1024)
+#define DEF_FLUSH_INTERVAL (1)
 
 static const char *msg_module = "json_storage(file)";
 
@@ -123,6 +126,56 @@ File::File(const pugi::xpath_node &config)
 		}
 	}
 
+	// Asynchronous writer (compression is always done by the writer thread)
+	std::string async = config.node().child_value("async");
+	std::string compression = config.node().child_value("compression");
+	bool use_async = (strcasecmp(async.c_str(), "yes") == 0 || async == "1");
+	if (!compression.empty() && strcasecmp(compression.c_str(), "none") != 0
+			&& !use_async) {
+		MSG_INFO(msg_module, "Compression enabled, using asynchronous writer.");
+		use_async = true;
+	}
+
+	_file = NULL;
+	_thread = NULL;
+	_writer = NULL;
+
+	if (use_async) {
+		AsyncWriter::cfg_t cfg;
+		cfg.storage_path = path;
+		cfg.file_prefix = prefix;
+		cfg.window_size = w_size;
+		cfg.compression = compression;
+		time(&cfg.window_time);
+
+		if (w_align) {
+			// Window alignment
+			cfg.window_time = (cfg.window_time / w_size) * w_size;
+		}
+
+		std::string tmp;
+		try {
+			tmp = config.node().child_value("bufferSize");
+			cfg.buffer_size = tmp.empty() ? DEF_BUFFER_SIZE : std::stoul(tmp);
+			tmp = config.node().child_value("flushInterval");
+			cfg.flush_interval = tmp.empty() ? DEF_FLUSH_INTERVAL :
+				std::stoul(tmp);
+			tmp = config.node().child_value("compressionLevel");
+			cfg.level = tmp.empty() ? -1 : std::stoi(tmp);
+		} catch (std::exception &e) {
+			throw std::invalid_argument("Invalid configuration of the "
+				"asynchronous writer.");
+		}
+
+		if (cfg.buffer_size == 0) {
+			throw std::invalid_argument("Size of the writer buffer must be "
+				"greater than zero.");
+		}
+
+		_writer = new AsyncWriter(cfg);
+		return;
+	}
+
 	// Prepare a configuration of the thread for changing time windows
 	_thread = new thread_ctx_t;
 	_thread->new_file = NULL;
@@ -173,6 +226,8 @@ File::File(const pugi::xpath_node &config)
  */
 File::~File()
 {
+	delete _writer;
+
 	if (_file) {
 		fclose(_file);
 	}
@@ -245,6 +300,11 @@ void *File::thread_window(void *context)
  */
 void File::ProcessDataRecord(const std::string &record)
 {
+	if (_writer) {
+		_writer->write(record.c_str(), record.size());
+		return;
+	}
+
 	// Should we change a time window
 	if (_thread->new_file_ready) {
 		// Close old time window
@@ -373,11 +433,14 @@ int File::dir_create(const std::string &path)
  * \brief Create a file for a time window
  *
  * Check/create a directory hierarchy and create a new file for time window.
+ * \param[in] tmplt Template of the directory path
+ * \param[in] prefix File prefix
  * \param[in] tm Time window
+ * \param[in] suffix File suffix (e.g. extension of compressed files)
  * \return On success returns pointer to the file, Otherwise returns NULL.
  */
 FILE *File::file_create(const std::string &tmplt, const std::string &prefix,
-	const time_t &tm)
+	const time_t &tm, const std::string &suffix)
 {
 	char file_fmt[20];
 
@@ -404,7 +467,7 @@ FILE *File::file_create(const std::string &tmplt, const std::string &prefix,
 		return NULL;
 	}
 
-	std::string file_name = directory + prefix + file_fmt;
+	std::string file_name = directory + prefix + file_fmt + suffix;
 	FILE *file = fopen(file_name.c_str(), "w");
 	if (!file) {
 		// Failed to create a flow file
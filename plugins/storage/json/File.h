@@ -48,6 +48,8 @@
 
 #include <pthread.h>
 
+class AsyncWriter;
+
 /**
  * \brief The class for file output interface
  */
@@ -67,7 +69,7 @@ public:
 	static int dir_create(const std::string &path);
 	// Create a file for a time window
 	static FILE *file_create(const std::string &tmplt, const std::string &prefix,
-				const time_t &tm);
+				const time_t &tm, const std::string &suffix = "");
 private:
 	/** Minimal window size */
 	const unsigned int _WINDOW_MIN_SIZE = 60; // seconds
@@ -91,6 +93,8 @@ private:
 	FILE *_file;
 	/** Thread for changing time windows */
 	thread_ctx_t *_thread;
+	/** Background writer (asynchronous mode only) */
+	AsyncWriter *_writer;
 
 	// Window changer
 	static void *thread_window(void *context);
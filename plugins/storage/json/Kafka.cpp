@@ -0,0 +1,1225 @@
+/**
+ * \file Kafka.cpp
+ * \brief Kafka producer output (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include "Kafka.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <cinttypes>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/** Kafka API keys and versions */
+#define API_PRODUCE        (0)
+#define API_PRODUCE_VER    (3)
+#define API_METADATA       (3)
+#define API_METADATA_VER   (1)
+
+/** Selected Kafka error codes */
+#define KERR_UNKNOWN_TOPIC  (3)
+#define KERR_LEADER_NA      (5)
+#define KERR_NOT_LEADER     (6)
+
+/** Defaults */
+#define DEF_PORT           "9092"
+#define DEF_CLIENT_ID      "ipfixcol"
+#define DEF_BATCH_SIZE     (1024 * 1024)
+#define DEF_LINGER         (100)
+#define DEF_IN_FLIGHT      (5)
+#define DEF_ACKS           (1)
+#define DEF_TIMEOUT        (5000)
+
+/** Attempts to get metadata of a topic that is being created */
+#define METADATA_ATTEMPTS  (5)
+/** Min. interval between metadata requests (ms) */
+#define METADATA_INTERVAL  (1000)
+
+static const char *msg_module = "json_storage(kafka)";
+
+/* Helpers for the encoding of protocol primitives (big endian) */
+static inline void put8(std::string &buf, int8_t val)
+{
+	buf += (char) val;
+}
+
+static inline void put16(std::string &buf, int16_t val)
+{
+	buf += (char) (val >> 8);
+	buf += (char) val;
+}
+
+static inline void put32(std::string &buf, int32_t val)
+{
+	for (int i = 24; i >= 0; i -= 8) {
+		buf += (char) (val >> i);
+	}
+}
+
+static inline void put64(std::string &buf, int64_t val)
+{
+	for (int i = 56; i >= 0; i -= 8) {
+		buf += (char) (val >> i);
+	}
+}
+
+static inline void set32(std::string &buf, size_t pos, int32_t val)
+{
+	for (int i = 0; i < 4; ++i) {
+		buf[pos + i] = (char) (val >> (24 - 8 * i));
+	}
+}
+
+static inline void put_str(std::string &buf, const std::string &str)
+{
+	put16(buf, str.size());
+	buf += str;
+}
+
+/* Zig-zag encoded variable length integer (record batches) */
+static inline void put_varint(std::string &buf, int64_t val)
+{
+	uint64_t tmp = ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+	while (tmp & ~0x7FULL) {
+		buf += (char) ((tmp & 0x7F) | 0x80);
+		tmp >>= 7;
+	}
+	buf += (char) tmp;
+}
+
+/**
+ * \brief Parser of protocol primitives
+ * \throw out_of_range if data are truncated
+ */
+class KafkaReader
+{
+public:
+	KafkaReader(const char *data, size_t len) : _data(data), _len(len),
+		_pos(0) {}
+
+	int8_t i8() { return (int8_t) get(1); }
+	int16_t i16() { return (int16_t) get(2); }
+	int32_t i32() { return (int32_t) get(4); }
+	int64_t i64() { return (int64_t) get(8); }
+
+	std::string str()
+	{
+		int16_t len = i16();
+		if (len < 0) {
+			return std::string();
+		}
+
+		check(len);
+		std::string res(_data + _pos, len);
+		_pos += len;
+		return res;
+	}
+
+	void skip_array(size_t item)
+	{
+		int32_t cnt = i32();
+		if (cnt > 0) {
+			check(cnt * item);
+			_pos += cnt * item;
+		}
+	}
+
+private:
+	const char *_data;
+	size_t _len;
+	size_t _pos;
+
+	void check(size_t len)
+	{
+		if (_pos + len > _len) {
+			throw std::out_of_range("Truncated Kafka response.");
+		}
+	}
+
+	uint64_t get(size_t len)
+	{
+		check(len);
+		uint64_t res = 0;
+		for (size_t i = 0; i < len; ++i) {
+			res = (res << 8) | (uint8_t) _data[_pos++];
+		}
+		return res;
+	}
+};
+
+/**
+ * \brief CRC32C (Castagnoli) of record batches
+ */
+static uint32_t crc32c(const char *data, size_t len)
+{
+	static uint32_t table[256];
+	static bool ready = false;
+
+	if (!ready) {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+			for (int j = 0; j < 8; ++j) {
+				crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+			}
+			table[i] = crc;
+		}
+		ready = true;
+	}
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; ++i) {
+		crc = table[(crc ^ (uint8_t) data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+/**
+ * \brief Murmur2 hash compatible with the default Kafka partitioner
+ */
+static uint32_t murmur2(const std::string &key)
+{
+	const uint32_t m = 0x5bd1e995;
+	const uint8_t *data = (const uint8_t *) key.data();
+	size_t len = key.size();
+	uint32_t h = 0x9747b28c ^ len;
+
+	for (size_t i = 0; i + 4 <= len; i += 4) {
+		uint32_t k = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) |
+			((uint32_t) data[i + 3] << 24);
+		k *= m;
+		k ^= k >> 24;
+		k *= m;
+		h *= m;
+		h ^= k;
+	}
+
+	size_t tail = len & ~((size_t) 3);
+	switch (len % 4) {
+	case 3: h ^= data[tail + 2] << 16; // fall through
+	case 2: h ^= data[tail + 1] << 8;  // fall through
+	case 1: h ^= data[tail];
+		h *= m;
+	}
+
+	h ^= h >> 13;
+	h *= m;
+	h ^= h >> 15;
+	return h;
+}
+
+/**
+ * \brief Split "host:port" (IPv6 addresses must be in brackets)
+ */
+static void split_address(const std::string &addr, std::string &host,
+	std::string &port)
+{
+	size_t pos;
+
+	if (addr[0] == '[' && (pos = addr.find(']')) != std::string::npos) {
+		host = addr.substr(1, pos - 1);
+		port = (addr.size() > pos + 2) ? addr.substr(pos + 2) : DEF_PORT;
+		return;
+	}
+
+	pos = addr.find(':');
+	if (pos == std::string::npos || addr.find(':', pos + 1) !=
+			std::string::npos) {
+		// No port or IPv6 address without brackets
+		host = addr;
+		port = DEF_PORT;
+	} else {
+		host = addr.substr(0, pos);
+		port = addr.substr(pos + 1);
+	}
+}
+
+/**
+ * \brief Class constructor
+ *
+ * Parse output configuration and load metadata of the topic
+ * \param config[in] XML configuration
+ */
+Kafka::Kafka(const pugi::xpath_node &config) : _sticky(0), _refresh(false),
+	_md_request(false), _md_stop(false), _md_ready(false), _md_corr_id(0),
+	_linger_running(false), _last_flush(0), _corr_id(0), _dropped(0)
+{
+	// Bootstrap brokers
+	std::string brokers = config.node().child_value("brokers");
+	if (brokers.empty()) {
+		throw std::invalid_argument("Missing Kafka brokers specification.");
+	}
+
+	size_t start = 0;
+	while (start <= brokers.size()) {
+		size_t end = brokers.find(',', start);
+		if (end == std::string::npos) {
+			end = brokers.size();
+		}
+
+		std::string item = brokers.substr(start, end - start);
+		item.erase(0, item.find_first_not_of(" \t"));
+		item.erase(item.find_last_not_of(" \t") + 1);
+		if (!item.empty()) {
+			_bootstrap.push_back(item);
+		}
+		start = end + 1;
+	}
+
+	_topic = config.node().child_value("topic");
+	if (_topic.empty()) {
+		throw std::invalid_argument("Missing Kafka topic specification.");
+	}
+
+	_client_id = config.node().child_value("clientId");
+	if (_client_id.empty()) {
+		_client_id = DEF_CLIENT_ID;
+	}
+
+	// Fields of the partition key
+	for (pugi::xml_node key = config.node().child("partitionKey"); key;
+			key = key.next_sibling("partitionKey")) {
+		std::string name = key.child_value();
+		if (!name.empty()) {
+			_key_fields.push_back("\"" + name + "\": ");
+		}
+	}
+
+	std::string tmp;
+	try {
+		tmp = config.node().child_value("batchSize");
+		_batch_size = tmp.empty() ? DEF_BATCH_SIZE : std::stoul(tmp);
+		tmp = config.node().child_value("lingerMs");
+		_linger = tmp.empty() ? DEF_LINGER : std::stoul(tmp);
+		tmp = config.node().child_value("maxInFlight");
+		_max_in_flight = tmp.empty() ? DEF_IN_FLIGHT : std::stoul(tmp);
+		tmp = config.node().child_value("acks");
+		_acks = tmp.empty() ? DEF_ACKS : std::stoi(tmp);
+		tmp = config.node().child_value("timeout");
+		_timeout = tmp.empty() ? DEF_TIMEOUT : std::stoi(tmp);
+	} catch (std::exception &e) {
+		throw std::invalid_argument("Invalid value of a Kafka parameter.");
+	}
+
+	if (_acks != 0 && _acks != 1 && _acks != -1) {
+		throw std::invalid_argument("Kafka acks must be 0, 1 or -1.");
+	}
+
+	if (_max_in_flight == 0) {
+		_max_in_flight = 1;
+	}
+
+	metadata_t md;
+	if (!fetch_metadata(md)) {
+		throw std::runtime_error("Failed to get metadata of the topic '" +
+			_topic + "'.");
+	}
+	apply_metadata(md);
+
+	if (pthread_mutex_init(&_mutex, NULL) != 0) {
+		throw std::runtime_error("Mutex initialization failed");
+	}
+
+	if (pthread_mutex_init(&_md_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&_mutex);
+		throw std::runtime_error("Mutex initialization failed");
+	}
+
+	if (pthread_cond_init(&_md_cond, NULL) != 0) {
+		pthread_mutex_destroy(&_md_mutex);
+		pthread_mutex_destroy(&_mutex);
+		throw std::runtime_error("Condition variable initialization failed");
+	}
+
+	_last_flush = now_ms(true);
+
+	if (pthread_create(&_md_thread, NULL, &Kafka::thread_metadata, this) != 0) {
+		pthread_cond_destroy(&_md_cond);
+		pthread_mutex_destroy(&_md_mutex);
+		pthread_mutex_destroy(&_mutex);
+		throw std::runtime_error("Failed to start a metadata thread.");
+	}
+
+	if (_linger > 0) {
+		if (pthread_create(&_linger_thread, NULL, &Kafka::thread_linger, this) != 0) {
+			MSG_WARNING(msg_module, "Failed to start a linger thread, batches "
+				"are sent only when records arrive.");
+		} else {
+			_linger_running = true;
+		}
+	}
+}
+
+/**
+ * \brief Class destructor
+ *
+ * Send remaining batches and wait for responses
+ */
+Kafka::~Kafka()
+{
+	pthread_mutex_lock(&_md_mutex);
+	_md_stop = true;
+	pthread_cond_broadcast(&_md_cond);
+	pthread_mutex_unlock(&_md_mutex);
+
+	pthread_join(_md_thread, NULL);
+	if (_linger_running) {
+		pthread_join(_linger_thread, NULL);
+	}
+	pthread_cond_destroy(&_md_cond);
+	pthread_mutex_destroy(&_md_mutex);
+	pthread_mutex_destroy(&_mutex);
+
+	flush_all();
+
+	for (auto &item: _brokers) {
+		broker_t &broker = item.second;
+		while (broker.conn && !broker.in_flight.empty()) {
+			if (!broker_recv(broker, _timeout)) {
+				break;
+			}
+		}
+
+		broker_close(broker);
+	}
+
+	if (_dropped > 0) {
+		MSG_WARNING(msg_module, "%" PRIu64 " records have been dropped.",
+			_dropped);
+	}
+}
+
+/**
+ * \brief Current time in milliseconds
+ * \param[in] monotonic Use a monotonic clock instead of the wall clock
+ */
+uint64_t Kafka::now_ms(bool monotonic)
+{
+	struct timespec ts;
+	clock_gettime(monotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief Open a connection to a broker
+ *
+ * Only one attempt per second is made.
+ * \return True if the broker is connected
+ */
+bool Kafka::broker_connect(broker_t &broker)
+{
+	if (broker.conn) {
+		return true;
+	}
+
+	uint64_t now = now_ms(true);
+	if (broker.conn_time != 0 && now - broker.conn_time < 1000) {
+		return false;
+	}
+	broker.conn_time = now;
+
+	sisoconf *conn = siso_create();
+	if (conn == NULL) {
+		MSG_ERROR(msg_module, "Memory error - cannot create sender object");
+		return false;
+	}
+
+	if (siso_create_connection(conn, broker.host.c_str(), broker.port.c_str(),
+			"TCP") != SISO_OK) {
+		MSG_WARNING(msg_module, "Failed to connect to broker %s:%s (%s).",
+			broker.host.c_str(), broker.port.c_str(), siso_get_last_err(conn));
+		siso_destroy(conn);
+		return false;
+	}
+
+	broker.conn = conn;
+	broker.in_flight.clear();
+	broker.rbuf.clear();
+	MSG_INFO(msg_module, "Connected to broker %s:%s.", broker.host.c_str(),
+		broker.port.c_str());
+	return true;
+}
+
+/**
+ * \brief Close a connection to a broker
+ *
+ * Requests without a response are considered lost.
+ */
+void Kafka::broker_close(broker_t &broker)
+{
+	if (!broker.conn) {
+		return;
+	}
+
+	if (!broker.in_flight.empty()) {
+		MSG_WARNING(msg_module, "%zu requests to broker %s:%s have not been "
+			"confirmed.", broker.in_flight.size(), broker.host.c_str(),
+			broker.port.c_str());
+	}
+
+	siso_destroy(broker.conn);
+	broker.conn = NULL;
+	broker.in_flight.clear();
+	broker.rbuf.clear();
+}
+
+/**
+ * \brief Start a new request in a request buffer
+ */
+void Kafka::request_header(std::string &req, int16_t api_key,
+	int16_t api_version, int32_t corr_id)
+{
+	req.clear();
+	put32(req, 0); // Size, filled by request_send()
+	put16(req, api_key);
+	put16(req, api_version);
+	put32(req, corr_id);
+	put_str(req, _client_id);
+}
+
+/**
+ * \brief Finish and send a request from a request buffer
+ * \param[in,out] broker Destination
+ * \param[in,out] req Request
+ * \param[in] corr_id Correlation ID of the request
+ * \param[in] response A response is expected
+ * \return False if the connection is broken
+ */
+bool Kafka::request_send(broker_t &broker, std::string &req, int32_t corr_id,
+	bool response)
+{
+	set32(req, 0, req.size() - 4);
+
+	if (siso_send(broker.conn, req.data(), req.size()) != SISO_OK) {
+		MSG_ERROR(msg_module, "Failed to send a request to broker %s:%s (%s). "
+			"Connection closed.", broker.host.c_str(), broker.port.c_str(),
+			siso_get_last_err(broker.conn));
+		broker_close(broker);
+		return false;
+	}
+
+	if (response) {
+		broker.in_flight.push_back(corr_id);
+	}
+
+	return true;
+}
+
+/**
+ * \brief Load brokers, partitions and leaders of the topic
+ *
+ * Bootstrap brokers are asked one by one. Only own connections are used, so
+ * the function can run in the metadata thread.
+ * \param[out] md Metadata
+ * \return True on success
+ */
+bool Kafka::fetch_metadata(metadata_t &md)
+{
+	std::string req;
+
+	for (const std::string &addr: _bootstrap) {
+		broker_t boot;
+		boot.id = -1;
+		boot.conn = NULL;
+		boot.conn_time = 0;
+		split_address(addr, boot.host, boot.port);
+
+		for (int attempt = 0; attempt < METADATA_ATTEMPTS; ++attempt) {
+			if (attempt > 0) {
+				// Topic is probably being created
+				usleep(500000);
+			}
+
+			boot.conn_time = 0;
+			if (!broker_connect(boot)) {
+				break;
+			}
+
+			int32_t corr_id = _md_corr_id++;
+			request_header(req, API_METADATA, API_METADATA_VER, corr_id);
+			put32(req, 1);
+			put_str(req, _topic);
+			if (!request_send(boot, req, corr_id, false)) {
+				break;
+			}
+
+			// Wait for the whole response
+			int fd = siso_get_socket(boot.conn);
+			uint64_t deadline = now_ms(true) + _timeout;
+			std::string resp;
+			bool failed = false;
+
+			while (resp.size() < 4 || resp.size() < 4 + (size_t)
+					KafkaReader(resp.data(), 4).i32()) {
+				struct pollfd pfd = {fd, POLLIN, 0};
+				uint64_t now = now_ms(true);
+				if (now >= deadline || poll(&pfd, 1, deadline - now) <= 0) {
+					MSG_WARNING(msg_module, "Broker %s did not respond.",
+						addr.c_str());
+					failed = true;
+					break;
+				}
+
+				char buf[4096];
+				ssize_t len = recv(fd, buf, sizeof(buf), 0);
+				if (len <= 0) {
+					failed = true;
+					break;
+				}
+				resp.append(buf, len);
+			}
+
+			if (failed) {
+				broker_close(boot);
+				break;
+			}
+
+			std::map<int32_t, broker_t> brokers;
+			std::vector<int32_t> leaders;
+			int16_t topic_err = 0;
+
+			try {
+				KafkaReader rd(resp.data() + 4, resp.size() - 4);
+				if (rd.i32() != corr_id) {
+					throw std::out_of_range("Unexpected correlation ID.");
+				}
+
+				int32_t cnt = rd.i32();
+				for (int32_t i = 0; i < cnt; ++i) {
+					broker_t br;
+					br.id = rd.i32();
+					br.host = rd.str();
+					br.port = std::to_string(rd.i32());
+					rd.str(); // rack
+					br.conn = NULL;
+					br.conn_time = 0;
+					brokers[br.id] = br;
+				}
+
+				rd.i32(); // controller ID
+				cnt = rd.i32();
+				for (int32_t i = 0; i < cnt; ++i) {
+					int16_t err = rd.i16();
+					std::string name = rd.str();
+					rd.i8(); // is_internal
+
+					int32_t parts = rd.i32();
+					for (int32_t p = 0; p < parts; ++p) {
+						rd.i16(); // partition error
+						int32_t index = rd.i32();
+						int32_t leader = rd.i32();
+						rd.skip_array(4); // replicas
+						rd.skip_array(4); // ISR
+
+						if (name != _topic || index < 0) {
+							continue;
+						}
+
+						if ((size_t) index >= leaders.size()) {
+							leaders.resize(index + 1, -1);
+						}
+						leaders[index] = leader;
+					}
+
+					if (name == _topic) {
+						topic_err = err;
+					}
+				}
+			} catch (std::exception &e) {
+				MSG_ERROR(msg_module, "Invalid metadata from %s (%s).",
+					addr.c_str(), e.what());
+				broker_close(boot);
+				break;
+			}
+
+			broker_close(boot);
+
+			if (topic_err == KERR_LEADER_NA || (topic_err == 0 &&
+					leaders.empty())) {
+				continue;
+			}
+
+			if (topic_err != 0) {
+				MSG_ERROR(msg_module, "Broker %s returned error %d for topic "
+					"'%s'.", addr.c_str(), topic_err, _topic.c_str());
+				return false;
+			}
+
+			md.brokers.swap(brokers);
+			md.leaders.swap(leaders);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * \brief Use loaded metadata
+ *
+ * Open connections to known brokers and batches of existing partitions are
+ * preserved.
+ * \param[in,out] md Metadata (brokers are moved)
+ */
+void Kafka::apply_metadata(metadata_t &md)
+{
+	std::map<int32_t, broker_t> &brokers = md.brokers;
+	const std::vector<int32_t> &leaders = md.leaders;
+
+	// Keep open connections to known brokers
+	for (auto &item: brokers) {
+		auto old = _brokers.find(item.first);
+		if (old != _brokers.end() && old->second.host ==
+				item.second.host && old->second.port ==
+				item.second.port) {
+			item.second = old->second;
+			old->second.conn = NULL;
+		}
+	}
+
+	for (auto &item: _brokers) {
+		broker_close(item.second);
+	}
+	_brokers.swap(brokers);
+
+	// Records of removed partitions are lost
+	for (size_t i = leaders.size(); i < _partitions.size(); ++i) {
+		_dropped += _partitions[i].count;
+	}
+
+	partition_t empty;
+	empty.leader = -1;
+	empty.count = 0;
+	empty.first_ts = 0;
+	empty.max_ts = 0;
+	_partitions.resize(leaders.size(), empty);
+	for (size_t i = 0; i < leaders.size(); ++i) {
+		_partitions[i].leader = leaders[i];
+	}
+
+	MSG_INFO(msg_module, "Topic '%s' has %zu partitions on %zu brokers.",
+		_topic.c_str(), _partitions.size(), _brokers.size());
+	_refresh = false;
+}
+
+/**
+ * \brief Ask the metadata thread for a refresh
+ */
+void Kafka::request_metadata()
+{
+	pthread_mutex_lock(&_md_mutex);
+	_md_request = true;
+	pthread_cond_broadcast(&_md_cond);
+	pthread_mutex_unlock(&_md_mutex);
+}
+
+/**
+ * \brief Metadata thread function
+ *
+ * Loads metadata on request of the storage thread, at most once per
+ * METADATA_INTERVAL. The storage thread applies the result before the next
+ * record.
+ * \param[in,out] context Instance of the output
+ * \return Nothing
+ */
+void *Kafka::thread_metadata(void *context)
+{
+	Kafka *kafka = (Kafka *) context;
+	MSG_DEBUG(msg_module, "Metadata thread started...");
+
+	pthread_mutex_lock(&kafka->_md_mutex);
+	while (true) {
+		while (!kafka->_md_request && !kafka->_md_stop) {
+			pthread_cond_wait(&kafka->_md_cond, &kafka->_md_mutex);
+		}
+
+		if (kafka->_md_stop) {
+			break;
+		}
+
+		kafka->_md_request = false;
+		pthread_mutex_unlock(&kafka->_md_mutex);
+
+		metadata_t md;
+		bool ok = kafka->fetch_metadata(md);
+
+		pthread_mutex_lock(&kafka->_md_mutex);
+		if (ok) {
+			kafka->_md.brokers.swap(md.brokers);
+			kafka->_md.leaders.swap(md.leaders);
+			kafka->_md_ready.store(true, std::memory_order_release);
+		} else {
+			MSG_WARNING(msg_module, "Failed to refresh metadata of the topic "
+				"'%s'.", kafka->_topic.c_str());
+		}
+
+		// Do not flood brokers with requests
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += METADATA_INTERVAL / 1000;
+		int ret = 0;
+		while (!kafka->_md_stop && ret != ETIMEDOUT) {
+			ret = pthread_cond_timedwait(&kafka->_md_cond, &kafka->_md_mutex,
+				&ts);
+		}
+	}
+	pthread_mutex_unlock(&kafka->_md_mutex);
+
+	MSG_DEBUG(msg_module, "Metadata thread terminated.");
+	return NULL;
+}
+
+/**
+ * \brief Linger thread function
+ *
+ * Sends batches when the linger time passed since the last flush, so records
+ * do not wait for the next record to arrive.
+ * \param[in,out] context Instance of the output
+ * \return Nothing
+ */
+void *Kafka::thread_linger(void *context)
+{
+	Kafka *kafka = (Kafka *) context;
+	MSG_DEBUG(msg_module, "Linger thread started...");
+
+	while (true) {
+		pthread_mutex_lock(&kafka->_mutex);
+		uint64_t wait = kafka->_linger;
+		uint64_t elapsed = now_ms(true) - kafka->_last_flush;
+		if (elapsed < kafka->_linger) {
+			wait = kafka->_linger - elapsed;
+		} else {
+			for (const partition_t &part: kafka->_partitions) {
+				if (part.count > 0) {
+					kafka->flush_all();
+					break;
+				}
+			}
+		}
+		pthread_mutex_unlock(&kafka->_mutex);
+
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += wait / 1000;
+		ts.tv_nsec += (wait % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&kafka->_md_mutex);
+		int ret = 0;
+		while (!kafka->_md_stop && ret != ETIMEDOUT) {
+			ret = pthread_cond_timedwait(&kafka->_md_cond, &kafka->_md_mutex,
+				&ts);
+		}
+		bool stop = kafka->_md_stop;
+		pthread_mutex_unlock(&kafka->_md_mutex);
+
+		if (stop) {
+			break;
+		}
+	}
+
+	MSG_DEBUG(msg_module, "Linger thread terminated.");
+	return NULL;
+}
+
+/**
+ * \brief Extract the partition key from a record
+ *
+ * Values of all configured fields are concatenated. Quotes of strings are
+ * removed, so the key of an address is its textual form.
+ */
+void Kafka::extract_key(const std::string &record)
+{
+	_key.clear();
+
+	for (const std::string &field: _key_fields) {
+		size_t pos = record.find(field);
+		if (pos == std::string::npos) {
+			continue;
+		}
+
+		pos += field.size();
+		size_t end;
+		if (record[pos] == '"') {
+			++pos;
+			end = record.find('"', pos);
+		} else {
+			end = record.find_first_of(",}", pos);
+		}
+
+		if (end == std::string::npos) {
+			continue;
+		}
+
+		if (!_key.empty()) {
+			_key += '|';
+		}
+		_key.append(record, pos, end - pos);
+	}
+}
+
+/**
+ * \brief Add a record to the batch of its partition
+ * \param[in] record JSON record
+ */
+void Kafka::ProcessDataRecord(const std::string &record)
+{
+	pthread_mutex_lock(&_mutex);
+	process_record(record);
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+ * \brief Add a record to the batch of its partition (the state is locked)
+ * \param[in] record JSON record
+ */
+void Kafka::process_record(const std::string &record)
+{
+	if (_md_ready.load(std::memory_order_acquire)) {
+		pthread_mutex_lock(&_md_mutex);
+		apply_metadata(_md);
+		_md_ready.store(false, std::memory_order_relaxed);
+		pthread_mutex_unlock(&_md_mutex);
+	}
+
+	if (_refresh) {
+		// Loaded in the background, records of unknown leaders are dropped
+		request_metadata();
+		_refresh = false;
+	}
+
+	if (_partitions.empty()) {
+		_dropped++;
+		return;
+	}
+
+	// Select a partition
+	size_t index;
+	bool keyed = false;
+	if (!_key_fields.empty()) {
+		extract_key(record);
+		keyed = !_key.empty();
+	}
+
+	if (keyed) {
+		index = (murmur2(_key) & 0x7FFFFFFF) % _partitions.size();
+	} else {
+		index = _sticky % _partitions.size();
+	}
+
+	partition_t &part = _partitions[index];
+	int64_t now = now_ms(false);
+	if (part.count == 0) {
+		part.first_ts = now;
+	}
+	part.max_ts = now;
+
+	// Record (without the trailing new line)
+	size_t len = record.size();
+	if (len > 0 && record[len - 1] == '\n') {
+		--len;
+	}
+
+	_body.clear();
+	put8(_body, 0);                          // attributes
+	put_varint(_body, now - part.first_ts);  // timestamp delta
+	put_varint(_body, part.count);           // offset delta
+	if (keyed) {
+		put_varint(_body, _key.size());
+		_body += _key;
+	} else {
+		put_varint(_body, -1);
+	}
+	put_varint(_body, len);
+	_body.append(record, 0, len);
+	put_varint(_body, 0);                    // headers
+
+	put_varint(part.records, _body.size());
+	part.records += _body;
+	part.count++;
+
+	if (part.records.size() >= _batch_size) {
+		auto broker = _brokers.find(part.leader);
+		if (broker != _brokers.end()) {
+			broker_flush(broker->second);
+		} else {
+			_dropped += part.count;
+			part.records.clear();
+			part.count = 0;
+			_refresh = true;
+		}
+
+		if (!keyed) {
+			_sticky++;
+		}
+	}
+
+	if (_linger == 0 || now_ms(true) - _last_flush >= _linger) {
+		flush_all();
+	}
+
+	if (_dropped >= 100000) {
+		MSG_WARNING(msg_module, "%" PRIu64 " records have been dropped.",
+			_dropped);
+		_dropped = 0;
+	}
+}
+
+/**
+ * \brief Send batches of all partitions
+ */
+void Kafka::flush_all()
+{
+	for (auto &item: _brokers) {
+		broker_flush(item.second);
+	}
+
+	// Partitions without a known leader
+	for (partition_t &part: _partitions) {
+		if (part.count > 0 && _brokers.find(part.leader) == _brokers.end()) {
+			_dropped += part.count;
+			part.records.clear();
+			part.count = 0;
+			_refresh = true;
+		}
+	}
+
+	_sticky++;
+	_last_flush = now_ms(true);
+}
+
+/**
+ * \brief Send one Produce request with batches of all partitions led by
+ * the broker
+ *
+ * If the window of requests without a response is full, wait for a response
+ * first.
+ */
+void Kafka::broker_flush(broker_t &broker)
+{
+	int32_t cnt = 0;
+	for (partition_t &part: _partitions) {
+		if (part.leader == broker.id && part.count > 0) {
+			cnt++;
+		}
+	}
+
+	if (cnt == 0) {
+		return;
+	}
+
+	// Collect responses that have already arrived
+	if (broker.conn) {
+		broker_recv(broker, 0);
+	}
+
+	while (broker.conn && broker.in_flight.size() >= _max_in_flight) {
+		if (!broker_recv(broker, _timeout)) {
+			break;
+		}
+	}
+
+	bool connected = broker_connect(broker);
+
+	if (connected) {
+		request_header(_req, API_PRODUCE, API_PRODUCE_VER, _corr_id);
+		put16(_req, -1);        // transactional ID
+		put16(_req, _acks);
+		put32(_req, _timeout);
+		put32(_req, 1);         // topics
+		put_str(_req, _topic);
+		put32(_req, cnt);
+	}
+
+	for (size_t i = 0; i < _partitions.size(); ++i) {
+		partition_t &part = _partitions[i];
+		if (part.leader != broker.id || part.count == 0) {
+			continue;
+		}
+
+		if (!connected) {
+			_dropped += part.count;
+			part.records.clear();
+			part.count = 0;
+			continue;
+		}
+
+		put32(_req, i);
+		size_t size_pos = _req.size();
+		put32(_req, 0);         // size of the record batch
+
+		put64(_req, 0);         // base offset
+		size_t len_pos = _req.size();
+		put32(_req, 0);         // batch length
+		put32(_req, -1);        // partition leader epoch
+		put8(_req, 2);          // magic
+		size_t crc_pos = _req.size();
+		put32(_req, 0);         // CRC
+		put16(_req, 0);         // attributes (no compression)
+		put32(_req, part.count - 1);
+		put64(_req, part.first_ts);
+		put64(_req, part.max_ts);
+		put64(_req, -1);        // producer ID
+		put16(_req, -1);        // producer epoch
+		put32(_req, -1);        // base sequence
+		put32(_req, part.count);
+		_req += part.records;
+
+		set32(_req, size_pos, _req.size() - size_pos - 4);
+		set32(_req, len_pos, _req.size() - len_pos - 4);
+		set32(_req, crc_pos, crc32c(_req.data() + crc_pos + 4,
+			_req.size() - crc_pos - 4));
+
+		part.records.clear();
+		part.count = 0;
+	}
+
+	if (connected) {
+		request_send(broker, _req, _corr_id++, _acks != 0);
+	}
+}
+
+/**
+ * \brief Receive and process responses from a broker
+ * \param[in,out] broker Broker
+ * \param[in] wait Max. time to wait for data (ms)
+ * \return False if the connection has been closed
+ */
+bool Kafka::broker_recv(broker_t &broker, int wait)
+{
+	int fd = siso_get_socket(broker.conn);
+	struct pollfd pfd = {fd, POLLIN, 0};
+
+	int ret = poll(&pfd, 1, wait);
+	if (ret == 0) {
+		if (wait > 0) {
+			MSG_WARNING(msg_module, "Broker %s:%s did not respond in time.",
+				broker.host.c_str(), broker.port.c_str());
+			broker_close(broker);
+			return false;
+		}
+		return true;
+	}
+
+	while (true) {
+		char buf[16384];
+		ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (len <= 0) {
+			MSG_WARNING(msg_module, "Connection to broker %s:%s closed.",
+				broker.host.c_str(), broker.port.c_str());
+			broker_close(broker);
+			return false;
+		}
+
+		broker.rbuf.append(buf, len);
+	}
+
+	// Process complete responses
+	size_t pos = 0;
+	while (broker.rbuf.size() - pos >= 4) {
+		size_t len = (uint32_t) KafkaReader(broker.rbuf.data() + pos, 4).i32();
+		if (broker.rbuf.size() - pos - 4 < len) {
+			break;
+		}
+
+		response_process(broker, broker.rbuf.data() + pos + 4, len);
+		pos += 4 + len;
+		if (!broker.conn) {
+			return false;
+		}
+	}
+
+	broker.rbuf.erase(0, pos);
+	return true;
+}
+
+/**
+ * \brief Process a Produce response
+ */
+void Kafka::response_process(broker_t &broker, const char *data, size_t len)
+{
+	try {
+		KafkaReader rd(data, len);
+		int32_t corr_id = rd.i32();
+		if (broker.in_flight.empty() || broker.in_flight.front() != corr_id) {
+			throw std::out_of_range("Unexpected correlation ID.");
+		}
+		broker.in_flight.pop_front();
+
+		int32_t topics = rd.i32();
+		for (int32_t t = 0; t < topics; ++t) {
+			rd.str();
+			int32_t parts = rd.i32();
+			for (int32_t p = 0; p < parts; ++p) {
+				int32_t index = rd.i32();
+				int16_t err = rd.i16();
+				rd.i64(); // base offset
+				rd.i64(); // log append time
+
+				if (err == 0) {
+					continue;
+				}
+
+				MSG_WARNING(msg_module, "Broker %s:%s refused a batch of "
+					"partition %d (error %d).", broker.host.c_str(),
+					broker.port.c_str(), index, err);
+				if (err == KERR_NOT_LEADER || err == KERR_UNKNOWN_TOPIC ||
+						err == KERR_LEADER_NA) {
+					_refresh = true;
+				}
+			}
+		}
+	} catch (std::exception &e) {
+		MSG_ERROR(msg_module, "Invalid response from broker %s:%s (%s).",
+			broker.host.c_str(), broker.port.c_str(), e.what());
+		broker_close(broker);
+	}
+}
@@ -0,0 +1,200 @@
+/**
+ * \file Kafka.h
+ * \brief Kafka producer output (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef KAFKA_H
+#define KAFKA_H
+
+#include "json.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include <siso.h>
+
+/**
+ * \brief The class for Kafka output interface
+ *
+ * Speaks the Kafka producer protocol (Metadata v1, Produce v3 with record
+ * batches of magic 2) directly. Records are batched per partition and each
+ * broker connection keeps a window of requests waiting for a response.
+ * Metadata are refreshed by an own thread, so an unavailable broker does not
+ * block the storage thread. Another thread sends batches older than the
+ * linger time when no records arrive.
+ */
+class Kafka : public Output
+{
+public:
+	Kafka(const pugi::xpath_node &config);
+	~Kafka();
+
+	// Add a record to a partition batch
+	void ProcessDataRecord(const std::string &record);
+
+private:
+	/** Broker connection */
+	typedef struct broker_s {
+		int32_t id;                  /**< Node ID                         */
+		std::string host;            /**< Hostname                        */
+		std::string port;            /**< Port                            */
+		sisoconf *conn;              /**< Connection (NULL if not open)   */
+		uint64_t conn_time;          /**< Last connection attempt (ms)    */
+		std::deque<int32_t> in_flight; /**< Correlation IDs of requests   */
+		std::string rbuf;            /**< Partially received responses    */
+	} broker_t;
+
+	/** Batch of records of one partition */
+	typedef struct partition_s {
+		int32_t leader;              /**< Node ID of the leader           */
+		std::string records;         /**< Encoded records                 */
+		int32_t count;               /**< Number of records               */
+		int64_t first_ts;            /**< Timestamp of the first record   */
+		int64_t max_ts;              /**< Timestamp of the last record    */
+	} partition_t;
+
+	/** Metadata of the topic */
+	typedef struct metadata_s {
+		std::map<int32_t, broker_t> brokers; /**< Brokers by node ID     */
+		std::vector<int32_t> leaders;        /**< Leaders of partitions  */
+	} metadata_t;
+
+	/** Bootstrap brokers ("host:port") */
+	std::vector<std::string> _bootstrap;
+	/** Topic */
+	std::string _topic;
+	/** Client ID */
+	std::string _client_id;
+	/** JSON fields forming the partition key */
+	std::vector<std::string> _key_fields;
+	/** Required acknowledgements (0, 1 or -1) */
+	int16_t _acks;
+	/** Timeout of the broker (ms) */
+	int32_t _timeout;
+	/** Max. size of a partition batch (bytes) */
+	size_t _batch_size;
+	/** Max. time records wait in a batch (ms) */
+	uint64_t _linger;
+	/** Max. number of requests without a response per broker */
+	size_t _max_in_flight;
+
+	/** Brokers by node ID */
+	std::map<int32_t, broker_t> _brokers;
+	/** Partitions of the topic */
+	std::vector<partition_t> _partitions;
+	/** Partition for records without a key */
+	size_t _sticky;
+	/** Metadata are out of date */
+	bool _refresh;
+
+	/** Metadata thread */
+	pthread_t _md_thread;
+	/** Protects the request, the stop flag and the result */
+	pthread_mutex_t _md_mutex;
+	/** Signals a request or the stop flag */
+	pthread_cond_t _md_cond;
+	/** Refresh requested by the storage thread */
+	bool _md_request;
+	/** Stop the metadata thread */
+	bool _md_stop;
+	/** Last loaded metadata */
+	metadata_t _md;
+	/** New metadata are waiting to be applied */
+	std::atomic<bool> _md_ready;
+	/** Correlation ID of the next metadata request */
+	int32_t _md_corr_id;
+
+	/** Linger thread (only when the linger time is set) */
+	pthread_t _linger_thread;
+	bool _linger_running;
+	/** Protects partitions and brokers (storage and linger thread) */
+	pthread_mutex_t _mutex;
+
+	/** Time of the last flush (ms) */
+	uint64_t _last_flush;
+	/** Correlation ID of the next request */
+	int32_t _corr_id;
+	/** Number of dropped records (since the last report) */
+	uint64_t _dropped;
+
+	/** Temporary buffers */
+	std::string _key;
+	std::string _body;
+	std::string _req;
+
+	// Load partitions and leaders of the topic (no shared state is changed)
+	bool fetch_metadata(metadata_t &md);
+	// Use loaded metadata (storage thread)
+	void apply_metadata(metadata_t &md);
+	// Ask the metadata thread for a refresh
+	void request_metadata();
+	// Metadata thread
+	static void *thread_metadata(void *context);
+	// Linger thread
+	static void *thread_linger(void *context);
+	// Open a connection to a broker
+	bool broker_connect(broker_t &broker);
+	// Close a connection to a broker
+	void broker_close(broker_t &broker);
+	// Send all batches led by the broker
+	void broker_flush(broker_t &broker);
+	// Process received responses (wait for at most \p wait ms)
+	bool broker_recv(broker_t &broker, int wait);
+	// Send all batches
+	void flush_all();
+	// Add a record to a partition batch (the state is locked)
+	void process_record(const std::string &record);
+
+	// Extract the partition key from a JSON record
+	void extract_key(const std::string &record);
+	// Encode a request header
+	void request_header(std::string &req, int16_t api_key,
+		int16_t api_version, int32_t corr_id);
+	// Finish a request (size prefix) and send it
+	bool request_send(broker_t &broker, std::string &req, int32_t corr_id,
+		bool response);
+	// Process one response
+	void response_process(broker_t &broker, const char *data, size_t len);
+
+	// Current time in milliseconds
+	static uint64_t now_ms(bool monotonic);
+};
+
+#endif // KAFKA_H
@@ -0,0 +1,392 @@
+/**
+ * \file kafka_test.cpp
+ * \brief Test of the Kafka output against a mock broker
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/*
+ * Test of the Kafka output of the JSON plugin against a mock broker.
+ *
+ * The mock broker answers Metadata and Produce requests, validates record
+ * batches (CRC32C, offset deltas) and remembers partitions of keys. The test
+ * checks that all records are delivered (also when no more records come
+ * within the linger time), that keys stay in one partition
+ * and that a slow metadata refresh does not block ProcessDataRecord().
+ */
+
+#include "../../Kafka.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <map>
+#include <set>
+#include <atomic>
+#include <cinttypes>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define PARTITIONS (3)
+#define TOPIC "ipfix"
+
+/** Mock broker state */
+static int listen_fd;
+static int port;
+static std::atomic<int> metadata_delay(0);   /**< Delay of Metadata (ms)  */
+static std::atomic<int> produce_error(0);    /**< Error of next Produce   */
+static std::atomic<int> metadata_requests(0);
+static std::atomic<int> records(0);
+static std::atomic<int> errors(0);
+static pthread_mutex_t keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, std::set<int> > keys;
+
+static uint32_t crc32c(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; ++i) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; ++j) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+		}
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+/** Big endian reader (bounds are checked by the caller) */
+struct reader {
+	const uint8_t *p;
+	int64_t get(int len)
+	{
+		int64_t res = 0;
+		for (int i = 0; i < len; ++i) {
+			res = (res << 8) | *p++;
+		}
+		return res;
+	}
+	int64_t varint()
+	{
+		uint64_t res = 0;
+		int shift = 0;
+		uint8_t byte;
+		do {
+			byte = *p++;
+			res |= (uint64_t) (byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		return (int64_t) (res >> 1) ^ -(int64_t) (res & 1);
+	}
+};
+
+static void put(std::string &buf, int64_t val, int len)
+{
+	for (int i = len - 1; i >= 0; --i) {
+		buf += (char) (val >> (8 * i));
+	}
+}
+
+static void put_str(std::string &buf, const char *str)
+{
+	put(buf, strlen(str), 2);
+	buf += str;
+}
+
+/** Validate a record batch and remember keys of its records */
+static void check_batch(const uint8_t *batch, int32_t size, int32_t partition)
+{
+	reader rd = {batch};
+	rd.get(8);                                // base offset
+	int32_t len = rd.get(4);
+	rd.get(4);                                // leader epoch
+	int8_t magic = rd.get(1);
+	uint32_t crc = rd.get(4);
+
+	if (magic != 2 || len != size - 12 || crc != crc32c(rd.p, size - 21)) {
+		fprintf(stderr, "Invalid record batch\n");
+		errors++;
+		return;
+	}
+
+	rd.p = batch + 57;
+	int32_t count = rd.get(4);
+	for (int32_t i = 0; i < count; ++i) {
+		int64_t rec_len = rd.varint();
+		const uint8_t *end = rd.p + rec_len;
+		rd.get(1);                            // attributes
+		rd.varint();                          // timestamp delta
+		if (rd.varint() != i) {
+			fprintf(stderr, "Invalid offset delta\n");
+			errors++;
+		}
+
+		int64_t key_len = rd.varint();
+		if (key_len >= 0) {
+			std::string key((const char *) rd.p, key_len);
+			rd.p += key_len;
+			pthread_mutex_lock(&keys_mutex);
+			keys[key].insert(partition);
+			pthread_mutex_unlock(&keys_mutex);
+		}
+
+		rd.p += rd.varint();                  // value
+		rd.varint();                          // headers
+		if (rd.p != end) {
+			fprintf(stderr, "Invalid record length\n");
+			errors++;
+		}
+		records++;
+	}
+}
+
+/** Answer requests of one connection */
+static void *broker_conn(void *arg)
+{
+	int fd = (int) (intptr_t) arg;
+	std::string buf;
+	char tmp[65536];
+	ssize_t len;
+
+	while ((len = recv(fd, tmp, sizeof(tmp), 0)) > 0) {
+		buf.append(tmp, len);
+
+		while (buf.size() >= 4) {
+			reader rd = {(const uint8_t *) buf.data()};
+			size_t size = rd.get(4);
+			if (buf.size() < size + 4) {
+				break;
+			}
+
+			int16_t api = rd.get(2);
+			rd.get(2);
+			int32_t corr_id = rd.get(4);
+			rd.p += rd.get(2);                // client ID
+
+			std::string resp;
+			put(resp, corr_id, 4);
+			if (api == 3) {
+				metadata_requests++;
+				usleep(metadata_delay * 1000);
+
+				put(resp, 1, 4);              // brokers
+				put(resp, 0, 4);
+				put_str(resp, "127.0.0.1");
+				put(resp, port, 4);
+				put(resp, -1, 2);             // rack
+				put(resp, 0, 4);              // controller
+				put(resp, 1, 4);              // topics
+				put(resp, 0, 2);
+				put_str(resp, TOPIC);
+				put(resp, 0, 1);
+				put(resp, PARTITIONS, 4);
+				for (int i = 0; i < PARTITIONS; ++i) {
+					put(resp, 0, 2);
+					put(resp, i, 4);
+					put(resp, 0, 4);          // leader
+					put(resp, 1, 4);          // replicas
+					put(resp, 0, 4);
+					put(resp, 1, 4);          // ISR
+					put(resp, 0, 4);
+				}
+			} else {
+				rd.get(2);                    // transactional ID
+				rd.get(2);                    // acks
+				rd.get(4);                    // timeout
+				rd.get(4);                    // topics
+				rd.p += rd.get(2);            // topic
+				int32_t parts = rd.get(4);
+				int16_t err = produce_error.exchange(0);
+
+				put(resp, 1, 4);
+				put_str(resp, TOPIC);
+				put(resp, parts, 4);
+				for (int32_t i = 0; i < parts; ++i) {
+					int32_t partition = rd.get(4);
+					int32_t batch_size = rd.get(4);
+					check_batch(rd.p, batch_size, partition);
+					rd.p += batch_size;
+
+					put(resp, partition, 4);
+					put(resp, err, 2);
+					put(resp, 0, 8);          // base offset
+					put(resp, -1, 8);         // log append time
+				}
+				put(resp, 0, 4);              // throttle time
+			}
+
+			std::string msg;
+			put(msg, resp.size(), 4);
+			msg += resp;
+			if (send(fd, msg.data(), msg.size(), MSG_NOSIGNAL) < 0) {
+				break;
+			}
+			buf.erase(0, size + 4);
+		}
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void *broker_accept(void *arg)
+{
+	(void) arg;
+	int fd;
+
+	while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		pthread_t thread;
+		pthread_create(&thread, NULL, broker_conn, (void *) (intptr_t) fd);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static Kafka *create_output()
+{
+	char cfg[512];
+	snprintf(cfg, sizeof(cfg), "<output><brokers>127.0.0.1:%d</brokers>"
+		"<topic>" TOPIC "</topic><partitionKey>ipfix.sourceIPv4Address"
+		"</partitionKey><batchSize>4000</batchSize><lingerMs>10</lingerMs>"
+		"</output>", port);
+
+	pugi::xml_document doc;
+	doc.load(cfg);
+	return new Kafka(doc.select_single_node("output"));
+}
+
+static void send_record(Kafka *kafka, int i)
+{
+	char rec[256];
+	snprintf(rec, sizeof(rec), "{\"@type\": \"ipfix.entry\", "
+		"\"ipfix.sourceIPv4Address\": \"10.0.0.%d\", \"ipfix.packetDeltaCount\": "
+		"%d}\n", i % 200, i);
+	kafka->ProcessDataRecord(rec);
+}
+
+int main()
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	pthread_t thread;
+	int failed = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr,
+			sizeof(addr)) != 0 || listen(listen_fd, 8) != 0 ||
+			getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len) != 0) {
+		perror("mock broker");
+		return 1;
+	}
+	port = ntohs(addr.sin_port);
+	pthread_create(&thread, NULL, broker_accept, NULL);
+
+	/* All records delivered, keys stay in one partition */
+	Kafka *kafka = create_output();
+	for (int i = 0; i < 20000; ++i) {
+		send_record(kafka, i);
+	}
+	delete kafka;
+
+	int multi = 0;
+	for (auto &item: keys) {
+		multi += (item.second.size() > 1);
+	}
+
+	printf("delivery: %d records, %zu keys, %d keys in more partitions, "
+		"%d errors\n", records.load(), keys.size(), multi, errors.load());
+	if (records != 20000 || keys.size() != 200 || multi != 0 || errors != 0) {
+		printf("FAILED: delivery\n");
+		failed = 1;
+	}
+
+	/* Batches are sent after the linger time even without more records */
+	kafka = create_output();
+	int delivered = records;
+	for (int i = 0; i < 10; ++i) {
+		send_record(kafka, i);
+	}
+	usleep(200000);
+	delivered = records - delivered;
+
+	printf("linger: %d of 10 records delivered\n", delivered);
+	if (delivered != 10) {
+		printf("FAILED: linger\n");
+		failed = 1;
+	}
+	delete kafka;
+
+	/* A slow metadata refresh must not block records */
+	kafka = create_output();
+	int requests = metadata_requests;
+	metadata_delay = 2000;
+	produce_error = 6; // NOT_LEADER_FOR_PARTITION
+
+	uint64_t max_time = 0, end = now_ms() + 1000;
+	for (int i = 0; now_ms() < end; ++i) {
+		uint64_t start = now_ms();
+		send_record(kafka, i);
+		if (now_ms() - start > max_time) {
+			max_time = now_ms() - start;
+		}
+		usleep(100);
+	}
+
+	printf("refresh: %d metadata requests, max. time of a record %" PRIu64
+		" ms\n", metadata_requests - requests, max_time);
+	if (metadata_requests == requests || max_time >= 500) {
+		printf("FAILED: refresh\n");
+		failed = 1;
+	}
+	delete kafka;
+
+	if (!failed) {
+		printf("OK\n");
+	}
+	return failed;
+}
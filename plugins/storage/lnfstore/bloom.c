@@ -0,0 +1,302 @@
+/**
+ * \file bloom.c
+ * \brief Blocked Bloom filter of IP addresses (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+#include <endian.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lnfstore.h"
+#include "bloom.h"
+
+/** Number of 64-bit words of a block (one cache line) */
+#define BLOOM_WORDS      (8U)
+/** Number of bits of a block                          */
+#define BLOOM_BLOCK_BITS (BLOOM_WORDS * 64U)
+/** Maximal number of bits of a key                    */
+#define BLOOM_K_MAX      (16U)
+/**
+ * Extra space of a blocked filter. Keys are not spread over the whole
+ * filter, so it needs more bits than a classic filter for the same false
+ * positive probability.
+ */
+#define BLOOM_OVERHEAD   (1.2)
+
+/** Odd multipliers that select bits of a key in its block (never change!) */
+static const uint32_t bloom_salt[BLOOM_K_MAX] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+	0x2f3e2b4dU, 0x8e27d3a9U, 0x1b873593U, 0xcc9e2d51U,
+	0x85ebca6bU, 0xc2b2ae35U, 0x27d4eb2fU, 0x165667b1U
+};
+
+/** \brief Block of a filter */
+struct bloom_block {
+	uint64_t words[BLOOM_WORDS];
+} __attribute__((aligned(64)));
+
+/** \brief Filter */
+struct bloom_s {
+	struct bloom_block *blocks; /**< Blocks                          */
+	uint64_t block_cnt;         /**< Number of blocks                */
+	unsigned int k;             /**< Number of bits of a key         */
+	uint64_t items;             /**< Number of inserted keys         */
+};
+
+bloom_t *
+bloom_create(uint64_t items, double prob)
+{
+	if (items == 0) {
+		items = 1;
+	}
+
+	// Optimal number of bits of a key and the size of a classic filter
+	double k = ceil(-log2(prob));
+	if (k < 1) {
+		k = 1;
+	} else if (k > BLOOM_K_MAX) {
+		k = BLOOM_K_MAX;
+	}
+
+	double bits = ceil(items * (-log(prob)) / (M_LN2 * M_LN2) * BLOOM_OVERHEAD);
+	double block_cnt = ceil(bits / BLOOM_BLOCK_BITS);
+	if (block_cnt < 1) {
+		block_cnt = 1;
+	} else if (block_cnt > UINT32_MAX) {
+		block_cnt = UINT32_MAX;
+	}
+
+	bloom_t *bloom = calloc(1, sizeof(*bloom));
+	if (!bloom) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		return NULL;
+	}
+
+	bloom->block_cnt = (uint64_t) block_cnt;
+	bloom->k = (unsigned int) k;
+	if (posix_memalign((void **) &bloom->blocks, sizeof(struct bloom_block),
+			bloom->block_cnt * sizeof(struct bloom_block)) != 0) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		free(bloom);
+		return NULL;
+	}
+
+	bloom_clear(bloom);
+	return bloom;
+}
+
+void
+bloom_destroy(bloom_t *bloom)
+{
+	free(bloom->blocks);
+	free(bloom);
+}
+
+void
+bloom_clear(bloom_t *bloom)
+{
+	memset(bloom->blocks, 0, bloom->block_cnt * sizeof(struct bloom_block));
+	bloom->items = 0;
+}
+
+/**
+ * \brief Get the block of a key
+ * \param[in] bloom Filter
+ * \param[in] hash  Hash of the key
+ */
+static inline struct bloom_block *
+bloom_block(const bloom_t *bloom, uint64_t hash)
+{
+	return &bloom->blocks[((hash >> 32) * bloom->block_cnt) >> 32];
+}
+
+/**
+ * \brief Get the bits of a key in its block
+ * \param[in]  bloom Filter
+ * \param[in]  hash  Hash of the key
+ * \param[out] mask  Bits of the key
+ */
+static inline void
+bloom_mask(const bloom_t *bloom, uint64_t hash, uint64_t mask[BLOOM_WORDS])
+{
+	const uint32_t key = (uint32_t) hash;
+
+	memset(mask, 0, BLOOM_WORDS * sizeof(uint64_t));
+	for (unsigned int i = 0; i < bloom->k; ++i) {
+		const unsigned int bit = (uint32_t) (key * bloom_salt[i]) >> 23;
+		mask[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+void
+bloom_add(bloom_t *bloom, const uint64_t *hashes, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; ++i) {
+		__builtin_prefetch(bloom_block(bloom, hashes[i]), 1);
+	}
+
+	for (size_t i = 0; i < cnt; ++i) {
+		struct bloom_block *block = bloom_block(bloom, hashes[i]);
+		uint64_t mask[BLOOM_WORDS];
+		bloom_mask(bloom, hashes[i], mask);
+
+		// Word-wise loops are vectorized by the compiler
+		uint64_t missing = 0;
+		for (unsigned int w = 0; w < BLOOM_WORDS; ++w) {
+			missing |= mask[w] & ~block->words[w];
+		}
+		for (unsigned int w = 0; w < BLOOM_WORDS; ++w) {
+			block->words[w] |= mask[w];
+		}
+
+		if (missing) {
+			bloom->items++;
+		}
+	}
+}
+
+bool
+bloom_contains(const bloom_t *bloom, uint64_t hash)
+{
+	const struct bloom_block *block = bloom_block(bloom, hash);
+	uint64_t mask[BLOOM_WORDS];
+	bloom_mask(bloom, hash, mask);
+
+	uint64_t missing = 0;
+	for (unsigned int w = 0; w < BLOOM_WORDS; ++w) {
+		missing |= mask[w] & ~block->words[w];
+	}
+
+	return missing == 0;
+}
+
+uint64_t
+bloom_items(const bloom_t *bloom)
+{
+	return bloom->items;
+}
+
+size_t
+bloom_size(const bloom_t *bloom)
+{
+	return bloom->block_cnt * sizeof(struct bloom_block);
+}
+
+double
+bloom_fpp(const bloom_t *bloom)
+{
+	// Probability of a false positive in a block with N bits set
+	double prob[BLOOM_BLOCK_BITS + 1];
+	for (unsigned int i = 0; i <= BLOOM_BLOCK_BITS; ++i) {
+		prob[i] = pow((double) i / BLOOM_BLOCK_BITS, bloom->k);
+	}
+
+	double sum = 0;
+	for (uint64_t i = 0; i < bloom->block_cnt; ++i) {
+		unsigned int bits = 0;
+		for (unsigned int w = 0; w < BLOOM_WORDS; ++w) {
+			bits += __builtin_popcountll(bloom->blocks[i].words[w]);
+		}
+		sum += prob[bits];
+	}
+
+	return sum / bloom->block_cnt;
+}
+
+int
+bloom_store(const bloom_t *bloom, const char *filename)
+{
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		const size_t err_len = 128;
+		char err_buff[err_len];
+		err_buff[0] = '\0';
+		strerror_r(errno, err_buff, err_len);
+		MSG_ERROR(msg_module, "Failed to create the index file '%s' (%s).",
+			filename, err_buff);
+		return 1;
+	}
+
+	struct {
+		char magic[8];
+		uint32_t k;
+		uint32_t reserved;
+		uint64_t block_cnt;
+		uint64_t items;
+	} hdr;
+
+	memcpy(hdr.magic, "LNFBBF01", sizeof(hdr.magic));
+	hdr.k = htole32(bloom->k);
+	hdr.reserved = 0;
+	hdr.block_cnt = htole64(bloom->block_cnt);
+	hdr.items = htole64(bloom->items);
+
+	bool failed = (fwrite(&hdr, sizeof(hdr), 1, file) != 1);
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	if (!failed && fwrite(bloom->blocks, sizeof(struct bloom_block),
+			bloom->block_cnt, file) != bloom->block_cnt) {
+		failed = true;
+	}
+#else
+	for (uint64_t i = 0; !failed && i < bloom->block_cnt; ++i) {
+		struct bloom_block block;
+		for (unsigned int w = 0; w < BLOOM_WORDS; ++w) {
+			block.words[w] = htole64(bloom->blocks[i].words[w]);
+		}
+
+		failed = (fwrite(&block, sizeof(block), 1, file) != 1);
+	}
+#endif
+
+	if (fclose(file) != 0) {
+		failed = true;
+	}
+
+	if (failed) {
+		MSG_ERROR(msg_module, "Failed to write the index file '%s'.",
+			filename);
+		return 1;
+	}
+
+	return 0;
+}
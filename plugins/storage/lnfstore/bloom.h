@@ -0,0 +1,171 @@
+/**
+ * \file bloom.h
+ * \brief Blocked Bloom filter of IP addresses (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LS_BLOOM_H
+#define LS_BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * \brief Blocked Bloom filter
+ *
+ * All bits of a key are set in one 64 byte block (i.e. one cache line), so
+ * an insertion or a lookup touches only one cache line of the filter.
+ *
+ * Keys are 16 byte addresses (see bloom_hash()). The block of a key is
+ * <tt>((hash >> 32) * blocks) >> 32</tt> and the bits of the key in the
+ * block are <tt>((uint32_t) hash * salt[i]) >> 23</tt> for i = 0..k-1
+ * (see the salts in bloom.c). Bit b of a block is bit (b % 64) of its
+ * 64-bit word (b / 64).
+ *
+ * File format (all integers are little endian):
+ * \n   8 B magic "LNFBBF01"
+ * \n   4 B number of bits of a key (k)
+ * \n   4 B reserved (zero)
+ * \n   8 B number of blocks
+ * \n   8 B number of inserted keys
+ * \n followed by the blocks (8 words of 64 bits each).
+ */
+typedef struct bloom_s bloom_t;
+
+/**
+ * \brief Hash of a key (16 byte address)
+ * \param[in] key Key
+ */
+static inline uint64_t
+bloom_hash(const unsigned char *key)
+{
+	uint64_t a, b;
+	memcpy(&a, key, sizeof(a));
+	memcpy(&b, key + sizeof(a), sizeof(b));
+
+	// Finalizer of MurmurHash3 applied on both halves
+	uint64_t h = a ^ (b * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	h ^= b;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * \brief Create a filter
+ * \param[in] items Expected number of keys
+ * \param[in] prob  False positive probability
+ * \return On success returns a pointer to the filter. Otherwise returns NULL.
+ */
+bloom_t *
+bloom_create(uint64_t items, double prob);
+
+/**
+ * \brief Destroy a filter
+ * \param[in] bloom Filter
+ */
+void
+bloom_destroy(bloom_t *bloom);
+
+/**
+ * \brief Remove all keys from a filter
+ * \param[in,out] bloom Filter
+ */
+void
+bloom_clear(bloom_t *bloom);
+
+/**
+ * \brief Insert a batch of keys
+ *
+ * Blocks of all keys are prefetched before bits are set.
+ * \param[in,out] bloom  Filter
+ * \param[in]     hashes Hashes of the keys (see bloom_hash())
+ * \param[in]     cnt    Number of the keys
+ */
+void
+bloom_add(bloom_t *bloom, const uint64_t *hashes, size_t cnt);
+
+/**
+ * \brief Test presence of a key
+ * \param[in] bloom Filter
+ * \param[in] hash  Hash of the key (see bloom_hash())
+ * \return False if the key is not present. True if it may be present.
+ */
+bool
+bloom_contains(const bloom_t *bloom, uint64_t hash);
+
+/**
+ * \brief Get the number of inserted keys
+ *
+ * Keys that did not change any bit of the filter (duplicates and false
+ * positives) are not counted.
+ * \param[in] bloom Filter
+ */
+uint64_t
+bloom_items(const bloom_t *bloom);
+
+/**
+ * \brief Get the size of a filter in bytes
+ * \param[in] bloom Filter
+ */
+size_t
+bloom_size(const bloom_t *bloom);
+
+/**
+ * \brief Estimate the false positive probability of a filter
+ *
+ * The estimate is based on the current fill of the blocks.
+ * \param[in] bloom Filter
+ */
+double
+bloom_fpp(const bloom_t *bloom);
+
+/**
+ * \brief Store a filter into a file
+ * \param[in] bloom    Filter
+ * \param[in] filename File name
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+int
+bloom_store(const bloom_t *bloom, const char *filename);
+
+#endif // LS_BLOOM_H
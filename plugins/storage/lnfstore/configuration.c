@@ -37,6 +37,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "configuration.h"
 #include "lnfstore.h"
 #include "idx_manager.h"
@@ -61,6 +65,7 @@ extern const char *msg_module;
 #define BF_DEFAULT_ITEM_CNT_EST 100000
 
 #define WINDOW_SIZE             300U
+#define WORKERS_MAX             64U
 
 /**
  * \brief Compare a value of a node with string boolen value
@@ -254,6 +259,19 @@ configuration_match_idx(xmlDocPtr doc, xmlNodePtr cur, struct conf_params *cfg)
 		return 0;
 	}
 
+	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "blocked")) {
+		// Blocked Bloom filter or bfindex library
+		int result = xml_cmp_bool(doc, cur);
+		if (result == 0) {
+			MSG_ERROR(msg_module, "Configuration error - invalid value of "
+				"<blocked> (expected true/false).");
+			return 1;
+		}
+
+		cfg->file_index.blocked = (result > 0) ? true : false;
+		return 0;
+	}
+
 	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "autosize")) {
 		// Enable/disable autosize
 		int result = xml_cmp_bool(doc, cur);
@@ -332,6 +350,19 @@ configuration_match(xmlDocPtr doc, xmlNodePtr cur, struct conf_params *cfg)
 		return 0;
 	}
 
+	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "workers")) {
+		// Number of threads storing records of channels
+		uint64_t result;
+		if (xml_convert_number(doc, cur, &result) || result > WORKERS_MAX) {
+			MSG_ERROR(msg_module, "Configuration error - invalid value of "
+				"<workers> (expected a number in range 0..%u).", WORKERS_MAX);
+			return 1;
+		}
+
+		cfg->profiles.workers = (unsigned int) result;
+		return 0;
+	}
+
 	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "storagePath")) {
 		// Get LNF and Index storage path (only non-profile)
 		xmlChar *original = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
@@ -446,6 +477,11 @@ configuration_validate(const struct conf_params *cfg)
 		ret_code = 1;
 	}
 
+	if (!cfg->profiles.en && cfg->profiles.workers > 0) {
+		MSG_WARNING(msg_module, "<workers> is ignored because profiles are "
+			"disabled.");
+	}
+
 	if (!cfg->files.suffix) {
 		MSG_ERROR(msg_module, "File suffix is not set.");
 		ret_code = 1;
@@ -475,6 +511,14 @@ configuration_validate(const struct conf_params *cfg)
 			ret_code = 1;
 		}
 
+#ifndef HAVE_BFINDEX
+		if (!cfg->file_index.blocked) {
+			MSG_ERROR(msg_module, "The plugin has been built without bfindex "
+				"library. Only blocked Bloom Filter Indexes are available.");
+			ret_code = 1;
+		}
+#endif
+
 		// Check output prefixes
 		if (xmlStrcmp((const xmlChar *) cfg->file_index.prefix,
 				(const xmlChar *) cfg->file_lnf.prefix) == 0) {
@@ -526,6 +570,11 @@ configuration_set_defaults(struct conf_params *cnf)
 	cnf->file_index.en = false;
 	cnf->file_index.autosize = true;
 	cnf->file_index.est_cnt = BF_DEFAULT_ITEM_CNT_EST;
+#ifdef HAVE_BFINDEX
+	cnf->file_index.blocked = false;
+#else
+	cnf->file_index.blocked = true;
+#endif
 	cnf->file_index.fp_prob = BF_DEFAULT_FP_PROB;
 	cnf->file_index.prefix = (char *) (xmlCharStrdup(BF_FILE_PREFIX));
 	if (!cnf->file_index.prefix) {
@@ -76,6 +76,7 @@ struct conf_params {
 
 		uint64_t est_cnt;  /**< Estimated item count in the filter           */
 		double fp_prob;    /**< False positive probability of the filter     */
+		bool  blocked;     /**< Use the built-in blocked Bloom filter        */
 	} file_index;          /**< Bloom Filter Index configuration  */
 
 	struct {
@@ -87,6 +88,8 @@ struct conf_params {
 		bool en;          /**< Enable/disable files generation based on
                             * profiles. When it is enabled, files.path is
                             * ignored                                        */
+		unsigned int workers; /**< Number of threads storing records of
+                                * channels (0 = plugin thread only)         */
 	} profiles; /**< Profiles configuration                                  */
 };
 
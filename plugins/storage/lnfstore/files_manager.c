@@ -294,7 +294,7 @@ files_mgr_create(enum FILES_MODE mode, const struct files_mgr_paths *paths,
 	if (mode & FILES_M_INDEX) {
 		// Create file index (IDX) manager
 		mgr->outputs.index_mgr = idx_mgr_create(idx_param->prob,
-			idx_param->item_cnt, idx_param->autosize);
+			idx_param->item_cnt, idx_param->autosize, idx_param->blocked);
 		if (!mgr->outputs.index_mgr) {
 			MSG_ERROR(msg_module, "Files manager error (unable to create "
 				"index manager).");
@@ -94,6 +94,7 @@ struct files_mgr_idx_param {
 	uint64_t item_cnt;   /**< Projected element count (i.e. IP address count) */
 	bool     autosize;   /**< Enable automatic recalculation of parameters
 						   *  based on usage. */
+	bool     blocked;    /**< Use the built-in blocked Bloom filter */
 };
 
 /**
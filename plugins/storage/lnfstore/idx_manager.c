@@ -38,12 +38,23 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_BFINDEX
 // Bloomfilter index library API
 #include <bf_index.h>
+#endif
 #include <ipfixcol.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
 #include "idx_manager.h"
+#include "bloom.h"
 
 #include <string.h> // strdup
 
@@ -71,6 +82,13 @@ extern const char* msg_module;
 #define BF_LOWER_TOLERANCE(val, coeff) \
 	((unsigned long)(val * (1 + coeff * ((coeff > 1.2) ? 1.3 : 0.5) )))
 
+/** Length of an address (IPv4 & IPv6)                                  */
+#define IDX_ADDR_LEN    (16U)
+/** Number of addresses inserted into the index at once                  */
+#define IDX_BATCH_SIZE  (64U)
+/** Number of recently inserted addresses that are not inserted again    */
+#define IDX_RECENT_SIZE (1024U)
+
 /** \brief State of the manager */
 enum IDX_MGR_STATE {
 	IDX_MGR_S_INIT,            /**< Before creating of the first window       */
@@ -87,7 +105,11 @@ enum IDX_MGR_STATE {
 
 /** \brief Internal structure of the manager */
 struct idx_mgr_s {
+#ifdef HAVE_BFINDEX
 	bfi_index_ptr_t idx_ptr;    /**< Instance of a Bloom filter index         */
+#endif
+	bloom_t *bloom;         /**< Instance of a blocked Bloom filter           */
+	bool blocked;           /**< Use the blocked filter instead of bfindex    */
 	char *idx_filename;     /**< Filename of current index file               */
 
 	struct {
@@ -99,11 +121,110 @@ struct idx_mgr_s {
 		bool  en_autosize;        /**< Enable auto-size (on/off)              */
 		enum IDX_MGR_STATE state; /**< State of the manager                   */
 	} cfg_mgr;             /**< Configuration of the manager                  */
+
+	struct {
+		uint64_t hashes[IDX_BATCH_SIZE];  /**< Hashes of addresses            */
+		unsigned char addrs[IDX_BATCH_SIZE][IDX_ADDR_LEN]; /**< Addresses
+		                                   *  (only for bfindex)              */
+		unsigned int cnt;                 /**< Number of addresses            */
+	} batch;               /**< Addresses waiting for insertion               */
+
+	struct {
+		unsigned char addrs[IDX_RECENT_SIZE][IDX_ADDR_LEN]; /**< Addresses    */
+		bool valid[IDX_RECENT_SIZE];      /**< Validity of the addresses      */
+	} recent;              /**< Recently inserted addresses (hash table)      */
+
+	struct {
+		uint64_t added;    /**< Addresses added to the window                 */
+		uint64_t skipped;  /**< Addresses skipped as recently inserted        */
+		uint64_t time_ns;  /**< Time spent by insertions                      */
+	} stats;               /**< Statistics of the current window              */
 };
 
+/**
+ * \brief Insert all addresses of the batch into the index
+ * \param[in,out] mgr Pointer to an index manager
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+idx_mgr_flush(idx_mgr_t *mgr)
+{
+	if (mgr->batch.cnt == 0) {
+		return 0;
+	}
+
+	struct timespec ts_start, ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+	int ret_code = 0;
+	if (mgr->blocked) {
+		bloom_add(mgr->bloom, mgr->batch.hashes, mgr->batch.cnt);
+	} else {
+#ifdef HAVE_BFINDEX
+		for (unsigned int i = 0; i < mgr->batch.cnt; ++i) {
+			bfi_ecode_t ret = bfi_add_addr_index(mgr->idx_ptr,
+				mgr->batch.addrs[i], IDX_ADDR_LEN);
+			if (ret != BFI_E_OK) {
+				MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+				ret_code = 1;
+				break;
+			}
+		}
+#endif
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	mgr->stats.time_ns += (ts_end.tv_sec - ts_start.tv_sec) * 1000000000ULL
+		+ ts_end.tv_nsec - ts_start.tv_nsec;
+	mgr->batch.cnt = 0;
+	return ret_code;
+}
+
+/**
+ * \brief Get the number of unique items in the index
+ * \param[in] mgr Pointer to an index manager
+ */
+static uint64_t
+idx_mgr_items(const idx_mgr_t *mgr)
+{
+	if (mgr->blocked) {
+		return bloom_items(mgr->bloom);
+	}
+
+#ifdef HAVE_BFINDEX
+	return bfi_stored_item_cnt(mgr->idx_ptr);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * \brief Get the false positive probability of the index
+ *
+ * For the blocked filter, the probability is estimated from its content.
+ * For bfindex, it is calculated from the number of items.
+ * \param[in] mgr Pointer to an index manager
+ */
+static double
+idx_mgr_fpp(const idx_mgr_t *mgr)
+{
+	if (mgr->blocked) {
+		return bloom_fpp(mgr->bloom);
+	}
+
+	const double est = mgr->cfg_bloom.est_items;
+	const double bits = -est * log(mgr->cfg_bloom.fp_prob) / (M_LN2 * M_LN2);
+	double k = round(bits / est * M_LN2);
+	if (k < 1) {
+		k = 1;
+	}
+
+	return pow(1 - exp(-k * idx_mgr_items(mgr) / bits), k);
+}
+
 
 idx_mgr_t *
-idx_mgr_create(double prob, uint64_t item_cnt, bool autosize)
+idx_mgr_create(double prob, uint64_t item_cnt, bool autosize, bool blocked)
 {
 	// Check parameters
 	if (prob < FPP_MIN || prob > FPP_MAX) {
@@ -112,6 +233,14 @@ idx_mgr_create(double prob, uint64_t item_cnt, bool autosize)
 		return NULL;
 	}
 
+#ifndef HAVE_BFINDEX
+	if (!blocked) {
+		MSG_ERROR(msg_module, "Index manager error (the plugin has been built "
+			"without bfindex library, only blocked indexes are available).");
+		return NULL;
+	}
+#endif
+
 	// Create structures
 	idx_mgr_t *mgr = (idx_mgr_t *) calloc(1, sizeof(idx_mgr_t));
 	if (!mgr) {
@@ -126,6 +255,7 @@ idx_mgr_create(double prob, uint64_t item_cnt, bool autosize)
 	mgr->cfg_bloom.fp_prob = prob;
 	mgr->cfg_mgr.en_autosize = autosize;
 	mgr->cfg_mgr.state = IDX_MGR_S_INIT;
+	mgr->blocked = blocked;
 
 	return mgr;
 }
@@ -138,9 +268,14 @@ idx_mgr_destroy(idx_mgr_t *mgr)
 	}
 
 	idx_mgr_save_index(mgr);
+	if (mgr->bloom) {
+		bloom_destroy(mgr->bloom);
+	}
+#ifdef HAVE_BFINDEX
 	if (mgr->idx_ptr) {
 		bfi_destroy_index(&(mgr->idx_ptr));
 	}
+#endif
 
 	free(mgr->idx_filename);
 	free(mgr);
@@ -169,22 +304,42 @@ idx_mgr_unset_curr_file(idx_mgr_t *mgr)
 }
 
 int
-idx_mgr_save_index(const idx_mgr_t *mgr)
+idx_mgr_save_index(idx_mgr_t *mgr)
 {
-	bfi_ecode_t ret;
-
 	if (mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FULL &&
 			mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FIRST_PARTIAL) {
 		// Index file is broken or doesn't exist, don't save.
 		return 0;
 	}
 
-	ret = bfi_store_index(mgr->idx_ptr, mgr->idx_filename);
-	if (ret != BFI_E_OK) {
-		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+	if (idx_mgr_flush(mgr) != 0) {
+		idx_mgr_invalidate(mgr);
 		return 1;
 	}
 
+	if (mgr->blocked) {
+		if (bloom_store(mgr->bloom, mgr->idx_filename) != 0) {
+			return 1;
+		}
+	} else {
+#ifdef HAVE_BFINDEX
+		bfi_ecode_t ret = bfi_store_index(mgr->idx_ptr, mgr->idx_filename);
+		if (ret != BFI_E_OK) {
+			MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+			return 1;
+		}
+#endif
+	}
+
+	// Statistics of the window
+	const uint64_t inserted = mgr->stats.added - mgr->stats.skipped;
+	const double rate = (mgr->stats.time_ns > 0)
+		? inserted * 1000.0 / mgr->stats.time_ns : 0;
+	MSG_INFO(msg_module, "Index '%s': %" PRIu64 " addresses (%" PRIu64 " "
+		"skipped as recent), %" PRIu64 " items, %.2f M inserts/s, false "
+		"positive probability %.2e (configured %.2e).", mgr->idx_filename,
+		mgr->stats.added, mgr->stats.skipped, idx_mgr_items(mgr), rate,
+		idx_mgr_fpp(mgr), mgr->cfg_bloom.fp_prob);
 	return 0;
 }
 
@@ -199,6 +354,18 @@ idx_mgr_save_index(const idx_mgr_t *mgr)
 static int
 idx_mgr_index_prepare(idx_mgr_t *mgr)
 {
+	if (mgr->blocked) {
+		if (mgr->bloom != NULL) {
+			// Destroy previous instance
+			bloom_destroy(mgr->bloom);
+		}
+
+		mgr->bloom = bloom_create(mgr->cfg_bloom.est_items,
+			mgr->cfg_bloom.fp_prob);
+		return (mgr->bloom != NULL) ? 0 : 1;
+	}
+
+#ifdef HAVE_BFINDEX
 	bfi_ecode_t ret;
 
 	if (mgr->idx_ptr != NULL) {
@@ -215,6 +382,7 @@ idx_mgr_index_prepare(idx_mgr_t *mgr)
 	}
 
 	mgr->idx_ptr = new_index;
+#endif
 
 	return 0;
 }
@@ -223,7 +391,6 @@ int
 idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 {
 	bool reinit = false;
-	bfi_ecode_t ret;
 
 	idx_mgr_unset_curr_file(mgr);
 
@@ -238,7 +405,7 @@ idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 		 * Calculate minimal & maximal expected estimate (item count in Bloom
 		 * filter index) based on number of elements in the current window.
 		 */
-		uint64_t act_cnt = bfi_stored_item_cnt(mgr->idx_ptr);
+		uint64_t act_cnt = idx_mgr_items(mgr);
 		double coeff = BF_TOL_COEFF(act_cnt);
 
 		double est_low = BF_LOWER_TOLERANCE(act_cnt, coeff);
@@ -269,16 +436,26 @@ idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 			idx_mgr_invalidate(mgr);
 			return 1;
 		}
+	} else if (mgr->blocked) {
+		// Only clear the current index (parameters are the same)
+		bloom_clear(mgr->bloom);
 	} else {
+#ifdef HAVE_BFINDEX
 		// Only clear the current index (parameters are the same)
-		ret = bfi_clear_index(mgr->idx_ptr);
+		bfi_ecode_t ret = bfi_clear_index(mgr->idx_ptr);
 		if (ret != BFI_E_OK){
 			MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
 			idx_mgr_invalidate(mgr);
 			return 1;
 		}
+#endif
 	}
 
+	// Start the window with empty batch, recent addresses and statistics
+	mgr->batch.cnt = 0;
+	memset(mgr->recent.valid, 0, sizeof(mgr->recent.valid));
+	memset(&mgr->stats, 0, sizeof(mgr->stats));
+
 	if (idx_mgr_set_curr_file(mgr, index_filename) != 0){
 		// Something went wrong
 		idx_mgr_invalidate(mgr);
@@ -319,20 +496,47 @@ idx_mgr_invalidate(idx_mgr_t *mgr)
 int
 idx_mgr_add(idx_mgr_t *mgr, const unsigned char *buffer, const size_t len)
 {
-	bfi_ecode_t ret;
-
 	if (mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FULL &&
 			mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FIRST_PARTIAL) {
 		return 1;
 	}
 
-	ret = bfi_add_addr_index(mgr->idx_ptr, buffer, len);
-	if (ret != BFI_E_OK){
-		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+	unsigned char key[IDX_ADDR_LEN];
+	if (len != IDX_ADDR_LEN) {
+		memset(key, 0, IDX_ADDR_LEN);
+		memcpy(key, buffer, (len < IDX_ADDR_LEN) ? len : IDX_ADDR_LEN);
+		buffer = key;
+	}
+
+	const uint64_t hash = bloom_hash(buffer);
+	mgr->stats.added++;
+
+	// Flows repeat addresses a lot, skip the recently inserted ones
+	const size_t slot = (hash >> 20) % IDX_RECENT_SIZE;
+	if (mgr->recent.valid[slot]
+			&& memcmp(mgr->recent.addrs[slot], buffer, IDX_ADDR_LEN) == 0) {
+		mgr->stats.skipped++;
+		return 0;
+	}
+
+	memcpy(mgr->recent.addrs[slot], buffer, IDX_ADDR_LEN);
+	mgr->recent.valid[slot] = true;
+
+	// Add to the batch
+	const unsigned int idx = mgr->batch.cnt++;
+	mgr->batch.hashes[idx] = hash;
+	if (!mgr->blocked) {
+		memcpy(mgr->batch.addrs[idx], buffer, IDX_ADDR_LEN);
+	}
+
+	if (mgr->batch.cnt < IDX_BATCH_SIZE) {
+		return 0;
+	}
+
+	if (idx_mgr_flush(mgr) != 0) {
 		idx_mgr_invalidate(mgr);
 		return 1;
 	}
 
 	return 0;
 }
-
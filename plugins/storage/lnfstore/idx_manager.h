@@ -63,13 +63,15 @@ typedef struct idx_mgr_s idx_mgr_t;
  * \param[in] item_cnt Projected element count (i.e. IP address count)
  * \param[in] autosize Enable automatic recalculation of parameters based on
  *   usage.
+ * \param[in] blocked  Use the built-in blocked Bloom filter instead of
+ *   the bfindex library.
  *
  * \warning Parameter \p prob must be in range 0.000001 - 1
  * \return On success returns a pointer to the manager. Otherwise returns
  *   NULL.
  */
 idx_mgr_t *
-idx_mgr_create(double prob, uint64_t item_cnt, bool autosize);
+idx_mgr_create(double prob, uint64_t item_cnt, bool autosize, bool blocked);
 
 /**
  * \brief Destroy a manager
@@ -105,13 +107,15 @@ idx_mgr_unset_curr_file(idx_mgr_t *mgr);
 /**
  * \brief Store/flush an Bloom filter index to an output file
  *
+ * Statistics of the window (insertions, false positive probability) are
+ * reported.
  * \param[in] mgr Pointer to a manager
  * \return If save was successful or should not be done because of indexing
  *   state (i.e. "nothing to save" in the error or initial state" 0 is returned.
  *   Otherwise returns a non-zero value.
  */
 int
-idx_mgr_save_index(const idx_mgr_t *mgr);
+idx_mgr_save_index(idx_mgr_t *mgr);
 
 /**
  * \brief Create a new window
@@ -145,6 +149,8 @@ idx_mgr_invalidate(idx_mgr_t *mgr);
 
 /**
  * \brief Add an IP address to an index
+ *
+ * Recently added addresses are skipped. Others are inserted in batches.
  * \param[in,out] index Pointer to a manager
  * \param[in] buffer Pointer to the address stored in a buffer
  * \param[in] len    Length of the buffer
@@ -79,6 +79,14 @@ storage_init (char *params, void **config) {
 		return 1;
 	}
 
+	conf->record.plans = tr_cache_create();
+	if (!conf->record.plans) {
+		lnf_rec_free(conf->record.rec_ptr);
+		configuration_free(parsed_params);
+		free(conf);
+		return 1;
+	}
+
 	// Init basic/profile file storage
 	if (conf->params->profiles.en) {
 		conf->storage.profiles = stg_profiles_create(parsed_params);
@@ -89,6 +97,7 @@ storage_init (char *params, void **config) {
 	if (!conf->storage.basic && !conf->storage.profiles) {
 		MSG_ERROR(msg_module, "Failed to initialize an internal structure "
 			"for file storage(s).");
+		tr_cache_destroy(conf->record.plans);
 		lnf_rec_free(conf->record.rec_ptr);
 		configuration_free(parsed_params);
 		free(conf);
@@ -129,6 +138,10 @@ store_packet (void *config, const struct ipfix_message *ipfix_msg,
 		}
 	}
 
+	// Plan of the last template (records usually share a few templates)
+	const struct ipfix_template *templ = NULL;
+	const struct tr_plan *plan = NULL;
+
 	for (unsigned int i = 0; i < ipfix_msg->data_records_count; i++) {
 		// Get a pointer to the next record
 		const struct metadata *mdata = &(ipfix_msg->metadata[i]);
@@ -141,17 +154,28 @@ store_packet (void *config, const struct ipfix_message *ipfix_msg,
 			continue;
 		}
 
+		if (mdata->record.templ != templ) {
+			templ = mdata->record.templ;
+			plan = tr_cache_get(conf->record.plans, templ);
+		}
+
+		if (!plan) {
+			continue;
+		}
+
 		// Fill record
 		lnf_rec_t *rec = conf->record.rec_ptr;
 		lnf_rec_clear(rec);
-		if (stg_common_fill_record(mdata, rec, conf->record.rec_buffer) <= 0) {
+		if (stg_common_fill_record(mdata, plan, rec,
+				conf->record.rec_buffer) <= 0) {
 			// Nothing to store
 			continue;
 		}
 
 		if (conf->params->profiles.en) {
 			// Profile mode
-			stg_profiles_store(conf->storage.profiles, mdata, rec);
+			stg_profiles_store(conf->storage.profiles, mdata,
+				&conf->record.rec_ptr);
 		} else {
 			// Basic mode
 			stg_basic_store(conf->storage.basic, rec);
@@ -184,6 +208,7 @@ storage_close (void **config)
 	}
 
 	// Destroy a record
+	tr_cache_destroy(conf->record.plans);
 	lnf_rec_free(conf->record.rec_ptr);
 
 	// Destroy parsed XML configuration
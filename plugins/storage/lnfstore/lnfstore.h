@@ -51,6 +51,7 @@
 #include "files_manager.h"
 #include "storage_basic.h"
 #include "storage_profiles.h"
+#include "translator.h"
 
 extern const char *msg_module;
 
@@ -72,6 +73,7 @@ struct conf_lnfstore {
 	struct {
 		lnf_rec_t *rec_ptr;  /**< LNF record (converted IPFIX record)        */
 		uint8_t    rec_buffer[REC_BUFF_SIZE]; /**< Record conversion buffer  */
+		tr_cache_t *plans;   /**< Conversion plans of templates              */
 	} record; /**< Record conversion */
 };
 
@@ -73,6 +73,7 @@ stg_common_files_mgr_create(const struct conf_params *params, const char *dir)
 		param_idx.autosize = params->file_index.autosize;
 		param_idx.item_cnt = params->file_index.est_cnt;
 		param_idx.prob = params->file_index.fp_prob;
+		param_idx.blocked = params->file_index.blocked;
 
 		param_idx_ptr = &param_idx;
 		mode |= FILES_M_INDEX;
@@ -82,34 +83,23 @@ stg_common_files_mgr_create(const struct conf_params *params, const char *dir)
 }
 
 int
-stg_common_fill_record(const struct metadata *mdata, lnf_rec_t *record,
-	uint8_t *buffer)
+stg_common_fill_record(const struct metadata *mdata,
+	const struct tr_plan *plan, lnf_rec_t *record, uint8_t *buffer)
 {
 	int added = 0;
 
 	uint16_t offset = 0;
 	uint16_t length;
 
-	struct ipfix_template *templ = mdata->record.templ;
 	uint8_t *data_record = (uint8_t*) mdata->record.record;
 
-	// Process all fields
-	for (uint16_t count = 0, id = 0; count < templ->field_count; ++count, ++id) {
-		// Create a key - get Enterprise and Element ID
-		struct ipfix_lnf_map key, *item;
+	// Process only fields to convert and fields of variable length
+	for (uint16_t i = 0; i < plan->count; ++i) {
+		const struct tr_field *conv = &plan->conv[i];
+		struct ipfix_lnf_map *item = conv->item;
 
-		key.ie = templ->fields[id].ie.id;
-		length = templ->fields[id].ie.length;
-		key.en = 0;
-
-		if (key.ie & 0x8000) {
-			key.ie &= 0x7fff;
-			key.en = templ->fields[++id].enterprise_number;
-		}
-
-		// Find conversion function
-		item = bsearch(&key, tr_table, MAX_TABLE, sizeof(struct ipfix_lnf_map),
-				ipfix_lnf_map_compare);
+		offset += conv->skip;
+		length = conv->length;
 
 		int conv_failed = 1;
 		if (item != NULL) {
@@ -43,6 +43,7 @@
 #include <ipfixcol.h>
 #include "files_manager.h"
 #include "configuration.h"
+#include "translator.h"
 
 
 /**
@@ -68,13 +69,14 @@ stg_common_files_mgr_create(const struct conf_params *params, const char *dir);
  * \brief Fill a new record (convert IPFIX to LNF)
  *
  * \param[in]     mdata  IPFIX record
+ * \param[in]     plan   Conversion plan of the template of the record
  * \param[out]    record LNF Record
  * \param[in,out] buffer Pointer to temporary buffer (for data conversion)
  * \return Number of converted fields
  */
 int
-stg_common_fill_record(const struct metadata *mdata, lnf_rec_t *record,
-	uint8_t *buffer);
+stg_common_fill_record(const struct metadata *mdata,
+	const struct tr_plan *plan, lnf_rec_t *record, uint8_t *buffer);
 
 
 #endif // STORAGE_COMMON_H
@@ -48,6 +48,7 @@
 #include "profiler_events.h"
 #include "configuration.h"
 #include "storage_common.h"
+#include "workers.h"
 
 /**
  * \brief Global data shared among all channels (read-only)
@@ -61,6 +62,11 @@ struct stg_profiles_global {
 
 	/** Operation status (returns status of selected callbacks) */
 	int op_status;
+
+	/** Workers storing records of channels (can be NULL) */
+	workers_t *workers;
+	/** Worker of the next created channel */
+	unsigned int next_worker;
 };
 
 /**
@@ -69,6 +75,8 @@ struct stg_profiles_global {
 struct stg_profiles_chnl_local {
 	/** Output file(s)  */
 	files_mgr_t *manager;
+	/** Index of the worker that stores records of the channel */
+	unsigned int worker;
 };
 
 /**
@@ -132,6 +140,20 @@ channel_get_dirname(void *channel)
 	return out_dir;
 }
 
+/**
+ * \brief Wait until workers store all pushed records
+ *
+ * MUST be called before files managers of channels are modified.
+ * \param[in] global Global structure shared among all channels
+ */
+static void
+channel_storage_sync(const struct stg_profiles_global *global)
+{
+	if (global->workers) {
+		workers_barrier(global->workers);
+	}
+}
+
 /**
  * \brief Close a channel's storage
  *
@@ -244,6 +266,11 @@ channel_create_cb(struct pevents_ctx *ctx)
 		return NULL;
 	}
 
+	struct stg_profiles_global *global = ctx->user.global;
+	if (global->workers) {
+		local_data->worker = global->next_worker++ % workers_count(global->workers);
+	}
+
 	if (channel_storage_open(local_data, ctx->user.global, ctx->ptr.channel)) {
 		// Failed
 		MSG_WARNING(msg_module, "Failed to create storage of channel '%s%s'. "
@@ -282,6 +309,7 @@ channel_delete_cb(struct pevents_ctx *ctx)
 	struct stg_profiles_chnl_local *local_data;
 	local_data = (struct stg_profiles_chnl_local *) ctx->user.local;
 	if (local_data != NULL) {
+		channel_storage_sync(ctx->user.global);
 		channel_storage_close(local_data);
 		free(local_data);
 	}
@@ -319,6 +347,9 @@ channel_update_cb(struct pevents_ctx *ctx, uint16_t flags)
 	void *profile = channel_get_profile(ctx->ptr.channel);
 	const enum PROFILE_TYPE type = profile_get_type(profile);
 
+	// Files of the channel can be closed/replaced
+	channel_storage_sync(ctx->user.global);
+
 	// Is the profile's type still the same?
 	if (type == PT_SHADOW) {
 		// The type is shadow -> Delete the files manager, if it exists.
@@ -381,6 +412,14 @@ channel_data_cb(struct pevents_ctx *ctx, void *data)
 		return;
 	}
 
+	struct stg_profiles_global *global = ctx->user.global;
+	if (global->workers) {
+		// Let the worker of the channel store the shared record
+		workers_push(global->workers, local_data->worker, local_data->manager,
+			(workers_rec_t *) data);
+		return;
+	}
+
 	lnf_rec_t *rec_ptr = data;
 	int ret = files_mgr_add_record(local_data->manager, rec_ptr);
 	if (ret != 0) {
@@ -429,6 +468,14 @@ stg_profiles_create(const struct conf_params *params)
 
 	mgr->global.params = params;
 
+	if (params->profiles.workers > 0) {
+		mgr->global.workers = workers_create(params->profiles.workers);
+		if (!mgr->global.workers) {
+			free(mgr);
+			return NULL;
+		}
+	}
+
 	// Initialize an array of callbacks
 	struct pevent_cb_set channel_cb;
 	memset(&channel_cb, 0, sizeof(channel_cb));
@@ -445,6 +492,9 @@ stg_profiles_create(const struct conf_params *params)
 	mgr->event_mgr = pevents_create(profile_cb, channel_cb);
 	if (!mgr->event_mgr) {
 		// Failed
+		if (mgr->global.workers) {
+			workers_destroy(mgr->global.workers);
+		}
 		free(mgr);
 		return NULL;
 	}
@@ -457,22 +507,37 @@ void
 stg_profiles_destroy(stg_profiles_t *storage)
 {
 	// Destroy a profile manager and close all files (delete callback)
+	channel_storage_sync(&storage->global);
 	pevents_destroy(storage->event_mgr);
+	if (storage->global.workers) {
+		workers_destroy(storage->global.workers);
+	}
 	free(storage);
 }
 
 int
 stg_profiles_store(stg_profiles_t *storage, const struct metadata *mdata,
-	lnf_rec_t *rec)
+	lnf_rec_t **rec)
 {
-	// Store the record to the channels
-	return pevents_process(storage->event_mgr, (const void **)mdata->channels,
-		rec);
+	workers_t *workers = storage->global.workers;
+	if (!workers) {
+		// Store the record to the channels
+		return pevents_process(storage->event_mgr,
+			(const void **) mdata->channels, *rec);
+	}
+
+	// Share the record among workers of the channels
+	workers_rec_t *shared = workers_rec_acquire(workers, rec);
+	int ret = pevents_process(storage->event_mgr,
+		(const void **) mdata->channels, shared);
+	workers_rec_release(workers, shared);
+	return ret;
 }
 
 int
 stg_profiles_new_window(stg_profiles_t *storage, time_t window)
 {
+	channel_storage_sync(&storage->global);
 	storage->global.window_start = window;
 	storage->global.op_status = 0;
 
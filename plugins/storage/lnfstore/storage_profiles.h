@@ -67,20 +67,26 @@ stg_profiles_destroy(stg_profiles_t *storage);
 
 /**
  * \brief Store a LNF record to a storage
+ *
+ * When workers are enabled, the record is passed to them by reference and
+ * \p rec is replaced with another LNF record that can be used for the next
+ * conversion.
  * \param[in,out] storage Storage
- * \param[in]     rec     LNF record
+ * \param[in]     mdata   IPFIX record (channels of the record)
+ * \param[in,out] rec     LNF record
  * \return On success (all channels have been found) returns 0. Otherwise
  *   (failed to find a channel and rebuild a new configuration) returns
  *   a non-zero value. The return value do not signalize status of output files.
  */
 int
 stg_profiles_store(stg_profiles_t *storage, const struct metadata *mdata,
-	lnf_rec_t *rec);
+	lnf_rec_t **rec);
 
 /**
  * \brief Create a new time window
  *
  * Current output file(s) will be closed and new ones will be opened.
+ * Records already passed to workers are stored first.
  * \param[in,out] storage Storage
  * \param[in]     window  Identification time of new window (UTC)
  * \return On success returns 0. Otherwise (at least one window is not
@@ -42,6 +42,8 @@
 #include "translator.h"
 
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #define readui8(_ptr_)(*((uint8_t*)(_ptr_)))
 #define readui16(_ptr_)(*((uint16_t*)(_ptr_)))
@@ -135,6 +137,9 @@ struct ipfix_lnf_map tr_table[]=
 	{0, 282, LNF_FLD_XLATE_DST_IP,   tr_address }
 };
 
+/** \brief Sizes of LNF fields of the conversion table (see tr_table_init()) */
+static int tr_size[MAX_TABLE];
+
 int ipfix_lnf_map_compare(const void* pkey, const void* pelem)
 {
 	const struct ipfix_lnf_map *key, *elem;
@@ -179,14 +184,7 @@ int tr_general(uint8_t *src_data, uint16_t* offset, uint16_t* length,
 	}
 
 	// Check size
-	// TODO: optimize out
-	int size = 0;
-	if (lnf_fld_info(item_info->lnf_id, LNF_FLD_INFO_SIZE, &size,
-			sizeof(size)) != LNF_OK) {
-		MSG_DEBUG(msg_module, "Failed to get a size of the LNF element.");
-		size = 0;
-	}
-
+	int size = tr_size[item_info - tr_table];
 	if ((int) *length < size) {
 		// IPFIX element is shorted then LNF value
 		memset(buffer, 0, size);
@@ -299,5 +297,215 @@ int tr_mpls(uint8_t *src_data, uint16_t* offset, uint16_t *length,
 	return 0;
 }
 
+/** Maximal number of plans in a cache (all are dropped when exceeded) */
+#define TR_CACHE_MAX (1024)
+
+struct tr_cache_s {
+	struct tr_plan **plans; /**< Plans                                     */
+	size_t count;           /**< Number of plans                           */
+	size_t size;            /**< Size of the array of plans                */
+};
+
+static pthread_once_t tr_table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Get sizes of LNF fields of the conversion table
+ */
+static void
+tr_table_init()
+{
+	for (int i = 0; i < MAX_TABLE; ++i) {
+		struct ipfix_lnf_map *item = &tr_table[i];
+		if (item->func == NULL) {
+			continue;
+		}
+
+		int size = 0;
+		if (lnf_fld_info(item->lnf_id, LNF_FLD_INFO_SIZE, &size,
+				sizeof(size)) != LNF_OK) {
+			MSG_DEBUG(msg_module, "Failed to get a size of the LNF element.");
+			size = 0;
+		}
+
+		tr_size[i] = size;
+	}
+}
+
+/**
+ * \brief Create a conversion plan of a template
+ * \param[in] templ Template
+ * \return On success returns a pointer to the plan. Otherwise returns NULL.
+ */
+static struct tr_plan *
+tr_plan_create(const struct ipfix_template *templ)
+{
+	struct tr_plan *plan = calloc(1, sizeof(*plan)
+		+ templ->field_count * sizeof(struct tr_field));
+	if (!plan) {
+		return NULL;
+	}
+
+	uint16_t skip = 0;
+	uint16_t id = 0;
+	for (uint16_t count = 0; count < templ->field_count; ++count, ++id) {
+		struct ipfix_lnf_map key, *item;
+
+		key.ie = templ->fields[id].ie.id;
+		uint16_t length = templ->fields[id].ie.length;
+		key.en = 0;
+
+		if (key.ie & 0x8000) {
+			key.ie &= 0x7fff;
+			key.en = templ->fields[++id].enterprise_number;
+		}
+
+		item = bsearch(&key, tr_table, MAX_TABLE, sizeof(struct ipfix_lnf_map),
+				ipfix_lnf_map_compare);
+		if (item == NULL && length != VAR_IE_LENGTH) {
+			// Nothing to convert, just skip the field
+			skip += length;
+			continue;
+		}
+
+		struct tr_field *conv = &plan->conv[plan->count++];
+		conv->skip = skip;
+		conv->length = length;
+		conv->item = item;
+		skip = 0;
+	}
+
+	// Remember the fields to detect a different template at the same address
+	plan->fields = malloc(id * sizeof(template_ie));
+	if (!plan->fields) {
+		free(plan);
+		return NULL;
+	}
+
+	memcpy(plan->fields, templ->fields, id * sizeof(template_ie));
+	plan->fields_cnt = id;
+	plan->templ = templ;
+	return plan;
+}
+
+/**
+ * \brief Destroy a conversion plan
+ * \param[in] plan Plan
+ */
+static void
+tr_plan_destroy(struct tr_plan *plan)
+{
+	free(plan->fields);
+	free(plan);
+}
+
+/**
+ * \brief Check whether a plan was created from a template
+ * \param[in] plan  Plan
+ * \param[in] templ Template
+ * \return True or false
+ */
+static bool
+tr_plan_match(const struct tr_plan *plan, const struct ipfix_template *templ)
+{
+	if (plan->templ != templ) {
+		return false;
+	}
+
+	// Compare fields one by one to never read behind the template
+	uint16_t id = 0;
+	for (uint16_t count = 0; count < templ->field_count; ++count, ++id) {
+		if (id >= plan->fields_cnt
+				|| plan->fields[id].ie.id != templ->fields[id].ie.id
+				|| plan->fields[id].ie.length != templ->fields[id].ie.length) {
+			return false;
+		}
+
+		if (templ->fields[id].ie.id & 0x8000) {
+			++id;
+			if (id >= plan->fields_cnt || plan->fields[id].enterprise_number
+					!= templ->fields[id].enterprise_number) {
+				return false;
+			}
+		}
+	}
+
+	return id == plan->fields_cnt;
+}
+
+tr_cache_t *
+tr_cache_create()
+{
+	pthread_once(&tr_table_once, tr_table_init);
+
+	tr_cache_t *cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__,
+			__LINE__);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void
+tr_cache_destroy(tr_cache_t *cache)
+{
+	for (size_t i = 0; i < cache->count; ++i) {
+		tr_plan_destroy(cache->plans[i]);
+	}
 
+	free(cache->plans);
+	free(cache);
+}
+
+const struct tr_plan *
+tr_cache_get(tr_cache_t *cache, const struct ipfix_template *templ)
+{
+	size_t idx;
+	for (idx = 0; idx < cache->count; ++idx) {
+		if (cache->plans[idx]->templ != templ) {
+			continue;
+		}
+
+		if (tr_plan_match(cache->plans[idx], templ)) {
+			return cache->plans[idx];
+		}
+
+		// The template was replaced
+		tr_plan_destroy(cache->plans[idx]);
+		cache->plans[idx] = cache->plans[--cache->count];
+		break;
+	}
 
+	if (cache->count == TR_CACHE_MAX) {
+		// Drop plans of (probably) withdrawn templates
+		for (idx = 0; idx < cache->count; ++idx) {
+			tr_plan_destroy(cache->plans[idx]);
+		}
+		cache->count = 0;
+	}
+
+	if (cache->count == cache->size) {
+		size_t new_size = (cache->size == 0) ? 16 : 2 * cache->size;
+		struct tr_plan **new_plans = realloc(cache->plans,
+			new_size * sizeof(*new_plans));
+		if (!new_plans) {
+			MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+				__FILE__, __LINE__);
+			return NULL;
+		}
+
+		cache->plans = new_plans;
+		cache->size = new_size;
+	}
+
+	struct tr_plan *plan = tr_plan_create(templ);
+	if (!plan) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__,
+			__LINE__);
+		return NULL;
+	}
+
+	cache->plans[cache->count++] = plan;
+	return plan;
+}
@@ -40,6 +40,7 @@
 #ifndef LS_TRANSLATOR_H
 #define LS_TRANSLATOR_H
 
+#include <ipfixcol.h>
 #include <libnf.h>
 
 #define MAX_TABLE 65
@@ -67,6 +68,60 @@ int ipfix_lnf_map_compare(const void* pkey, const void* pelem);
 
 uint16_t real_length(uint8_t* src_data, uint16_t* offset, uint16_t length);
 
+/** \brief Conversion of a field of a template */
+struct tr_field {
+	/** Total length of unmapped fixed-length fields before the field */
+	uint16_t skip;
+	/** Length of the field from the template (can be #VAR_IE_LENGTH) */
+	uint16_t length;
+	/** Conversion (NULL for an unmapped variable-length field)        */
+	struct ipfix_lnf_map *item;
+};
+
+/**
+ * \brief Conversion plan of a template
+ *
+ * Only fields that must be converted or whose length must be decoded
+ * from a record are present. Unmapped fixed-length fields are folded
+ * into the \p skip of the following conversion.
+ */
+struct tr_plan {
+	const struct ipfix_template *templ; /**< Template                   */
+	template_ie *fields;   /**< Copy of the fields of the template        */
+	uint16_t fields_cnt;   /**< Number of items in \p fields              */
+	uint16_t count;        /**< Number of conversions                     */
+	struct tr_field conv[]; /**< Conversions                              */
+};
+
+/** \brief Cache of conversion plans */
+typedef struct tr_cache_s tr_cache_t;
+
+/**
+ * \brief Create a cache of conversion plans
+ * \return On success returns a pointer to the cache. Otherwise returns NULL.
+ */
+tr_cache_t *
+tr_cache_create();
+
+/**
+ * \brief Destroy a cache of conversion plans
+ * \param[in] cache Cache
+ */
+void
+tr_cache_destroy(tr_cache_t *cache);
+
+/**
+ * \brief Get a conversion plan of a template
+ *
+ * The plan is created on the first use of the template and remains valid
+ * until the next call of this function.
+ * \param[in] cache Cache
+ * \param[in] templ Template
+ * \return On success returns a pointer to the plan. Otherwise returns NULL.
+ */
+const struct tr_plan *
+tr_cache_get(tr_cache_t *cache, const struct ipfix_template *templ);
+
 
 
 #endif //LS_TRANSLATOR_H
@@ -0,0 +1,362 @@
+/**
+ * \file workers.c
+ * \brief Workers storing records of channels (source file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lnfstore.h"
+#include "workers.h"
+
+/** Number of shared records (limits records waiting in queues) */
+#define WORKERS_POOL_SIZE  (1024U)
+/** Size of a queue of a worker                                  */
+#define WORKERS_QUEUE_SIZE (4096U)
+/** Maximal number of jobs taken from a queue at once            */
+#define WORKERS_BATCH      (64U)
+
+/** \brief Shared record */
+struct workers_rec {
+	lnf_rec_t *rec;       /**< Converted record                           */
+	unsigned int refs;    /**< Number of references (atomic)              */
+};
+
+/** \brief Record to store into files of a channel */
+struct workers_job {
+	files_mgr_t *mgr;     /**< Files manager of the channel               */
+	workers_rec_t *rec;   /**< Shared record                              */
+};
+
+/** \brief Worker */
+struct workers_thread {
+	pthread_t thread;     /**< Thread                                     */
+	workers_t *parent;    /**< Pool                                       */
+
+	pthread_mutex_t mutex;       /**< Lock of the queue                   */
+	pthread_cond_t  cond_push;   /**< A job has been added / stop request */
+	pthread_cond_t  cond_pop;    /**< Jobs have been removed              */
+	pthread_cond_t  cond_idle;   /**< The queue is empty and processed    */
+
+	struct workers_job *queue;   /**< Ring buffer of jobs                 */
+	unsigned int head;           /**< Index of the oldest job             */
+	unsigned int count;          /**< Number of jobs in the queue         */
+	bool busy;                   /**< Jobs are being stored               */
+	bool stop;                   /**< Stop request                        */
+};
+
+/** \brief Pool of workers */
+struct workers_s {
+	struct workers_thread *threads; /**< Workers                          */
+	unsigned int count;             /**< Number of workers                */
+
+	struct {
+		pthread_mutex_t mutex;      /**< Lock of free records             */
+		pthread_cond_t  cond;       /**< A record has been released      */
+		workers_rec_t  *recs;       /**< All shared records               */
+		workers_rec_t **free;       /**< Stack of free records            */
+		unsigned int    free_cnt;   /**< Number of free records           */
+	} pool; /**< Shared records */
+};
+
+/**
+ * \brief Main function of a worker
+ * \param[in,out] arg Worker
+ */
+static void *
+workers_main(void *arg)
+{
+	struct workers_thread *thread = arg;
+	struct workers_job batch[WORKERS_BATCH];
+
+	pthread_mutex_lock(&thread->mutex);
+	while (true) {
+		while (thread->count == 0 && !thread->stop) {
+			pthread_cond_wait(&thread->cond_push, &thread->mutex);
+		}
+
+		if (thread->count == 0) {
+			// Stop request and nothing to store
+			break;
+		}
+
+		// Take a batch of jobs
+		unsigned int cnt = 0;
+		while (cnt < WORKERS_BATCH && thread->count > 0) {
+			batch[cnt++] = thread->queue[thread->head];
+			thread->head = (thread->head + 1) % WORKERS_QUEUE_SIZE;
+			thread->count--;
+		}
+
+		thread->busy = true;
+		pthread_cond_signal(&thread->cond_pop);
+		pthread_mutex_unlock(&thread->mutex);
+
+		for (unsigned int i = 0; i < cnt; ++i) {
+			if (files_mgr_add_record(batch[i].mgr, batch[i].rec->rec) != 0) {
+				MSG_DEBUG(msg_module, "Failed to store a record into a "
+					"channel.");
+			}
+
+			workers_rec_release(thread->parent, batch[i].rec);
+		}
+
+		pthread_mutex_lock(&thread->mutex);
+		thread->busy = false;
+		if (thread->count == 0) {
+			pthread_cond_broadcast(&thread->cond_idle);
+		}
+	}
+
+	pthread_mutex_unlock(&thread->mutex);
+	return NULL;
+}
+
+/**
+ * \brief Stop and destroy the first \p count workers
+ * \param[in,out] workers Pool
+ * \param[in]     count   Number of running workers
+ */
+static void
+workers_threads_destroy(workers_t *workers, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		struct workers_thread *thread = &workers->threads[i];
+
+		pthread_mutex_lock(&thread->mutex);
+		thread->stop = true;
+		pthread_cond_signal(&thread->cond_push);
+		pthread_mutex_unlock(&thread->mutex);
+
+		pthread_join(thread->thread, NULL);
+
+		pthread_cond_destroy(&thread->cond_idle);
+		pthread_cond_destroy(&thread->cond_pop);
+		pthread_cond_destroy(&thread->cond_push);
+		pthread_mutex_destroy(&thread->mutex);
+		free(thread->queue);
+	}
+
+	free(workers->threads);
+	workers->threads = NULL;
+}
+
+/**
+ * \brief Destroy the first \p count shared records and the pool
+ * \param[in,out] workers Pool
+ * \param[in]     count   Number of initialized records
+ */
+static void
+workers_pool_destroy(workers_t *workers, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		lnf_rec_free(workers->pool.recs[i].rec);
+	}
+
+	free(workers->pool.free);
+	free(workers->pool.recs);
+	pthread_cond_destroy(&workers->pool.cond);
+	pthread_mutex_destroy(&workers->pool.mutex);
+}
+
+workers_t *
+workers_create(unsigned int count)
+{
+	workers_t *workers = calloc(1, sizeof(*workers));
+	if (!workers) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		return NULL;
+	}
+
+	// Prepare shared records
+	pthread_mutex_init(&workers->pool.mutex, NULL);
+	pthread_cond_init(&workers->pool.cond, NULL);
+	workers->pool.recs = calloc(WORKERS_POOL_SIZE, sizeof(workers_rec_t));
+	workers->pool.free = calloc(WORKERS_POOL_SIZE, sizeof(workers_rec_t *));
+	if (!workers->pool.recs || !workers->pool.free) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		workers_pool_destroy(workers, 0);
+		free(workers);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < WORKERS_POOL_SIZE; ++i) {
+		if (lnf_rec_init(&workers->pool.recs[i].rec) != LNF_OK) {
+			MSG_ERROR(msg_module, "Failed to initialize an internal "
+				"structure for shared records");
+			workers_pool_destroy(workers, i);
+			free(workers);
+			return NULL;
+		}
+
+		workers->pool.free[i] = &workers->pool.recs[i];
+	}
+	workers->pool.free_cnt = WORKERS_POOL_SIZE;
+
+	// Start workers
+	workers->threads = calloc(count, sizeof(struct workers_thread));
+	if (!workers->threads) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		workers_pool_destroy(workers, WORKERS_POOL_SIZE);
+		free(workers);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		struct workers_thread *thread = &workers->threads[i];
+		thread->parent = workers;
+		thread->queue = calloc(WORKERS_QUEUE_SIZE, sizeof(struct workers_job));
+		if (!thread->queue) {
+			MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+				__FILE__, __LINE__);
+			workers_threads_destroy(workers, i);
+			workers_pool_destroy(workers, WORKERS_POOL_SIZE);
+			free(workers);
+			return NULL;
+		}
+
+		pthread_mutex_init(&thread->mutex, NULL);
+		pthread_cond_init(&thread->cond_push, NULL);
+		pthread_cond_init(&thread->cond_pop, NULL);
+		pthread_cond_init(&thread->cond_idle, NULL);
+
+		if (pthread_create(&thread->thread, NULL, &workers_main, thread)) {
+			MSG_ERROR(msg_module, "Failed to start a worker thread.");
+			pthread_cond_destroy(&thread->cond_idle);
+			pthread_cond_destroy(&thread->cond_pop);
+			pthread_cond_destroy(&thread->cond_push);
+			pthread_mutex_destroy(&thread->mutex);
+			free(thread->queue);
+			workers_threads_destroy(workers, i);
+			workers_pool_destroy(workers, WORKERS_POOL_SIZE);
+			free(workers);
+			return NULL;
+		}
+	}
+
+	workers->count = count;
+	MSG_INFO(msg_module, "Records of channels are stored by %u worker(s).",
+		count);
+	return workers;
+}
+
+void
+workers_destroy(workers_t *workers)
+{
+	// Workers store all remaining records before they stop
+	workers_threads_destroy(workers, workers->count);
+	workers_pool_destroy(workers, WORKERS_POOL_SIZE);
+	free(workers);
+}
+
+unsigned int
+workers_count(const workers_t *workers)
+{
+	return workers->count;
+}
+
+workers_rec_t *
+workers_rec_acquire(workers_t *workers, lnf_rec_t **rec)
+{
+	pthread_mutex_lock(&workers->pool.mutex);
+	while (workers->pool.free_cnt == 0) {
+		pthread_cond_wait(&workers->pool.cond, &workers->pool.mutex);
+	}
+
+	workers_rec_t *shared = workers->pool.free[--workers->pool.free_cnt];
+	pthread_mutex_unlock(&workers->pool.mutex);
+
+	// Swap records (the caller gets the old record of the shared one)
+	lnf_rec_t *tmp = shared->rec;
+	shared->rec = *rec;
+	*rec = tmp;
+
+	shared->refs = 1;
+	return shared;
+}
+
+void
+workers_rec_release(workers_t *workers, workers_rec_t *rec)
+{
+	if (__sync_sub_and_fetch(&rec->refs, 1) != 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->pool.mutex);
+	workers->pool.free[workers->pool.free_cnt++] = rec;
+	pthread_cond_signal(&workers->pool.cond);
+	pthread_mutex_unlock(&workers->pool.mutex);
+}
+
+void
+workers_push(workers_t *workers, unsigned int idx, files_mgr_t *mgr,
+	workers_rec_t *rec)
+{
+	struct workers_thread *thread = &workers->threads[idx % workers->count];
+	__sync_add_and_fetch(&rec->refs, 1);
+
+	pthread_mutex_lock(&thread->mutex);
+	while (thread->count == WORKERS_QUEUE_SIZE) {
+		pthread_cond_wait(&thread->cond_pop, &thread->mutex);
+	}
+
+	unsigned int tail = (thread->head + thread->count) % WORKERS_QUEUE_SIZE;
+	thread->queue[tail].mgr = mgr;
+	thread->queue[tail].rec = rec;
+	if (thread->count++ == 0) {
+		pthread_cond_signal(&thread->cond_push);
+	}
+	pthread_mutex_unlock(&thread->mutex);
+}
+
+void
+workers_barrier(workers_t *workers)
+{
+	for (unsigned int i = 0; i < workers->count; ++i) {
+		struct workers_thread *thread = &workers->threads[i];
+
+		pthread_mutex_lock(&thread->mutex);
+		while (thread->count > 0 || thread->busy) {
+			pthread_cond_wait(&thread->cond_idle, &thread->mutex);
+		}
+		pthread_mutex_unlock(&thread->mutex);
+	}
+}
@@ -0,0 +1,127 @@
+/**
+ * \file workers.h
+ * \brief Workers storing records of channels (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LS_WORKERS_H
+#define LS_WORKERS_H
+
+#include <libnf.h>
+#include "files_manager.h"
+
+/**
+ * \brief Pool of threads storing records into files of channels
+ *
+ * Each files manager (i.e. a channel) is always served by the same worker,
+ * so its files are never accessed concurrently. A record is converted only
+ * once and shared by all channels where it belongs.
+ */
+typedef struct workers_s workers_t;
+
+/** \brief Shared record (see workers_rec_acquire()) */
+typedef struct workers_rec workers_rec_t;
+
+/**
+ * \brief Create a pool of workers
+ * \param[in] count Number of workers (threads)
+ * \return On success returns a pointer to the pool. Otherwise returns NULL.
+ */
+workers_t *
+workers_create(unsigned int count);
+
+/**
+ * \brief Destroy a pool of workers
+ *
+ * All records already pushed are stored before the workers are stopped.
+ * \param[in,out] workers Pool
+ */
+void
+workers_destroy(workers_t *workers);
+
+/**
+ * \brief Get the number of workers
+ * \param[in] workers Pool
+ */
+unsigned int
+workers_count(const workers_t *workers);
+
+/**
+ * \brief Pass a converted record to workers
+ *
+ * The record \p rec is moved into a shared record and it is replaced with
+ * another (not cleared) LNF record that the caller can use for conversion
+ * of the next IPFIX record. If all shared records are still in use by
+ * workers, the function waits.
+ * \param[in,out] workers Pool
+ * \param[in,out] rec     LNF record
+ * \return Shared record. It MUST be released by workers_rec_release().
+ */
+workers_rec_t *
+workers_rec_acquire(workers_t *workers, lnf_rec_t **rec);
+
+/**
+ * \brief Release a shared record acquired by workers_rec_acquire()
+ * \param[in,out] workers Pool
+ * \param[in]     rec     Shared record
+ */
+void
+workers_rec_release(workers_t *workers, workers_rec_t *rec);
+
+/**
+ * \brief Store a shared record into output files of a channel
+ *
+ * The record is added to the queue of the worker. If the queue is full,
+ * the function waits.
+ * \param[in,out] workers Pool
+ * \param[in]     idx     Index of the worker (modulo number of workers)
+ * \param[in]     mgr     Files manager of the channel
+ * \param[in]     rec     Shared record
+ */
+void
+workers_push(workers_t *workers, unsigned int idx, files_mgr_t *mgr,
+	workers_rec_t *rec);
+
+/**
+ * \brief Wait until all workers have stored all records in their queues
+ *
+ * Files managers MUST NOT be modified (e.g. a new window, destruction)
+ * without calling this function first.
+ * \param[in,out] workers Pool
+ */
+void
+workers_barrier(workers_t *workers);
+
+#endif // LS_WORKERS_H
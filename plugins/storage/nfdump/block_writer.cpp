@@ -0,0 +1,436 @@
+/**
+ * \file block_writer.cpp
+ * \brief Compression and writing of nfdump data blocks
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+extern "C" {
+#include <ipfixcol/verbose.h>
+}
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "block_writer.h"
+#include "nfstore.h"
+#include "nffile.h"
+
+/* zstd level (nfdump uses the fastest levels too) */
+#define ZSTD_LEVEL 1
+
+BlockCompressor::BlockCompressor(enum BlockCodec codec){
+	codec_ = codec;
+	wrkmem_ = NULL;
+
+	switch(codec_){
+	case CODEC_LZO:
+		wrkmem_ = malloc(LZO1X_1_MEM_COMPRESS);
+		break;
+#ifdef HAVE_LZ4
+	case CODEC_LZ4:
+		wrkmem_ = malloc(LZ4_sizeofState());
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case CODEC_ZSTD:
+		wrkmem_ = ZSTD_createCCtx();
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+BlockCompressor::~BlockCompressor(){
+#ifdef HAVE_ZSTD
+	if(codec_ == CODEC_ZSTD){
+		ZSTD_freeCCtx((ZSTD_CCtx *) wrkmem_);
+		return;
+	}
+#endif
+	free(wrkmem_);
+}
+
+int BlockCompressor::compress(const char *in, uint32_t inSize, char *out,
+		uint32_t outSize, uint32_t *outUsed){
+	switch(codec_){
+	case CODEC_LZO: {
+		lzo_uint oSize = 0;
+		if(outSize < bound(CODEC_LZO, inSize)){
+			return -1;
+		}
+		if(lzo1x_1_compress((const unsigned char __LZO_MMODEL *) in, inSize,
+				(unsigned char __LZO_MMODEL *) out, &oSize, wrkmem_) != LZO_E_OK){
+			return -1;
+		}
+		*outUsed = oSize;
+		return 0;
+	}
+#ifdef HAVE_LZ4
+	case CODEC_LZ4: {
+		int oSize = LZ4_compress_fast_extState(wrkmem_, in, out, inSize, outSize, 1);
+		if(oSize <= 0){
+			return -1;
+		}
+		*outUsed = oSize;
+		return 0;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case CODEC_ZSTD: {
+		size_t oSize = ZSTD_compressCCtx((ZSTD_CCtx *) wrkmem_, out, outSize,
+				in, inSize, ZSTD_LEVEL);
+		if(ZSTD_isError(oSize)){
+			return -1;
+		}
+		*outUsed = oSize;
+		return 0;
+	}
+#endif
+	default:
+		return -1;
+	}
+}
+
+bool BlockCompressor::available(enum BlockCodec codec){
+	switch(codec){
+	case CODEC_NONE:
+	case CODEC_LZO:
+		return true;
+#ifdef HAVE_LZ4
+	case CODEC_LZ4:
+		return true;
+#endif
+#ifdef HAVE_ZSTD
+	case CODEC_ZSTD:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+uint32_t BlockCompressor::bound(enum BlockCodec codec, uint32_t size){
+	switch(codec){
+	case CODEC_LZO:
+		/* worst case expansion of LZO1X-1 */
+		return size + size / 16 + 64 + 3;
+#ifdef HAVE_LZ4
+	case CODEC_LZ4:
+		return LZ4_compressBound(size);
+#endif
+#ifdef HAVE_ZSTD
+	case CODEC_ZSTD:
+		return ZSTD_compressBound(size);
+#endif
+	default:
+		return size;
+	}
+}
+
+uint32_t BlockCompressor::flags(enum BlockCodec codec){
+	switch(codec){
+	case CODEC_LZO:
+		return FLAG_COMPRESSED;
+	case CODEC_LZ4:
+		return FLAG_LZ4_COMPRESSED;
+	case CODEC_ZSTD:
+		return FLAG_ZSTD_COMPRESSED;
+	default:
+		return 0;
+	}
+}
+
+BlockWriter::BlockWriter(){
+	codec_ = CODEC_NONE;
+	dataSize_ = 0;
+	outSize_ = 0;
+	writerRunning_ = false;
+	stop_ = false;
+	maxPending_ = 0;
+	nextCompressor_ = 0;
+
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&queued_, NULL);
+	pthread_cond_init(&compressed_, NULL);
+	pthread_cond_init(&done_, NULL);
+}
+
+int BlockWriter::init(enum BlockCodec codec, unsigned int threads, uint32_t blockSize){
+	codec_ = codec;
+	dataSize_ = blockSize;
+	outSize_ = (codec_ == CODEC_NONE) ? 0 : BlockCompressor::bound(codec_, blockSize);
+	maxPending_ = MAX_IN_FLIGHT_PER_THREAD * threads + 1;
+
+	/* compressors of the threads (or of the caller) */
+	for(unsigned int i = 0; i < (threads ? threads : 1); i++){
+		BlockCompressor *compressor = new BlockCompressor(codec_);
+		compressors_.push_back(compressor);
+		if(!compressor->valid()){
+			MSG_ERROR(MSG_MODULE, "Can't allocate memory for compression");
+			return 1;
+		}
+	}
+
+	for(unsigned int i = 0; i < threads; i++){
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, &BlockWriter::compressThread, this) != 0){
+			MSG_ERROR(MSG_MODULE, "Can't create compression thread");
+			return 1;
+		}
+		threads_.push_back(thread);
+	}
+
+	if(threads){
+		if(pthread_create(&writer_, NULL, &BlockWriter::writerThread, this) != 0){
+			MSG_ERROR(MSG_MODULE, "Can't create writer thread");
+			return 1;
+		}
+		writerRunning_ = true;
+	}
+
+	MSG_DEBUG(MSG_MODULE, "Block writer with %u compression thread(s)", threads);
+	return 0;
+}
+
+struct BlockJob *BlockWriter::getBlock(){
+	struct BlockJob *job = NULL;
+
+	pthread_mutex_lock(&mutex_);
+	if(!free_.empty()){
+		job = free_.back();
+		free_.pop_back();
+	}
+	pthread_mutex_unlock(&mutex_);
+
+	if(job == NULL){
+		job = new struct BlockJob;
+		job->data = new char[dataSize_];
+		job->out = outSize_ ? new char[outSize_] : NULL;
+
+		pthread_mutex_lock(&mutex_);
+		all_.push_back(job);
+		pthread_mutex_unlock(&mutex_);
+	}
+
+	job->state = BlockJob::FILLING;
+	job->f = NULL;
+	job->close = false;
+	job->payload = job->data;
+	return job;
+}
+
+void BlockWriter::submit(struct BlockJob *job){
+	/* no threads, do everything now */
+	if(threads_.empty()){
+		compressJob(compressors_[0], job);
+		writeJob(job);
+
+		pthread_mutex_lock(&mutex_);
+		job->state = BlockJob::FREE;
+		free_.push_back(job);
+		pthread_mutex_unlock(&mutex_);
+		return;
+	}
+
+	pthread_mutex_lock(&mutex_);
+	/* limit memory used by blocks waiting for compression or writing */
+	while(pending_.size() >= maxPending_){
+		pthread_cond_wait(&done_, &mutex_);
+	}
+
+	job->state = BlockJob::QUEUED;
+	queue_.push_back(job);
+	pending_.push_back(job);
+	pthread_cond_signal(&queued_);
+	pthread_mutex_unlock(&mutex_);
+}
+
+void BlockWriter::sync(){
+	pthread_mutex_lock(&mutex_);
+	while(!pending_.empty()){
+		pthread_cond_wait(&done_, &mutex_);
+	}
+	pthread_mutex_unlock(&mutex_);
+}
+
+void *BlockWriter::compressThread(void *arg){
+	BlockWriter *writer = (BlockWriter *) arg;
+	BlockCompressor *compressor;
+	struct BlockJob *job;
+
+	pthread_mutex_lock(&writer->mutex_);
+	/* each thread has its own compressor */
+	compressor = writer->compressors_[writer->nextCompressor_++];
+
+	while(true){
+		while(writer->queue_.empty() && !writer->stop_){
+			pthread_cond_wait(&writer->queued_, &writer->mutex_);
+		}
+		if(writer->queue_.empty()){
+			break;
+		}
+
+		job = writer->queue_.front();
+		writer->queue_.pop_front();
+		job->state = BlockJob::COMPRESSING;
+		pthread_mutex_unlock(&writer->mutex_);
+
+		writer->compressJob(compressor, job);
+
+		pthread_mutex_lock(&writer->mutex_);
+		job->state = BlockJob::COMPRESSED;
+		if(job == writer->pending_.front()){
+			pthread_cond_signal(&writer->compressed_);
+		}
+	}
+	pthread_mutex_unlock(&writer->mutex_);
+	return NULL;
+}
+
+void *BlockWriter::writerThread(void *arg){
+	BlockWriter *writer = (BlockWriter *) arg;
+	struct BlockJob *job;
+
+	pthread_mutex_lock(&writer->mutex_);
+	while(true){
+		/* blocks are written in the order of submission */
+		while((writer->pending_.empty() && !writer->stop_) ||
+				(!writer->pending_.empty() &&
+				writer->pending_.front()->state != BlockJob::COMPRESSED)){
+			pthread_cond_wait(&writer->compressed_, &writer->mutex_);
+		}
+		if(writer->pending_.empty()){
+			break;
+		}
+
+		job = writer->pending_.front();
+		pthread_mutex_unlock(&writer->mutex_);
+
+		writer->writeJob(job);
+
+		pthread_mutex_lock(&writer->mutex_);
+		writer->pending_.pop_front();
+		job->state = BlockJob::FREE;
+		writer->free_.push_back(job);
+		pthread_cond_broadcast(&writer->done_);
+	}
+	pthread_mutex_unlock(&writer->mutex_);
+	return NULL;
+}
+
+void BlockWriter::compressJob(class BlockCompressor *compressor, struct BlockJob *job){
+	uint32_t outUsed = 0;
+
+	job->payload = job->data;
+	if(codec_ == CODEC_NONE){
+		return;
+	}
+
+	if(compressor->compress(job->data, job->block.dataSize(), job->out,
+			outSize_, &outUsed) != 0){
+		/* keep the records, the block is marked as uncompressed */
+		MSG_ERROR(MSG_MODULE, "Compression failed; writing uncompressed block");
+		job->block.uncompressed();
+		return;
+	}
+
+	job->block.dataSize(outUsed);
+	job->payload = job->out;
+}
+
+void BlockWriter::writeJob(struct BlockJob *job){
+	if(job->f == NULL){
+		return;
+	}
+
+	job->block.writeBlock(job->f, job->payload);
+	job->header.updateHeader(job->f);
+	job->stats.updateStats(job->f);
+
+	if(job->close){
+		fclose(job->f);
+	}
+}
+
+void BlockWriter::stopThreads(){
+	pthread_mutex_lock(&mutex_);
+	stop_ = true;
+	pthread_cond_broadcast(&queued_);
+	pthread_cond_broadcast(&compressed_);
+	pthread_mutex_unlock(&mutex_);
+
+	for(size_t i = 0; i < threads_.size(); i++){
+		pthread_join(threads_[i], NULL);
+	}
+	threads_.clear();
+
+	if(writerRunning_){
+		pthread_join(writer_, NULL);
+		writerRunning_ = false;
+	}
+}
+
+BlockWriter::~BlockWriter(){
+	/* submitted blocks are written before the threads stop */
+	stopThreads();
+
+	for(size_t i = 0; i < compressors_.size(); i++){
+		delete compressors_[i];
+	}
+	for(size_t i = 0; i < all_.size(); i++){
+		delete[] all_[i]->data;
+		delete[] all_[i]->out;
+		delete all_[i];
+	}
+
+	pthread_mutex_destroy(&mutex_);
+	pthread_cond_destroy(&queued_);
+	pthread_cond_destroy(&compressed_);
+	pthread_cond_destroy(&done_);
+}
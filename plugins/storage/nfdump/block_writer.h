@@ -0,0 +1,155 @@
+/**
+ * \file block_writer.h
+ * \brief Compression and writing of nfdump data blocks
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef BLOCK_WRITER_H_
+#define BLOCK_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "record_map.h"
+
+/* codec of data blocks */
+enum BlockCodec {
+	CODEC_NONE,
+	CODEC_LZO,	/* FLAG_COMPRESSED */
+	CODEC_LZ4,	/* FLAG_LZ4_COMPRESSED */
+	CODEC_ZSTD	/* FLAG_ZSTD_COMPRESSED */
+};
+
+/* compressor of data blocks with its own work memory (one for each thread) */
+class BlockCompressor {
+	enum BlockCodec codec_;
+	/* LZO work memory or zstd context */
+	void *wrkmem_;
+
+	BlockCompressor(const BlockCompressor &);
+	BlockCompressor &operator=(const BlockCompressor &);
+public:
+	BlockCompressor(enum BlockCodec codec);
+	~BlockCompressor();
+	bool valid(){return codec_ == CODEC_NONE || wrkmem_ != NULL;}
+	int compress(const char *in, uint32_t inSize, char *out, uint32_t outSize,
+			uint32_t *outUsed);
+
+	/* is the codec compiled in? */
+	static bool available(enum BlockCodec codec);
+	/* maximal size of compressed block */
+	static uint32_t bound(enum BlockCodec codec, uint32_t size);
+	/* file header flags of the codec */
+	static uint32_t flags(enum BlockCodec codec);
+};
+
+/* data block being filled, compressed or written */
+struct BlockJob {
+	enum {FREE, FILLING, QUEUED, COMPRESSING, COMPRESSED};
+	int state;
+
+	/* output file and snapshot of its headers */
+	FILE *f;
+	class FileHeader header;
+	class Stats stats;
+	class BlockHeader block;
+	/* close the file after the block is written */
+	bool close;
+
+	/* records of the block (buffer_ of NfdumpFile) */
+	char *data;
+	/* compressed block */
+	char *out;
+	/* data block stored to the file (data or out) */
+	const char *payload;
+};
+
+/*
+ * Compresses full blocks by a pool of threads and appends them to their files
+ * by one writer thread in the order of submission. With no threads, blocks
+ * are compressed and written by the caller.
+ */
+class BlockWriter {
+	enum {MAX_IN_FLIGHT_PER_THREAD = 2};
+
+	enum BlockCodec codec_;
+	uint32_t dataSize_;
+	uint32_t outSize_;
+
+	std::vector<class BlockCompressor *> compressors_;
+	size_t nextCompressor_;
+	std::vector<pthread_t> threads_;
+	pthread_t writer_;
+	bool writerRunning_;
+
+	pthread_mutex_t mutex_;
+	pthread_cond_t queued_;		/* a job to compress */
+	pthread_cond_t compressed_;	/* the oldest job is compressed */
+	pthread_cond_t done_;		/* a job was written */
+	bool stop_;
+
+	/* jobs to compress */
+	std::deque<struct BlockJob *> queue_;
+	/* submitted jobs in order of submission */
+	std::deque<struct BlockJob *> pending_;
+	size_t maxPending_;
+	/* unused jobs */
+	std::vector<struct BlockJob *> free_;
+	std::vector<struct BlockJob *> all_;
+
+	static void *compressThread(void *arg);
+	static void *writerThread(void *arg);
+	void compressJob(class BlockCompressor *compressor, struct BlockJob *job);
+	void writeJob(struct BlockJob *job);
+	void stopThreads();
+
+	BlockWriter(const BlockWriter &);
+	BlockWriter &operator=(const BlockWriter &);
+public:
+	BlockWriter();
+	~BlockWriter();
+	int init(enum BlockCodec codec, unsigned int threads, uint32_t blockSize);
+	/* get an empty block to fill */
+	struct BlockJob *getBlock();
+	/* compress and write the block (it can't be used afterwards) */
+	void submit(struct BlockJob *job);
+	/* wait for all submitted blocks to be written */
+	void sync();
+};
+
+#endif /* BLOCK_WRITER_H_ */
@@ -47,6 +47,7 @@
 
 #include "nfstore.h"
 #include "record_map.h"
+#include "block_writer.h"
 
 class templateTable;
 
@@ -73,8 +74,14 @@ struct nfdumpConfig{
 	/* identification string for nffiles*/
 	std::string ident;
 
-	/* lzo compression of records */
-	bool compression;
+	/* compression of blocks of records */
+	enum BlockCodec compression;
+
+	/* number of compression threads (0 = compress by storage thread) */
+	unsigned int compressionThreads;
+
+	/* compresses and writes blocks of all files */
+	class BlockWriter *writer;
 
 	/* time of last flush (used for time based rotation,
 	 * name is based on start of interval not its end!) */
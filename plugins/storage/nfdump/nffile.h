@@ -98,9 +98,13 @@ typedef struct file_header_s {
 #define FLAG_COMPRESSED 	0x1		// flow records are compressed
 #define FLAG_ANONYMIZED 	0x2		// flow data are anonimized 
 #define FLAG_CATALOG		0x4		// has a file catalog record after stat record
+#define FLAG_LZ4_COMPRESSED	0x10	// flow records are LZ4 compressed (nfdump 1.6.x)
+#define FLAG_ZSTD_COMPRESSED	0x20	// flow records are zstd compressed (not readable by nfdump 1.6.x)
 
 									/*
 										0x1 File is compressed with LZO1X-1 compression
+										0x10 File is compressed with LZ4 compression
+										0x20 File is compressed with zstd compression
 									 */
 	uint32_t	NumBlocks;			// number of data blocks in file
 	char		ident[IDENTLEN];	// string identifier for this file
@@ -63,6 +63,7 @@ IPFIXCOL_API_VERSION;
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 #include "pugixml.hpp"
 #include "config_struct.h"
@@ -181,14 +182,33 @@ int processStartupXML(char *params, struct nfdumpConfig* c){
 		}
 
 		tmp=ie.node().child_value("compression");
-		if(tmp == "yes"){
-			c->compression = true;
+		if(tmp == "yes" || tmp == "lzo"){
+			c->compression = CODEC_LZO;
 			if (lzo_init() != LZO_E_OK){
 				MSG_WARNING(MSG_MODULE,"Compression initialization failed (storing without compression)!");
-				c->compression = false;
+				c->compression = CODEC_NONE;
 			}
+		} else if(tmp == "lz4"){
+			c->compression = CODEC_LZ4;
+		} else if(tmp == "zstd"){
+			c->compression = CODEC_ZSTD;
+		} else {
+			c->compression = CODEC_NONE;
+		}
+		if(!BlockCompressor::available(c->compression)){
+			MSG_WARNING(MSG_MODULE,"Compression \"%s\" is not supported by this build (storing without compression)!", tmp.c_str());
+			c->compression = CODEC_NONE;
+		}
+
+		tmp=ie.node().child_value("compressionThreads");
+		if(tmp == ""){
+			c->compressionThreads = 1;
 		} else {
-			c->compression = false;
+			c->compressionThreads = atoi(tmp.c_str());
+			if(c->compressionThreads > MAX_COMPRESSION_THREADS){
+				MSG_WARNING(MSG_MODULE,"Too many compression threads (max %u)", MAX_COMPRESSION_THREADS);
+				c->compressionThreads = MAX_COMPRESSION_THREADS;
+			}
 		}
 
 		ie = doc.select_single_node("fileWriter/dumpInterval");
@@ -244,6 +264,18 @@ int storage_init (char *params, void **config){
 		MSG_ERROR(MSG_MODULE, "Unable to parse configuration xml!");
 		return 1;
 	}
+
+	/* blocks are compressed and written by the writer */
+	c->writer = new BlockWriter();
+	if(c->writer->init(c->compression, c->compressionThreads,
+			std::max(c->bufferSize, (uint) BUFFER_SIZE))){
+		MSG_ERROR(MSG_MODULE, "Unable to initialize block writer!");
+		delete c->writer;
+		delete c->files;
+		delete c;
+		*config = NULL;
+		return 1;
+	}
 	return 0;
 }
 
@@ -295,8 +327,12 @@ int store_packet (void *config,	const struct ipfix_message *ipfix_msg,
 }
 
 extern "C"
-int store_now (const void *){
+int store_now (const void *config){
 	MSG_DEBUG(MSG_MODULE,"STORE_NOW");
+	struct nfdumpConfig *conf = (struct nfdumpConfig *) config;
+
+	/* wait for blocks being compressed and written */
+	conf->writer->sync();
 	return 0;
 }
 
@@ -312,6 +348,8 @@ int storage_close (void **config){
 		delete files_it->second;
 	}
 
+	/* write the last blocks and close the files */
+	delete conf->writer;
 	delete conf->files;
 	delete conf;
 
@@ -43,6 +43,9 @@
 /* default buffer size */
 #define BUFFER_SIZE 512000
 
+/* maximal number of compression threads */
+#define MAX_COMPRESSION_THREADS 64
+
 /* Identifier to MSG_* macros */
 #define MSG_MODULE "nfdump storage"
 
@@ -52,20 +52,14 @@ extern "C" {
 #include "record_map.h"
 #include "nfstore.h"
 #include "nffile.h"
-
-#include <lzo/lzoconf.h>
-#include <lzo/lzo1x.h>
-
-static lzo_align_t __LZO_MMODEL wrkmem[LZO1X_1_MEM_COMPRESS];
+#include "block_writer.h"
 
 void FileHeader::newHeader(FILE *f, struct nfdumpConfig* conf){
 	header_.magic = MAGIC;
 	header_.version = LAYOUT_VERSION_1;
 	header_.flags = 0;
 	header_.NumBlocks = 0;
-	if(conf->compression){
-		header_.flags = header_.flags | FLAG_COMPRESSED;
-	}
+	header_.flags = header_.flags | BlockCompressor::flags(conf->compression);
 	memset(header_.ident,0,IDENTLEN);
 	strncpy(header_.ident,conf->ident.c_str(), IDENTLEN-1);
 	position_ = ftell(f);
@@ -147,49 +141,27 @@ void Stats::increaseSQFail(){
 }
 
 
-void BlockHeader::newBlock(FILE *f){
+void BlockHeader::newBlock(){
 	block_.NumRecords = 0;
 	block_.size = 0;
 	block_.id = 2;
-	position_ = ftell(f);
-	updateBlock(f);
+	block_.flags = 0;
 }
 
-void BlockHeader::updateBlock(FILE *f){
-	//seek block header
-	if((fseek(f, position_, SEEK_SET)) != 0){
-		MSG_ERROR(MSG_MODULE,"Can't update block header");
+void BlockHeader::writeBlock(FILE *f, const char *data){
+	//blocks are appended to the file
+	if((fseek(f, 0, SEEK_END)) != 0){
+		MSG_ERROR(MSG_MODULE,"Can't write block");
 	}
 	//write block header
 	if((fwrite(&block_,1,sizeof(struct data_block_header_s),f))
 			!= sizeof(struct data_block_header_s)){
-		MSG_ERROR(MSG_MODULE,"Can't update block header");
+		MSG_ERROR(MSG_MODULE,"Can't write block header");
 	}
-}
-
-
-
-void BlockHeader::compress(char *buffer, uint *bufferUsed){ //TODO
-	lzo_uint iSize,oSize;
-	unsigned char __LZO_MMODEL *input;
-	unsigned char __LZO_MMODEL *output;
-
-	char *ibuff;
-
-	ibuff = new char[block_.size];
-	memcpy(ibuff,buffer,block_.size);
-
-	input = (unsigned char __LZO_MMODEL *) ibuff;
-	iSize = block_.size;
-	output = (unsigned char __LZO_MMODEL *) buffer;
-	oSize = 0;
-	if(lzo1x_1_compress(input,iSize,output,&oSize,wrkmem) != LZO_E_OK){
-		MSG_ERROR(MSG_MODULE,"Compression failed");
+	//write block data
+	if((fwrite(data,1,block_.size,f)) != block_.size){
+		MSG_ERROR(MSG_MODULE,"Can't write block");
 	}
-	*bufferUsed = oSize;
-	block_.size = oSize;
-	delete[] ibuff;
-	//TODO ret val
 }
 
 
@@ -205,7 +177,7 @@ int NfdumpFile::newFile(std::string name, struct nfdumpConfig* conf){
 	//create stats
 	stats_.newStats(f_);
 	fileHeader_.increaseBlockCnt();
-	currentBlock_.newBlock(f_);
+	currentBlock_.newBlock();
 
 	extMaps_ = new std::map<uint16_t,RecordMap*>;
 	if(extMaps_ == NULL){
@@ -213,47 +185,36 @@ int NfdumpFile::newFile(std::string name, struct nfdumpConfig* conf){
 		return -1;
 	}
 
+	//records are stored directly to the data of the next block
+	writer_ = conf->writer;
+	job_ = writer_->getBlock();
 	bufferSize_ = conf->bufferSize;
 	bufferUsed_ = 0;
-	buffer_ = new char[BUFFER_SIZE];
-
-	if(buffer_ == NULL){
-		MSG_ERROR(MSG_MODULE,"Can't allocate memory");
-		return -1;
-	}
+	buffer_ = job_->data;
 	return 0;
 }
 
-void NfdumpFile::updateFile(bool compression){
-	uint check;
-
+void NfdumpFile::flushBlock(bool close){
 	if(f_ == NULL){
 		MSG_ERROR(MSG_MODULE,"Can't update file");
 		bufferUsed_ = 0;
 		return;
 	}
-	//update file header
-	fileHeader_.updateHeader(f_);
-	//update stats
-	stats_.updateStats(f_);
-	//update last block header
 
+	//the block is written with the current headers of the file
+	job_->f = f_;
+	job_->close = close;
+	job_->header = fileHeader_;
+	job_->stats = stats_;
+	job_->block = currentBlock_;
+	writer_->submit(job_);
 
-	if(compression){
-		currentBlock_.compress(buffer_, &bufferUsed_);
-		currentBlock_.updateBlock(f_);
+	if(close){
+		job_ = NULL;
+		buffer_ = NULL;
 	}else{
-		currentBlock_.updateBlock(f_);
-	}
-
-	//flush data from buffer
-	check = fseek(f_, 0, SEEK_END);
-	if(check != 0){
-		MSG_ERROR(MSG_MODULE,"Can't update file");
-	}
-	check = fwrite(buffer_,1,bufferUsed_,f_);
-	if(check != bufferUsed_){
-		MSG_ERROR(MSG_MODULE,"Can't update file");
+		job_ = writer_->getBlock();
+		buffer_ = job_->data;
 	}
 	bufferUsed_ = 0;
 }
@@ -300,9 +261,9 @@ NfdumpFile::bufferPtk(const data_template_couple *dtcouple){
 		/* flush data if there is no space in buffers */
 		if(bufferSize_ <= bufferUsed_ + ext_map_it->second->maxSize()){
 			std::map<uint16_t,RecordMap*>::iterator maps_it;
-			updateFile(fileHeader_.compressed());
+			flushBlock();
 			fileHeader_.increaseBlockCnt();
-			currentBlock_.newBlock(f_);
+			currentBlock_.newBlock();
 			//for(maps_it = _ext_maps->begin(); maps_it!=_ext_maps->end();maps_it++){
 			//	maps_it->second->clean_metadata();
 			//}
@@ -343,15 +304,14 @@ void NfdumpFile::closeFile(){
 		return;
 	}
 
-	updateFile(fileHeader_.compressed());
-	fclose(f_);
-
+	//the file is closed by the writer
+	flushBlock(true);
+	f_ = NULL;
 
 	for(maps_it = extMaps_->begin(); maps_it!=extMaps_->end();maps_it++){
 		delete maps_it->second;
 	}
 	delete extMaps_;
-	delete[] buffer_;
 }
 
 RecordMap::RecordMap() {
@@ -47,8 +47,8 @@
 #include <string>
 #include <map>
 
-
-
+class BlockWriter;
+struct BlockJob;
 
 struct FlowStats{
 
@@ -80,14 +80,15 @@ public:
 class BlockHeader {
 	enum{HEADER_SIZE=12,MAX_SIZE=500/*MAX_SIZE=4294967295*/};
 	struct data_block_header_s block_;
-	long position_;
 public:
 	uint size(){return HEADER_SIZE;}
 	void increaseRecordsCnt(){block_.NumRecords++;}
 	void addRecordSize(uint32_t size){block_.size+=size;}
-	void newBlock(FILE *f);
-	void compress(char *buffer, uint *bufferUsed);
-	void updateBlock(FILE *f);
+	uint32_t dataSize(){return block_.size;}
+	void dataSize(uint32_t size){block_.size = size;}
+	void uncompressed(){block_.flags = 1;}
+	void newBlock();
+	void writeBlock(FILE *f, const char *data);
 };
 
 class FileHeader{
@@ -95,7 +96,6 @@ class FileHeader{
 	long position_;
 public:
 	uint size(){return sizeof(struct file_header_s);}
-	bool compressed(){return header_.flags & FLAG_COMPRESSED;}
 	void increaseBlockCnt(){header_.NumBlocks++;};
 	void newHeader(FILE *f, struct nfdumpConfig* conf);
 	void updateHeader(FILE *f);
@@ -144,6 +144,10 @@ class NfdumpFile{
 	std::map<uint16_t,RecordMap*> *extMaps_;
 	unsigned int nextSQ_;
 
+	/* compresses and writes full blocks */
+	class BlockWriter *writer_;
+	/* block being filled (buffer_ is its data) */
+	struct BlockJob *job_;
 	char *buffer_;
 	/* buffer allocated size */
 	unsigned int bufferSize_;
@@ -151,7 +155,7 @@ class NfdumpFile{
 	unsigned int bufferUsed_;
 public:
 	int newFile(std::string name, struct nfdumpConfig* conf);
-	void updateFile(bool compression = false);
+	void flushBlock(bool close = false);
 	unsigned int bufferPtk(const struct data_template_couple dtcouple[]);
 	void checkSQNumber(unsigned int SQ, unsigned int recFlows);
 	void closeFile();
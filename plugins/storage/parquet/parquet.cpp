@@ -0,0 +1,426 @@
+/**
+ * \file parquet.cpp
+ * \brief Columnar (Apache Parquet / Arrow IPC) storage plugin
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+extern "C" {
+	#include <ipfixcol/storage.h>
+	#include <ipfixcol/verbose.h>
+
+	/* API version constant */
+	IPFIXCOL_API_VERSION;
+}
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <limits.h>
+
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <arrow/util/compression.h>
+
+#include "pugixml.hpp"
+#include "parquet.h"
+#include "parquet_table.h"
+
+/** Supported compression methods */
+static const struct {
+	const char *name;
+	arrow::Compression::type type;
+	bool parquet;   /**< Supported by Parquet files */
+	bool arrow;     /**< Supported by Arrow IPC streams */
+} compressions[] = {
+	{"none",   arrow::Compression::UNCOMPRESSED, true,  true},
+	{"snappy", arrow::Compression::SNAPPY,       true,  false},
+	{"gzip",   arrow::Compression::GZIP,         true,  false},
+	{"brotli", arrow::Compression::BROTLI,       true,  false},
+	{"zstd",   arrow::Compression::ZSTD,         true,  true},
+	{"lz4",    arrow::Compression::LZ4_FRAME,    false, true},
+};
+
+static void ipv6_addr_non_canonical(char *str, const struct in6_addr *addr)
+{
+	for (int i = 0; i < 16; ++i) {
+		sprintf(str + 2 * i, "%02x", addr->s6_addr[i]);
+	}
+}
+
+static std::string generate_path(struct parquet_config *config,
+		const std::string &exporter_ip_addr, uint32_t odid)
+{
+	struct tm *timeinfo = localtime(&(config->last_flush));
+	const int ft_size = 1000;
+	char formated_time[ft_size];
+	std::string path;
+
+	std::stringstream ss;
+	ss << odid;
+	std::string odid_str = ss.str();
+
+	strftime(formated_time, ft_size, (config->sys_dir).c_str(), timeinfo);
+	path = std::string(formated_time);
+
+	size_t pos = 0;
+	while ((pos = path.find("%E", pos)) != std::string::npos) {
+		path.replace(pos, 2, exporter_ip_addr);
+	}
+
+	pos = 0;
+	while ((pos = path.find("%o", pos)) != std::string::npos) {
+		path.replace(pos, 2, odid_str);
+	}
+
+	path += config->window_dir;
+	return path;
+}
+
+/**
+ * \brief Update name of the window directory (same naming as the FastBit plugin)
+ *
+ * \param[in,out] conf Plugin configuration
+ */
+static void update_window_name(struct parquet_config *conf)
+{
+	/* Change window directory name */
+	if (conf->dump_name == PREFIX) {
+		conf->window_dir = conf->prefix + "/";
+	} else if (conf->dump_name == INCREMENTAL) {
+		std::stringstream ss;
+		ss << std::setw(12) << std::setfill('0') << conf->flushed;
+		conf->window_dir = conf->prefix + ss.str() + "/";
+		conf->flushed++;
+	} else {
+		char formated_time[17];
+		struct tm *timeinfo = localtime(&(conf->last_flush));
+		strftime(formated_time, 17, "%Y%m%d%H%M%S", timeinfo);
+		conf->window_dir = conf->prefix + std::string(formated_time) + "/";
+	}
+}
+
+/**
+ * \brief Close files of all templates of all exporters and ODIDs
+ *
+ * @param conf Plugin configuration
+ */
+static void close_all_files(struct parquet_config *conf)
+{
+	std::map<std::string, std::map<uint32_t, od_info> >::iterator exporter_it;
+	std::map<uint32_t, od_info>::iterator odid_it;
+	std::map<uint16_t, parquet_table*>::iterator table;
+
+	for (exporter_it = conf->od_infos.begin(); exporter_it != conf->od_infos.end(); ++exporter_it) {
+		for (odid_it = exporter_it->second.begin(); odid_it != exporter_it->second.end(); ++odid_it) {
+			std::map<uint16_t, parquet_table*> &templates = odid_it->second.template_info;
+			for (table = templates.begin(); table != templates.end(); ++table) {
+				table->second->close();
+			}
+		}
+	}
+}
+
+static int process_startup_xml(char *params, struct parquet_config *c)
+{
+	std::string path, format, compression, dictionary, batch, time_alignment, name_type;
+	pugi::xml_document doc;
+	doc.load(params);
+
+	if (!doc) {
+		return 1;
+	}
+
+	pugi::xpath_node ie = doc.select_single_node("fileWriter");
+	path = ie.node().child_value("path");
+	if (path.empty()) {
+		MSG_ERROR(msg_module, "Storage path is not specified");
+		return 1;
+	}
+
+	/* Make sure path ends with '/' character */
+	if (path.at(path.size() - 1) != '/') {
+		c->sys_dir = path + "/";
+	} else {
+		c->sys_dir = path;
+	}
+
+	format = ie.node().child_value("fileFormat");
+	if (format.empty() || format == "parquet") {
+		c->format = FORMAT_PARQUET;
+	} else if (format == "arrow") {
+		c->format = FORMAT_ARROW;
+	} else {
+		MSG_ERROR(msg_module, "Unknown file format '%s'", format.c_str());
+		return 1;
+	}
+
+	compression = ie.node().child_value("compression");
+	if (compression.empty()) {
+		compression = "zstd";
+	}
+
+	size_t i;
+	size_t cnt = sizeof(compressions) / sizeof(compressions[0]);
+	for (i = 0; i < cnt; ++i) {
+		if (compression == compressions[i].name) {
+			break;
+		}
+	}
+
+	if (i == cnt || (c->format == FORMAT_PARQUET && !compressions[i].parquet) ||
+			(c->format == FORMAT_ARROW && !compressions[i].arrow)) {
+		MSG_ERROR(msg_module, "Compression '%s' is not supported by the '%s' format",
+				compression.c_str(), c->format == FORMAT_PARQUET ? "parquet" : "arrow");
+		return 1;
+	}
+
+	if (!arrow::util::Codec::IsAvailable(compressions[i].type)) {
+		MSG_ERROR(msg_module, "Compression '%s' is not available in the Arrow library",
+				compression.c_str());
+		return 1;
+	}
+
+	c->compression = compressions[i].type;
+
+	dictionary = ie.node().child_value("dictionary");
+	c->dictionary = (dictionary != "no");
+
+	batch = ie.node().child_value("batchSize");
+	c->batch_rows = batch.empty() ? DEF_BATCH_ROWS : strtoi(batch.c_str(), 10);
+	if (c->batch_rows == 0 || c->batch_rows == INT_MAX) {
+		MSG_ERROR(msg_module, "Invalid batch size '%s'", batch.c_str());
+		return 1;
+	}
+
+	ie = doc.select_single_node("fileWriter/dumpInterval");
+	c->time_window = atoi(ie.node().child_value("timeWindow"));
+	c->records_window = atoi(ie.node().child_value("recordLimit"));
+	time_alignment = ie.node().child_value("timeAlignment");
+
+	ie = doc.select_single_node("fileWriter/namingStrategy");
+	c->prefix = ie.node().child_value("prefix");
+
+	time(&(c->last_flush));
+	c->flushed = 1;
+
+	name_type = ie.node().child_value("type");
+	if (name_type == "incremental") {
+		c->dump_name = INCREMENTAL;
+	} else if (name_type == "prefix") {
+		c->dump_name = PREFIX;
+		if (c->prefix == "") {
+			c->prefix = "parquetfiles";
+		}
+	} else {
+		c->dump_name = TIME;
+		if (time_alignment == "yes" && c->time_window > 0) {
+			/* operators '/' and '*' are used for round down time to time window */
+			c->last_flush = ((c->last_flush / c->time_window) * c->time_window);
+		}
+	}
+
+	update_window_name(c);
+	return 0;
+}
+
+extern "C"
+int storage_init(char *params, void **config)
+{
+	MSG_DEBUG(msg_module, "Parquet plugin: initialization");
+
+	/* Create config structure */
+	struct parquet_config *c = new (std::nothrow) struct parquet_config;
+	if (c == NULL) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	c->records = 0;
+
+	/* Parse configuration xml and updated configure structure according to it */
+	if (process_startup_xml(params, c)) {
+		MSG_ERROR(msg_module, "Unable to parse plugin configuration");
+		delete c;
+		return 1;
+	}
+
+	*config = c;
+	return 0;
+}
+
+extern "C"
+int store_packet(void *config, const struct ipfix_message *ipfix_msg,
+		const struct ipfix_template_mgr *template_mgr)
+{
+	(void) template_mgr;
+	struct parquet_config *conf = (struct parquet_config *) config;
+	std::map<uint16_t, parquet_table*>::iterator table;
+
+	uint32_t odid = ntohl(ipfix_msg->pkt_header->observation_domain_id);
+	struct input_info_network *input = (struct input_info_network *) ipfix_msg->input_info;
+
+	char exporter_ip_addr_tmp[INET6_ADDRSTRLEN];
+	if (input->l3_proto == 6) { /* IPv6 */
+		ipv6_addr_non_canonical(exporter_ip_addr_tmp, &(input->src_addr.ipv6));
+	} else { /* IPv4 */
+		inet_ntop(AF_INET, &(input->src_addr.ipv4.s_addr), exporter_ip_addr_tmp, INET_ADDRSTRLEN);
+	}
+
+	std::string exporter_ip_addr(exporter_ip_addr_tmp);
+	std::map<uint32_t, od_info> &odids = conf->od_infos[exporter_ip_addr];
+
+	/* Find ODID (under exporter) */
+	std::map<uint32_t, od_info>::iterator odid_it = odids.find(odid);
+	if (odid_it == odids.end()) {
+		MSG_INFO(msg_module, "Received new ODID for exporter %s: %u", exporter_ip_addr.c_str(), odid);
+		odid_it = odids.insert(std::make_pair(odid, od_info())).first;
+		odid_it->second.path = generate_path(conf, exporter_ip_addr, odid);
+	}
+
+	std::map<uint16_t, parquet_table*> &templates = odid_it->second.template_info;
+
+	/* Process all datasets in message */
+	for (int i = 0; i < MSG_MAX_DATA_COUPLES && ipfix_msg->data_couple[i].data_set; i++) {
+		struct ipfix_template *tmpl = ipfix_msg->data_couple[i].data_template;
+		if (tmpl == NULL) {
+			/* Skip data couples without templates */
+			continue;
+		}
+
+		/* Check whether the window has to be rotated before storing data records */
+		bool flush_records = conf->records_window > 0 &&
+				conf->records > (uint64_t) conf->records_window;
+		bool flush_time = false;
+		time_t now;
+		if (conf->time_window > 0) {
+			time(&now);
+			flush_time = difftime(now, conf->last_flush) > conf->time_window;
+		}
+
+		if (flush_records || flush_time) {
+			close_all_files(conf);
+
+			/* Time management differs between flush policies (records vs. time) */
+			if (flush_records) {
+				time(&(conf->last_flush));
+			} else {
+				while (difftime(now, conf->last_flush) > conf->time_window) {
+					conf->last_flush = conf->last_flush + conf->time_window;
+				}
+			}
+
+			/* Update window name and paths */
+			update_window_name(conf);
+			std::map<std::string, std::map<uint32_t, od_info> >::iterator exp_it;
+			std::map<uint32_t, od_info>::iterator od_it;
+			for (exp_it = conf->od_infos.begin(); exp_it != conf->od_infos.end(); ++exp_it) {
+				for (od_it = exp_it->second.begin(); od_it != exp_it->second.end(); ++od_it) {
+					od_it->second.path = generate_path(conf, exp_it->first, od_it->first);
+				}
+			}
+
+			conf->records = 0;
+		}
+
+		uint16_t template_id = tmpl->template_id;
+		table = templates.find(template_id);
+
+		/* On reception of a new template it is crucial to start a new file */
+		if (table != templates.end() &&
+				tmpl->first_transmission > table->second->get_first_transmission()) {
+			MSG_DEBUG(msg_module, "Received new template with already used template ID: %hu", template_id);
+			delete table->second;
+			templates.erase(table);
+			table = templates.end();
+		}
+
+		if (table == templates.end()) {
+			MSG_DEBUG(msg_module, "Received new template: %hu", template_id);
+			parquet_table *table_tmp = new parquet_table(template_id, conf);
+			if (table_tmp->parse_template(tmpl) != 0) {
+				/* Template cannot be parsed, skip data set */
+				delete table_tmp;
+				continue;
+			}
+
+			table = templates.insert(std::make_pair(template_id, table_tmp)).first;
+		}
+
+		/* Store data records */
+		int rc_flows = table->second->store(ipfix_msg->data_couple[i].data_set,
+				odid_it->second.path);
+		if (rc_flows > 0) {
+			conf->records += rc_flows;
+		}
+	}
+
+	return 0;
+}
+
+extern "C"
+int store_now(const void *config)
+{
+	(void) config;
+	return 0;
+}
+
+extern "C"
+int storage_close(void **config)
+{
+	struct parquet_config *conf = (struct parquet_config *) (*config);
+
+	std::map<std::string, std::map<uint32_t, od_info> >::iterator exporter_it;
+	std::map<uint32_t, od_info>::iterator odid_it;
+	std::map<uint16_t, parquet_table*>::iterator table;
+
+	/* Write remaining records and release templates */
+	for (exporter_it = conf->od_infos.begin(); exporter_it != conf->od_infos.end(); ++exporter_it) {
+		for (odid_it = exporter_it->second.begin(); odid_it != exporter_it->second.end(); ++odid_it) {
+			std::map<uint16_t, parquet_table*> &templates = odid_it->second.template_info;
+			for (table = templates.begin(); table != templates.end(); ++table) {
+				delete table->second;
+			}
+		}
+	}
+
+	delete conf;
+	*config = NULL;
+	return 0;
+}
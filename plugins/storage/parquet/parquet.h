@@ -0,0 +1,132 @@
+/**
+ * \file parquet.h
+ * \brief Columnar (Apache Parquet / Arrow IPC) storage plugin (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PARQUET_H_
+#define PARQUET_H_
+
+/* Get defines from configure */
+#ifdef HAVE_CONFIG_H
+	#include <config.h>
+#endif
+
+extern "C" {
+	#include <ipfixcol.h>
+}
+
+#include <map>
+#include <string>
+#include <arrow/api.h>
+
+/** Identifier to MSG_* macros */
+#define msg_module "parquet storage"
+
+/* Default number of rows of a record batch (row group) */
+const uint32_t DEF_BATCH_ROWS = 65536;
+
+/* File name strategies (same as in the FastBit plugin) */
+enum name_type { TIME, INCREMENTAL, PREFIX };
+
+/* Output formats */
+enum out_format { FORMAT_PARQUET, FORMAT_ARROW };
+
+class parquet_table;
+
+/* Data structure for holding information about observation domain (OD) */
+struct od_info {
+	/* parquet_table by template ID */
+	std::map<uint16_t, parquet_table*> template_info;
+
+	/* Directory for storing data for this observation domain */
+	std::string path;
+};
+
+struct parquet_config {
+	/* Stores information on templates per flow data source (identified by
+	 * exporter IP address and ODID).
+	 */
+	std::map<std::string, /* Exporter IP address */
+			std::map<uint32_t, /* ODID */
+					struct od_info> > od_infos;
+
+	/* Output format */
+	enum out_format format;
+
+	/* Compression of column chunks (Parquet) or record batches (Arrow) */
+	arrow::Compression::type compression;
+
+	/* Dictionary encoding of columns (Parquet only) */
+	bool dictionary;
+
+	/* Number of rows of a record batch / row group */
+	uint32_t batch_rows;
+
+	/* Specifies time interval for storage directory rotation
+	 * (0 = no time based rotation)
+	 */
+	int time_window;
+
+	/* Specifies record count for storage directory rotation
+	 * (0 = no record based rotation)
+	 */
+	int records_window;
+
+	/* Holds type of name strategy for storage directory rotation */
+	enum name_type dump_name;
+
+	/* Path to directory where should be storage directory flushed */
+	std::string sys_dir;
+
+	/* Current window directory */
+	std::string window_dir;
+
+	/* User prefix for storage directory */
+	std::string prefix;
+
+	/* Time of last flush, used for time based rotation.
+	 * Name is based on start of interval, not its end.
+	 */
+	time_t last_flush;
+
+	/* Number of records in the current window */
+	uint64_t records;
+
+	/* Counter of the incremental naming strategy */
+	int flushed;
+};
+
+#endif /* PARQUET_H_ */
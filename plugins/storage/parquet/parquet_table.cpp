@@ -0,0 +1,592 @@
+/**
+ * \file parquet_table.cpp
+ * \brief Columnar table of records of one template
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+extern "C" {
+	#include <ipfixcol/verbose.h>
+}
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include <arrow/util/compression.h>
+
+#include "parquet_table.h"
+
+/** Seconds between the NTP epoch (1900) and the UNIX epoch (1970) */
+#define NTP_EPOCH_OFFSET (2208988800ULL)
+
+/**
+ * \brief Read an unsigned integer in network byte order (reduced-size
+ * encoding is allowed)
+ */
+static inline uint64_t read_uint(const uint8_t *data, uint16_t size)
+{
+	uint64_t value = 0;
+	for (uint16_t i = 0; i < size; ++i) {
+		value = (value << 8) | data[i];
+	}
+
+	return value;
+}
+
+/**
+ * \brief Create a directory including all its parents
+ * \return 0 on success, otherwise -1
+ */
+static int mkdir_recursive(const std::string &path)
+{
+	size_t pos = 0;
+	while ((pos = path.find('/', pos + 1)) != std::string::npos) {
+		std::string dir = path.substr(0, pos);
+		if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+			MSG_ERROR(msg_module, "Cannot create directory '%s' (%s)", dir.c_str(),
+					strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+parquet_table::parquet_table(uint16_t template_id, const struct parquet_config *config):
+	_template_id(template_id), _config(config), _first_transmission(0),
+	_generation(0), _min_record_size(0), _rows(0)
+{
+}
+
+parquet_table::~parquet_table()
+{
+	close();
+}
+
+int parquet_table::add_column(const ipfix_element_t *elem, uint32_t en, uint16_t id,
+		uint16_t length, std::vector<std::shared_ptr<arrow::Field> > &fields)
+{
+	column col;
+	col.length = length;
+	col.width = 0;
+
+	std::shared_ptr<arrow::DataType> type;
+	int elem_type = elem ? elem->type : ET_UNASSIGNED;
+
+	switch (elem_type) {
+	case ET_UNSIGNED_8:
+		col.conv = CONV_UINT; col.width = 1; type = arrow::uint8();
+		break;
+	case ET_UNSIGNED_16:
+		col.conv = CONV_UINT; col.width = 2; type = arrow::uint16();
+		break;
+	case ET_UNSIGNED_32:
+	case ET_IPV4_ADDRESS:
+		col.conv = CONV_UINT; col.width = 4; type = arrow::uint32();
+		break;
+	case ET_UNSIGNED_64:
+		col.conv = CONV_UINT; col.width = 8; type = arrow::uint64();
+		break;
+	case ET_SIGNED_8:
+		col.conv = CONV_SINT; col.width = 1; type = arrow::int8();
+		break;
+	case ET_SIGNED_16:
+		col.conv = CONV_SINT; col.width = 2; type = arrow::int16();
+		break;
+	case ET_SIGNED_32:
+		col.conv = CONV_SINT; col.width = 4; type = arrow::int32();
+		break;
+	case ET_SIGNED_64:
+		col.conv = CONV_SINT; col.width = 8; type = arrow::int64();
+		break;
+	case ET_FLOAT_32:
+		col.conv = CONV_FLOAT32; col.width = 4; type = arrow::float32();
+		break;
+	case ET_FLOAT_64:
+		col.conv = CONV_FLOAT64; col.width = 8; type = arrow::float64();
+		break;
+	case ET_BOOLEAN:
+		col.conv = CONV_BOOL; col.width = 1; type = arrow::boolean();
+		break;
+	case ET_DATE_TIME_SECONDS:
+		col.conv = CONV_TS; col.width = 4;
+		type = arrow::timestamp(arrow::TimeUnit::SECOND, "UTC");
+		break;
+	case ET_DATE_TIME_MILLISECONDS:
+		col.conv = CONV_TS; col.width = 8;
+		type = arrow::timestamp(arrow::TimeUnit::MILLI, "UTC");
+		break;
+	case ET_DATE_TIME_MICROSECONDS:
+		col.conv = CONV_TS_NTP_USEC; col.width = 8;
+		type = arrow::timestamp(arrow::TimeUnit::MICRO, "UTC");
+		break;
+	case ET_DATE_TIME_NANOSECONDS:
+		col.conv = CONV_TS_NTP_NSEC; col.width = 8;
+		type = arrow::timestamp(arrow::TimeUnit::NANO, "UTC");
+		break;
+	case ET_IPV6_ADDRESS:
+		col.conv = CONV_FIXED; col.width = 16; type = arrow::fixed_size_binary(16);
+		break;
+	case ET_MAC_ADDRESS:
+		col.conv = CONV_FIXED; col.width = 6; type = arrow::fixed_size_binary(6);
+		break;
+	case ET_STRING:
+		col.conv = CONV_STRING; type = arrow::utf8();
+		break;
+	default:
+		/* Octet arrays, structured data and unknown elements */
+		col.conv = CONV_BINARY; type = arrow::binary();
+		break;
+	}
+
+	/* Values that do not match the type are stored as they are */
+	bool valid = true;
+	switch (col.conv) {
+	case CONV_UINT:
+	case CONV_SINT:
+	case CONV_TS:
+		valid = (length <= col.width);
+		break;
+	case CONV_FLOAT64:
+		valid = (length == 4 || length == 8);
+		break;
+	case CONV_FLOAT32:
+	case CONV_BOOL:
+	case CONV_TS_NTP_USEC:
+	case CONV_TS_NTP_NSEC:
+	case CONV_FIXED:
+		valid = (length == col.width);
+		break;
+	default:
+		break;
+	}
+
+	if (!valid) {
+		MSG_WARNING(msg_module, "Element e%uid%u has unexpected size %u; stored as binary",
+				en, id, length);
+		col.conv = CONV_BINARY;
+		type = arrow::binary();
+	}
+
+	/* Column name */
+	std::string name;
+	if (elem) {
+		name = elem->name;
+	} else {
+		std::stringstream ss;
+		ss << "e" << en << "id" << id;
+		name = ss.str();
+	}
+
+	/* Check that this column does not already exist */
+	for (size_t i = 0; i < fields.size(); ++i) {
+		if (fields[i]->name() == name) {
+			MSG_DEBUG(msg_module, "Template %hu: duplicate element '%s' is not stored",
+					_template_id, name.c_str());
+			col.conv = CONV_SKIP;
+			_columns.push_back(col);
+			return 0;
+		}
+	}
+
+	arrow::Result<std::unique_ptr<arrow::ArrayBuilder> > builder = arrow::MakeBuilder(type);
+	if (!builder.ok()) {
+		MSG_ERROR(msg_module, "Unable to create a column builder: %s",
+				builder.status().ToString().c_str());
+		return 1;
+	}
+
+	col.builder = std::move(builder).ValueUnsafe();
+	_columns.push_back(col);
+	fields.push_back(arrow::field(name, type));
+	return 0;
+}
+
+int parquet_table::parse_template(const struct ipfix_template *tmp)
+{
+	/* We don't want to parse option tables ect., so check it */
+	if (tmp->template_type != TM_TEMPLATE) {
+		MSG_WARNING(msg_module, "Received Options Template; skipping data...");
+		return 1;
+	}
+
+	_first_transmission = tmp->first_transmission;
+	std::vector<std::shared_ptr<arrow::Field> > fields;
+
+	/* Enterprise numbers occupy extra items of the field array */
+	for (int i = 0, cnt = 0; cnt < tmp->field_count; ++i, ++cnt) {
+		const template_ie *field = &(tmp->fields[i]);
+		uint16_t id = field->ie.id & 0x7FFF;
+		uint16_t length = field->ie.length;
+
+		/* Is this an enterprise element? */
+		uint32_t en = 0;
+		if (field->ie.id & 0x8000) {
+			en = tmp->fields[++i].enterprise_number;
+		}
+
+		_min_record_size += (length == VAR_IE_LENGTH) ? 1 : length;
+		if (add_column(get_element_by_id(id, en), en, id, length, fields) != 0) {
+			return 1;
+		}
+	}
+
+	if (_columns.empty()) {
+		MSG_WARNING(msg_module, "Template %hu has no fields; skipping data...", _template_id);
+		return 1;
+	}
+
+	_schema = arrow::schema(fields);
+	_values.resize(_columns.size());
+	return 0;
+}
+
+arrow::Status parquet_table::reserve(column &col, uint16_t size)
+{
+	if (col.conv == CONV_SKIP) {
+		return arrow::Status::OK();
+	}
+
+	ARROW_RETURN_NOT_OK(col.builder->Reserve(1));
+	if (col.conv == CONV_STRING || col.conv == CONV_BINARY) {
+		/* StringBuilder is derived from BinaryBuilder */
+		return static_cast<arrow::BinaryBuilder *>(col.builder.get())->ReserveData(size);
+	}
+
+	return arrow::Status::OK();
+}
+
+arrow::Status parquet_table::append(column &col, const uint8_t *data, uint16_t size)
+{
+	arrow::ArrayBuilder *builder = col.builder.get();
+
+	switch (col.conv) {
+	case CONV_UINT: {
+		uint64_t value = read_uint(data, size);
+		switch (col.width) {
+		case 1: return static_cast<arrow::UInt8Builder *>(builder)->Append(value);
+		case 2: return static_cast<arrow::UInt16Builder *>(builder)->Append(value);
+		case 4: return static_cast<arrow::UInt32Builder *>(builder)->Append(value);
+		default: return static_cast<arrow::UInt64Builder *>(builder)->Append(value);
+		}
+	}
+	case CONV_SINT: {
+		/* Sign extension of reduced-size values */
+		uint64_t value = read_uint(data, size);
+		if (size > 0 && size < 8 && (data[0] & 0x80)) {
+			value |= ~((uint64_t) 0) << (size * 8);
+		}
+
+		switch (col.width) {
+		case 1: return static_cast<arrow::Int8Builder *>(builder)->Append(value);
+		case 2: return static_cast<arrow::Int16Builder *>(builder)->Append(value);
+		case 4: return static_cast<arrow::Int32Builder *>(builder)->Append(value);
+		default: return static_cast<arrow::Int64Builder *>(builder)->Append(value);
+		}
+	}
+	case CONV_FLOAT32: {
+		uint32_t raw = ntohl(*(const uint32_t *) data);
+		float value;
+		memcpy(&value, &raw, sizeof(value));
+		return static_cast<arrow::FloatBuilder *>(builder)->Append(value);
+	}
+	case CONV_FLOAT64: {
+		double value;
+		if (size == 4) { /* Reduced-size encoding */
+			uint32_t raw = ntohl(*(const uint32_t *) data);
+			float value32;
+			memcpy(&value32, &raw, sizeof(value32));
+			value = value32;
+		} else {
+			uint64_t raw = be64toh(*(const uint64_t *) data);
+			memcpy(&value, &raw, sizeof(value));
+		}
+
+		return static_cast<arrow::DoubleBuilder *>(builder)->Append(value);
+	}
+	case CONV_BOOL:
+		return static_cast<arrow::BooleanBuilder *>(builder)->Append(data[0] == 1);
+	case CONV_TS:
+		return static_cast<arrow::TimestampBuilder *>(builder)->Append(
+				read_uint(data, size));
+	case CONV_TS_NTP_USEC:
+	case CONV_TS_NTP_NSEC: {
+		uint64_t sec = ntohl(*(const uint32_t *) data) - NTP_EPOCH_OFFSET;
+		uint64_t frac = ntohl(*(const uint32_t *) (data + 4));
+		uint64_t units = (col.conv == CONV_TS_NTP_USEC) ? 1000000ULL : 1000000000ULL;
+		int64_t value = sec * units + ((frac * units) >> 32);
+		return static_cast<arrow::TimestampBuilder *>(builder)->Append(value);
+	}
+	case CONV_FIXED:
+		return static_cast<arrow::FixedSizeBinaryBuilder *>(builder)->Append(data);
+	case CONV_STRING:
+		/* Drop trailing zeros of fixed-length strings */
+		while (size > 0 && data[size - 1] == '\0') {
+			size--;
+		}
+
+		return static_cast<arrow::StringBuilder *>(builder)->Append(
+				(const char *) data, size);
+	case CONV_BINARY:
+		return static_cast<arrow::BinaryBuilder *>(builder)->Append(data, size);
+	default:
+		return arrow::Status::OK();
+	}
+}
+
+int parquet_table::store(const struct ipfix_data_set *data_set, const std::string &path)
+{
+	const uint8_t *data = data_set->records;
+	uint32_t data_size = ntohs(data_set->header.length) - sizeof(struct ipfix_set_header);
+	uint32_t offset = 0;
+	int record_cnt = 0;
+
+	/* Directory of the next file */
+	if (!_sink && _rows == 0) {
+		_path = path;
+	}
+
+	while (data_size - offset >= _min_record_size && data_size > offset) {
+		/* Find all values first, so that a truncated record is not stored at all */
+		uint32_t pos = offset;
+		size_t i;
+		for (i = 0; i < _columns.size(); ++i) {
+			uint16_t size = _columns[i].length;
+			if (size == VAR_IE_LENGTH) {
+				if (pos >= data_size) {
+					break;
+				}
+
+				size = data[pos++];
+				if (size == 255) {
+					if (pos + 2 > data_size) {
+						break;
+					}
+
+					size = ntohs(*(const uint16_t *) (data + pos));
+					pos += 2;
+				}
+			}
+
+			if (pos + size > data_size) {
+				break;
+			}
+
+			_values[i] = std::make_pair(pos, size);
+			pos += size;
+		}
+
+		if (i != _columns.size()) {
+			MSG_WARNING(msg_module, "Template %hu: truncated data record", _template_id);
+			break;
+		}
+
+		/*
+		 * All columns must have the same length. Builders cannot remove a value,
+		 * so space for the whole record is reserved before the first append.
+		 */
+		arrow::Status st;
+		for (i = 0; i < _columns.size() && st.ok(); ++i) {
+			st = reserve(_columns[i], _values[i].second);
+		}
+
+		if (!st.ok()) {
+			MSG_ERROR(msg_module, "Template %hu: %s", _template_id, st.ToString().c_str());
+			return -1;
+		}
+
+		for (i = 0; i < _columns.size() && st.ok(); ++i) {
+			st = append(_columns[i], data + _values[i].first, _values[i].second);
+		}
+
+		if (!st.ok()) {
+			/* Part of the record is appended, the batch cannot be written */
+			MSG_ERROR(msg_module, "Template %hu: %s; %" PRId64 " records of the batch are lost",
+					_template_id, st.ToString().c_str(), _rows);
+			discard_batch();
+			return -1;
+		}
+
+		offset = pos;
+		record_cnt++;
+
+		if (++_rows < (int64_t) _config->batch_rows) {
+			continue;
+		}
+
+		/* The batch is full */
+		st = _parquet || _ipc ? arrow::Status::OK() : open();
+		if (st.ok()) {
+			st = write_batch();
+		}
+
+		if (!st.ok()) {
+			MSG_ERROR(msg_module, "Template %hu: %s", _template_id, st.ToString().c_str());
+			return -1;
+		}
+	}
+
+	return record_cnt;
+}
+
+arrow::Status parquet_table::open()
+{
+	if (mkdir_recursive(_path) != 0) {
+		return arrow::Status::IOError("Cannot create directory ", _path);
+	}
+
+	/* Do not overwrite files of a previous definition of the template */
+	const char *suffix = (_config->format == FORMAT_PARQUET) ? ".parquet" : ".arrows";
+	std::string file;
+	do {
+		std::stringstream ss;
+		ss << _path << _template_id;
+		if (_generation > 0) {
+			ss << "-" << _generation;
+		}
+
+		ss << suffix;
+		file = ss.str();
+		_generation++;
+	} while (access(file.c_str(), F_OK) == 0);
+
+	MSG_DEBUG(msg_module, "Creating file %s", file.c_str());
+	ARROW_ASSIGN_OR_RAISE(_sink, arrow::io::FileOutputStream::Open(file));
+
+	if (_config->format == FORMAT_PARQUET) {
+		parquet::WriterProperties::Builder props;
+		props.compression(_config->compression);
+		props.max_row_group_length(_config->batch_rows);
+		if (_config->dictionary) {
+			props.enable_dictionary();
+		} else {
+			props.disable_dictionary();
+		}
+
+		/* Keep Arrow types (e.g. time zone of timestamps) in the metadata */
+		parquet::ArrowWriterProperties::Builder arrow_props;
+		arrow_props.store_schema();
+
+		ARROW_ASSIGN_OR_RAISE(_parquet, parquet::arrow::FileWriter::Open(*_schema,
+				arrow::default_memory_pool(), _sink, props.build(), arrow_props.build()));
+	} else {
+		arrow::ipc::IpcWriteOptions options = arrow::ipc::IpcWriteOptions::Defaults();
+		if (_config->compression != arrow::Compression::UNCOMPRESSED) {
+			ARROW_ASSIGN_OR_RAISE(options.codec,
+					arrow::util::Codec::Create(_config->compression));
+		}
+
+		ARROW_ASSIGN_OR_RAISE(_ipc, arrow::ipc::MakeStreamWriter(_sink, _schema, options));
+	}
+
+	return arrow::Status::OK();
+}
+
+arrow::Status parquet_table::write_batch()
+{
+	std::vector<std::shared_ptr<arrow::Array> > arrays;
+	for (size_t i = 0; i < _columns.size(); ++i) {
+		if (_columns[i].conv == CONV_SKIP) {
+			continue;
+		}
+
+		std::shared_ptr<arrow::Array> array;
+		ARROW_RETURN_NOT_OK(_columns[i].builder->Finish(&array));
+		arrays.push_back(array);
+	}
+
+	std::shared_ptr<arrow::RecordBatch> batch = arrow::RecordBatch::Make(_schema, _rows, arrays);
+	_rows = 0;
+
+	if (_parquet) {
+		ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Table> table,
+				arrow::Table::FromRecordBatches(_schema, {batch}));
+		return _parquet->WriteTable(*table, batch->num_rows());
+	}
+
+	return _ipc->WriteRecordBatch(*batch);
+}
+
+void parquet_table::close()
+{
+	arrow::Status st;
+
+	if (_rows > 0) {
+		st = _parquet || _ipc ? arrow::Status::OK() : open();
+		if (st.ok()) {
+			st = write_batch();
+		}
+	}
+
+	if (_parquet) {
+		st &= _parquet->Close();
+		_parquet.reset();
+	}
+
+	if (_ipc) {
+		st &= _ipc->Close();
+		_ipc.reset();
+	}
+
+	if (_sink) {
+		st &= _sink->Close();
+		_sink.reset();
+	}
+
+	if (!st.ok()) {
+		MSG_ERROR(msg_module, "Template %hu: %s", _template_id, st.ToString().c_str());
+	}
+
+	/* Builders of a failed batch must not leak into the next file */
+	discard_batch();
+	_generation = 0;
+}
+
+void parquet_table::discard_batch()
+{
+	for (size_t i = 0; i < _columns.size(); ++i) {
+		if (_columns[i].builder) {
+			_columns[i].builder->Reset();
+		}
+	}
+
+	_rows = 0;
+}
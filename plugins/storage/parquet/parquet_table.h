@@ -0,0 +1,155 @@
+/**
+ * \file parquet_table.h
+ * \brief Columnar table of records of one template (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PARQUET_TABLE_H_
+#define PARQUET_TABLE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <parquet/arrow/writer.h>
+
+#include "parquet.h"
+
+/**
+ * \brief Columnar table of records of one template
+ *
+ * Records are transposed into Arrow builders (one per template field). When
+ * a batch is full, it is written as a Parquet row group or an Arrow IPC
+ * record batch to the file of the current window.
+ */
+class parquet_table
+{
+public:
+	parquet_table(uint16_t template_id, const struct parquet_config *config);
+	~parquet_table();
+
+	/**
+	 * \brief Create columns from a template
+	 *
+	 * \param[in] tmp Template
+	 * \return 0 on success, otherwise non-zero
+	 */
+	int parse_template(const struct ipfix_template *tmp);
+
+	/**
+	 * \brief Transpose records of a data set into columns
+	 *
+	 * Full batches are written to a file in the directory \p path.
+	 * \param[in] data_set Data set
+	 * \param[in] path Window directory of the observation domain
+	 * \return Number of stored records or -1 on error
+	 */
+	int store(const struct ipfix_data_set *data_set, const std::string &path);
+
+	/**
+	 * \brief Write the remaining records and close the file
+	 *
+	 * The next batch is written to a new file.
+	 */
+	void close();
+
+	time_t get_first_transmission() const { return _first_transmission; }
+
+private:
+	/** Conversion of a field into a column */
+	enum conv_type {
+		CONV_UINT,          /**< Unsigned integer (any width)   */
+		CONV_SINT,          /**< Signed integer (any width)     */
+		CONV_FLOAT32,       /**< 32-bit float                   */
+		CONV_FLOAT64,       /**< 64-bit float                   */
+		CONV_BOOL,          /**< Boolean (1 = true, 2 = false)  */
+		CONV_TS,            /**< Seconds or milliseconds        */
+		CONV_TS_NTP_USEC,   /**< NTP timestamp to microseconds  */
+		CONV_TS_NTP_NSEC,   /**< NTP timestamp to nanoseconds   */
+		CONV_FIXED,         /**< Fixed size binary (IPv6, MAC)  */
+		CONV_STRING,        /**< UTF-8 string                   */
+		CONV_BINARY,        /**< Octet array, lists, unknown    */
+		CONV_SKIP           /**< Not stored (duplicate field)   */
+	};
+
+	/** Column of a field */
+	struct column {
+		enum conv_type conv;         /**< Conversion                     */
+		uint16_t length;             /**< Length from the template       */
+		uint8_t width;               /**< Width of integer values        */
+		std::shared_ptr<arrow::ArrayBuilder> builder; /**< Values        */
+	};
+
+	uint16_t _template_id;
+	const struct parquet_config *_config;
+	time_t _first_transmission;
+	/** Number of the file of the template in the window */
+	int _generation;
+	/** Directory of the current file */
+	std::string _path;
+
+	std::vector<column> _columns;
+	std::shared_ptr<arrow::Schema> _schema;
+	/** Minimal size of a record (to detect padding) */
+	uint32_t _min_record_size;
+	/** Number of rows in the current batch */
+	int64_t _rows;
+	/** Offsets and sizes of values of the record being stored */
+	std::vector<std::pair<uint32_t, uint16_t> > _values;
+
+	/** Output file (only one of the writers is used) */
+	std::shared_ptr<arrow::io::FileOutputStream> _sink;
+	std::unique_ptr<parquet::arrow::FileWriter> _parquet;
+	std::shared_ptr<arrow::ipc::RecordBatchWriter> _ipc;
+
+	// Add a column for a field
+	int add_column(const ipfix_element_t *elem, uint32_t en, uint16_t id,
+			uint16_t length, std::vector<std::shared_ptr<arrow::Field> > &fields);
+	// Reserve space for a value in a column
+	static arrow::Status reserve(column &col, uint16_t size);
+	// Append a value to a column
+	static arrow::Status append(column &col, const uint8_t *data, uint16_t size);
+	// Drop the current batch
+	void discard_batch();
+	// Open a file for the table in the directory _path
+	arrow::Status open();
+	// Write the current batch
+	arrow::Status write_batch();
+};
+
+#endif /* PARQUET_TABLE_H_ */
@@ -54,6 +54,9 @@
 #include <arpa/inet.h>
 #include <inttypes.h>
 #include <endian.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
 
 #include <ipfixcol.h>
 #include "ipfix_entities.h"
@@ -72,10 +75,58 @@ IPFIXCOL_API_VERSION;
 #define SQL_COMMAND_LENGTH 2048
 /* number of store packet call in one transaction */
 #define TRANSACTION_MAX 2
+/* default number of records that triggers sending of COPY batches */
+#define DEFAULT_COPY_ROWS 10000
+/* default maximal age of COPY batches (seconds) */
+#define DEFAULT_COPY_TIME 1
+/* initial size of the COPY batch of a table */
+#define COPY_BUFFER_SIZE (256 * 1024)
+/* size of the data passed to PQputCopyData() at once */
+#define COPY_CHUNK_SIZE (64 * 1024)
+/* maximal size of an encoded value of fixed size (numeric, inet) */
+#define COPY_VALUE_MAX 24
+/* signature of the binary COPY format */
+#define COPY_SIGNATURE "PGCOPY\n\377\r\n\0"
+#define COPY_SIGNATURE_LEN 11
+/* address families of the binary inet format */
+#define PGSQL_AF_INET (AF_INET + 0)
+#define PGSQL_AF_INET6 (AF_INET + 1)
+/* PostgreSQL epoch (2000-01-01) and NTP epoch (1900-01-01) in UNIX time */
+#define POSTGRES_EPOCH 946684800ULL
+#define NTP_EPOCH 2208988800ULL
 
 /** Identifier to MSG_* macros */
 static char *msg_module = "postgres storage";
 
+/**
+ * \struct copy_column
+ *
+ * \brief Column of a table filled by COPY (field of a template)
+ */
+struct copy_column {
+	uint16_t id;				/**< Information Element ID (with enterprise bit) */
+	uint16_t length;			/**< Length of the field in the template */
+	uint32_t pen;				/**< Enterprise number */
+	int type;				/**< Internal IPFIX type, -1 for bytea */
+};
+
+/**
+ * \struct copy_table
+ *
+ * \brief Column plan and batch of records of a table filled by COPY
+ */
+struct copy_table {
+	uint16_t template_id;			/**< Original template ID */
+	char table_name[TABLE_NAME_LEN];	/**< Name of the table */
+	struct copy_column *columns;		/**< Columns of the template */
+	uint16_t column_count;			/**< Number of columns */
+	uint32_t min_record_len;		/**< Minimal length of a data record */
+	uint8_t *buffer;			/**< Batch in the binary COPY format */
+	size_t buffer_len;			/**< Used size of the buffer */
+	size_t buffer_size;			/**< Allocated size of the buffer */
+	uint32_t rows;				/**< Number of records in the batch */
+};
+
 /**
  * \struct postgres_config
  *
@@ -87,8 +138,18 @@ struct postgres_config {
 	uint16_t table_counter;		/** number of known tables in database */
 	uint16_t table_size;		/** size of the table_names member */
 	uint32_t transaction_counter;	/**< Number of store_packet calls in current transaction */
+	uint8_t copy;				/**< Store records by binary COPY instead of INSERT */
+	uint32_t copy_max_rows;		/**< Number of records that triggers sending of batches */
+	uint32_t copy_max_time;		/**< Maximal age of batches (seconds) */
+	struct copy_table *copy_tables;	/**< Tables filled by COPY */
+	uint16_t copy_table_count;	/**< Number of tables filled by COPY */
+	uint16_t copy_table_size;	/**< Size of the copy_tables member */
+	uint32_t copy_rows;			/**< Number of records in all batches */
+	time_t copy_start;			/**< Time of the first record in batches */
 };
 
+static int copy_flush_table(struct postgres_config *conf, struct copy_table *table);
+
 
 /**
  * \brief Begin SQL transaction if necessary
@@ -149,6 +210,11 @@ inline static void commit_transaction(struct postgres_config *conf)
  */
 inline static void restart_transaction(struct postgres_config *conf)
 {
+	/* COPY batches are not sent in explicit transactions */
+	if (conf->copy) {
+		return;
+	}
+
 	conf->transaction_counter = 0;
 	commit_transaction(conf);
 	begin_transaction(conf);
@@ -831,6 +897,560 @@ err_sql_command:
 }
 
 
+/**
+ * \brief Write integers in network byte order to the (unaligned) COPY stream
+ */
+static inline void copy_put16(uint8_t *out, uint16_t value)
+{
+	value = htons(value);
+	memcpy(out, &value, sizeof(value));
+}
+
+static inline void copy_put32(uint8_t *out, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(out, &value, sizeof(value));
+}
+
+static inline void copy_put64(uint8_t *out, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(out, &value, sizeof(value));
+}
+
+
+/**
+ * \brief Find the column plan of a template field
+ *
+ * Columns are planned the same way as they are created by create_table().
+ *
+ * \param[out] column column plan
+ * \param[in] field template field (ID, length and enterprise number)
+ * \return size of the template field
+ */
+static uint16_t copy_plan_column(struct copy_column *column, const uint8_t *field)
+{
+	column->id = *((uint16_t *) field);
+	column->length = *((uint16_t *) (field+2));
+	column->pen = 0;
+	column->type = -1;	/* bytea */
+
+	if (column->id >> 15) {
+		/* Enterprise Element */
+		column->pen = *((uint32_t *) (field+4));
+		return 8;
+	}
+
+	if (get_postgres_data_type(get_ie_type(column->id)) != NULL) {
+		column->type = ipfix_type_to_internal(get_ie_type(column->id));
+	}
+	return 4;
+}
+
+
+/**
+ * \brief Start a new batch of a COPY table
+ *
+ * \param[in] table COPY table
+ */
+static void copy_reset(struct copy_table *table)
+{
+	/* binary COPY signature, flags and header extension length */
+	memcpy(table->buffer, COPY_SIGNATURE, COPY_SIGNATURE_LEN);
+	memset(table->buffer+COPY_SIGNATURE_LEN, 0, 8);
+	table->buffer_len = COPY_SIGNATURE_LEN + 8;
+	table->rows = 0;
+}
+
+
+/**
+ * \brief Get the COPY table of a template
+ *
+ * Column plan is created when the template is seen for the first time or
+ * when its fields are changed.
+ *
+ * \param[in] conf config structure
+ * \param[in] template IPFIX template
+ * \return COPY table or NULL on error
+ */
+static struct copy_table *copy_table_get(struct postgres_config *conf, struct ipfix_template *template)
+{
+	struct copy_table *table = NULL;
+	struct copy_column column;
+	uint8_t *fields;
+	uint16_t u;
+	int index;
+
+	for (u = 0; u < conf->copy_table_count; u++) {
+		if (conf->copy_tables[u].template_id == template->original_id) {
+			table = &conf->copy_tables[u];
+			break;
+		}
+	}
+
+	if (table && table->column_count == template->field_count) {
+		/* check that the plan is still valid */
+		fields = (uint8_t *) template->fields;
+		index = 0;
+		for (u = 0; u < template->field_count; u++) {
+			index += copy_plan_column(&column, fields+index);
+			if (column.id != table->columns[u].id || column.length != table->columns[u].length
+					|| column.pen != table->columns[u].pen) {
+				break;
+			}
+		}
+
+		if (u == template->field_count) {
+			return table;
+		}
+	}
+
+	if (table == NULL) {
+		if (conf->copy_table_count == conf->copy_table_size) {
+			table = realloc(conf->copy_tables, 2 * conf->copy_table_size * sizeof(*table));
+			if (!table) {
+				MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+				return NULL;
+			}
+			conf->copy_tables = table;
+			conf->copy_table_size *= 2;
+		}
+
+		table = &conf->copy_tables[conf->copy_table_count];
+		memset(table, 0, sizeof(*table));
+		table->template_id = template->original_id;
+		snprintf(table->table_name, TABLE_NAME_LEN, TABLE_NAME_PREFIX "%u", template->original_id);
+
+		table->buffer_size = COPY_BUFFER_SIZE;
+		table->buffer = malloc(table->buffer_size);
+		if (!table->buffer) {
+			MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+			return NULL;
+		}
+		copy_reset(table);
+		conf->copy_table_count++;
+	} else if (table->rows > 0) {
+		/* rows of the old template go to the table first */
+		copy_flush_table(conf, table);
+	}
+
+	/* (re)create the plan */
+	free(table->columns);
+	table->column_count = 0;
+	table->min_record_len = 0;
+	table->columns = malloc(template->field_count * sizeof(struct copy_column));
+	if (!table->columns && template->field_count > 0) {
+		MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	fields = (uint8_t *) template->fields;
+	index = 0;
+	for (u = 0; u < template->field_count; u++) {
+		index += copy_plan_column(&table->columns[u], fields+index);
+		table->min_record_len += (table->columns[u].length == VAR_IE_LENGTH) ? 1 : table->columns[u].length;
+	}
+	table->column_count = template->field_count;
+
+	return table;
+}
+
+
+/**
+ * \brief Encode PostgreSQL numeric value
+ *
+ * \param[out] out output buffer (at least COPY_NUMERIC_MAX bytes)
+ * \param[in] value value
+ * \return size of the encoded value
+ */
+static int32_t copy_numeric(uint8_t *out, uint64_t value)
+{
+	uint16_t digits[5];	/* base 10000, least significant first */
+	int count = 0;
+	int first = 0;
+	int i;
+
+	while (value > 0) {
+		digits[count++] = value % 10000;
+		value /= 10000;
+	}
+
+	/* trailing zeros are covered by the weight */
+	while (first < count && digits[first] == 0) {
+		first++;
+	}
+
+	copy_put16(out, count - first);			/* ndigits */
+	copy_put16(out+2, count > 0 ? count - 1 : 0);	/* weight */
+	copy_put16(out+4, 0);				/* sign (positive) */
+	copy_put16(out+6, 0);				/* dscale */
+	for (i = count - 1; i >= first; i--) {
+		copy_put16(out+8+2*(count-1-i), digits[i]);
+	}
+
+	return 8 + 2 * (count - first);
+}
+
+
+/**
+ * \brief Read unsigned integer in network byte order (reduced size encoding)
+ */
+static inline uint64_t copy_read_uint(const uint8_t *data, uint16_t length)
+{
+	uint64_t value = 0;
+	uint16_t i;
+
+	for (i = 0; i < length; i++) {
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+
+/**
+ * \brief Read signed integer in network byte order (reduced size encoding)
+ */
+static inline int64_t copy_read_int(const uint8_t *data, uint16_t length)
+{
+	uint64_t value = copy_read_uint(data, length);
+
+	if (length > 0 && length < 8 && (data[0] & 0x80)) {
+		/* sign extension */
+		value |= ~((uint64_t) 0) << (length * 8);
+	}
+	return (int64_t) value;
+}
+
+
+/**
+ * \brief Encode a value of a field into the binary COPY format
+ *
+ * Values that can't be represented by the column type are stored as NULL.
+ *
+ * \param[out] out output buffer (size of value and value itself)
+ * \param[in] type internal IPFIX type of the column (-1 for bytea)
+ * \param[in] data value of the field
+ * \param[in] length length of the value
+ * \return number of bytes written
+ */
+static size_t copy_encode(uint8_t *out, int type, const uint8_t *data, uint16_t length)
+{
+	uint8_t *value = out + 4;
+	int32_t size = -1;	/* NULL */
+	const uint8_t *end;
+	uint64_t uint64;
+	uint32_t uint32;
+	float float32;
+	double float64;
+
+	switch (type) {
+	case (UINT8):
+	case (INT8):
+	case (INT16):
+		/* smallint */
+		if (length <= 8) {
+			uint64 = (type == UINT8) ? copy_read_uint(data, length) : (uint64_t) copy_read_int(data, length);
+			copy_put16(value, (uint16_t) uint64);
+			size = 2;
+		}
+		break;
+
+	case (UINT16):
+	case (INT32):
+		/* integer */
+		if (length <= 8) {
+			uint64 = (type == UINT16) ? copy_read_uint(data, length) : (uint64_t) copy_read_int(data, length);
+			copy_put32(value, (uint32_t) uint64);
+			size = 4;
+		}
+		break;
+
+	case (UINT32):
+	case (INT64):
+		/* bigint */
+		if (length <= 8) {
+			uint64 = (type == UINT32) ? copy_read_uint(data, length) : (uint64_t) copy_read_int(data, length);
+			copy_put64(value, uint64);
+			size = 8;
+		}
+		break;
+
+	case (UINT64):
+		/* decimal */
+		if (length <= 8) {
+			size = copy_numeric(value, copy_read_uint(data, length));
+		}
+		break;
+
+	case (BOOLEAN):
+		/* decimal, in IPFIX 1 means TRUE, 2 means FALSE */
+		if (length == 1 && (data[0] == 1 || data[0] == 2)) {
+			size = copy_numeric(value, data[0] == 1);
+		}
+		break;
+
+	case (IPV4ADDR):
+	case (IPV6ADDR):
+		/* inet: family, bits, is_cidr, address length, address */
+		if (length == 4 || length == 16) {
+			value[0] = (length == 4) ? PGSQL_AF_INET : PGSQL_AF_INET6;
+			value[1] = length * 8;
+			value[2] = 0;
+			value[3] = length;
+			memcpy(value+4, data, length);
+			size = 4 + length;
+		}
+		break;
+
+	case (MACADDR):
+		if (length == 6) {
+			memcpy(value, data, 6);
+			size = 6;
+		}
+		break;
+
+	case (DATETIMESECONDS):
+		/* timestamp, microseconds since 2000-01-01 */
+		if (length == 4) {
+			uint64 = (copy_read_uint(data, 4) - POSTGRES_EPOCH) * 1000000;
+			copy_put64(value, uint64);
+			size = 8;
+		}
+		break;
+
+	case (DATETIMEMILLISECONDS):
+		if (length == 8) {
+			uint64 = copy_read_uint(data, 8) * 1000 - POSTGRES_EPOCH * 1000000;
+			copy_put64(value, uint64);
+			size = 8;
+		}
+		break;
+
+	case (DATETIMEMICROSECONDS):
+	case (DATETIMENANOSECONDS):
+		/* NTP timestamp, fraction is converted to microseconds */
+		if (length == 8) {
+			uint64 = (copy_read_uint(data, 4) - NTP_EPOCH - POSTGRES_EPOCH) * 1000000
+					+ ((copy_read_uint(data+4, 4) * 1000000) >> 32);
+			copy_put64(value, uint64);
+			size = 8;
+		}
+		break;
+
+	case (FLOAT32):
+	case (FLOAT64):
+		/* float (double precision) */
+		if (length == 4) {
+			uint32 = (uint32_t) copy_read_uint(data, 4);
+			memcpy(&float32, &uint32, 4);
+			float64 = float32;
+			memcpy(&uint64, &float64, 8);
+			copy_put64(value, uint64);
+			size = 8;
+		} else if (length == 8) {
+			memcpy(value, data, 8);
+			size = 8;
+		}
+		break;
+
+	case (STRING):
+		/* text can't contain NUL bytes, fixed-length strings are padded by them */
+		end = memchr(data, '\0', length);
+		size = end ? end - data : length;
+		memcpy(value, data, size);
+		break;
+
+	default:
+		/* bytea */
+		memcpy(value, data, length);
+		size = length;
+		break;
+	}
+
+	copy_put32(out, (uint32_t) size);
+	return 4 + (size > 0 ? size : 0);
+}
+
+
+/**
+ * \brief Add records of a data set to the batch of its table
+ *
+ * \param[in] conf config structure
+ * \param[in] couple template+data couple
+ * \return number of added records or -1 on error
+ */
+static int copy_data_set(struct postgres_config *conf, const struct data_template_couple *couple)
+{
+	struct copy_table *table;
+	const uint8_t *records = couple->data_set->records;
+	uint32_t records_len;
+	uint32_t offset = 0;
+	uint32_t record_start;
+	uint32_t needed;
+	uint16_t length;
+	uint16_t u;
+	uint8_t *tmp;
+	int count = 0;
+
+	table = copy_table_get(conf, couple->data_template);
+	if (!table) {
+		return -1;
+	}
+
+	records_len = ntohs(couple->data_set->header.length) - sizeof(struct ipfix_set_header);
+
+	/* the rest is padding */
+	while (table->min_record_len > 0 && records_len - offset >= table->min_record_len) {
+		/* the whole record is encoded at most to this (with the file trailer) */
+		needed = 2 + table->column_count * (4 + COPY_VALUE_MAX) + (records_len - offset) + 2;
+		if (table->buffer_len + needed > table->buffer_size) {
+			tmp = realloc(table->buffer, table->buffer_len + needed + COPY_BUFFER_SIZE);
+			if (!tmp) {
+				MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+				return -1;
+			}
+			table->buffer = tmp;
+			table->buffer_size = table->buffer_len + needed + COPY_BUFFER_SIZE;
+		}
+
+		record_start = table->buffer_len;
+		copy_put16(table->buffer+table->buffer_len, table->column_count);
+		table->buffer_len += 2;
+
+		for (u = 0; u < table->column_count; u++) {
+			length = table->columns[u].length;
+
+			/* check whether this element has variable length */
+			if (length == VAR_IE_LENGTH) {
+				if (offset + 1 > records_len) {
+					break;
+				}
+				length = records[offset];
+				offset += 1;
+				if (length == 255) {
+					if (offset + 2 > records_len) {
+						break;
+					}
+					length = ntohs(*((uint16_t *) (records+offset)));
+					offset += 2;
+				}
+			}
+
+			if (offset + length > records_len) {
+				break;
+			}
+
+			table->buffer_len += copy_encode(table->buffer+table->buffer_len,
+					table->columns[u].type, records+offset, length);
+			offset += length;
+		}
+
+		if (u < table->column_count) {
+			/* malformed record, drop it */
+			MSG_WARNING(msg_module, "Malformed data record of template %u", table->template_id);
+			table->buffer_len = record_start;
+			break;
+		}
+
+		if (conf->copy_rows == 0) {
+			conf->copy_start = time(NULL);
+		}
+		table->rows++;
+		conf->copy_rows++;
+		count++;
+	}
+
+	return count;
+}
+
+
+/**
+ * \brief Send the batch of a table by COPY FROM STDIN
+ *
+ * Every batch is committed on its own, so an error in one table doesn't affect
+ * batches of others.
+ *
+ * \param[in] conf config structure
+ * \param[in] table COPY table
+ * \return 0 on success
+ */
+static int copy_flush_table(struct postgres_config *conf, struct copy_table *table)
+{
+	PGresult *res;
+	char sql_command[SQL_COMMAND_LENGTH];
+	size_t sent;
+	size_t chunk;
+	int ret = 0;
+
+	if (table->rows == 0) {
+		return 0;
+	}
+
+	/* file trailer */
+	copy_put16(table->buffer+table->buffer_len, 0xffff);
+	table->buffer_len += 2;
+
+	/* WITH BINARY is understood by older servers too */
+	snprintf(sql_command, SQL_COMMAND_LENGTH, "COPY \"%s\" FROM STDIN WITH BINARY", table->table_name);
+	res = PQexec(conf->conn, sql_command);
+	if (PQresultStatus(res) != PGRES_COPY_IN) {
+		MSG_ERROR(msg_module, "PostgreSQL: %s", PQerrorMessage(conf->conn));
+		PQclear(res);
+		ret = -1;
+		goto reset;
+	}
+	PQclear(res);
+
+	/* libpq sends the data while the next chunk is being queued */
+	for (sent = 0; sent < table->buffer_len; sent += chunk) {
+		chunk = table->buffer_len - sent;
+		if (chunk > COPY_CHUNK_SIZE) {
+			chunk = COPY_CHUNK_SIZE;
+		}
+
+		if (PQputCopyData(conf->conn, (const char *) table->buffer+sent, chunk) != 1) {
+			MSG_ERROR(msg_module, "PostgreSQL: %s", PQerrorMessage(conf->conn));
+			ret = -1;
+			break;
+		}
+	}
+
+	if (PQputCopyEnd(conf->conn, ret ? "Unable to send data" : NULL) != 1) {
+		MSG_ERROR(msg_module, "PostgreSQL: %s", PQerrorMessage(conf->conn));
+		ret = -1;
+	}
+
+	while ((res = PQgetResult(conf->conn)) != NULL) {
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			MSG_ERROR(msg_module, "PostgreSQL: unable to store %u records to table %s: %s",
+					table->rows, table->table_name, PQerrorMessage(conf->conn));
+			ret = -1;
+		}
+		PQclear(res);
+	}
+
+reset:
+	conf->copy_rows -= table->rows;
+	copy_reset(table);
+	return ret;
+}
+
+
+/**
+ * \brief Send batches of all tables
+ *
+ * \param[in] conf config structure
+ */
+static void copy_flush(struct postgres_config *conf)
+{
+	uint16_t u;
+
+	for (u = 0; u < conf->copy_table_count; u++) {
+		copy_flush_table(conf, &conf->copy_tables[u]);
+	}
+}
+
+
 /**
  * \brief Process new templates
  *
@@ -912,8 +1532,12 @@ static int process_data_records(struct postgres_config *conf, const struct ipfix
 			set_index++;
 			continue;
 		}
-		snprintf(table_name, TABLE_NAME_LEN, TABLE_NAME_PREFIX "%u", ipfix_msg->data_couple[set_index].data_template->original_id);
-		insert_into(conf, table_name, &(ipfix_msg->data_couple[set_index]));
+		if (conf->copy) {
+			copy_data_set(conf, &(ipfix_msg->data_couple[set_index]));
+		} else {
+			snprintf(table_name, TABLE_NAME_LEN, TABLE_NAME_PREFIX "%u", ipfix_msg->data_couple[set_index].data_template->original_id);
+			insert_into(conf, table_name, &(ipfix_msg->data_couple[set_index]));
+		}
 
 		set_index++;
 	}
@@ -946,6 +1570,8 @@ int storage_init(char *params, void **config)
 	uint8_t dbname_allocated = 0; /* indicates whether dbname was allocated via malloc() */
 	char *user = NULL;
 	char *pass = NULL;
+	char *value;
+	const char *integer_datetimes;
 	size_t connection_string_len;
 	size_t str_len;
 
@@ -955,7 +1581,9 @@ int storage_init(char *params, void **config)
 		return -1;
 	}
 	memset(conf, 0, sizeof(*conf));
-
+	conf->copy = 1;
+	conf->copy_max_rows = DEFAULT_COPY_ROWS;
+	conf->copy_max_time = DEFAULT_COPY_TIME;
 
 	doc = xmlReadMemory(params, strlen(params), "nobase.xml", NULL, 0);
 	if (doc == NULL) {
@@ -1025,6 +1653,28 @@ int storage_init(char *params, void **config)
 			pass = (char *) xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
 		}
 
+		if ((!xmlStrcmp(cur->name, (const xmlChar *) "copy"))) {
+			value = (char *) xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			conf->copy = (value == NULL || strcasecmp(value, "no") != 0);
+			xmlFree(value);
+		}
+
+		if ((!xmlStrcmp(cur->name, (const xmlChar *) "batchRows"))) {
+			value = (char *) xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (value != NULL && atoi(value) > 0) {
+				conf->copy_max_rows = atoi(value);
+			}
+			xmlFree(value);
+		}
+
+		if ((!xmlStrcmp(cur->name, (const xmlChar *) "batchTime"))) {
+			value = (char *) xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			if (value != NULL) {
+				conf->copy_max_time = atoi(value);
+			}
+			xmlFree(value);
+		}
+
 		cur = cur->next;
 	}
 
@@ -1139,7 +1789,25 @@ int storage_init(char *params, void **config)
 	}
 	memset(conf->table_names, 0, conf->table_size * sizeof(uint16_t));
 
+	if (conf->copy) {
+		/* binary timestamps are 64-bit integers only with integer datetimes */
+		integer_datetimes = PQparameterStatus(conn, "integer_datetimes");
+		if (integer_datetimes == NULL || strcmp(integer_datetimes, "on") != 0) {
+			MSG_WARNING(msg_module, "Server doesn't use integer datetimes, records are stored by INSERT");
+			conf->copy = 0;
+		}
+	}
+
 	conf->conn = conn;
+
+	conf->copy_table_size = 16;
+	conf->copy_tables = (struct copy_table *) malloc(conf->copy_table_size * sizeof(struct copy_table));
+	if (!(conf->copy_tables)) {
+		MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+		free(conf->table_names);
+		goto err_table_names;
+	}
+
 	*config = conf;
 
 	/* done using connection string */
@@ -1188,6 +1856,18 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 
 	conf = (struct postgres_config *) config;
 
+	if (conf->copy) {
+		process_new_templates(conf, ipfix_msg);
+		process_data_records(conf, ipfix_msg);
+
+		/* send batches when they are large or old enough */
+		if (conf->copy_rows >= conf->copy_max_rows || (conf->copy_rows > 0
+				&& difftime(time(NULL), conf->copy_start) >= conf->copy_max_time)) {
+			copy_flush(conf);
+		}
+		return 0;
+	}
+
 	begin_transaction(conf);
 	process_new_templates(conf, ipfix_msg);
 	process_data_records(conf, ipfix_msg);
@@ -1209,6 +1889,11 @@ int store_now(const void *config)
 {
 	struct postgres_config *conf = (struct postgres_config *) config;
 
+	if (conf->copy) {
+		copy_flush(conf);
+		return 0;
+	}
+
 	/* commit transaction */
 	conf->transaction_counter = 0;
 	commit_transaction(conf);
@@ -1229,12 +1914,23 @@ int store_now(const void *config)
 int storage_close(void **config)
 {
 	struct postgres_config *conf;
+	uint16_t u;
 
 	conf = (struct postgres_config *) *config;
 
+	/* send the rest of the batches */
+	if (conf->copy) {
+		copy_flush(conf);
+	}
+
 	PQfinish(conf->conn);
 	MSG_INFO(msg_module, "Connection to the database has been closed.");
 
+	for (u = 0; u < conf->copy_table_count; u++) {
+		free(conf->copy_tables[u].columns);
+		free(conf->copy_tables[u].buffer);
+	}
+	free(conf->copy_tables);
 	free(conf->table_names);
 	free(conf);
 
@@ -0,0 +1,199 @@
+/**
+ * \file copy_test.c
+ * \brief Test of the binary COPY encoding of the PostgreSQL plugin
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/*
+ * Test of the binary COPY encoding of the PostgreSQL storage plugin.
+ *
+ * A data set with NUL padded strings is encoded into a COPY batch. Text
+ * values must end at the first NUL byte (PostgreSQL rejects NUL bytes in
+ * text), values of bytea columns must be kept unchanged.
+ */
+
+#include <stdarg.h>
+
+#include "../../postgres_output.c"
+
+/** Fields: interfaceName (16), interfaceName (variable), bytea (8) */
+#define STRING_LEN 16
+#define BYTEA_LEN 8
+
+static const uint8_t *pos;
+static size_t left;
+
+static int failed = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failed = 1; \
+		return; \
+	} \
+} while (0)
+
+static uint32_t read_be(int size)
+{
+	uint32_t value = 0;
+
+	while (size-- > 0 && left > 0) {
+		value = (value << 8) | *pos++;
+		left--;
+	}
+	return value;
+}
+
+/**
+ * \brief Check the next value of the batch
+ */
+static void check_value(const char *expected, size_t expected_len)
+{
+	if (failed) {
+		return;
+	}
+
+	CHECK(left >= 4);
+	CHECK(read_be(4) == expected_len);
+	CHECK(left >= expected_len);
+	CHECK(memcmp(pos, expected, expected_len) == 0);
+	pos += expected_len;
+	left -= expected_len;
+}
+
+/**
+ * \brief Append a record to the data set
+ */
+static uint16_t add_record(uint8_t *data, const char *fixed, size_t fixed_len, const char *var,
+		const uint8_t *bytes)
+{
+	uint16_t len = 0;
+
+	memset(data, 0, STRING_LEN);
+	memcpy(data, fixed, fixed_len);
+	len += STRING_LEN;
+
+	data[len++] = strlen(var);
+	memcpy(data+len, var, strlen(var));
+	len += strlen(var);
+
+	memcpy(data+len, bytes, BYTEA_LEN);
+	len += BYTEA_LEN;
+
+	return len;
+}
+
+int main(void)
+{
+	static const uint8_t bytes[BYTEA_LEN] = {1, 0, 2, 0, 0, 3, 0, 0};
+	struct postgres_config conf;
+	struct ipfix_template *template;
+	struct ipfix_data_set *data_set;
+	struct data_template_couple couple;
+	struct copy_table *table;
+	uint8_t set[512];
+	uint8_t *fields;
+	uint16_t len = sizeof(struct ipfix_set_header);
+	uint16_t field[2];
+	uint32_t pen = 8057;
+
+	verbose = ICMSG_ERROR;
+
+	/* template 256 with fixed and variable-length strings and a bytea */
+	template = calloc(1, sizeof(*template) + 4 * sizeof(template_ie));
+	fields = (uint8_t *) template->fields;
+	field[0] = 82;
+	field[1] = STRING_LEN;
+	memcpy(fields, field, 4);
+	field[1] = VAR_IE_LENGTH;
+	memcpy(fields+4, field, 4);
+	field[0] = 0x8000 | 100;
+	field[1] = BYTEA_LEN;
+	memcpy(fields+8, field, 4);
+	memcpy(fields+12, &pen, 4);
+	template->field_count = 3;
+	template->original_id = 256;
+
+	len += add_record(set+len, "eth0", 4, "abc", bytes);
+	len += add_record(set+len, "0123456789abcdef", 16, "", bytes);
+	len += add_record(set+len, "", 0, "x", bytes);
+	len += add_record(set+len, "lo\0x", 4, "z", bytes);
+
+	data_set = (struct ipfix_data_set *) set;
+	data_set->header.flowset_id = htons(256);
+	data_set->header.length = htons(len);
+	couple.data_set = data_set;
+	couple.data_template = template;
+
+	memset(&conf, 0, sizeof(conf));
+	conf.copy = 1;
+	conf.copy_table_size = 1;
+	conf.copy_tables = malloc(sizeof(struct copy_table));
+
+	if (copy_data_set(&conf, &couple) != 4) {
+		fprintf(stderr, "copy_data_set() did not add 4 records\n");
+		return 1;
+	}
+
+	table = &conf.copy_tables[0];
+	pos = table->buffer + COPY_SIGNATURE_LEN + 8;
+	left = table->buffer_len - COPY_SIGNATURE_LEN - 8;
+
+	const char *expected[4][2] = {
+		{"eth0", "abc"}, {"0123456789abcdef", ""}, {"", "x"}, {"lo", "z"},
+	};
+	for (int r = 0; r < 4 && !failed; r++) {
+		if (left < 2 || read_be(2) != 3) {
+			fprintf(stderr, "record %d: wrong number of columns\n", r);
+			return 1;
+		}
+		check_value(expected[r][0], strlen(expected[r][0]));
+		check_value(expected[r][1], strlen(expected[r][1]));
+		check_value((const char *) bytes, BYTEA_LEN);
+	}
+
+	if (!failed && left != 0) {
+		fprintf(stderr, "%zu unexpected bytes at the end of the batch\n", left);
+		failed = 1;
+	}
+
+	free(table->columns);
+	free(table->buffer);
+	free(conf.copy_tables);
+	free(template);
+
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
@@ -254,56 +254,313 @@ static unirecField *match_field(template_ie *element, fht_table_t *ht, uint16_t
 }
 
 /**
- * \brief Get data from data record
+ * \brief Resolve conversion of an IPFIX field into an UniRec field
  *
- * Uses conf->unirecFields to store values from this record
+ * @param field Matched UniRec field
+ * @param ipfix_id Ipfix element id
+ * @param en_id Enterprise id
+ * @param length Length of the element from the template
+ * @param conf Pointer to storage plugin structure
+ * @return Conversion (see urConversion)
+ */
+static uint8_t plan_conversion(unirecField *field, uint16_t ipfix_id, uint32_t en_id, uint16_t length, unirec_config *conf)
+{
+   if (field->size == -1) {
+      return UR_CONV_DYNAMIC;
+   }
+
+   switch (field->type) {
+      case UNIREC_FIELD_IP:
+         if ((en_id == 0 && (ipfix_id == 8 || ipfix_id == 12)) ||
+             (en_id == 39499 && ipfix_id == 40)) {
+            // IPv4 or INVEA_SIP_RTP_IPV4
+            return UR_CONV_IPV4;
+         }
+         return UR_CONV_IP;
+      case UNIREC_FIELD_PACKET:
+         // PACKET SIZE IS DIFFERENT FOR DIFFERENT EXPORTER!!!
+         if (length == 4) {
+            return UR_CONV_PACKET4;
+         } else if (length == 8) {
+            return UR_CONV_PACKET8;
+         }
+         return UR_CONV_PACKET_INVALID;
+      case UNIREC_FIELD_TS:
+         return UR_CONV_TS;
+      case UNIREC_FIELD_DBF:
+         return UR_CONV_DBF;
+      case UNIREC_FIELD_LBF:
+         // Only filled from the record with ODID JOINFLOWS method
+         return conf->ODID_get_method == ODID_JOINFLOWS_METHOD ? UR_CONV_LBF : UR_CONV_NONE;
+      default:
+         break;
+   }
+
+   if (length == VAR_IE_LENGTH) {
+      return UR_CONV_COPY_VAR;
+   }
+   // If ipfix element is larger than unirec element, saturate unirec element
+   if (field->size < length) {
+      return UR_CONV_SATURATE;
+   }
+
+   switch (length) {
+      case 1:
+         return UR_CONV_U8;
+      case 2:
+         return UR_CONV_U16;
+      case 4:
+         return UR_CONV_U32;
+      case 8:
+         return UR_CONV_U64;
+      default:
+         return UR_CONV_COPY;
+   }
+}
+
+/**
+ * \brief Destroy a plan of a template
  *
- * \param[in] data_record IPFIX data record
- * \param[in] template corresponding template
- * \param[out] conf structure containing necessary information for converting ipfix to unirec
- * \return length of the data record
+ * @param plan Plan to destroy
  */
-static uint16_t process_record(char *data_record, struct ipfix_template *template, unirec_config *conf)
+static void plan_destroy(urPlan *plan)
 {
+   if (!plan) {
+      return;
+   }
 
-   if (!template) {
-      /* We don't have template for this data set */
-      MSG_WARNING(msg_module, "No template for the data set\n");
-      return 0;
+   for (int i = 0; i < plan->fieldCount; i++) {
+      free(plan->fields[i].actions);
    }
+   free(plan->fields);
+   free(plan->ies);
+   free(plan);
+}
 
-   if (!conf) {
-      /* Configuration not given */
-      MSG_WARNING(msg_module, "No configuration given to process_record\n");
+/**
+ * \brief Create a plan for records of a template
+ *
+ * Fields are matched against UniRec fields only once here. Lengths of
+ * unmatched fixed-length fields are folded into skips.
+ *
+ * @param template Template
+ * @param conf Pointer to storage plugin structure
+ * @return New plan or NULL on memory allocation error
+ */
+static urPlan *plan_create(struct ipfix_template *template, unirec_config *conf)
+{
+   uint16_t index, count;
+   uint16_t length, skip = 0;
+   uint16_t ipfix_id;
+   uint32_t en_id;
+   unirecField *matchField;
+   urPlanField *planField;
+   urPlan *plan;
+
+   plan = calloc(1, sizeof(urPlan));
+   if (!plan) {
+      goto error;
+   }
+   plan->template = template;
+
+   plan->fields = calloc(template->field_count ? template->field_count : 1, sizeof(urPlanField));
+   if (!plan->fields) {
+      goto error;
+   }
+
+   for (count = index = 0; count < template->field_count; count++, index++) {
+      matchField = match_field(&template->fields[index], conf->ht_fields, &ipfix_id, &en_id);
+      length = template->fields[index].ie.length;
+
+      /* Skip enterprise element number if necessary */
+      if (template->fields[index].ie.id >> 15) {
+         index++;
+      }
+
+      /* Variable-length fields have at least the length */
+      plan->minLength += (length == VAR_IE_LENGTH) ? 1 : length;
+
+      if (!matchField && length != VAR_IE_LENGTH) {
+         skip += length;
+         continue;
+      }
+
+      planField = &plan->fields[plan->fieldCount++];
+      planField->skip = skip;
+      planField->length = length;
+      planField->field = matchField;
+      skip = 0;
+
+      if (!matchField) {
+         /* Only the length has to be read */
+         continue;
+      }
+
+      planField->conv = plan_conversion(matchField, ipfix_id, en_id, length, conf);
+      planField->actions = calloc(conf->ifc_count, sizeof(urPlanAction));
+      if (!planField->actions) {
+         goto error;
+      }
+
+      for (int i = 0; i < conf->ifc_count; i++) {
+         // For every interface where the element is present
+         // (interfaces sharing records of another one are skipped)
+         if (matchField->included_ar[i] && conf->ifc[i].primary == i) {
+            planField->actions[planField->actionCount].ifc = i;
+            planField->actions[planField->actionCount].offset = matchField->offset_ar[i];
+            planField->actions[planField->actionCount].required = matchField->required_ar[i];
+            planField->actionCount++;
+         }
+      }
+   }
+   plan->tailSkip = skip;
+
+   /* Keep the fields to recognize the template */
+   plan->ieCount = index;
+   plan->ies = malloc((index ? index : 1) * sizeof(template_ie));
+   if (!plan->ies) {
+      goto error;
+   }
+   memcpy(plan->ies, template->fields, index * sizeof(template_ie));
+
+   return plan;
+
+error:
+   MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+   plan_destroy(plan);
+   return NULL;
+}
+
+/**
+ * \brief Check that a plan was created for the template
+ *
+ * A new template can be allocated at the address of a withdrawn one.
+ *
+ * @param plan Plan
+ * @param template Template
+ * @return 1 if the plan belongs to the template, 0 otherwise
+ */
+static int plan_match(const urPlan *plan, const struct ipfix_template *template)
+{
+   uint16_t index, count;
+
+   if (plan->template != template) {
       return 0;
    }
 
+   for (count = index = 0; count < template->field_count; count++, index++) {
+      if (template->fields[index].ie.id >> 15) {
+         index++;
+      }
+   }
+
+   return index == plan->ieCount &&
+      memcmp(plan->ies, template->fields, index * sizeof(template_ie)) == 0;
+}
+
+/**
+ * \brief Get a plan of a template, create it when the template is new
+ *
+ * @param conf Pointer to storage plugin structure
+ * @param template Template
+ * @return Plan or NULL on memory allocation error
+ */
+static urPlan *plan_get(unirec_config *conf, struct ipfix_template *template)
+{
+   urPlan *plan;
+   int i;
+
+   for (i = 0; i < conf->planCount; i++) {
+      if (conf->plans[i]->template != template) {
+         continue;
+      }
+
+      plan = conf->plans[i];
+      if (plan_match(plan, template)) {
+         // Keep the most recently used plan first
+         conf->plans[i] = conf->plans[0];
+         conf->plans[0] = plan;
+         return plan;
+      }
+
+      // Template was replaced
+      if (conf->workers) {
+         workers_sync(conf->workers);
+      }
+      plan_destroy(plan);
+      conf->plans[i] = conf->plans[--conf->planCount];
+      break;
+   }
+
+   if (conf->planCount == PLAN_CACHE_MAX) {
+      // Withdrawn templates are not reported, start over
+      if (conf->workers) {
+         workers_sync(conf->workers);
+      }
+      for (i = 0; i < conf->planCount; i++) {
+         plan_destroy(conf->plans[i]);
+      }
+      conf->planCount = 0;
+   }
+
+   if (conf->planCount == conf->planAlloc) {
+      int alloc = conf->planAlloc ? conf->planAlloc * 2 : 16;
+      urPlan **plans = realloc(conf->plans, alloc * sizeof(urPlan *));
+      if (!plans) {
+         MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+         return NULL;
+      }
+      conf->plans = plans;
+      conf->planAlloc = alloc;
+   }
+
+   plan = plan_create(template, conf);
+   if (!plan) {
+      return NULL;
+   }
+
+   conf->plans[conf->planCount] = conf->plans[0];
+   conf->plans[0] = plan;
+   conf->planCount++;
+   return plan;
+}
 
+/**
+ * \brief Get data from data record
+ *
+ * Uses buffers of the encoder to store values from this record
+ *
+ * \param[in] data_record IPFIX data record
+ * \param[in] plan plan of the corresponding template
+ * \param[out] enc encoder to fill
+ * \param[in] conf structure containing necessary information for converting ipfix to unirec
+ * \param[in] odid ODID of the message
+ * \return length of the data record
+ */
+static uint16_t process_record(char *data_record, const urPlan *plan, urEncoder *enc, const unirec_config *conf, uint16_t odid)
+{
    uint16_t offset = 0;
-   uint16_t index, count;
    uint16_t length, size_length;
-   unirecField *matchField;
-
-   uint16_t ipfix_id;
-   uint32_t en_id;
    uint64_t sec, msec, frac;
-
+   const urPlanField *planField;
+   const urPlanAction *action;
+   unirecField *matchField;
+   char *src, *dst;
 
     // Fill ODID (link bit field) in all ifc where it is included
     // Only do this if using ODID MANAGER method
-    if (conf->ODID_get_method == ODID_MANAGER_METHOD) {
+    if (conf->ODID_get_method == ODID_MANAGER_METHOD && conf->LBF_field) {
         for (int i = 0; i < conf->ifc_count; i++) {
-            if (conf->LBF_field->included_ar[i]) {
-                *(uint64_t*)(conf->ifc[i].buffer + conf->LBF_field->offset_ar[i]) = 1LLU << (conf->odid - 1);
+            if (conf->LBF_field->included_ar[i] && conf->ifc[i].primary == i) {
+                *(uint64_t*)(enc->buffer[i] + conf->LBF_field->offset_ar[i]) = 1LLU << (odid - 1);
             }
         }
     }
 
-   /* Go over all fields */
-   for (count = index = 0; count < template->field_count; count++, index++) {
-      matchField = match_field(&template->fields[index], conf->ht_fields, &ipfix_id, &en_id);
-
-      length = template->fields[index].ie.length;
+   /* Go over matched and variable-length fields */
+   for (planField = plan->fields; planField < plan->fields + plan->fieldCount; planField++) {
+      offset += planField->skip;
+      length = planField->length;
       size_length = 0;
 
       /* Handle variable length */
@@ -318,137 +575,333 @@ static uint16_t process_record(char *data_record, struct ipfix_template *templat
          }
       }
 
-      /* Copy the element value on match */
-      if (matchField) {
-         // Determine if it is static or dynamic element
-         // If static, copy to all Unirec ifcs whose are using this element
-         // Else if dynamic, copy ptr to this element to `matchField->value` for futher use
-         if (matchField->size != -1) {
-            // Static element
-            for (int i = 0; i < conf->ifc_count; i++) {
-               // For every interface
-               if (matchField->included_ar[i]) {
-                  // If element is present in current interface
-                  // Copy special elements in special way
-                  switch (matchField->type) {
-                     case UNIREC_FIELD_IP:
-                        if ((en_id == 0 && (ipfix_id == 8 || ipfix_id == 12)) ||
-                            (en_id == 39499 && ipfix_id == 40)) {
-                           // IPv4 or INVEA_SIP_RTP_IPV4
-                           // Put IPv4 into 128 bits in a special way (see ipaddr.h in Nemea-UniRec for details)
-                           *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = 0;
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i] + 8) = *(uint32_t*)(data_record + offset + size_length);
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i] + 12) = 0xffffffff;
-                        } else {
-                           // IPv6 or INVEA_SIP_RTP_IPV6
-                           memcpy(conf->ifc[i].buffer + matchField->offset_ar[i], data_record + offset + size_length, length);
-                        }
-                        break;
-                     case UNIREC_FIELD_PACKET:
-                        // PACKET SIZE IS DIFFERENT FOR DIFFERENT EXPORTER!!!
-                        if (template->fields[index].ie.length == 4) {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  ntohl(*(uint32_t*)(data_record + offset + size_length));
-                        }
-                        else if (template->fields[index].ie.length == 8) {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  ntohl(*(uint32_t*)(data_record + offset + size_length + 4));
-                        } else {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  0xFFFFFFFF;
-                        }
-                        break;
-                     case UNIREC_FIELD_TS:
-                        // Handle Time variables
-                        msec = be64toh(*(uint64_t*)(data_record + offset + size_length));
-                        sec = msec / 1000;
-                        frac = ((msec % 1000) * 0x4189374BC6A7EFULL) >> 32;
-                        *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  (sec<<32) | frac;
-                        break;
-                     case UNIREC_FIELD_DBF:
-                        // Handle DIR_BIT_FIELD
-                        *(uint8_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = ((*(uint16_t*)(data_record + offset + size_length)) >> 8) & 0x1;
-                        break;
-                     case UNIREC_FIELD_LBF:
-                        // Handle LINK_BIT_FIELD, is BIG ENDIAN but we are using only LSB
-                        // Only do this if ODID JOINFLOWS method
-                        if (conf->ODID_get_method == ODID_JOINFLOWS_METHOD) {
-                            *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = 1LLU << ((*(uint8_t*)(data_record + offset + size_length + 3)) - 1);
-                                }
-                        break;
-                     default:
-                        // Check length of ipfix element and if it is larger than unirec element, then saturate unirec element
-                        if (matchField->size >= length) {
-                           data_copy( (conf->ifc[i].buffer) + matchField->offset_ar[i],	// Offset to Unirec buffer for current ifc
-                                 (data_record + offset + size_length),		// Offset to data in Ipfix message
-                              length);						// Size of element
-                        } else {
-                           // set maximum value to unirec element
-                           memset( (conf->ifc[i].buffer) + matchField->offset_ar[i],
-                              0xFF,
-                              matchField->size);
-                        }
-                  }
+      matchField = planField->field;
+      src = data_record + offset + size_length;
 
-                  // if required, add required-filled count
-                  conf->ifc[i].requiredFilled += matchField->required_ar[i];
-               }
-            }
-         } else {
-            // Dynamic element
-            matchField->valueSize = length;
-            matchField->value     = (void*) (data_record + offset + size_length);
-            matchField->valueFilled = 1;
-            // Fill required count for Unirec where this element is required
-            for (int i = 0; i < conf->ifc_count; i++) {
-               // For every interface
-               if (matchField->included_ar[i]) {
-                  // If element is present in current ifc
-                  conf->ifc[i].requiredFilled += matchField->required_ar[i];
-               }
-            }
-         }
+      /* Skip the length of the value */
+      offset += length + size_length;
+
+      if (!matchField) {
+         continue;
       }
 
-      /* Skip enterprise element number if necessary*/
-      if (template->fields[index].ie.id >> 15) {
-         index++;
+      if (planField->conv == UR_CONV_DYNAMIC) {
+         // Copy ptr to this element to the encoder for futher use
+         enc->dyn[matchField->dynIndex].size = length;
+         enc->dyn[matchField->dynIndex].value = (void*) src;
+         enc->dyn[matchField->dynIndex].filled = 1;
+         // Fill required count for Unirec where this element is required
+         for (action = planField->actions; action < planField->actions + planField->actionCount; action++) {
+            enc->requiredFilled[action->ifc] += action->required;
+         }
+         continue;
       }
 
-      /* Skip the length of the value */
-      offset += length + size_length;
+      // Static element, copy to all Unirec ifcs whose are using this element
+      for (action = planField->actions; action < planField->actions + planField->actionCount; action++) {
+         dst = enc->buffer[action->ifc] + action->offset;
+
+         switch (planField->conv) {
+            case UR_CONV_IPV4:
+               // Put IPv4 into 128 bits in a special way (see ipaddr.h in Nemea-UniRec for details)
+               *(uint64_t*)(dst) = 0;
+               *(uint32_t*)(dst + 8) = *(uint32_t*)(src);
+               *(uint32_t*)(dst + 12) = 0xffffffff;
+               break;
+            case UR_CONV_IP:
+               memcpy(dst, src, length);
+               break;
+            case UR_CONV_PACKET4:
+               *(uint32_t*)(dst) = ntohl(*(uint32_t*)(src));
+               break;
+            case UR_CONV_PACKET8:
+               *(uint32_t*)(dst) = ntohl(*(uint32_t*)(src + 4));
+               break;
+            case UR_CONV_PACKET_INVALID:
+               *(uint32_t*)(dst) = 0xFFFFFFFF;
+               break;
+            case UR_CONV_TS:
+               // Handle Time variables
+               msec = be64toh(*(uint64_t*)(src));
+               sec = msec / 1000;
+               frac = ((msec % 1000) * 0x4189374BC6A7EFULL) >> 32;
+               *(uint64_t*)(dst) = (sec<<32) | frac;
+               break;
+            case UR_CONV_DBF:
+               // Handle DIR_BIT_FIELD
+               *(uint8_t*)(dst) = ((*(uint16_t*)(src)) >> 8) & 0x1;
+               break;
+            case UR_CONV_LBF:
+               // Handle LINK_BIT_FIELD, is BIG ENDIAN but we are using only LSB
+               *(uint64_t*)(dst) = 1LLU << ((*(uint8_t*)(src + 3)) - 1);
+               break;
+            case UR_CONV_U8:
+               *dst = read8(src);
+               break;
+            case UR_CONV_U16:
+               *(uint16_t *) dst = ntohs(read16(src));
+               break;
+            case UR_CONV_U32:
+               *(uint32_t *) dst = ntohl(read32(src));
+               break;
+            case UR_CONV_U64:
+               *(uint64_t *) dst = be64toh(read64(src));
+               break;
+            case UR_CONV_COPY:
+               data_copy(dst, src, length);
+               break;
+            case UR_CONV_COPY_VAR:
+               // Check length of ipfix element and if it is larger than unirec element, then saturate unirec element
+               if (matchField->size >= length) {
+                  data_copy(dst, src, length);
+               } else {
+                  memset(dst, 0xFF, matchField->size);
+               }
+               break;
+            case UR_CONV_SATURATE:
+               // set maximum value to unirec element
+               memset(dst, 0xFF, matchField->size);
+               break;
+            default:
+               break;
+         }
+
+         // if required, add required-filled count
+         enc->requiredFilled[action->ifc] += action->required;
+      }
    }
 
-   return offset;
+   return offset + plan->tailSkip;
 }
 
 /**
  * \brief Copy dynamic fields to output buffer
  *
  * \param[in] conf Pointer to interface config structure
+ * \param[in] enc Encoder with values of dynamic fields
+ * \param[out] buffer Record buffer of the interface
+ * \return size of the record
  */
-static void process_dynamic(ifc_config *conf)
+static uint16_t process_dynamic(const ifc_config *conf, const urEncoder *enc, char *buffer)
 {
-   conf->bufferOffset = conf->bufferStaticSize;
+   uint16_t bufferOffset = conf->bufferStaticSize;
+   uint16_t bufferDynSize = 0;
 
    // Cycle throu all fields
    for (int i = 0; i < conf->dynCount; i++) {
+      const urDynValue *dyn = &enc->dyn[conf->dynAr[i]->dynIndex];
       // Saturate dynamic field size
-      size_t size = conf->dynAr[i]->valueSize > MAX_DYNAMIC_FIELD_SIZE ? MAX_DYNAMIC_FIELD_SIZE : conf->dynAr[i]->valueSize;
+      size_t size = dyn->size > MAX_DYNAMIC_FIELD_SIZE ? MAX_DYNAMIC_FIELD_SIZE : dyn->size;
 
       // Store end offset of dynamic value to Unirec buffer
-      *(uint16_t*)(conf->buffer + conf->dynAr[i]->offset_ar[conf->number]) = (uint16_t)conf->bufferDynSize;
+      *(uint16_t*)(buffer + conf->dynAr[i]->offset_ar[conf->number]) = bufferDynSize;
       // Store size of dynamic value to Unirec buffer
-      *(uint16_t*)(conf->buffer + conf->dynAr[i]->offset_ar[conf->number] + 2) = (uint16_t)size;
+      *(uint16_t*)(buffer + conf->dynAr[i]->offset_ar[conf->number] + 2) = (uint16_t)size;
       // If dynamic field was filled, copy it to Unirec buffer
-      if (conf->dynAr[i]->valueFilled) {
-         memcpy(	conf->buffer + conf->bufferOffset,
-            conf->dynAr[i]->value,
-            size);
-
-         conf->bufferOffset  += size;
-         conf->bufferDynSize += size;
-         conf->dynAr[i]->valueFilled = 0;
-         conf->dynAr[i]->valueSize = 0;
+      if (dyn->filled) {
+         memcpy(buffer + bufferOffset, dyn->value, size);
+
+         bufferOffset  += size;
+         bufferDynSize += size;
       }
    }
+
+   return bufferOffset;
+}
+
+/**
+ * \brief Clear the record being encoded
+ *
+ * \param[in] conf Pointer to storage plugin structure
+ * \param[in,out] enc Encoder
+ */
+static void encoder_reset(const unirec_config *conf, urEncoder *enc)
+{
+   // Clear static fields
+   for (int i = 0; i < conf->ifc_count; i++) {
+      if (conf->ifc[i].primary == i) {
+         memset(enc->buffer[i], 0, conf->ifc[i].bufferStaticSize);
+         enc->requiredFilled[i] = 0;
+      }
+   }
+   // Set default values for dynamic fields
+   memset(enc->dyn, 0, conf->dynFieldCount * sizeof(urDynValue));
+}
+
+/**
+ * \brief Encode all records of a data set
+ *
+ * Complete records are sent to TRAP interfaces or, if \p job is given,
+ * added to outputs of the job. Interfaces sharing records of another
+ * interface get the same record. On failure, the encoder is cleared and
+ * outputs of the job keep only complete records.
+ *
+ * \param[in] conf Pointer to storage plugin structure
+ * \param[in,out] enc Encoder
+ * \param[in] plan Plan of the template of the data set
+ * \param[in] data_set Data set
+ * \param[in] odid ODID of the message
+ * \param[out] job Job to fill or NULL to send the records
+ * \return 0 on success, -1 otherwise
+ */
+static int encode_data_set(const unirec_config *conf, urEncoder *enc, const urPlan *plan,
+      struct ipfix_data_set *data_set, uint16_t odid, workers_job_t *job)
+{
+   char *data_record;
+   uint32_t offset = 4;  /* Size of the header */
+   uint16_t ret;
+   int i;
+
+   while ((int) ntohs(data_set->header.length) - (int) offset - (int) plan->minLength >= 0) {
+      data_record = (((char *) data_set) + offset);
+
+      // Process data record only once
+      ret = process_record(data_record, plan, enc, conf, odid);
+
+      // Check that the record was processes successfuly
+      if (ret == 0) {
+         encoder_reset(conf, enc);
+         return -1;
+      }
+
+      //Fill dynamic fields for every UniRec record
+      for (i = 0; i < conf->ifc_count; i++) {
+         enc->recordSize[i] = 0;
+         if (conf->ifc[i].primary != i) {
+            continue;
+         }
+
+         // Check if we have all required fields
+         if (conf->ifc[i].requiredCount == enc->requiredFilled[i]) {
+            // Fill dynamic fields if there are ones
+            if (conf->ifc[i].dynamic) {
+               enc->recordSize[i] = process_dynamic(&(conf->ifc[i]), enc, enc->buffer[i]);
+            } else {
+               enc->recordSize[i] = conf->ifc[i].bufferStaticSize;
+            }
+
+            if (job && workers_output_add(&job->output[i], enc->buffer[i], enc->recordSize[i])) {
+               // Remove the record from outputs of the previous interfaces
+               while (--i >= 0) {
+                  if (enc->recordSize[i]) {
+                     job->output[i].size -= sizeof(uint16_t) + enc->recordSize[i];
+                  }
+               }
+               encoder_reset(conf, enc);
+               return -1;
+            }
+         }
+      }
+
+      // Send record
+      for (i = 0; !job && i < conf->ifc_count; i++) {
+         int primary = conf->ifc[i].primary;
+         if (enc->recordSize[primary]) {
+            trap_ctx_send(	conf->trap_ctx_ptr,
+                  conf->ifc[i].number,
+                  enc->buffer[primary],
+                  enc->recordSize[primary]);
+                  // conf->ifc[i].timeout); // Timeout is set by IFCCTL
+         }
+      }
+
+      encoder_reset(conf, enc);
+      offset += ret;
+   }
+
+   return 0;
+}
+
+/**
+ * \brief Encode a data set of a job (run by workers)
+ *
+ * \param[in] arg Pointer to storage plugin structure
+ * \param[in] worker Index of the worker
+ * \param[in,out] job Job
+ */
+static void encode_job(void *arg, unsigned int worker, workers_job_t *job)
+{
+   unirec_config *conf = (unirec_config *) arg;
+
+   if (job->plan == NULL) {
+      return;
+   }
+
+   if (encode_data_set(conf, conf->encoders[worker], job->plan,
+         (struct ipfix_data_set *) job->data, job->odid, job)) {
+      MSG_ERROR(msg_module, "Failed to encode a data set\n");
+   }
+}
+
+/**
+ * \brief Destroy an encoder
+ *
+ * \param[in] enc Encoder to destroy
+ * \param[in] ifc_count Number of interfaces
+ */
+static void encoder_destroy(urEncoder *enc, int ifc_count)
+{
+   if (!enc) {
+      return;
+   }
+
+   if (enc->ownBuffers && enc->buffer) {
+      for (int i = 0; i < ifc_count; i++) {
+         free(enc->buffer[i]);
+      }
+   }
+   free(enc->buffer);
+   free(enc->requiredFilled);
+   free(enc->recordSize);
+   free(enc->dyn);
+   free(enc);
+}
+
+/**
+ * \brief Create an encoder
+ *
+ * \param[in] conf Pointer to storage plugin structure
+ * \param[in] shared Use buffers of interfaces instead of own ones
+ * \return New encoder or NULL on memory allocation error
+ */
+static urEncoder *encoder_create(const unirec_config *conf, int shared)
+{
+   urEncoder *enc;
+   int count = conf->ifc_count ? conf->ifc_count : 1;
+
+   enc = calloc(1, sizeof(urEncoder));
+   if (!enc) {
+      goto error;
+   }
+   enc->ownBuffers = !shared;
+   enc->buffer = calloc(count, sizeof(char *));
+   enc->requiredFilled = calloc(count, sizeof(uint8_t));
+   enc->recordSize = calloc(count, sizeof(uint16_t));
+   enc->dyn = calloc(conf->dynFieldCount ? conf->dynFieldCount : 1, sizeof(urDynValue));
+   if (!enc->buffer || !enc->requiredFilled || !enc->recordSize || !enc->dyn) {
+      goto error;
+   }
+
+   for (int i = 0; i < conf->ifc_count; i++) {
+      if (conf->ifc[i].primary != i) {
+         continue;
+      }
+      if (shared) {
+         enc->buffer[i] = conf->ifc[i].buffer;
+         continue;
+      }
+      enc->buffer[i] = calloc(1, conf->ifc[i].bufferAllocSize);
+      if (!enc->buffer[i]) {
+         goto error;
+      }
+   }
+
+   return enc;
+
+error:
+   MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+   encoder_destroy(enc, conf->ifc_count);
+   return NULL;
 }
 
 /**
@@ -462,11 +915,9 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
 {
    uint16_t data_index = 0;
    struct ipfix_data_set *data_set;
-   char *data_record;
    struct ipfix_template *template;
-   uint32_t offset;
-   uint16_t min_record_length, ret = 0;
-   int i;
+   urPlan *plan;
+   workers_job_t *job;
 
    // ********** Store ODID *************
    uint32_t ODID = ntohl(ipfix_msg->pkt_header->observation_domain_id);
@@ -487,58 +938,28 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
          continue;
       }
 
-      min_record_length = template->data_length;
-      offset = 4;  /* Size of the header */
-
-      if (min_record_length & 0x8000) {
-         /* Record contains fields with variable length */
-         min_record_length = min_record_length & 0x7fff; /* size of the fields, variable fields excluded  */
+      /* Fields are resolved once per template */
+      plan = plan_get(conf, template);
+      if (plan == NULL) {
+         return -1;
       }
 
-      while ((int) ntohs(data_set->header.length) - (int) offset - (int) min_record_length >= 0) {
-         data_record = (((char *) data_set) + offset);
-
-         // Process data record only once
-         ret = process_record(data_record, template, conf);
-
-         // Check that the record was processes successfuly
-         if (ret == 0) {
+      if (conf->workers) {
+         /* Encoded by workers, the message is not available later */
+         job = workers_job_get(conf->workers);
+         job->plan = plan;
+         job->odid = conf->odid;
+         if (workers_job_copy(job, data_set, ntohs(data_set->header.length))) {
+            /* Nothing to encode, the job must be submitted anyway */
+            job->plan = NULL;
+            workers_job_submit(conf->workers, job);
             return -1;
          }
-
-          //Fill dynamic fields for every UniRec record and send it
-         for (i = 0; i < conf->ifc_count; i++) {
-            // Check if we have all required fields
-            if (conf->ifc[i].requiredCount == conf->ifc[i].requiredFilled) {
-               // Fill dynamic fields if there are ones
-               if (conf->ifc[i].dynamic) {
-                  process_dynamic(&(conf->ifc[i]));
-               }
-               // Send record
-               trap_ctx_send(	conf->trap_ctx_ptr,
-                     conf->ifc[i].number,
-                     conf->ifc[i].buffer,
-                     conf->ifc[i].bufferStaticSize + conf->ifc[i].bufferDynSize);
-                     // conf->ifc[i].timeout); // Timeout is set by IFCCTL
-            } else {
-               // Set default values for dynamic fields
-               for (int j = 0; j < conf->ifc[i].dynCount; j++) {
-                  conf->ifc[i].dynAr[j]->valueFilled = 0;
-                  conf->ifc[i].dynAr[j]->valueSize = 0;
-               }
-            }
-
-            // Clear static fields
-            memset(conf->ifc[i].buffer, 0, conf->ifc[i].bufferStaticSize);
-
-            conf->ifc[i].requiredFilled = 0;
-            conf->ifc[i].bufferDynSize = 0;
-         }
-
-         offset += ret;
+         workers_job_submit(conf->workers, job);
+      } else if (encode_data_set(conf, conf->encoders[0], plan, data_set, conf->odid, NULL)) {
+         return -1;
       }
 
-
       /* Process next set */
       data_set = ipfix_msg->data_couple[++data_index].data_set;
    }
@@ -1125,6 +1546,67 @@ static int parse_format(unirec_config *conf_plugin)
    return 0;
 }
 
+/**
+ * \brief Check whether two interfaces produce identical records
+ *
+ * @param conf Pointer to storage plugin structure
+ * @param a Index of the first interface
+ * @param b Index of the second interface
+ * @return 1 if the UniRec templates and required fields are the same, 0 otherwise
+ */
+static int same_records(const unirec_config *conf, int a, int b)
+{
+   const ifc_config *ifc_a = &conf->ifc[a], *ifc_b = &conf->ifc[b];
+   const unirecField *field;
+
+   if (strcmp(ifc_a->unirec_data_format, ifc_b->unirec_data_format) != 0 ||
+       ifc_a->requiredCount != ifc_b->requiredCount ||
+       ifc_a->bufferStaticSize != ifc_b->bufferStaticSize) {
+      return 0;
+   }
+
+   for (field = conf->fields; field != NULL; field = field->next) {
+      if (field->included_ar[a] != field->included_ar[b] ||
+          field->required_ar[a] != field->required_ar[b] ||
+          (field->included_ar[a] && field->offset_ar[a] != field->offset_ar[b])) {
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+/**
+ * \brief Prepare fields and interfaces for encoding
+ *
+ * Assigns indexes of values to dynamic fields and finds interfaces with
+ * identical records, which are encoded only once.
+ *
+ * @param conf Pointer to storage plugin structure
+ */
+static void prepare_encoding(unirec_config *conf)
+{
+   unirecField *field;
+
+   conf->dynFieldCount = 0;
+   for (field = conf->fields; field != NULL; field = field->next) {
+      if (field->size == -1) {
+         field->dynIndex = conf->dynFieldCount++;
+      }
+   }
+
+   for (int i = 0; i < conf->ifc_count; i++) {
+      conf->ifc[i].primary = i;
+      for (int j = 0; j < i; j++) {
+         if (conf->ifc[j].primary == j && same_records(conf, i, j)) {
+            MSG_INFO(msg_module, "Interface %d sends records of interface %d (same UniRec template)\n", i, j);
+            conf->ifc[i].primary = j;
+            break;
+         }
+      }
+   }
+}
+
 /**
  * \brief Storage plugin initialization function.
  *
@@ -1249,7 +1731,18 @@ int storage_init (char *params, void **config)
               MSG_WARNING(msg_module, "Unknown ODID Get Method. Using default method \"%s\"\n", "manager");
                 ODID_get_method = ODID_MANAGER_METHOD;
             }
-       }
+       } else
+      if ((!xmlStrcmp(cur->name, (const xmlChar *) "workers"))) {
+         char *workers = (char *) xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+         if (workers != NULL) {
+            conf->workerCount = atoi(workers);
+            free(workers);
+         }
+         if (conf->workerCount < 0 || conf->workerCount > WORKERS_MAX) {
+            MSG_ERROR(msg_module, "Number of workers must be between 0 and %d\n", WORKERS_MAX);
+            goto err_xml;
+         }
+      }
 
       cur = cur->next;
    }
@@ -1285,9 +1778,9 @@ int storage_init (char *params, void **config)
    conf->ifc = (ifc_config *) malloc(sizeof(ifc_config) * conf->ifc_count);
    if (!conf->ifc) {
       MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
-      return -1;
+      goto err_xml;
    }
-   memset(conf->ifc, 0, sizeof(ifc_config *) * conf->ifc_count);
+   memset(conf->ifc, 0, sizeof(ifc_config) * conf->ifc_count);
 
 
    // Set initial data to interface config structures
@@ -1299,9 +1792,7 @@ int storage_init (char *params, void **config)
       conf->ifc[i].special_field_odid = NULL;
       conf->ifc[i].special_field_link_bit_field = NULL;
       conf->ifc[i].requiredCount = 0;
-      conf->ifc[i].requiredFilled = 0;
       conf->ifc[i].bufferStaticSize = 0;
-      conf->ifc[i].bufferDynSize = 0;
       conf->ifc[i].bufferAllocSize = 0;
 
       /* Check that all necessary information is provided */
@@ -1331,6 +1822,7 @@ int storage_init (char *params, void **config)
    if (parse_format(conf)) {
       goto err_parse;
    }
+   prepare_encoding(conf);
 
 
    /* Set number of TRAP output interfaces */
@@ -1352,6 +1844,39 @@ int storage_init (char *params, void **config)
       MSG_ERROR(msg_module, "Could not initialize TRAP\n");
    }
 
+   /* Create encoders (the first one uses buffers of interfaces) */
+   conf->encoders = calloc(conf->workerCount ? conf->workerCount : 1, sizeof(urEncoder *));
+   if (!conf->encoders) {
+      MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+      goto err_trap;
+   }
+   for (i = 0; i < (conf->workerCount ? conf->workerCount : 1); i++) {
+      conf->encoders[i] = encoder_create(conf, i == 0);
+      if (!conf->encoders[i]) {
+         goto err_encoders;
+      }
+   }
+
+   if (conf->workerCount) {
+      int *primary = malloc(sizeof(int) * (conf->ifc_count ? conf->ifc_count : 1));
+      if (!primary) {
+         MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+         goto err_encoders;
+      }
+      for (i = 0; i < conf->ifc_count; i++) {
+         primary[i] = conf->ifc[i].primary;
+      }
+
+      conf->workers = workers_create(conf->workerCount, conf->trap_ctx_ptr,
+            conf->ifc_count, primary, encode_job, conf);
+      free(primary);
+      if (!conf->workers) {
+         /* Threads already started were stopped by workers_create() */
+         goto err_encoders;
+      }
+      MSG_INFO(msg_module, "Records are encoded by %d workers\n", conf->workerCount);
+   }
+
    /* Copy configuration */
    *config = conf;
 
@@ -1365,15 +1890,31 @@ int storage_init (char *params, void **config)
 
    return 0;
 
+err_encoders:
+   for (i = 0; i < (conf->workerCount ? conf->workerCount : 1); i++) {
+      encoder_destroy(conf->encoders[i], conf->ifc_count);
+   }
+   free(conf->encoders);
+
+err_trap:
+   if (conf->trap_ctx_ptr) {
+      trap_ctx_finalize(&conf->trap_ctx_ptr);
+   }
+
 err_parse:
    for (i = 0; i < conf->ifc_count; i++) {
       /* free format */
       free(conf->ifc[i].format);
+      free(conf->ifc[i].buffer);
+      free(conf->ifc[i].dynAr);
 
       /* free fieldList */
       destroy_fields(conf->ifc[i].fields);
    }
+   destroy_fields(conf->fields);
+
 err_xml:
+   free(conf->ifc);
    xmlFreeDoc(doc);
 
 err_init:
@@ -1435,6 +1976,13 @@ int store_now (const void *config)
       return -1;
    }
 
+   const unirec_config *conf = (const unirec_config *) config;
+
+   /* Send everything that was passed to workers */
+   if (conf->workers) {
+      workers_sync(conf->workers);
+   }
+
    return 0;
 }
 
@@ -1454,10 +2002,19 @@ int storage_close (void **config)
 
    printf("Plugin is shuting down for ODID: %u\n", conf->odid);
 
+   // Encode and send all records passed to workers
+   workers_destroy(conf->workers);
+
    trap_ctx_finalize(&conf->trap_ctx_ptr);
 
    // Free everything
    int i;
+   if (conf->encoders) {
+      for (i = 0; i < (conf->workerCount ? conf->workerCount : 1); i++) {
+         encoder_destroy(conf->encoders[i], conf->ifc_count);
+      }
+      free(conf->encoders);
+   }
    for (i = 0 ; i < conf->ifc_count; i++) {
       free(conf->ifc[i].format);
       free(conf->ifc[i].buffer);
@@ -1465,6 +2022,11 @@ int storage_close (void **config)
    }
       destroy_fields(conf->fields);
 
+   for (i = 0; i < conf->planCount; i++) {
+      plan_destroy(conf->plans[i]);
+   }
+   free(conf->plans);
+
    free(*config);
    return 0;
 }
@@ -42,6 +42,7 @@
 #define IPFIX2UNIREC_H_
 
 #include "fast_hash_table.h"
+#include "workers.h"
 
 
 
@@ -57,6 +58,8 @@
 #define UNIREC_DEFAULT_LENGTH_OF_DATA_FORMAT 1024 /// Length of string of a template
 
 #define DEFAULT_TIMEOUT 0 /**< No waiting */
+#define PLAN_CACHE_MAX 1024 /**< Maximal number of cached template plans */
+#define WORKERS_MAX 64 /**< Maximal number of encoding workers */
 
 // Path to unirec elements config file
 const char *UNIREC_ELEMENTS_FILE = DATAROOTDIR "/ipfixcol/unirec-elements.txt";
@@ -96,6 +99,7 @@ typedef struct unirecField {
    void *value;				/**< Pointer to value of the field */
    uint16_t valueSize;			/**< Size of the value */
    uint8_t valueFilled;		/**< Is the value filled? */
+   int dynIndex;				/**< Index of the value of a dynamic field in urEncoder */
 
 
 
@@ -107,6 +111,93 @@ typedef struct unirecField {
 } unirecField;
 
 
+/**
+ * \brief Conversion of an IPFIX field into an UniRec field
+ *
+ * Resolved once per template from the type of the UniRec field and the
+ * IPFIX element and its length.
+ */
+enum urConversion {
+   UR_CONV_NONE,           /**< Nothing to copy (only required count) */
+   UR_CONV_IPV4,           /**< IPv4 address into 128 bits */
+   UR_CONV_IP,             /**< IPv6 address */
+   UR_CONV_PACKET4,        /**< 32 bit packet count */
+   UR_CONV_PACKET8,        /**< 64 bit packet count (lower half) */
+   UR_CONV_PACKET_INVALID, /**< Packet count of unsupported size */
+   UR_CONV_TS,             /**< Timestamp in milliseconds */
+   UR_CONV_DBF,            /**< DIR_BIT_FIELD */
+   UR_CONV_LBF,            /**< LINK_BIT_FIELD */
+   UR_CONV_U8,             /**< 1 byte value */
+   UR_CONV_U16,            /**< 2 byte value (byte order conversion) */
+   UR_CONV_U32,            /**< 4 byte value (byte order conversion) */
+   UR_CONV_U64,            /**< 8 byte value (byte order conversion) */
+   UR_CONV_COPY,           /**< Fixed length value (data_copy()) */
+   UR_CONV_COPY_VAR,       /**< Variable length value (copy or saturate) */
+   UR_CONV_SATURATE,       /**< Value larger than the UniRec field */
+   UR_CONV_DYNAMIC         /**< Dynamic UniRec field */
+};
+
+/**
+ * \brief Destination of a value in an interface buffer
+ */
+typedef struct urPlanAction {
+   uint16_t ifc;        /**< Index of the interface */
+   uint16_t offset;     /**< Offset in the buffer of the interface */
+   int8_t required;     /**< Is the field required by the interface */
+} urPlanAction;
+
+/**
+ * \brief Processing of a template field
+ */
+typedef struct urPlanField {
+   uint16_t skip;       /**< Length of unmatched fixed-length fields before this one */
+   uint16_t length;     /**< Length from the template (VAR_IE_LENGTH for variable) */
+   uint8_t conv;        /**< Conversion (see urConversion) */
+   unirecField *field;  /**< UniRec field (NULL for an unmatched variable-length field) */
+   uint16_t actionCount;   /**< Number of destinations */
+   urPlanAction *actions;  /**< Destinations (interfaces including the field) */
+} urPlanField;
+
+/**
+ * \brief Processing of records of a template
+ *
+ * Only matched fields and variable-length fields are present, lengths of
+ * the others are folded into skips. Fixed-length templates therefore need
+ * no length decoding at all.
+ */
+typedef struct urPlan {
+   struct ipfix_template *template; /**< Template */
+   template_ie *ies;       /**< Copy of the template fields (to detect a new template at the same address) */
+   uint16_t ieCount;       /**< Number of items in ies */
+   urPlanField *fields;    /**< Fields to process */
+   uint16_t fieldCount;    /**< Number of fields to process */
+   uint16_t tailSkip;      /**< Length of unmatched fixed-length fields at the end */
+   uint16_t minLength;     /**< Minimal length of a record (1 for each variable-length field) */
+} urPlan;
+
+/**
+ * \brief Value of a dynamic field in the record being encoded
+ */
+typedef struct urDynValue {
+   void *value;            /**< Pointer to the value in the IPFIX record */
+   uint16_t size;          /**< Size of the value */
+   uint8_t filled;         /**< Is the value filled? */
+} urDynValue;
+
+/**
+ * \brief Scratch space for encoding of records
+ *
+ * Every encoding thread has its own. Only interfaces that are not sharing
+ * records of another interface have buffers.
+ */
+typedef struct urEncoder {
+   char **buffer;          /**< Record buffer of each interface */
+   int ownBuffers;         /**< Were the buffers allocated by the encoder */
+   uint8_t *requiredFilled;   /**< Count of filled required fields of each interface */
+   uint16_t *recordSize;   /**< Size of the encoded record of each interface (0 if incomplete) */
+   urDynValue *dyn;        /**< Values of dynamic fields (by dynIndex) */
+} urEncoder;
+
 /**
  * \struct interface
  *
@@ -123,17 +214,15 @@ typedef struct ifc_config {
    unirecField			*fields;
    char 				*buffer;	/**< UniRec ouput buffer */
    int				bufferSize;		/**< UniRec ouput buffer size */
-   int 				bufferDynSize;
    int				bufferAllocSize;
    int				dynamicPartOffset;	/**< Offset of current position in dynamic part of record (sum of dynamic field sizes) */
-   int				bufferOffset;
    uint8_t				requiredCount;	/**< Count of all required Unirec fields */
-   uint8_t				requiredFilled;	/**< Count of filled required Unirec fields */
    uint16_t 			bufferStaticSize;
    uint8_t 			dynamic;
    uint16_t 			dynCount;
    uint16_t 			dynArAlloc;
    unirecField 			**dynAr;
+   int				primary;	/**< Interface whose records are sent (same UniRec template) */
 
    unirecField			*special_field_odid; /**< Pointer to special field ODID */
    unirecField			*special_field_link_bit_field; /**< Pointer to special field LINK_BIT_FIELD */
@@ -158,6 +247,13 @@ typedef struct unirec_config {
     uint8_t ODID_get_method;
    uint8_t SF_DATA;
    fht_table_t *ht_fields;
+   urPlan **plans;      /**< Plans of templates (most recently used first) */
+   int planCount;       /**< Number of plans */
+   int planAlloc;       /**< Size of the array of plans */
+   int dynFieldCount;   /**< Number of dynamic fields */
+   urEncoder **encoders;   /**< Encoders (one for each worker or one for the plugin thread) */
+   int workerCount;     /**< Number of encoding workers (0 = plugin thread) */
+   workers_t *workers;  /**< Encoding workers and interface senders */
 } unirec_config;
 
 
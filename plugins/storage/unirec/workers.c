@@ -0,0 +1,383 @@
+/**
+ * \file workers.c
+ * \brief Workers encoding UniRec records
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ipfixcol.h>
+
+#include "workers.h"
+
+/** Number of jobs (data sets) in flight */
+#define WORKERS_JOBS 256
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "unirec";
+
+/** States of a job */
+enum job_state {
+   JOB_FREE,         /**< Can be taken by workers_job_get() */
+   JOB_FILLING,      /**< Taken, not submitted yet */
+   JOB_QUEUED,       /**< Waiting for a worker */
+   JOB_ENCODING,     /**< Being encoded */
+   JOB_ENCODED       /**< Waiting for senders */
+};
+
+/** Thread of the pool */
+struct workers_thread {
+   workers_t *pool;        /**< Pool */
+   unsigned int idx;       /**< Index of the worker or the interface */
+   pthread_t thread;       /**< Thread */
+};
+
+struct workers_s {
+   pthread_mutex_t lock;         /**< Protects jobs and counters */
+   pthread_cond_t cond_queued;   /**< A job was submitted */
+   pthread_cond_t cond_encoded;  /**< A job was encoded */
+   pthread_cond_t cond_free;     /**< A job was sent to all interfaces */
+
+   workers_job_t jobs[WORKERS_JOBS]; /**< Ring of jobs */
+   uint64_t next_get;      /**< Sequence number of the next taken job */
+   uint64_t next_encode;   /**< Sequence number of the next job to encode */
+   unsigned int busy;      /**< Number of jobs that are not free */
+   int stop;               /**< Stop the threads */
+
+   trap_ctx_t *ctx;        /**< TRAP context */
+   int ifc_count;          /**< Number of interfaces */
+   int *primary;           /**< Output sent to each interface */
+   workers_encode_f encode;   /**< Encoding function */
+   void *arg;              /**< Argument of the encoding function */
+
+   unsigned int count;     /**< Number of workers */
+   unsigned int started;   /**< Number of started threads */
+   struct workers_thread *threads; /**< Workers followed by senders */
+};
+
+/**
+ * \brief Mark a job as free (lock must be held)
+ */
+static void
+job_free(workers_t *pool, workers_job_t *job)
+{
+   job->state = JOB_FREE;
+   pool->busy--;
+   pthread_cond_broadcast(&pool->cond_free);
+}
+
+/**
+ * \brief Worker thread
+ *
+ * Takes submitted jobs in their order and encodes them.
+ */
+static void *
+worker_main(void *arg)
+{
+   struct workers_thread *thr = arg;
+   workers_t *pool = thr->pool;
+   workers_job_t *job;
+
+   pthread_mutex_lock(&pool->lock);
+   while (1) {
+      job = &pool->jobs[pool->next_encode % WORKERS_JOBS];
+      if (job->state == JOB_QUEUED && job->seq == pool->next_encode) {
+         job->state = JOB_ENCODING;
+         pool->next_encode++;
+         pthread_mutex_unlock(&pool->lock);
+
+         pool->encode(pool->arg, thr->idx, job);
+
+         pthread_mutex_lock(&pool->lock);
+         job->state = JOB_ENCODED;
+         job->senders = pool->ifc_count;
+         if (job->senders == 0) {
+            job_free(pool, job);
+         }
+         pthread_cond_broadcast(&pool->cond_encoded);
+         continue;
+      }
+
+      if (pool->stop) {
+         break;
+      }
+      pthread_cond_wait(&pool->cond_queued, &pool->lock);
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return NULL;
+}
+
+/**
+ * \brief Sender thread of an interface
+ *
+ * Sends records of encoded jobs strictly in the order of sequence numbers.
+ */
+static void *
+sender_main(void *arg)
+{
+   struct workers_thread *thr = arg;
+   workers_t *pool = thr->pool;
+   workers_job_t *job;
+   workers_output_t *output;
+   uint64_t seq = 0;
+   uint16_t size;
+   char *pos;
+
+   pthread_mutex_lock(&pool->lock);
+   while (1) {
+      job = &pool->jobs[seq % WORKERS_JOBS];
+      if (job->state == JOB_ENCODED && job->seq == seq) {
+         pthread_mutex_unlock(&pool->lock);
+
+         output = &job->output[pool->primary[thr->idx]];
+         for (pos = output->data; pos < output->data + output->size; pos += size) {
+            memcpy(&size, pos, sizeof(size));
+            pos += sizeof(size);
+            trap_ctx_send(pool->ctx, thr->idx, pos, size);
+         }
+
+         pthread_mutex_lock(&pool->lock);
+         if (--job->senders == 0) {
+            job_free(pool, job);
+         }
+         seq++;
+         continue;
+      }
+
+      if (pool->stop) {
+         break;
+      }
+      pthread_cond_wait(&pool->cond_encoded, &pool->lock);
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return NULL;
+}
+
+/**
+ * \brief Stop and join started threads, free the pool
+ */
+static void
+workers_free(workers_t *pool)
+{
+   unsigned int i;
+
+   pthread_mutex_lock(&pool->lock);
+   pool->stop = 1;
+   pthread_cond_broadcast(&pool->cond_queued);
+   pthread_cond_broadcast(&pool->cond_encoded);
+   pthread_mutex_unlock(&pool->lock);
+
+   for (i = 0; i < pool->started; i++) {
+      pthread_join(pool->threads[i].thread, NULL);
+   }
+
+   for (i = 0; i < WORKERS_JOBS; i++) {
+      if (pool->jobs[i].output) {
+         for (int j = 0; j < pool->ifc_count; j++) {
+            free(pool->jobs[i].output[j].data);
+         }
+      }
+      free(pool->jobs[i].output);
+      free(pool->jobs[i].data);
+   }
+
+   pthread_cond_destroy(&pool->cond_free);
+   pthread_cond_destroy(&pool->cond_encoded);
+   pthread_cond_destroy(&pool->cond_queued);
+   pthread_mutex_destroy(&pool->lock);
+   free(pool->threads);
+   free(pool->primary);
+   free(pool);
+}
+
+workers_t *
+workers_create(unsigned int count, trap_ctx_t *ctx, int ifc_count,
+      const int *primary, workers_encode_f encode, void *arg)
+{
+   workers_t *pool;
+   unsigned int i;
+
+   pool = calloc(1, sizeof(*pool));
+   if (!pool) {
+      MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+      return NULL;
+   }
+
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->cond_queued, NULL);
+   pthread_cond_init(&pool->cond_encoded, NULL);
+   pthread_cond_init(&pool->cond_free, NULL);
+   pool->ctx = ctx;
+   pool->ifc_count = ifc_count;
+   pool->encode = encode;
+   pool->arg = arg;
+   pool->count = count;
+
+   pool->primary = malloc((ifc_count ? ifc_count : 1) * sizeof(int));
+   pool->threads = calloc(count + ifc_count, sizeof(struct workers_thread));
+   if (!pool->primary || !pool->threads) {
+      goto error;
+   }
+   memcpy(pool->primary, primary, ifc_count * sizeof(int));
+
+   for (i = 0; i < WORKERS_JOBS; i++) {
+      pool->jobs[i].output = calloc(ifc_count ? ifc_count : 1, sizeof(workers_output_t));
+      if (!pool->jobs[i].output) {
+         goto error;
+      }
+   }
+
+   for (i = 0; i < count + ifc_count; i++) {
+      struct workers_thread *thr = &pool->threads[i];
+      int ret;
+
+      thr->pool = pool;
+      thr->idx = (i < count) ? i : i - count;
+      ret = pthread_create(&thr->thread, NULL, (i < count) ? worker_main : sender_main, thr);
+      if (ret != 0) {
+         MSG_ERROR(msg_module, "Failed to start a thread: %s\n", strerror(ret));
+         workers_free(pool);
+         return NULL;
+      }
+      pool->started++;
+   }
+
+   return pool;
+
+error:
+   MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+   workers_free(pool);
+   return NULL;
+}
+
+void
+workers_destroy(workers_t *workers)
+{
+   if (!workers) {
+      return;
+   }
+
+   workers_sync(workers);
+   workers_free(workers);
+}
+
+workers_job_t *
+workers_job_get(workers_t *workers)
+{
+   workers_job_t *job;
+
+   pthread_mutex_lock(&workers->lock);
+   job = &workers->jobs[workers->next_get % WORKERS_JOBS];
+   while (job->state != JOB_FREE) {
+      pthread_cond_wait(&workers->cond_free, &workers->lock);
+   }
+   job->state = JOB_FILLING;
+   job->seq = workers->next_get++;
+   workers->busy++;
+   pthread_mutex_unlock(&workers->lock);
+
+   for (int i = 0; i < workers->ifc_count; i++) {
+      job->output[i].size = 0;
+   }
+   job->plan = NULL;
+
+   return job;
+}
+
+int
+workers_job_copy(workers_job_t *job, const void *data, uint32_t size)
+{
+   if (size > job->dataAlloc) {
+      char *tmp = realloc(job->data, size);
+      if (!tmp) {
+         MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+         return -1;
+      }
+      job->data = tmp;
+      job->dataAlloc = size;
+   }
+
+   memcpy(job->data, data, size);
+   return 0;
+}
+
+void
+workers_job_submit(workers_t *workers, workers_job_t *job)
+{
+   pthread_mutex_lock(&workers->lock);
+   job->state = JOB_QUEUED;
+   pthread_cond_signal(&workers->cond_queued);
+   pthread_mutex_unlock(&workers->lock);
+}
+
+int
+workers_output_add(workers_output_t *output, const char *record, uint16_t size)
+{
+   uint32_t need = output->size + sizeof(size) + size;
+
+   if (need > output->alloc) {
+      uint32_t alloc = output->alloc ? output->alloc : 4096;
+      char *tmp;
+
+      while (alloc < need) {
+         alloc *= 2;
+      }
+      tmp = realloc(output->data, alloc);
+      if (!tmp) {
+         MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)\n", __FILE__, __LINE__);
+         return -1;
+      }
+      output->data = tmp;
+      output->alloc = alloc;
+   }
+
+   memcpy(output->data + output->size, &size, sizeof(size));
+   memcpy(output->data + output->size + sizeof(size), record, size);
+   output->size = need;
+   return 0;
+}
+
+void
+workers_sync(workers_t *workers)
+{
+   pthread_mutex_lock(&workers->lock);
+   while (workers->busy > 0) {
+      pthread_cond_wait(&workers->cond_free, &workers->lock);
+   }
+   pthread_mutex_unlock(&workers->lock);
+}
@@ -0,0 +1,147 @@
+/**
+ * \file workers.h
+ * \brief Workers encoding UniRec records (header file)
+ *
+ * Copyright (C) 2017 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef UR_WORKERS_H
+#define UR_WORKERS_H
+
+#include <stdint.h>
+#include <libtrap/trap.h>
+
+struct urPlan;
+
+/**
+ * \brief Pool of threads encoding data sets into UniRec records
+ *
+ * Data sets are encoded by workers in parallel. Each TRAP interface has
+ * its own sender thread that sends records in the order in which the data
+ * sets were submitted.
+ */
+typedef struct workers_s workers_t;
+
+/** \brief Encoded records of an interface */
+typedef struct workers_output {
+   char *data;          /**< Records, each preceded by its size (2 bytes) */
+   uint32_t size;       /**< Size of the data */
+   uint32_t alloc;      /**< Size of the allocated memory */
+} workers_output_t;
+
+/** \brief Data set to encode */
+typedef struct workers_job {
+   uint64_t seq;        /**< Sequence number (order of sending) */
+   int state;           /**< State of the job (internal) */
+   int senders;         /**< Senders that have not sent the records yet (internal) */
+   const struct urPlan *plan; /**< Plan of the template of the data set */
+   uint16_t odid;       /**< ODID of the message */
+   char *data;          /**< Copy of the data set */
+   uint32_t dataAlloc;  /**< Size of the allocated memory */
+   workers_output_t *output;  /**< Encoded records of each interface */
+} workers_job_t;
+
+/**
+ * \brief Encode a data set of a job
+ * \param[in]     arg    Argument given to workers_create()
+ * \param[in]     worker Index of the worker
+ * \param[in,out] job    Job (records are added to its outputs)
+ */
+typedef void (*workers_encode_f)(void *arg, unsigned int worker, workers_job_t *job);
+
+/**
+ * \brief Create a pool of workers and interface senders
+ * \param[in] count     Number of workers
+ * \param[in] ctx       TRAP context
+ * \param[in] ifc_count Number of interfaces
+ * \param[in] primary   Interface whose output is sent to each interface
+ * \param[in] encode    Encoding function
+ * \param[in] arg       Argument of the encoding function
+ * \return On success returns a pointer to the pool. Otherwise returns NULL.
+ */
+workers_t *workers_create(unsigned int count, trap_ctx_t *ctx, int ifc_count,
+      const int *primary, workers_encode_f encode, void *arg);
+
+/**
+ * \brief Destroy a pool of workers
+ *
+ * All submitted jobs are sent before the threads are stopped.
+ * \param[in,out] workers Pool
+ */
+void workers_destroy(workers_t *workers);
+
+/**
+ * \brief Get a free job
+ *
+ * If all jobs are in use, the function waits. The job MUST be submitted
+ * by workers_job_submit() before another one is taken.
+ * \param[in,out] workers Pool
+ * \return Job with empty outputs
+ */
+workers_job_t *workers_job_get(workers_t *workers);
+
+/**
+ * \brief Copy a data set into a job
+ * \param[in,out] job  Job
+ * \param[in]     data Data set
+ * \param[in]     size Size of the data set
+ * \return 0 on success, -1 on memory allocation error
+ */
+int workers_job_copy(workers_job_t *job, const void *data, uint32_t size);
+
+/**
+ * \brief Pass a job to the workers
+ * \param[in,out] workers Pool
+ * \param[in]     job     Job from workers_job_get()
+ */
+void workers_job_submit(workers_t *workers, workers_job_t *job);
+
+/**
+ * \brief Append an encoded record to an output
+ * \param[in,out] output Output
+ * \param[in]     record Record
+ * \param[in]     size   Size of the record
+ * \return 0 on success, -1 on memory allocation error
+ */
+int workers_output_add(workers_output_t *output, const char *record, uint16_t size);
+
+/**
+ * \brief Wait until records of all submitted jobs are sent
+ *
+ * Plans of templates MUST NOT be destroyed without calling this first.
+ * \param[in,out] workers Pool
+ */
+void workers_sync(workers_t *workers);
+
+#endif /* UR_WORKERS_H */
@@ -61,7 +61,7 @@
 static const char *msg_module = "configuration";
 
 /** Acceptable command-line parameters (normal) */
-#define OPTSTRING "hVlaA::r:f:n:c:D:N::s:qeIM:m::R:o:v:Zt:i::d::C:Tp:SOP:"
+#define OPTSTRING "hVlaA::r:f:n:c:D:N::s:qeIM:m::R:H:o:v:Zt:i::d::C:Tp:SOP:"
 
 /** Acceptable command-line parameters (long) */
 struct option long_opts[] = {
@@ -268,6 +268,15 @@ int Configuration::init(int argc, char *argv[])
 
 			break;
 
+		case 'H':
+			if (optarg == NULL || optarg == std::string("")) {
+				throw std::invalid_argument("-H requires a path specification");
+			}
+
+			this->processHOption(tables, optarg);
+
+			break;
+
 		case 'o': /* output format */
 			if (optarg == NULL || optarg == std::string("")) {
 				throw std::invalid_argument("-o requires an output path specification");
@@ -848,6 +857,7 @@ void Configuration::help() const
 	<< "  -R <expr>       Recursively read input from directory and subdirectories; can be repeated" << std::endl
 	<< "                  /any/dir        Reads all data from directory 'dir'" << std::endl
 	<< "                  /dir/dir1:dir2  Reads all data from directory 'dir1' to 'dir2'" << std::endl
+	<< "  -H <dir>        Read also records not yet flushed by the FastBit storage plugin (its hotPath)" << std::endl
 	<< "  -o <mode>       Use <mode> to print out flow records:" << std::endl
 	//<< "                 raw      Raw record dump." << std::endl
 	<< "                    line     Standard output line format." << std::endl
@@ -1052,6 +1062,25 @@ void Configuration::processROption(stringVector &tables, const char *optarg)
 	Utils::loadDirsTree(root, left, right, tables);
 }
 
+void Configuration::processHOption(stringVector &tables, const char *optarg)
+{
+	std::string dir = optarg;
+	Utils::sanitizePath(dir);
+
+	/* The file contains name of the last complete generation of the hot window */
+	std::ifstream current((dir + "current").c_str());
+	std::string generation;
+
+	if (!(current >> generation) || generation.find('/') != generation.npos) {
+		std::cerr << "No hot window published in \"" << dir << "\"" << std::endl;
+		return;
+	}
+
+	std::string table = dir + generation;
+	Utils::sanitizePath(table);
+	tables.push_back(table);
+}
+
 void Configuration::parseAggregateArg(char *arg) throw (std::invalid_argument)
 {
 	this->aggregate = true;